@@ -198,12 +198,11 @@ struct ThreadSafeQueue {
 		return true;
 	}
 
+	/// @return false if the queue is full.
 	bool push(const T &val) {
 		auto lock = cs.lock();
 
-		pushUnsafe(val);
-
-		return true;
+		return pushUnsafe(val);
 	}
 
 	bool pop(T &res) {
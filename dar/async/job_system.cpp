@@ -166,6 +166,35 @@ FiberHandle searchWaiting(bool isWindows) {
 	return handle;
 }
 
+void decrementFence(JobSystem::Fence *fence) {
+	fence->decrement();
+
+	// If the fence completed make the fibers waiting on
+	// it ready for execution.
+	if (fence->ready()) {
+		auto lock = waitingFibersCS.lock();
+		auto it = waitingFibers.find(fence);
+		if (it != waitingFibers.end()) {
+			auto &waitingFibersQueue = it->second;
+			FiberHandle handle;
+			while (waitingFibersQueue.pop(handle)) {
+				Fiber &f = getFiberFromHandle(handle);
+				switch (f.currentJobType) {
+				case JobSystem::JobType::Default:
+					waitingReadyDefaultFibers.push(handle);
+					break;
+				case JobSystem::JobType::NonWindows:
+					waitingReadyNonWindowsFibers.push(handle);
+					break;
+				case JobSystem::JobType::Windows:
+					waitingReadyWindowsFibers.push(handle);
+					break;
+				}
+			}
+		}
+	}
+}
+
 void fiberStartRoutine(void *param) {
 	FiberHandle fiberIndex = reinterpret_cast<FiberHandle>(param);
 	Fiber &thisFiber = getFiberFromHandle(fiberIndex);
@@ -221,32 +250,7 @@ void fiberStartRoutine(void *param) {
 
 		job.function(job.param);
 		if (job.fence != nullptr) { // if no one is waiting on the job. Nothing to do anymore.
-			job.fence->decrement();
-
-			// If the fence completed make the fibers waiting on
-			// it ready for execution.
-			if (job.fence->ready()) {
-				auto lock = waitingFibersCS.lock();
-				auto it = waitingFibers.find(job.fence);
-				if (it != waitingFibers.end()) {
-					auto &waitingFibersQueue = it->second;
-					FiberHandle handle;
-					while (waitingFibersQueue.pop(handle)) {
-						Fiber &f = getFiberFromHandle(handle);
-						switch (f.currentJobType) {
-						case JobSystem::JobType::Default:
-							waitingReadyDefaultFibers.push(handle);
-							break;
-						case JobSystem::JobType::NonWindows:
-							waitingReadyNonWindowsFibers.push(handle);
-							break;
-						case JobSystem::JobType::Windows:
-							waitingReadyWindowsFibers.push(handle);
-							break;
-						}
-					}
-				}
-			}
+			decrementFence(job.fence);
 		}
 
 		fibersPool.push(fiberIndex);
@@ -256,6 +260,62 @@ void fiberStartRoutine(void *param) {
 	SwitchToFiber(thisFiber.executionThread);
 }
 
+/// @return Handle of the fiber the caller runs on or INVALID_FIBER_HANDLE if it isn't called from a job.
+FiberHandle findCurrentFiberHandle() {
+	if (!IsThreadAFiber()) {
+		return INVALID_FIBER_HANDLE;
+	}
+
+	PVOID addr = GetCurrentFiber();
+	for (int i = 0; i < NUM_FIBERS; ++i) {
+		if (fibers[i].address == addr) {
+			return i;
+		}
+	}
+
+	return INVALID_FIBER_HANDLE;
+}
+
+/// Run a job on the calling fiber instead of one of the workers.
+/// @return false if the job can't be run on the thread of the fiber.
+bool runJobInline(FiberHandle handle, const Job &job) {
+	Fiber &f = getFiberFromHandle(handle);
+	const bool isWindowsFiber = f.executionThread == WINDOWS_THREAD_FIBER;
+	if ((job.type == JobSystem::JobType::Windows && !isWindowsFiber) || (job.type == JobSystem::JobType::NonWindows && isWindowsFiber)) {
+		return false;
+	}
+
+	// The job may wait on a fence, in which case the fiber has to resume on a thread matching the job's type.
+	const JobSystem::JobType outerJobType = f.currentJobType;
+	f.currentJobType = job.type;
+
+	job.function(job.param);
+	if (job.fence != nullptr) {
+		decrementFence(job.fence);
+	}
+
+	// Waiting could have moved the fiber to another thread, but its handle stays the same.
+	getFiberFromHandle(handle).currentJobType = outerJobType;
+
+	return true;
+}
+
+/// Push a job, waiting for the workers to make space if the queue is full.
+/// Dropping the job would leave its fence unsignaled and everyone waiting on it hanging.
+/// If the producer is itself a job it runs the job instead of waiting, otherwise
+/// the workers could all end up waiting on a full queue with no one left to pop from it.
+template <class JobQueue>
+void pushJob(JobQueue &queue, const Job &job) {
+	while (!queue.push(job)) {
+		FiberHandle handle = findCurrentFiberHandle();
+		if (handle != INVALID_FIBER_HANDLE && runJobInline(handle, job)) {
+			return;
+		}
+
+		SwitchToThread();
+	}
+}
+
 JobSystem::Fence *getFreeFence() {
 	// TODO: allocate memory for fences beforehand
 	return new JobSystem::Fence();
@@ -327,13 +387,13 @@ void JobSystem::kickJobs(JobSystem::JobDecl *jobs, int numJobs, JobSystem::Fence
 		Job job = { jobs[i].f, jobs[i].param, fence ? *fence : nullptr, type };
 		switch (type) {
 		case JobType::Default:
-			defaultJobsQueue.push(job);
+			pushJob(defaultJobsQueue, job);
 			break;
 		case JobType::NonWindows:
-			nonWindowsJobsQueue.push(job);
+			pushJob(nonWindowsJobsQueue, job);
 			break;
 		case JobType::Windows:
-			windowsJobsQueue.push(job);
+			pushJob(windowsJobsQueue, job);
 			break;
 		}
 	}
@@ -347,6 +407,66 @@ void JobSystem::kickJobsAndWait(JobSystem::JobDecl *jobs, int numJobs, JobSystem
 	waitFenceAndFree(f);
 }
 
+void JobSystem::prepareFence(JobSystem::Fence **fence, int numSignals) {
+	if (fence == nullptr) {
+		return;
+	}
+
+	if (*fence == nullptr) {
+		*fence = getFreeFence();
+	}
+
+	(*fence)->init(numSignals);
+}
+
+void JobSystem::signalFence(JobSystem::Fence *fence) {
+	if (fence == nullptr) {
+		return;
+	}
+
+	decrementFence(fence);
+}
+
+void JobSystem::parallelFor(SizeType count, SizeType minRangeSize, JobSystem::RangeFunction f, void *param, JobSystem::JobType type) {
+	// Keep the number of jobs well below the capacity of the job queues.
+	constexpr SizeType MAX_JOBS = 64;
+
+	if (count == 0) {
+		return;
+	}
+
+	minRangeSize = std::max(minRangeSize, SizeType(1));
+	const SizeType maxJobs = std::min(MAX_JOBS, SizeType(numThreads) * 2);
+	const SizeType numJobs = std::max(SizeType(1), std::min(maxJobs, (count + minRangeSize - 1) / minRangeSize));
+	if (numJobs == 1) {
+		f(0, count, param);
+		return;
+	}
+
+	struct RangeJob {
+		RangeFunction f;
+		void *param;
+		SizeType begin;
+		SizeType end;
+	};
+
+	Vector<RangeJob> ranges(numJobs);
+	Vector<JobDecl> jobs(numJobs);
+	const SizeType rangeSize = (count + numJobs - 1) / numJobs;
+	for (SizeType i = 0; i < numJobs; ++i) {
+		ranges[i] = RangeJob{ f, param, std::min(count, i * rangeSize), std::min(count, (i + 1) * rangeSize) };
+		jobs[i].f = [](void *param) {
+			auto range = reinterpret_cast<RangeJob*>(param);
+			if (range->begin < range->end) {
+				range->f(range->begin, range->end, range->param);
+			}
+		};
+		jobs[i].param = &ranges[i];
+	}
+
+	kickJobsAndWait(jobs.data(), static_cast<int>(numJobs), type);
+}
+
 void JobSystem::waitFence(JobSystem::Fence *fence) {
 	if (fence == nullptr) {
 		return;
@@ -7,6 +7,7 @@ namespace Dar {
 namespace JobSystem {
 
 using JobFunction = void(*)(void*);
+using RangeFunction = void(*)(SizeType begin, SizeType end, void *param);
 
 enum class JobType {
 	Default = 0, ///< Generic work, any thread my take the work.
@@ -40,11 +41,30 @@ void stop();
 /// Kick a batch of jobs. If the passed fence is valid one can
 /// wait for the completion of the jobs by calling
 /// waitForFence(AndFree) on the fence.
+/// If the queue of the job type is full, waits for the workers to make space, so jobs are never dropped.
 void kickJobs(JobDecl *jobs, int numJobs, Fence **fence, JobType type = JobType::Default);
 
 /// Kick a batch of jobs and wait for their completion.
 void kickJobsAndWait(JobDecl *jobs, int numJobs, JobType type = JobType::Default);
 
+/// Split the range [0, count) into chunks of at least minRangeSize elements
+/// and process them in parallel, waiting for all of them to finish.
+/// The number of kicked jobs is bounded, so it's safe to call with large ranges.
+/// @note If more than one job is needed this must be called from inside a job.
+/// @param f Function called for each of the chunks.
+/// @param param Parameter passed to f.
+void parallelFor(SizeType count, SizeType minRangeSize, RangeFunction f, void *param, JobType type = JobType::Default);
+
+/// Prepare a fence that is signaled manually instead of by finished jobs.
+/// F.e useful for waiting on work done outside of the job system, like I/O.
+/// @param fence If it points to nullptr a new fence is created.
+/// @param numSignals Number of signalFence() calls after which the fence is ready.
+void prepareFence(Fence **fence, int numSignals);
+
+/// Signal a fence prepared with prepareFence(). When the fence gets ready
+/// the fibers waiting on it are resumed. Could be called from any thread.
+void signalFence(Fence *fence);
+
 /// If the given fence is valid wait for the jobs associated with it
 /// to complete.
 void waitFence(Fence *fence);
@@ -2,6 +2,7 @@
 
 #include "async/job_system.h"
 #include "d3d12/command_list.h"
+#include "d3d12/pipeline_cache.h"
 #include "d3d12/resource_manager.h"
 #include "utils/defines.h"
 #include "utils/profile.h"
@@ -140,6 +141,7 @@ bool App::initJob() {
 	window = glfwGetWin32Window(glfwWindow);
 
 	initResourceLibrary();
+	initPipelineCache(".\\res\\pipelines.psocache");
 	
 	device.init();
 
@@ -156,6 +158,8 @@ bool App::initJob() {
 void App::deinit() {
 	LOG(Info, "App::deinit");
 
+	deinitPipelineCache();
+	clearRootSignatureCache();
 	deinitResourceLibrary();
 	deinitResourceManager();
 	resManager = nullptr;
@@ -112,6 +112,15 @@ float Camera::getFarPlane() const {
 	return farPlane;
 }
 
+float Camera::getProjectedSize(float size, float distance, int viewportHeight) const {
+	if (type == CameraType::Orthographic) {
+		return size * viewportHeight / height;
+	}
+
+	const float projScale = viewportHeight / (2.f * glm::tan(glm::radians(fov) * 0.5f));
+	return size * projScale / glm::max(distance, nearPlane);
+}
+
 void Camera::updateAspectRatio(unsigned int w, unsigned int h) {
 	if (type == CameraType::Orthographic) {
 		width = float(w);
@@ -182,4 +191,19 @@ Mat4 Camera::getProjectionMatrix() const {
 	return projectionMatrix;
 }
 
+void Camera::getFrustumPlanes(Vec4 planes[static_cast<int>(FrustumPlane::Count)]) const {
+	extractFrustumPlanes(getProjectionMatrix() * getViewMatrix(), planes);
+}
+
+void Camera::getViewRay(const Vec2 &screenPos, Vec3 &origin, Vec3 &direction) const {
+	const Mat4 invViewProjection = glm::inverse(getProjectionMatrix() * getViewMatrix());
+	const Vec2 ndc = Vec2(screenPos.x * 2.f - 1.f, 1.f - screenPos.y * 2.f);
+
+	const Vec4 nearPoint = invViewProjection * Vec4(ndc, 0.f, 1.f);
+	const Vec4 farPoint = invViewProjection * Vec4(ndc, 1.f, 1.f);
+
+	origin = Vec3(nearPoint) / nearPoint.w;
+	direction = glm::normalize(Vec3(farPoint) / farPoint.w - origin);
+}
+
 } // namespace Dar
\ No newline at end of file
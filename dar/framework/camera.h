@@ -30,6 +30,15 @@ struct Camera {
 	/// Get the camera-to-clip transformation
 	Mat4 getProjectionMatrix() const;
 
+	/// Get the world-space planes of the view frustum. See extractFrustumPlanes().
+	void getFrustumPlanes(Vec4 planes[static_cast<int>(FrustumPlane::Count)]) const;
+
+	/// Get the world-space ray through a point on the screen, f.e for picking objects with the mouse.
+	/// @param screenPos Position on the screen in [0, 1], (0, 0) being the top-left corner.
+	/// @param origin Receives the origin of the ray on the near plane.
+	/// @param direction Receives the normalized direction of the ray.
+	void getViewRay(const Vec2 &screenPos, Vec3 &origin, Vec3 &direction) const;
+
 	/// Add `magnitude` to the camera position
 	void move(const Vec3 &magnitude);
 
@@ -87,6 +96,12 @@ struct Camera {
 	float getNearPlane() const;
 	float getFarPlane() const;
 
+	/// Get the size in pixels of an object seen by the camera.
+	/// @param size Size of the object in world space.
+	/// @param distance Distance of the object from the camera. Clamped to the near plane. Ignored by orthographic cameras.
+	/// @param viewportHeight Height of the viewport in pixels.
+	float getProjectedSize(float size, float distance, int viewportHeight) const;
+
 	void updateAspectRatio(unsigned int width, unsigned int height);
 	float getAspectRatio() const {
 		return aspectRatio;
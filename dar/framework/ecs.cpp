@@ -0,0 +1,36 @@
+#include "framework/ecs.h"
+
+namespace Dar {
+
+Entity World::createEntity() {
+	if (!freeIndices.empty()) {
+		const uint32_t index = freeIndices.back();
+		freeIndices.pop_back();
+		return Entity{ index, generations[index] };
+	}
+
+	generations.push_back(0);
+	return Entity{ static_cast<uint32_t>(generations.size() - 1), 0 };
+}
+
+void World::destroyEntity(Entity entity) {
+	if (!isAlive(entity)) {
+		return;
+	}
+
+	for (auto &pool : pools) {
+		if (pool) {
+			pool->remove(entity);
+		}
+	}
+
+	++generations[entity.index];
+	freeIndices.push_back(entity.index);
+}
+
+SizeType World::allocateComponentTypeId() {
+	static Atomic<SizeType> nextTypeId = 0;
+	return nextTypeId++;
+}
+
+} // namespace Dar
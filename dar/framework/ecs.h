@@ -0,0 +1,284 @@
+#pragma once
+
+#include "async/job_system.h"
+#include "utils/defines.h"
+
+#include <tuple>
+
+namespace Dar {
+
+/// Handle of an entity. The generation tells apart the entities reusing the index of a destroyed one.
+struct Entity {
+	uint32_t index = uint32_t(-1);
+	uint32_t generation = 0;
+
+	bool operator==(const Entity &other) const {
+		return index == other.index && generation == other.generation;
+	}
+
+	bool operator!=(const Entity &other) const {
+		return !(*this == other);
+	}
+};
+
+#define INVALID_ENTITY Dar::Entity{}
+
+struct IComponentPool {
+	virtual ~IComponentPool() {}
+
+	virtual bool has(Entity entity) const = 0;
+	virtual void remove(Entity entity) = 0;
+};
+
+/// Sparse set of the components of one type. Components are packed in a dense array,
+/// so iterating over them touches only memory of live components.
+/// Removing a component moves the last one in its place, so pointers to components are invalidated
+/// by adding and removing components of the same type.
+template <class T>
+class ComponentPool : public IComponentPool {
+public:
+	static constexpr uint32_t INVALID_DENSE_INDEX = uint32_t(-1);
+
+	T &add(Entity entity, T &&component) {
+		if (entity.index >= sparse.size()) {
+			sparse.resize(SizeType(entity.index) + 1, INVALID_DENSE_INDEX);
+		}
+
+		uint32_t &denseIndex = sparse[entity.index];
+		if (denseIndex != INVALID_DENSE_INDEX) {
+			entities[denseIndex] = entity;
+			components[denseIndex] = std::move(component);
+			return components[denseIndex];
+		}
+
+		denseIndex = static_cast<uint32_t>(components.size());
+		entities.push_back(entity);
+		components.push_back(std::move(component));
+		return components.back();
+	}
+
+	void remove(Entity entity) override {
+		if (!has(entity)) {
+			return;
+		}
+
+		const uint32_t denseIndex = sparse[entity.index];
+		const uint32_t lastIndex = static_cast<uint32_t>(components.size() - 1);
+		if (denseIndex != lastIndex) {
+			components[denseIndex] = std::move(components[lastIndex]);
+			entities[denseIndex] = entities[lastIndex];
+			sparse[entities[denseIndex].index] = denseIndex;
+		}
+
+		components.pop_back();
+		entities.pop_back();
+		sparse[entity.index] = INVALID_DENSE_INDEX;
+	}
+
+	bool has(Entity entity) const override {
+		return entity.index < sparse.size() && sparse[entity.index] != INVALID_DENSE_INDEX && entities[sparse[entity.index]] == entity;
+	}
+
+	/// @return Pointer to the component of the entity or nullptr if it doesn't have one.
+	T *get(Entity entity) {
+		return has(entity) ? &components[sparse[entity.index]] : nullptr;
+	}
+
+	const T *get(Entity entity) const {
+		return has(entity) ? &components[sparse[entity.index]] : nullptr;
+	}
+
+	/// Same as get(), but checks the given dense index first. Entities usually get their components in the same order,
+	/// so they are at the same dense index in all pools and the iteration over them stays sequential. \see World::sortPool.
+	T *get(Entity entity, SizeType denseIndexHint) {
+		if (denseIndexHint < entities.size() && entities[denseIndexHint] == entity) {
+			return &components[denseIndexHint];
+		}
+		return get(entity);
+	}
+
+	SizeType size() const {
+		return components.size();
+	}
+
+	/// Entity owning each of the components in the dense array.
+	Entity getEntity(SizeType denseIndex) const {
+		return entities[denseIndex];
+	}
+
+	T &getDense(SizeType denseIndex) {
+		return components[denseIndex];
+	}
+
+	void reserve(SizeType count) {
+		entities.reserve(count);
+		components.reserve(count);
+	}
+
+	/// Reorder the components so the ones of the entities also in other come first, in the same order as in other.
+	/// Afterwards iterating over other finds the components of this pool at the same dense indices.
+	template <class U>
+	void sortAs(const ComponentPool<U> &other) {
+		uint32_t next = 0;
+		for (SizeType i = 0; i < other.size(); ++i) {
+			const Entity entity = other.getEntity(i);
+			if (has(entity)) {
+				swapDense(sparse[entity.index], next++);
+			}
+		}
+	}
+
+private:
+	void swapDense(uint32_t a, uint32_t b) {
+		if (a == b) {
+			return;
+		}
+
+		std::swap(components[a], components[b]);
+		std::swap(entities[a], entities[b]);
+		sparse[entities[a].index] = a;
+		sparse[entities[b].index] = b;
+	}
+
+	Vector<uint32_t> sparse; ///< Index in the dense arrays of the component of each entity index.
+	Vector<Entity> entities; ///< Entity owning each component.
+	Vector<T> components; ///< Dense array of the components.
+};
+
+/// Entities and their components. Any movable type can be a component, f.e Mesh, LightData or Camera.
+/// Systems are functions iterating over the entities having a set of components with forEach() or parallelForEach().
+/// @note Not thread-safe. Entities and components should not be added or removed while iterating over them.
+class World {
+public:
+	Entity createEntity();
+
+	/// Destroy the entity and remove all its components. The handle and its copies become invalid.
+	void destroyEntity(Entity entity);
+
+	bool isAlive(Entity entity) const {
+		return entity.index < generations.size() && generations[entity.index] == entity.generation;
+	}
+
+	SizeType getNumEntities() const {
+		return generations.size() - freeIndices.size();
+	}
+
+	template <class T>
+	T &addComponent(Entity entity, T component = T{}) {
+		dassert(isAlive(entity));
+		return getPool<T>().add(entity, std::move(component));
+	}
+
+	template <class T>
+	void removeComponent(Entity entity) {
+		getPool<T>().remove(entity);
+	}
+
+	/// @return Pointer to the component of the entity or nullptr if it doesn't have one.
+	template <class T>
+	T *getComponent(Entity entity) {
+		return getPool<T>().get(entity);
+	}
+
+	template <class T>
+	bool hasComponent(Entity entity) {
+		return getPool<T>().has(entity);
+	}
+
+	template <class T>
+	ComponentPool<T> &getPool() {
+		const SizeType typeId = getComponentTypeId<T>();
+		if (typeId >= pools.size()) {
+			pools.resize(typeId + 1);
+		}
+
+		if (pools[typeId] == nullptr) {
+			pools[typeId] = std::make_unique<ComponentPool<T>>();
+		}
+
+		return static_cast<ComponentPool<T>&>(*pools[typeId]);
+	}
+
+	/// Reorder the pools of T and U, so the entities having both components come first in both pools and in the same order.
+	/// Pools diverge in order when entities get their components in different orders or only some of them.
+	/// forEach<U, T>() is correct either way, but finds the components of T with a sequential read only when the orders match.
+	/// Keeps the order of U for the entities having both components. Should be called again after adding or removing many components.
+	template <class T, class U>
+	void sortPool() {
+		getPool<T>().sortAs(getPool<U>());
+		getPool<U>().sortAs(getPool<T>());
+	}
+
+	/// Call f(entity, T&, Others&...) for each entity having all of the components.
+	/// Iterates over the dense array of T, so T should be the rarest of the components.
+	/// The other components are found at the same dense index if the pools are in the same order. \see sortPool.
+	template <class T, class... Others, class F>
+	void forEach(F &&f) {
+		auto typedPools = std::tie(getPool<T>(), getPool<Others>()...);
+		forEachInRange<T, Others...>(typedPools, 0, std::get<0>(typedPools).size(), f);
+	}
+
+	/// Same as forEach(), but the dense array of T is split between the threads of the job system.
+	/// f is called concurrently for different entities, so it should only write to their components.
+	/// @note Must be called from inside a job.
+	/// @param minRangeSize Min number of entities processed by a job.
+	template <class T, class... Others, class F>
+	void parallelForEach(F &&f, SizeType minRangeSize = 1024) {
+		using Pools = std::tuple<ComponentPool<T>&, ComponentPool<Others>&...>;
+
+		struct ForEachParams {
+			Pools pools;
+			F &f;
+		} params = { std::tie(getPool<T>(), getPool<Others>()...), f };
+
+		JobSystem::parallelFor(
+			std::get<0>(params.pools).size(),
+			minRangeSize,
+			[](SizeType begin, SizeType end, void *param) {
+				auto params = reinterpret_cast<ForEachParams*>(param);
+				forEachInRange<T, Others...>(params->pools, begin, end, params->f);
+			},
+			&params
+		);
+	}
+
+private:
+	static SizeType allocateComponentTypeId();
+
+	template <class T>
+	static SizeType getComponentTypeId() {
+		static const SizeType typeId = allocateComponentTypeId();
+		return typeId;
+	}
+
+	template <class T, class... Others, class Pools, class F>
+	static void forEachInRange(Pools &pools, SizeType begin, SizeType end, F &f) {
+		ComponentPool<T> &pool = std::get<0>(pools);
+		for (SizeType i = begin; i < end; ++i) {
+			const Entity entity = pool.getEntity(i);
+			if constexpr (sizeof...(Others) == 0) {
+				f(entity, pool.getDense(i));
+			} else {
+				auto others = std::apply([entity, i](ComponentPool<T>&, auto &...otherPools) {
+					return std::make_tuple(otherPools.get(entity, i)...);
+				}, pools);
+
+				const bool hasAll = std::apply([](auto *...components) {
+					return ((components != nullptr) && ...);
+				}, others);
+
+				if (hasAll) {
+					std::apply([&f, &pool, entity, i](auto *...components) {
+						f(entity, pool.getDense(i), *components...);
+					}, others);
+				}
+			}
+		}
+	}
+
+	Vector<uint32_t> generations; ///< Current generation of each entity index.
+	Vector<uint32_t> freeIndices; ///< Indices of destroyed entities, reused by new ones.
+	Vector<UniquePtr<IComponentPool>> pools; ///< Pool of each component type, indexed by the type id.
+};
+
+} // namespace Dar
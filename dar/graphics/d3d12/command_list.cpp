@@ -154,6 +154,11 @@ void CommandList::drawIndexedInstanced(uint32_t indexCount, uint32_t instanceCou
 
 D3D12Result CommandList::reset(ID3D12CommandAllocator *cmdAllocator) {
 	flushCurrentPendingBarriers();
+
+	graphicsRootSignature = nullptr;
+	computeRootSignature = nullptr;
+	descriptorHeap = nullptr;
+
 	return get()->Reset(cmdAllocator, nullptr);
 }
 
@@ -201,6 +206,13 @@ void CommandList::setRenderTargets(const D3D12_CPU_DESCRIPTOR_HANDLE *rtvHandle,
 void CommandList::setDescriptorHeap(ID3D12DescriptorHeap *const *heap) {
 	flushCurrentPendingBarriers();
 	get()->SetDescriptorHeaps(1, heap);
+
+	// Root signatures with directly indexed heaps must be set after the heaps.
+	if (*heap != descriptorHeap) {
+		descriptorHeap = *heap;
+		graphicsRootSignature = nullptr;
+		computeRootSignature = nullptr;
+	}
 }
 
 void CommandList::setViewport(const D3D12_VIEWPORT &viewport) {
@@ -217,9 +229,15 @@ void CommandList::setRootSignature(ID3D12RootSignature *rootSignature, bool comp
 	flushCurrentPendingBarriers();
 
 	if (compute) {
-		get()->SetComputeRootSignature(rootSignature);
+		if (rootSignature != computeRootSignature) {
+			get()->SetComputeRootSignature(rootSignature);
+			computeRootSignature = rootSignature;
+		}
 	} else {
-		get()->SetGraphicsRootSignature(rootSignature);
+		if (rootSignature != graphicsRootSignature) {
+			get()->SetGraphicsRootSignature(rootSignature);
+			graphicsRootSignature = rootSignature;
+		}
 	}
 }
 
@@ -41,6 +41,9 @@ struct CommandList {
 	}
 
 	void dispatch(uint32_t threadGroupCount);
+
+	/// Set the root signature. Does nothing if it's already set and the descriptor heap
+	/// didn't change since then, so passes sharing a root signature don't rebind it.
 	void setRootSignature(ID3D12RootSignature *rootSignature, bool compute);
 	void setConstantBufferView(unsigned int rootParameterIndex, ResourceHandle constBufferHandle, bool compute);
 	void drawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance);
@@ -75,6 +78,9 @@ private:
 	Vector<PendingResourceBarrier> initialPendingBarriers;
 	Vector<D3D12_RESOURCE_BARRIER> currentPendingBarriers;
 	LastStates lastStates;
+	ID3D12RootSignature *graphicsRootSignature = nullptr; ///< Currently bound graphics root signature.
+	ID3D12RootSignature *computeRootSignature = nullptr; ///< Currently bound compute root signature.
+	ID3D12DescriptorHeap *descriptorHeap = nullptr; ///< Currently bound CBV/SRV/UAV heap.
 	D3D12_COMMAND_LIST_TYPE type;
 	bool valid;
 };
@@ -0,0 +1,298 @@
+#include "d3d12/pipeline_cache.h"
+
+#include "d3d12/pipeline_state.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace Dar {
+
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x434F5350; // PSOC
+constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+template <typename T>
+static uint64_t hashValue(const T &value, uint64_t seed) {
+	return hashData(&value, sizeof(T), seed);
+}
+
+void PipelineCacheKey::addDesc(const PipelineStateDesc &desc) {
+	// Static samplers, root signature flags and constant buffers are part of the root signature.
+	// Shader names are irrelevant, as shaders are hashed by their contents.
+	hash = hashValue(desc.shadersMask, hash);
+	hash = hashValue(desc.depthStencilBufferFormat, hash);
+	hash = hashValue(desc.cullMode, hash);
+	hash = hashValue(desc.numRenderTargets, hash);
+	hash = hashData(desc.renderTargetFormats, sizeof(DXGI_FORMAT) * std::min(desc.numRenderTargets, UINT(MAX_RENDER_TARGETS)), hash);
+
+	const UINT numInputLayouts = desc.inputLayouts != nullptr ? desc.numInputLayouts : 0;
+	hash = hashValue(numInputLayouts, hash);
+	for (UINT i = 0; i < numInputLayouts; ++i) {
+		const D3D12_INPUT_ELEMENT_DESC &element = desc.inputLayouts[i];
+		hash = hashData(element.SemanticName, strlen(element.SemanticName), hash);
+		hash = hashValue(element.SemanticIndex, hash);
+		hash = hashValue(element.Format, hash);
+		hash = hashValue(element.InputSlot, hash);
+		hash = hashValue(element.AlignedByteOffset, hash);
+		hash = hashValue(element.InputSlotClass, hash);
+		hash = hashValue(element.InstanceDataStepRate, hash);
+	}
+}
+
+void PipelineCacheKey::addShader(const void *bytecode, SizeType size) {
+	hash = hashValue(size, hash);
+	hash = hashData(bytecode, size, hash);
+}
+
+void PipelineCacheKey::addRootSignature(const void *data, SizeType size) {
+	hash = hashValue(size, hash);
+	hash = hashData(data, size, hash);
+}
+
+bool PipelineCache::load(const fs::path &f, const PipelineCacheSettings &s) {
+	auto lock = cacheLock.lock();
+
+	file = f;
+	settings = s;
+	entries.clear();
+	totalSize = 0;
+	session = 0;
+	dirty = false;
+
+	// The cache is written on save() anyway
+	if (!fs::exists(file)) {
+		return true;
+	}
+
+	std::ifstream ifs(file, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!ifs.good()) {
+		LOG_FMT(Error, "Failed to open pipeline cache %s!", file.string().c_str());
+		return false;
+	}
+
+	Vector<uint8_t> data(static_cast<SizeType>(ifs.tellg()));
+	ifs.seekg(0, std::ios::beg);
+	ifs.read(reinterpret_cast<char*>(data.data()), data.size());
+	if (ifs.fail()) {
+		LOG_FMT(Error, "Failed to read pipeline cache %s!", file.string().c_str());
+		return false;
+	}
+
+	SizeType pos = 0;
+	auto read = [&](void *dst, SizeType bytes) {
+		if (pos + bytes > data.size()) {
+			return false;
+		}
+
+		memcpy(dst, data.data() + pos, bytes);
+		pos += bytes;
+		return true;
+	};
+
+	uint32_t magic = 0, version = 0, numEntries = 0;
+	if (!read(&magic, sizeof(uint32_t)) || magic != PIPELINE_CACHE_MAGIC || !read(&version, sizeof(uint32_t)) || version != PIPELINE_CACHE_VERSION) {
+		LOG_FMT(Warning, "Discarding pipeline cache %s of unknown version.", file.string().c_str());
+		dirty = true;
+		return true;
+	}
+
+	if (!read(&session, sizeof(uint32_t)) || !read(&numEntries, sizeof(uint32_t))) {
+		dirty = true;
+		return true;
+	}
+
+	for (uint32_t i = 0; i < numEntries; ++i) {
+		uint64_t key = 0, size = 0, hash = 0;
+		Entry entry;
+		if (!read(&key, sizeof(uint64_t)) || !read(&entry.lastUsedSession, sizeof(uint32_t)) || !read(&size, sizeof(uint64_t)) || !read(&hash, sizeof(uint64_t))) {
+			break;
+		}
+
+		if (pos + size > data.size()) {
+			break;
+		}
+
+		entry.blob.assign(data.data() + pos, data.data() + pos + size);
+		pos += size;
+
+		// Skip corrupted entries
+		if (hashData(entry.blob.data(), entry.blob.size()) != hash) {
+			dirty = true;
+			continue;
+		}
+
+		totalSize += entry.blob.size();
+		entries[key] = std::move(entry);
+	}
+
+	dirty |= entries.size() != numEntries;
+	++session;
+
+	LOG_FMT(Info, "Loaded pipeline cache with %llu entries(%llu bytes)", entries.size(), totalSize);
+
+	return true;
+}
+
+bool PipelineCache::save() {
+	evict();
+
+	auto lock = cacheLock.lock();
+
+	if (!dirty || file.empty()) {
+		return true;
+	}
+
+	std::error_code ec;
+	if (file.has_parent_path()) {
+		fs::create_directories(file.parent_path(), ec);
+	}
+
+	// Write to a temporary file first, so a crash never leaves a partially written cache.
+	auto tmpFile = file;
+	tmpFile += ".tmp";
+	{
+		std::ofstream ofs(tmpFile, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!ofs.good()) {
+			LOG_FMT(Error, "Failed to write pipeline cache %s!", tmpFile.string().c_str());
+			return false;
+		}
+
+		const uint32_t magic = PIPELINE_CACHE_MAGIC;
+		const uint32_t version = PIPELINE_CACHE_VERSION;
+		const auto numEntries = static_cast<uint32_t>(entries.size());
+		ofs.write(reinterpret_cast<const char*>(&magic), sizeof(uint32_t));
+		ofs.write(reinterpret_cast<const char*>(&version), sizeof(uint32_t));
+		ofs.write(reinterpret_cast<const char*>(&session), sizeof(uint32_t));
+		ofs.write(reinterpret_cast<const char*>(&numEntries), sizeof(uint32_t));
+
+		for (auto &[key, entry] : entries) {
+			const uint64_t size = entry.blob.size();
+			const uint64_t hash = hashData(entry.blob.data(), entry.blob.size());
+			ofs.write(reinterpret_cast<const char*>(&key), sizeof(uint64_t));
+			ofs.write(reinterpret_cast<const char*>(&entry.lastUsedSession), sizeof(uint32_t));
+			ofs.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+			ofs.write(reinterpret_cast<const char*>(&hash), sizeof(uint64_t));
+			ofs.write(reinterpret_cast<const char*>(entry.blob.data()), entry.blob.size());
+		}
+
+		if (ofs.fail()) {
+			LOG_FMT(Error, "Failed to write pipeline cache %s!", tmpFile.string().c_str());
+			return false;
+		}
+	}
+
+	fs::rename(tmpFile, file, ec);
+	if (ec) {
+		LOG_FMT(Error, "Failed to write pipeline cache %s!", file.string().c_str());
+		fs::remove(tmpFile, ec);
+		return false;
+	}
+
+	dirty = false;
+
+	LOG_FMT(Info, "Saved pipeline cache with %llu entries(%llu bytes). Hits: %d, misses: %d", entries.size(), totalSize, hits.load(), misses.load());
+
+	return true;
+}
+
+bool PipelineCache::find(uint64_t key, Vector<uint8_t> &blob) {
+	auto lock = cacheLock.lock();
+
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		++misses;
+		return false;
+	}
+
+	++hits;
+	if (it->second.lastUsedSession != session) {
+		it->second.lastUsedSession = session;
+		dirty = true;
+	}
+
+	blob = it->second.blob;
+
+	return true;
+}
+
+void PipelineCache::store(uint64_t key, const void *blob, SizeType size) {
+	auto lock = cacheLock.lock();
+
+	removeImpl(key);
+
+	Entry entry;
+	entry.blob.assign(reinterpret_cast<const uint8_t*>(blob), reinterpret_cast<const uint8_t*>(blob) + size);
+	entry.lastUsedSession = session;
+
+	totalSize += size;
+	entries[key] = std::move(entry);
+	dirty = true;
+}
+
+void PipelineCache::remove(uint64_t key) {
+	auto lock = cacheLock.lock();
+	removeImpl(key);
+}
+
+void PipelineCache::removeImpl(uint64_t key) {
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		return;
+	}
+
+	totalSize -= it->second.blob.size();
+	entries.erase(it);
+	dirty = true;
+}
+
+void PipelineCache::evict() {
+	auto lock = cacheLock.lock();
+
+	Vector<std::pair<uint32_t, uint64_t>> lastUsed; // (last used session, key)
+	for (auto &[key, entry] : entries) {
+		lastUsed.push_back({ entry.lastUsedSession, key });
+	}
+
+	std::sort(lastUsed.begin(), lastUsed.end());
+
+	for (auto &[lastUsedSession, key] : lastUsed) {
+		const bool stale = session - lastUsedSession > settings.maxUnusedSessions;
+		if (!stale && totalSize <= settings.maxSize) {
+			break;
+		}
+
+		removeImpl(key);
+	}
+}
+
+SizeType PipelineCache::getNumEntries() const {
+	auto lock = cacheLock.lock();
+	return entries.size();
+}
+
+SizeType PipelineCache::getSize() const {
+	auto lock = cacheLock.lock();
+	return totalSize;
+}
+
+static PipelineCache *g_PipelineCache = nullptr;
+
+void initPipelineCache(const fs::path &file) {
+	deinitPipelineCache();
+
+	g_PipelineCache = new PipelineCache;
+	g_PipelineCache->load(file);
+}
+
+PipelineCache* getPipelineCache() {
+	return g_PipelineCache;
+}
+
+void deinitPipelineCache() {
+	if (g_PipelineCache) {
+		g_PipelineCache->save();
+		delete g_PipelineCache;
+		g_PipelineCache = nullptr;
+	}
+}
+
+} // namespace Dar
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "async/async.h"
+#include "utils/defines.h"
+
+#include "reslib/hash.h"
+
+namespace Dar {
+
+struct PipelineStateDesc;
+
+/// Key of a pipeline state in the PipelineCache. It is built from everything the pipeline state
+/// is created from, so pipeline states with the same key are interchangeable.
+struct PipelineCacheKey {
+	/// Hash the fixed-function state of the description together with the input layouts it points to.
+	/// Shaders and the root signature are hashed by their contents. See addShader() and addRootSignature().
+	void addDesc(const PipelineStateDesc &desc);
+
+	void addShader(const void *bytecode, SizeType size);
+
+	/// @param data Serialized root signature.
+	void addRootSignature(const void *data, SizeType size);
+
+	uint64_t hash = HASH_SEED;
+};
+
+struct PipelineCacheSettings {
+	SizeType maxSize = SizeType(64) * 1024 * 1024; ///< Max bytes of cached blobs. Least recently used entries are evicted above it.
+	uint32_t maxUnusedSessions = 8; ///< Entries not used in that many sessions are evicted.
+};
+
+/// Cache of compiled pipeline states(see ID3D12PipelineState::GetCachedBlob) persisted between runs.
+/// Blobs are addressed by PipelineCacheKey. The cache only stores the blobs and never touches the device,
+/// so blobs rejected by the driver, f.e after a driver update, should be removed by the caller.
+///
+/// File format:
+/// magic, version, session, number of entries (uint32_t each), followed by the entries:
+/// key(uint64_t), last used session(uint32_t), size(uint64_t), hash of the blob(uint64_t), blob.
+class PipelineCache {
+public:
+	/// Read the cache from a file. A missing or invalid file results in an empty cache,
+	/// which is written to the same file on save().
+	/// @return false if the file exists, but could not be read.
+	bool load(const fs::path &file, const PipelineCacheSettings &settings = {});
+
+	/// Evict the stale entries and write the cache to the file it was loaded from.
+	/// Does nothing if no entries were added or removed.
+	bool save();
+
+	/// Find the cached blob of a pipeline state. Marks the entry as used in the current session.
+	/// @return false if there is no such entry.
+	bool find(uint64_t key, Vector<uint8_t> &blob);
+
+	void store(uint64_t key, const void *blob, SizeType size);
+
+	void remove(uint64_t key);
+
+	/// Drop the entries not used in the last maxUnusedSessions sessions. After that drop
+	/// the least recently used entries until the size of the cache fits in maxSize.
+	void evict();
+
+	SizeType getNumEntries() const;
+
+	/// @return Size of all cached blobs in bytes.
+	SizeType getSize() const;
+
+	int getNumHits() const {
+		return hits;
+	}
+
+	int getNumMisses() const {
+		return misses;
+	}
+
+private:
+	struct Entry {
+		Vector<uint8_t> blob;
+		uint32_t lastUsedSession = 0;
+	};
+
+	void removeImpl(uint64_t key);
+
+	Map<uint64_t, Entry> entries;
+	PipelineCacheSettings settings;
+	fs::path file;
+	SizeType totalSize = 0;
+	uint32_t session = 0; ///< Incremented on every load, so entries could be aged.
+	Atomic<int> hits = 0;
+	Atomic<int> misses = 0;
+	bool dirty = false;
+	mutable SpinLock cacheLock;
+};
+
+void initPipelineCache(const fs::path &file);
+
+/// @return nullptr if the pipeline cache is not initialized.
+PipelineCache* getPipelineCache();
+
+/// Save and destroy the pipeline cache.
+void deinitPipelineCache();
+
+} // namespace Dar
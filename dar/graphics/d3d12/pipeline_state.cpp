@@ -1,4 +1,5 @@
 #include "d3d12/pipeline_state.h"
+#include "d3d12/pipeline_cache.h"
 
 #include "math/dar_math.h"
 
@@ -18,6 +19,49 @@ SizeType PipelineStateStream::getSize() const {
 	return data.size();
 }
 
+struct CachedRootSignature {
+	Vector<uint8_t> data; ///< Serialized root signature
+	ComPtr<ID3D12RootSignature> rootSignature;
+};
+
+static Map<uint64_t, CachedRootSignature> rootSignatureCache;
+static SpinLock rootSignatureCacheLock;
+
+ComPtr<ID3D12RootSignature> getOrCreateRootSignature(const ComPtr<ID3D12Device> &device, const void *data, SizeType size) {
+	const uint64_t hash = hashData(data, size);
+	{
+		auto lock = rootSignatureCacheLock.lock();
+		auto it = rootSignatureCache.find(hash);
+		if (it != rootSignatureCache.end() && it->second.data.size() == size && memcmp(it->second.data.data(), data, size) == 0) {
+			return it->second.rootSignature;
+		}
+	}
+
+	ComPtr<ID3D12RootSignature> rootSignature;
+	if (FAILED(device->CreateRootSignature(0, data, size, IID_PPV_ARGS(rootSignature.GetAddressOf())))) {
+		return nullptr;
+	}
+
+	auto lock = rootSignatureCacheLock.lock();
+	auto it = rootSignatureCache.find(hash);
+	if (it == rootSignatureCache.end()) {
+		CachedRootSignature cached;
+		cached.data.assign(reinterpret_cast<const uint8_t*>(data), reinterpret_cast<const uint8_t*>(data) + size);
+		cached.rootSignature = rootSignature;
+		rootSignatureCache[hash] = std::move(cached);
+	} else if (it->second.data.size() == size && memcmp(it->second.data.data(), data, size) == 0) {
+		// Created by another thread in the meantime
+		return it->second.rootSignature;
+	}
+
+	return rootSignature;
+}
+
+void clearRootSignatureCache() {
+	auto lock = rootSignatureCacheLock.lock();
+	rootSignatureCache.clear();
+}
+
 PipelineState::PipelineState() {
 	pipelineState.Reset();
 	rootSignature.Reset();
@@ -51,6 +95,8 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, PipelineStateStream
 
 bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineStateDesc &desc) {
 	PipelineStateStream stream;
+	PipelineCacheKey cacheKey;
+	cacheKey.addDesc(desc);
 
 	auto mask = desc.shadersMask;
 	auto *rootSignatureFlags = desc.rootSignatureFlags;
@@ -70,18 +116,20 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 			rsFlags |= D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
 		}
 
-		auto psShaderName = sname + "_ps";
+		auto psShaderName = ShaderCompiler::getShaderVariantName(sname + "_ps", desc.shaderVariant);
 		auto psShader = reslib.getShader(psShaderName);
 		if (psShader == nullptr) {
 			LOG_FMT(Error, "Failed to read %s!", psShaderName.c_str());
 			return false;
 		}
 		stream.insert(PixelShaderToken(D3D12_SHADER_BYTECODE{ psShader->GetBufferPointer(), psShader->GetBufferSize() }));
+		cacheKey.addShader(psShader->GetBufferPointer(), psShader->GetBufferSize());
 
 		if (mask & shaderInfoFlags_useVertex) {
-			auto vsShaderName = sname + "_vs";
+			auto vsShaderName = ShaderCompiler::getShaderVariantName(sname + "_vs", desc.shaderVariant);
 			if (auto vsShader = reslib.getShader(vsShaderName)) {
 				stream.insert(VertexShaderToken({ vsShader->GetBufferPointer(), vsShader->GetBufferSize() }));
+				cacheKey.addShader(vsShader->GetBufferPointer(), vsShader->GetBufferSize());
 			} else {
 				LOG_FMT(Error, "Failed to read %s!", vsShaderName.c_str());
 				return false;
@@ -91,9 +139,10 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 		}
 
 		if (mask & shaderInfoFlags_useGeometry) {
-			auto gsShaderName = sname + "_gs";
+			auto gsShaderName = ShaderCompiler::getShaderVariantName(sname + "_gs", desc.shaderVariant);
 			if (auto gsShader = reslib.getShader(gsShaderName)) {
 				stream.insert(GeometryShaderToken({ gsShader->GetBufferPointer(), gsShader->GetBufferSize() }));
+				cacheKey.addShader(gsShader->GetBufferPointer(), gsShader->GetBufferSize());
 			} else {
 				LOG_FMT(Error, "Failed to read %s!", gsShaderName.c_str());
 				return false;
@@ -103,9 +152,10 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 		}
 
 		if (mask & shaderInfoFlags_useDomain) {
-			auto dsShaderName = sname + "_ds";
+			auto dsShaderName = ShaderCompiler::getShaderVariantName(sname + "_ds", desc.shaderVariant);
 			if (auto dsShader = reslib.getShader(dsShaderName)) {
 				stream.insert(DomainShaderToken({ dsShader->GetBufferPointer(), dsShader->GetBufferSize() }));
+				cacheKey.addShader(dsShader->GetBufferPointer(), dsShader->GetBufferSize());
 			} else {
 				LOG_FMT(Error, "Failed to read %s!", dsShaderName.c_str());
 				return false;
@@ -115,9 +165,10 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 		}
 
 		if (mask & shaderInfoFlags_useHull) {
-			auto hsShaderName = sname + "_hs";
+			auto hsShaderName = ShaderCompiler::getShaderVariantName(sname + "_hs", desc.shaderVariant);
 			if (auto hsShader = reslib.getShader(hsShaderName)) {
 				stream.insert(HullShaderToken({ hsShader->GetBufferPointer(), hsShader->GetBufferSize() }));
+				cacheKey.addShader(hsShader->GetBufferPointer(), hsShader->GetBufferSize());
 			} else {
 				LOG_FMT(Error, "Failed to read %s!", hsShaderName.c_str());
 				return false;
@@ -127,9 +178,10 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 		}
 
 		if (mask & shaderInfoFlags_useMesh) {
-			auto msShaderName = sname + "_ms";
+			auto msShaderName = ShaderCompiler::getShaderVariantName(sname + "_ms", desc.shaderVariant);
 			if (auto msShader = reslib.getShader(msShaderName)) {
 				stream.insert(MeshShaderToken({ msShader->GetBufferPointer(), msShader->GetBufferSize() }));
+				cacheKey.addShader(msShader->GetBufferPointer(), msShader->GetBufferSize());
 			} else {
 				LOG_FMT(Error, "Failed to read %s!", msShaderName.c_str());
 				return false;
@@ -139,9 +191,10 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 		}
 
 		if (mask & shaderInfoFlags_useAmplification) {
-			auto asShaderName = sname + "_as";
+			auto asShaderName = ShaderCompiler::getShaderVariantName(sname + "_as", desc.shaderVariant);
 			if (auto asShader = reslib.getShader(asShaderName)) {
 				stream.insert(AmplificationShaderToken({ asShader->GetBufferPointer(), asShader->GetBufferSize() }));
+				cacheKey.addShader(asShader->GetBufferPointer(), asShader->GetBufferSize());
 			} else {
 				LOG_FMT(Error, "Failed to read %s!", asShaderName.c_str());
 				return false;
@@ -169,9 +222,10 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 			stream.insert(InputLayoutToken(D3D12_INPUT_LAYOUT_DESC{ desc.inputLayouts, desc.numInputLayouts }));
 		}
 	} else {
-		auto csShaderName = sname + "_cs";
+		auto csShaderName = ShaderCompiler::getShaderVariantName(sname + "_cs", desc.shaderVariant);
 		if (auto csShader = reslib.getShader(csShaderName)) {
 			stream.insert(ComputeShaderToken({ csShader->GetBufferPointer(), csShader->GetBufferSize() }));
+			cacheKey.addShader(csShader->GetBufferPointer(), csShader->GetBufferSize());
 		} else {
 			LOG_FMT(Error, "Failed to read %s!", csShaderName.c_str());
 			return false;
@@ -202,14 +256,16 @@ bool PipelineState::init(const ComPtr<ID3D12Device> &device, const PipelineState
 		"Failed to create root signature!"
 	);
 
-	RETURN_FALSE_ON_ERROR(
-		device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(rootSignature.GetAddressOf())),
-		"Failed to create root signature!"
-	);
+	rootSignature = getOrCreateRootSignature(device, signature->GetBufferPointer(), signature->GetBufferSize());
+	if (rootSignature == nullptr) {
+		LOG(Error, "Failed to create root signature!");
+		return false;
+	}
 	
 	stream.insert(RootSignatureToken{ rootSignature.Get() });
+	cacheKey.addRootSignature(signature->GetBufferPointer(), signature->GetBufferSize());
 
-	return initPipeline(device, stream);
+	return initPipeline(device, stream, &cacheKey);
 }
 
 ID3D12PipelineState *PipelineState::getPipelineState() const {
@@ -225,10 +281,31 @@ void PipelineState::deinit() {
 	rootSignature.Reset();
 }
 
-bool PipelineState::initPipeline(const ComPtr<ID3D12Device> &device, PipelineStateStream &pss) {
+bool PipelineState::initPipeline(const ComPtr<ID3D12Device> &device, PipelineStateStream &pss, const PipelineCacheKey *cacheKey) {
 	ComPtr<ID3D12Device2> device2;
 	RETURN_FALSE_ON_ERROR(device.As(&device2), "Failed to aquire ID3D12Device2 interface!");
 
+	PipelineCache *cache = cacheKey != nullptr ? getPipelineCache() : nullptr;
+
+	Vector<uint8_t> cachedBlob;
+	if (cache != nullptr && cache->find(cacheKey->hash, cachedBlob)) {
+		PipelineStateStream cachedStream = pss;
+		cachedStream.insert(CachedPSOToken{ D3D12_CACHED_PIPELINE_STATE{ cachedBlob.data(), cachedBlob.size() } });
+
+		D3D12_PIPELINE_STATE_STREAM_DESC pipelineDesc = {};
+		pipelineDesc.pPipelineStateSubobjectStream = cachedStream.getData();
+		pipelineDesc.SizeInBytes = cachedStream.getSize();
+
+		if (SUCCEEDED(device2->CreatePipelineState(&pipelineDesc, IID_PPV_ARGS(pipelineState.GetAddressOf())))) {
+			return true;
+		}
+
+		// Most likely the blob was created by a different driver or adapter.
+		// Recreate it below.
+		LOG(Warning, "Cached pipeline state was rejected by the driver!");
+		cache->remove(cacheKey->hash);
+	}
+
 	D3D12_PIPELINE_STATE_STREAM_DESC pipelineDesc = {};
 	pipelineDesc.pPipelineStateSubobjectStream = pss.getData();
 	pipelineDesc.SizeInBytes = pss.getSize();
@@ -238,6 +315,11 @@ bool PipelineState::initPipeline(const ComPtr<ID3D12Device> &device, PipelineSta
 		"Failed to create pipeline state!"
 	);
 
+	ComPtr<ID3DBlob> blob;
+	if (cache != nullptr && SUCCEEDED(pipelineState->GetCachedBlob(blob.GetAddressOf()))) {
+		cache->store(cacheKey->hash, blob->GetBufferPointer(), blob->GetBufferSize());
+	}
+
 	return true;
 }
 
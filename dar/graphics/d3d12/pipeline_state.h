@@ -8,6 +8,8 @@
 
 namespace Dar {
 
+struct PipelineCacheKey;
+
 template <class DataType, D3D12_PIPELINE_STATE_SUBOBJECT_TYPE D3D12Type>
 struct alignas(void *) PipelineStateStreamToken {
 	PipelineStateStreamToken() {}
@@ -109,8 +111,18 @@ struct PipelineStateDesc {
 	UINT numInputLayouts = 0; ///< Number of input layouts.
 	UINT numConstantBufferViews = 0; ///< Number of constant buffer views. Used for root signature creation.
 	UINT8 shadersMask = 0; ///< Mask indicating which types of shaders will be used. Only the fragment shader is ON by default. \see ShaderInfoFlags.
+	UINT32 shaderVariant = 0; ///< Mask of the shader keywords enabled for the pipeline state. \see ShaderCompiler::findShaderKeywords.
+	UINT32 variantKeywords = 0; ///< Mask of the shader keywords that could be toggled at runtime. A render pass creates a pipeline state for each of their combinations. \see FrameData::setShaderVariant.
 };
 
+/// Get a root signature by its serialized bytes. Identical root signatures are created once and shared
+/// between all pipeline states, so render passes with the same layout don't need to rebind them.
+/// @return nullptr if the root signature could not be created.
+ComPtr<ID3D12RootSignature> getOrCreateRootSignature(const ComPtr<ID3D12Device> &device, const void *data, SizeType size);
+
+/// Release the cached root signatures. Pipeline states keep the ones they use alive.
+void clearRootSignatureCache();
+
 struct PipelineState {
 	PipelineState();
 
@@ -123,7 +135,8 @@ struct PipelineState {
 	void deinit();
 
 private:
-	bool initPipeline(const ComPtr<ID3D12Device> &device, PipelineStateStream &pss);
+	/// @param cacheKey If set, the pipeline state is looked up in the pipeline cache and stored there after creation.
+	bool initPipeline(const ComPtr<ID3D12Device> &device, PipelineStateStream &pss, const PipelineCacheKey *cacheKey = nullptr);
 
 private:
 	ComPtr<ID3D12PipelineState> pipelineState;
@@ -50,13 +50,15 @@ UINT64 TextureResource::upload(UploadHandle uploadHandle, ImageData &imgData) {
 	}
 
 	Vector<D3D12_SUBRESOURCE_DATA> textureSubresources;
-	int width = imgData.header.width;
-	int height = imgData.header.height;
-	for (int i = 0; i < imgData.header.mipMapCount; ++i) {
-		SizeType offset = imgData.header.mipOffsets[i];
+	// Only the mip chain starting at imgData.firstMip is loaded. The texture is expected to be created
+	// with that mip as its most detailed one.
+	int width = std::max(1, imgData.header.width >> imgData.firstMip);
+	int height = std::max(1, imgData.header.height >> imgData.firstMip);
+	for (int i = imgData.firstMip; i < imgData.header.mipMapCount; ++i) {
+		SizeType offset = imgData.getMipOffset(i);
 
 		D3D12_SUBRESOURCE_DATA subresData = {};
-		subresData.pData = reinterpret_cast<void*>(imgData.data + offset);
+		subresData.pData = reinterpret_cast<void*>(imgData.data.get() + offset);
 
 		// BC3/BC7 block is 4x4 so each row would have width/4 blocks
 		SizeType numBlocksPerRow = std::max(1, (width + 3) / 4);
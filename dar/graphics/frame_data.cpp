@@ -6,24 +6,26 @@ namespace Dar {
 
 void FrameData::clear() {
 	useSameCommands = false;
-	vertexBuffer = nullptr;
+	numVertexBuffers = 0;
 	indexBuffer = nullptr;
 	constantBuffers.clear();
 	shaderResources.clear();
 	renderCommands.clear();
+	shaderVariants.clear();
 	uploadsToWait.clear();
 	fencesToWait.clear();
 }
 
 void FrameData::beginFrame(const Renderer &renderer) {
 	passIndex = -1;
-	vertexBuffer = nullptr;
+	numVertexBuffers = 0;
 	indexBuffer = nullptr;
 	constantBuffers.clear();
 	shaderResources.clear();
 	uploadsToWait.clear();
 	fencesToWait.clear();
 	shaderResources.resize(renderer.getNumPasses());
+	shaderVariants.assign(renderer.getNumPasses(), 0);
 	
 	if (!useSameCommands) {
 		renderCommands.clear();
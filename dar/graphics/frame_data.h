@@ -8,6 +8,9 @@
 
 namespace Dar {
 
+/// Max number of vertex buffers bound at the same time. See FrameData::setVertexBuffers.
+constexpr int MAX_VERTEX_BUFFERS = 4;
+
 struct FrameData {
 	friend class Renderer;
 	friend struct RenderPass;
@@ -21,7 +24,17 @@ struct FrameData {
 	void startNewPass();
 
 	void setVertexBuffer(VertexBuffer *vb) {
-		vertexBuffer = vb;
+		setVertexBuffers(vb, 1);
+	}
+
+	/// Bind vertex buffers holding different attributes of the same vertices, f.e positions and normals.
+	/// Buffer i is bound to input slot i for all passes. Passes read only the slots their input layouts use.
+	void setVertexBuffers(VertexBuffer *vbs, int count) {
+		dassert(count <= MAX_VERTEX_BUFFERS);
+		numVertexBuffers = std::min(count, MAX_VERTEX_BUFFERS);
+		for (int i = 0; i < numVertexBuffers; ++i) {
+			vertexBuffers[i] = &vbs[i];
+		}
 	}
 
 	void setIndexBuffer(IndexBuffer *ib) {
@@ -79,6 +92,12 @@ struct FrameData {
 		fencesToWait.push_back(fence);
 	}
 
+	/// Select the shader variant used by the current pass by enabling runtime keywords.
+	/// Keywords not in PipelineStateDesc::variantKeywords of the pass are ignored.
+	void setShaderVariant(UINT32 variant) {
+		shaderVariants[passIndex] = variant;
+	}
+
 	/// Optimization. If set to true doesn't update
 	// the commands on the next frame.
 	void setUseSameCommands(bool use) {
@@ -123,10 +142,14 @@ private:
 	/// i.e it preserves the order of the commands as they were passed.
 	Vector<RenderCommandList> renderCommands;
 
+	/// Runtime keywords enabled for each pass of the pipeline.
+	Vector<UINT32> shaderVariants;
+
 	Vector<UploadContextHandle> uploadsToWait;
 	Vector<FenceValue> fencesToWait;
 
-	VertexBuffer *vertexBuffer = nullptr;
+	VertexBuffer *vertexBuffers[MAX_VERTEX_BUFFERS] = {};
+	int numVertexBuffers = 0;
 	IndexBuffer *indexBuffer = nullptr;
 
 	int passIndex = -1;
@@ -36,4 +36,13 @@ bool FramePipeline::compilePipeline(Device &device) {
 	return true;
 }
 
+bool FramePipeline::reloadShaders(Device &device, const Vector<String> &shaders) {
+	bool success = true;
+	for (auto renderPass : renderPasses) {
+		success &= renderPass->reloadShaders(device.getDevice(), shaders);
+	}
+
+	return success;
+}
+
 } // namespace Dar
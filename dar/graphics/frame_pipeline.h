@@ -26,6 +26,10 @@ public:
 	/// and compile only the render passes that were added after the previous call to compilePipeline.
 	bool compilePipeline(Device &device);
 
+	/// Recreate the pipeline states of the render passes using any of the given shaders.
+	/// @see RenderPass::reloadShaders()
+	bool reloadShaders(Device &device, const Vector<String> &shaders);
+
 	RenderPass &getPass(SizeType index) {
 		dassert(renderPasses.size() > index && renderPasses[index]);
 
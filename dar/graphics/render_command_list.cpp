@@ -39,6 +39,9 @@ void RenderCommandList::execCommands(CommandList &cmdList) const {
 		case Dispatch:
 			perCmdCallback((RenderCommandDispatch *)nullptr);
 			break;
+		case SetIndexBuffer:
+			perCmdCallback((RenderCommandSetIndexBuffer*)nullptr);
+			break;
 		default:
 			dassert(false);
 			break;
@@ -2,6 +2,7 @@
 
 #include "core.h"
 #include "d3d12/command_list.h"
+#include "d3d12/vertex_index_buffer.h"
 #include "utils/defines.h"
 
 namespace Dar {
@@ -12,6 +13,7 @@ enum class RenderCommandType {
 	SetConstantBuffer,
 	Transition,
 	Dispatch,
+	SetIndexBuffer,
 
 	Invalid,
 };
@@ -116,6 +118,25 @@ private:
 	uint32_t threadGroupCount;
 };
 
+/// Bind an index buffer for the next draws, f.e for switching between 16-bit and 32-bit indices.
+/// Overrides the index buffer set with FrameData::setIndexBuffer until the end of the pass.
+struct RenderCommandSetIndexBuffer {
+	RenderCommandType type = RenderCommandType::SetIndexBuffer;
+
+	RenderCommandSetIndexBuffer(const IndexBuffer &indexBuffer)
+		: bufferView(indexBuffer.bufferView), bufferHandle(indexBuffer.bufferHandle) {}
+
+	void exec(CommandList &cmdList) const {
+		D3D12_INDEX_BUFFER_VIEW view = bufferView;
+		cmdList.transition(bufferHandle, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+		cmdList.setIndexBuffer(&view);
+	}
+
+private:
+	D3D12_INDEX_BUFFER_VIEW bufferView;
+	ResourceHandle bufferHandle;
+};
+
 // TODO: when execCommands is called cache the commands in a bundle for next frame use.
 struct RenderCommandList {
 	RenderCommandList() : memory(nullptr), size(0) {}
@@ -25,8 +25,23 @@ void RenderPassDesc::setViewport(int width, int height) {
 }
 
 bool RenderPass::init(ComPtr<ID3D12Device> device, Backbuffer *backbuf, const RenderPassDesc &rpd) {
-	auto &psoDesc = rpd.psoDesc;
-	if (!pipeline.init(device, psoDesc)) {
+	// Keep a copy of the description, so the pipeline states could be recreated on shader reload.
+	psoDesc = rpd.psoDesc;
+	if (psoDesc.inputLayouts != nullptr) {
+		inputLayouts.assign(psoDesc.inputLayouts, psoDesc.inputLayouts + psoDesc.numInputLayouts);
+		psoDesc.inputLayouts = inputLayouts.data();
+	}
+	if (psoDesc.staticSamplerDescs != nullptr) {
+		staticSamplerDescs.assign(psoDesc.staticSamplerDescs, psoDesc.staticSamplerDescs + psoDesc.numStaticSamplers);
+		psoDesc.staticSamplerDescs = staticSamplerDescs.data();
+	}
+	if (psoDesc.rootSignatureFlags != nullptr) {
+		rootSignatureFlags = *psoDesc.rootSignatureFlags;
+		psoDesc.rootSignatureFlags = &rootSignatureFlags;
+	}
+
+	variantKeywords = psoDesc.variantKeywords;
+	if (!initPipelines(device, pipelines, pipelineVariants)) {
 		return false;
 	}
 
@@ -108,8 +123,74 @@ bool RenderPass::init(ComPtr<ID3D12Device> device, Backbuffer *backbuf, const Re
 	return true;
 }
 
-void RenderPass::begin(CommandList &cmdList, int backbufferIndex) {
-	cmdList.setPipelineState(pipeline.getPipelineState());
+bool RenderPass::initPipelines(const ComPtr<ID3D12Device> &device, Vector<PipelineState> &states, Vector<UINT32> &variants) const {
+	// Create a pipeline state for every subset of the runtime keywords
+	UINT32 variant = 0;
+	do {
+		PipelineStateDesc variantDesc = psoDesc;
+		variantDesc.shaderVariant = (psoDesc.shaderVariant & ~variantKeywords) | variant;
+
+		states.emplace_back();
+		variants.push_back(variant);
+		if (!states.back().init(device, variantDesc)) {
+			return false;
+		}
+
+		variant = (variant - variantKeywords) & variantKeywords;
+	} while (variant != 0);
+
+	return true;
+}
+
+bool RenderPass::reloadShaders(const ComPtr<ID3D12Device> &device, const Vector<String> &shaders) {
+	// Shaders given by blob are not in the resource library.
+	if (psoDesc.shaderBlob != nullptr) {
+		return true;
+	}
+
+	bool usesShader = false;
+	for (const auto &name : shaders) {
+		// Shader names are in the form shaderName_{vs,ps,etc}[@variant]
+		auto stageName = std::string_view{ name }.substr(0, name.find('@'));
+		auto stagePos = stageName.find_last_of('_');
+		usesShader |= stagePos != std::string_view::npos && stageName.substr(0, stagePos) == psoDesc.shaderName;
+	}
+
+	if (!usesShader) {
+		return true;
+	}
+
+	Vector<PipelineState> newPipelines;
+	Vector<UINT32> newVariants;
+	if (!initPipelines(device, newPipelines, newVariants)) {
+		LOG_FMT(Error, "Failed to reload shader %s! Keeping the old pipeline states.", psoDesc.shaderName.c_str());
+		return false;
+	}
+
+	for (auto &pipeline : pipelines) {
+		pipeline.deinit();
+	}
+
+	pipelines = std::move(newPipelines);
+	pipelineVariants = std::move(newVariants);
+
+	return true;
+}
+
+const PipelineState& RenderPass::getPipeline(UINT32 shaderVariant) const {
+	shaderVariant &= variantKeywords;
+	for (SizeType i = 0; i < pipelineVariants.size(); ++i) {
+		if (pipelineVariants[i] == shaderVariant) {
+			return pipelines[i];
+		}
+	}
+
+	dassert(false);
+	return pipelines[0];
+}
+
+void RenderPass::begin(CommandList &cmdList, int backbufferIndex, UINT32 shaderVariant) {
+	cmdList.setPipelineState(getPipeline(shaderVariant).getPipelineState());
 
 	if (compute) {
 		return;
@@ -155,7 +236,11 @@ void RenderPass::end(CommandList &) {
 }
 
 void RenderPass::deinit() {
-	pipeline.deinit();
+	for (auto &pipeline : pipelines) {
+		pipeline.deinit();
+	}
+	pipelines.clear();
+	pipelineVariants.clear();
 	for (int i = 0; i < FRAME_COUNT; ++i) {
 		rtvHeap[i].deinit();
 		srvHeap[i].deinit();
@@ -150,20 +150,39 @@ private:
 struct FrameData;
 struct RenderPass {
 	/// Initialize the render pass given the description.
-	/// Creates the pipeline state (TODO: load PSO from cache)
+	/// Creates the pipeline states. Compiled pipeline states are cached on disk, see PipelineCache.
 	/// @param device Device used for the render pass initialization steps.
 	/// @param rpd Render pass description.
 	/// @param frameCount How many frames are rendered at the same time. Used for determining the size of the SRV and RTV heaps.
 	bool init(ComPtr<ID3D12Device> device, Backbuffer *backbuffer, const RenderPassDesc &rpd);
 
-	void begin(CommandList &cmdList, int backbufferIndex);
+	/// @param shaderVariant Mask of the runtime keywords to enable. \see PipelineStateDesc::variantKeywords
+	void begin(CommandList &cmdList, int backbufferIndex, UINT32 shaderVariant = 0);
 	
 	void end(CommandList &cmdList);
 	
 	void deinit();
 
+	/// Pipeline state of the shader variant with the given runtime keywords enabled.
+	const PipelineState& getPipeline(UINT32 shaderVariant) const;
+
+	/// Recreate the pipeline states if they use any of the given shaders.
+	/// The GPU must not be using the pipeline states. See Renderer::reloadShaders().
+	/// @param shaders Names of the shaders as found in the ResourceLibrary.
+	/// @return false if the pipeline states could not be recreated. The old ones are kept in that case.
+	bool reloadShaders(const ComPtr<ID3D12Device> &device, const Vector<String> &shaders);
+
+private:
+	bool initPipelines(const ComPtr<ID3D12Device> &device, Vector<PipelineState> &states, Vector<UINT32> &variants) const;
+
 public:
-	PipelineState pipeline;
+	PipelineStateDesc psoDesc; ///< Copy of the description of the pipeline states. Points to the copies below. Semantic names are expected to be string literals.
+	Vector<D3D12_INPUT_ELEMENT_DESC> inputLayouts;
+	Vector<D3D12_STATIC_SAMPLER_DESC> staticSamplerDescs;
+	D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+	Vector<PipelineState> pipelines; ///< One for each combination of the runtime keywords.
+	Vector<UINT32> pipelineVariants; ///< Runtime keywords enabled for each pipeline state.
+	UINT32 variantKeywords = 0;
 	Vector<RenderPassAttachment> renderTargetAttachments;
 	RenderPassAttachment depthBufferAttachment;
 	Vector<D3D12_RENDER_PASS_RENDER_TARGET_DESC> renderTargetDescs;
@@ -114,6 +114,17 @@ void Renderer::setFramePipeline(FramePipeline *fp) {
 	framePipeline = fp;
 }
 
+bool Renderer::reloadShaders(const Vector<String> &shaders) {
+	if (framePipeline == nullptr || shaders.empty()) {
+		return true;
+	}
+
+	// Old pipeline states may still be in use by the frames in flight.
+	device->flushCommandQueue();
+
+	return framePipeline->reloadShaders(*device, shaders);
+}
+
 void Renderer::renderUI(CommandList &cmdList, D3D12_CPU_DESCRIPTOR_HANDLE &rtvHandle) {
 	if (!settings.useImGui) {
 		return;
@@ -156,7 +167,7 @@ CommandList Renderer::populateCommandList(const FrameData &frameData) {
 		}
 
 		RenderPass &renderPass = framePipeline->getPass(renderPassIndex);
-		renderPass.begin(cmdList, backbufferIndex);
+		renderPass.begin(cmdList, backbufferIndex, frameData.shaderVariants[renderPassIndex]);
 
 		auto &shaderResources = frameData.shaderResources[renderPassIndex];
 		const SizeType numShaderResources = shaderResources.size();
@@ -213,7 +224,7 @@ CommandList Renderer::populateCommandList(const FrameData &frameData) {
 			cmdList.setDescriptorHeap(renderPass.srvHeap[backbufferIndex].getAddressOf());
 		}
 
-		cmdList.setRootSignature(renderPass.pipeline.getRootSignature(), renderPass.compute);
+		cmdList.setRootSignature(renderPass.getPipeline(frameData.shaderVariants[renderPassIndex]).getRootSignature(), renderPass.compute);
 
 		for (auto &cb : frameData.constantBuffers) {
 			cmdList.transition(cb.handle, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
@@ -247,9 +258,13 @@ CommandList Renderer::populateCommandList(const FrameData &frameData) {
 
 			cmdList.setPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-			if (frameData.vertexBuffer) {
-				cmdList.transition(frameData.vertexBuffer->bufferHandle, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-				cmdList.setVertexBuffers(&frameData.vertexBuffer->bufferView, 1);
+			if (frameData.numVertexBuffers > 0) {
+				D3D12_VERTEX_BUFFER_VIEW views[MAX_VERTEX_BUFFERS];
+				for (int i = 0; i < frameData.numVertexBuffers; ++i) {
+					cmdList.transition(frameData.vertexBuffers[i]->bufferHandle, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+					views[i] = frameData.vertexBuffers[i]->bufferView;
+				}
+				cmdList.setVertexBuffers(views, frameData.numVertexBuffers);
 			}
 			if (frameData.indexBuffer) {
 				cmdList.transition(frameData.indexBuffer->bufferHandle, D3D12_RESOURCE_STATE_INDEX_BUFFER);
@@ -41,6 +41,11 @@ public:
 
 	void setFramePipeline(FramePipeline *framePipeline);
 
+	/// Recreate the pipeline states using any of the given shaders, f.e after ResourceLibrary::pollHotReload().
+	/// Waits for the GPU to finish all submitted frames first.
+	/// @return false if any of the pipeline states failed to be recreated.
+	bool reloadShaders(const Vector<String> &shaders);
+
 	RenderSettings& getSettings() {
 		return settings;
 	}
@@ -0,0 +1,543 @@
+#include "math/bvh.h"
+
+#include <algorithm>
+
+#include <xmmintrin.h>
+
+namespace Dar {
+
+/// Number of bins the centroids are sorted in when searching for the best split of a node.
+constexpr int SAH_BINS = 16;
+
+/// Cost of visiting an inner node relative to testing a primitive.
+constexpr float SAH_TRAVERSAL_COST = 1.f;
+
+/// Leaves are never bigger than this, even if the SAH prefers it.
+constexpr uint32_t MAX_LEAF_SIZE = 16;
+
+constexpr SizeType STACK_RESERVE = 64;
+
+/// Number of primitives of a leaf tested together by queryFrustum().
+constexpr uint32_t LEAF_BATCH_SIZE = 4;
+
+/// SAH cost of testing the primitives of a leaf. Up to LEAF_BATCH_SIZE of them cost as much as one,
+/// so splitting leaves smaller than that never pays off.
+static float getLeafCost(uint32_t count, float halfArea) {
+	return float((count + LEAF_BATCH_SIZE - 1) / LEAF_BATCH_SIZE) * halfArea;
+}
+
+static bool overlaps(const AABB &a, const Vec3 &bMin, const Vec3 &bMax) {
+	return a.min.x <= bMax.x && a.max.x >= bMin.x &&
+		a.min.y <= bMax.y && a.max.y >= bMin.y &&
+		a.min.z <= bMax.z && a.max.z >= bMin.z;
+}
+
+static bool overlapsSphere(const Vec3 &boxMin, const Vec3 &boxMax, const Vec3 &center, float radius) {
+	const Vec3 offset = center - glm::clamp(center, boxMin, boxMax);
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+/// @return Distance along the ray where it enters the box, or a negative value if it misses it.
+static float intersectRayBox(const Vec3 &origin, const Vec3 &invDirection, float maxT, const Vec3 &boxMin, const Vec3 &boxMax) {
+	const Vec3 t0 = (boxMin - origin) * invDirection;
+	const Vec3 t1 = (boxMax - origin) * invDirection;
+	const Vec3 tNear = glm::min(t0, t1);
+	const Vec3 tFar = glm::max(t0, t1);
+	const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+	const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxT));
+	return tEnter <= tExit ? tEnter : -1.f;
+}
+
+int BVH::Split::getBin(float centroid) const {
+	return std::min(SAH_BINS - 1, static_cast<int>((centroid - binsMin) * binsScale));
+}
+
+void BVH::build(const Vector<AABB> &primitiveBoxes) {
+	const uint32_t numPrimitives = static_cast<uint32_t>(primitiveBoxes.size());
+
+	nodes.clear();
+	primitives.resize(numPrimitives);
+	boxes = primitiveBoxes;
+	centroids.resize(numPrimitives);
+	for (uint32_t i = 0; i < numPrimitives; ++i) {
+		primitives[i] = i;
+		centroids[i] = boxes[i].getCenter();
+	}
+
+	if (numPrimitives == 0) {
+		return;
+	}
+
+	// A binary tree with N leaves has 2N - 1 nodes.
+	nodes.reserve(2 * SizeType(numPrimitives) - 1);
+
+	Node root;
+	root.leftFirst = 0;
+	root.count = numPrimitives;
+	nodes.push_back(root);
+
+	Vector<uint32_t> stack;
+	stack.reserve(STACK_RESERVE);
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+
+		updateNodeBox(nodes[nodeIndex]);
+
+		const Node node = nodes[nodeIndex];
+		if (node.count <= LEAF_BATCH_SIZE) {
+			continue;
+		}
+
+		const Split split = findBestSplit(node);
+		const AABB nodeBox{ node.boxMin, node.boxMax };
+		const float leafCost = getLeafCost(node.count, nodeBox.getHalfArea());
+		if (node.count <= MAX_LEAF_SIZE && (split.axis == -1 || split.cost + SAH_TRAVERSAL_COST * nodeBox.getHalfArea() >= leafCost)) {
+			continue;
+		}
+
+		uint32_t i = node.leftFirst;
+		if (split.axis == -1) {
+			// All centroids are at the same point, so any split is as good as the others.
+			i += node.count / 2;
+		} else {
+			// Partition the primitives of the node in place, so each node covers a continuous range of them.
+			uint32_t j = node.leftFirst + node.count;
+			while (i < j) {
+				if (split.getBin(centroids[i][split.axis]) <= split.bin) {
+					++i;
+				} else {
+					--j;
+					std::swap(primitives[i], primitives[j]);
+					std::swap(boxes[i], boxes[j]);
+					std::swap(centroids[i], centroids[j]);
+				}
+			}
+		}
+
+		const uint32_t leftCount = i - node.leftFirst;
+		dassert(leftCount > 0 && leftCount < node.count);
+
+		const uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+		Node left, right;
+		left.leftFirst = node.leftFirst;
+		left.count = leftCount;
+		right.leftFirst = i;
+		right.count = node.count - leftCount;
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		nodes[nodeIndex].leftFirst = leftIndex;
+		nodes[nodeIndex].count = 0;
+
+		stack.push_back(leftIndex + 1);
+		stack.push_back(leftIndex);
+	}
+
+	centroids.clear();
+	centroids.shrink_to_fit();
+
+	updateLeafBoxes();
+}
+
+void BVH::refit(const Vector<AABB> &primitiveBoxes) {
+	dassert(primitiveBoxes.size() == primitives.size());
+
+	for (SizeType i = 0; i < primitives.size(); ++i) {
+		boxes[i] = primitiveBoxes[primitives[i]];
+	}
+
+	// Children are always after their parent, so going backwards updates them first.
+	for (SizeType i = nodes.size(); i-- > 0;) {
+		Node &node = nodes[i];
+		if (node.isLeaf()) {
+			updateNodeBox(node);
+		} else {
+			const Node &left = nodes[node.leftFirst];
+			const Node &right = nodes[node.leftFirst + 1];
+			node.boxMin = glm::min(left.boxMin, right.boxMin);
+			node.boxMax = glm::max(left.boxMax, right.boxMax);
+		}
+	}
+
+	updateLeafBoxes();
+}
+
+void BVH::queryFrustum(const Vec4 planes[static_cast<int>(FrustumPlane::Count)], Vector<uint32_t> &result) const {
+	constexpr int numPlanes = static_cast<int>(FrustumPlane::Count);
+	constexpr uint32_t allPlanesMask = (1 << numPlanes) - 1;
+
+	if (nodes.empty()) {
+		return;
+	}
+
+	Vec3 absNormals[numPlanes];
+	__m128 nx[numPlanes], ny[numPlanes], nz[numPlanes], nw[numPlanes];
+	__m128 absNx[numPlanes], absNy[numPlanes], absNz[numPlanes];
+	for (int p = 0; p < numPlanes; ++p) {
+		absNormals[p] = glm::abs(Vec3(planes[p]));
+
+		nx[p] = _mm_set1_ps(planes[p].x);
+		ny[p] = _mm_set1_ps(planes[p].y);
+		nz[p] = _mm_set1_ps(planes[p].z);
+		nw[p] = _mm_set1_ps(planes[p].w);
+		absNx[p] = _mm_set1_ps(absNormals[p].x);
+		absNy[p] = _mm_set1_ps(absNormals[p].y);
+		absNz[p] = _mm_set1_ps(absNormals[p].z);
+	}
+
+	// Classify a box against the planes in the mask. Planes the box is fully inside of are removed from the mask,
+	// since the boxes of the children are inside it too.
+	auto classify = [&planes, &absNormals](const Vec3 &boxMin, const Vec3 &boxMax, uint32_t &mask) {
+		const Vec3 center = (boxMin + boxMax) * 0.5f;
+		const Vec3 extent = (boxMax - boxMin) * 0.5f;
+		for (int p = 0; p < numPlanes; ++p) {
+			if ((mask & (1 << p)) == 0) {
+				continue;
+			}
+
+			const float distance = glm::dot(Vec3(planes[p]), center) + planes[p].w;
+			const float radius = glm::dot(absNormals[p], extent);
+			if (distance + radius < 0.f) {
+				return false;
+			}
+			if (distance - radius >= 0.f) {
+				mask &= ~(1 << p);
+			}
+		}
+		return true;
+	};
+
+	struct StackEntry {
+		uint32_t node;
+		uint32_t mask;
+	};
+	Vector<StackEntry> stack;
+	stack.reserve(STACK_RESERVE);
+	stack.push_back(StackEntry{ 0, allPlanesMask });
+	while (!stack.empty()) {
+		const StackEntry entry = stack.back();
+		stack.pop_back();
+
+		const Node &node = nodes[entry.node];
+		uint32_t mask = entry.mask;
+		if (!classify(node.boxMin, node.boxMax, mask)) {
+			continue;
+		}
+
+		if (mask == 0) {
+			addSubtree(entry.node, result);
+			continue;
+		}
+
+		if (node.isLeaf()) {
+			const uint32_t end = node.leftFirst + node.count;
+			for (uint32_t i = node.leftFirst; i < end; i += 4) {
+				const __m128 cx = _mm_loadu_ps(centerX.data() + i);
+				const __m128 cy = _mm_loadu_ps(centerY.data() + i);
+				const __m128 cz = _mm_loadu_ps(centerZ.data() + i);
+				const __m128 ex = _mm_loadu_ps(extentX.data() + i);
+				const __m128 ey = _mm_loadu_ps(extentY.data() + i);
+				const __m128 ez = _mm_loadu_ps(extentZ.data() + i);
+
+				// Same test as classify(), only against the planes the leaf is not fully inside of.
+				__m128 outside = _mm_cmplt_ps(ex, _mm_setzero_ps());
+				for (int p = 0; p < numPlanes; ++p) {
+					if ((mask & (1 << p)) == 0) {
+						continue;
+					}
+
+					const __m128 distance = _mm_add_ps(
+						_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_mul_ps(nz[p], cz)),
+						nw[p]
+					);
+					const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNx[p], ex), _mm_mul_ps(absNy[p], ey)), _mm_mul_ps(absNz[p], ez));
+					outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+				}
+
+				const int outsideMask = _mm_movemask_ps(outside);
+				const uint32_t count = std::min(4u, end - i);
+				for (uint32_t j = 0; j < count; ++j) {
+					if ((outsideMask & (1 << j)) == 0) {
+						result.push_back(primitives[i + j]);
+					}
+				}
+			}
+		} else {
+			stack.push_back(StackEntry{ node.leftFirst + 1, mask });
+			stack.push_back(StackEntry{ node.leftFirst, mask });
+		}
+	}
+}
+
+void BVH::queryBox(const AABB &box, Vector<uint32_t> &result) const {
+	if (nodes.empty()) {
+		return;
+	}
+
+	Vector<uint32_t> stack;
+	stack.reserve(STACK_RESERVE);
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlaps(box, node.boxMin, node.boxMax)) {
+			continue;
+		}
+
+		if (node.isLeaf()) {
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+				if (overlaps(box, boxes[i].min, boxes[i].max)) {
+					result.push_back(primitives[i]);
+				}
+			}
+		} else {
+			stack.push_back(node.leftFirst + 1);
+			stack.push_back(node.leftFirst);
+		}
+	}
+}
+
+void BVH::querySphere(const Vec3 &center, float radius, Vector<uint32_t> &result) const {
+	if (nodes.empty()) {
+		return;
+	}
+
+	Vector<uint32_t> stack;
+	stack.reserve(STACK_RESERVE);
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlapsSphere(node.boxMin, node.boxMax, center, radius)) {
+			continue;
+		}
+
+		if (node.isLeaf()) {
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+				if (overlapsSphere(boxes[i].min, boxes[i].max, center, radius)) {
+					result.push_back(primitives[i]);
+				}
+			}
+		} else {
+			stack.push_back(node.leftFirst + 1);
+			stack.push_back(node.leftFirst);
+		}
+	}
+}
+
+bool BVH::raycast(const Vec3 &origin, const Vec3 &direction, float maxT, RayHit &hit, const RayIntersector &intersect) const {
+	hit = RayHit{};
+	if (nodes.empty()) {
+		return false;
+	}
+
+	const Vec3 invDirection = 1.f / direction;
+	hit.t = maxT;
+
+	struct StackEntry {
+		uint32_t node;
+		float t; ///< Distance to the box of the node.
+	};
+
+	Vector<StackEntry> stack;
+	stack.reserve(STACK_RESERVE);
+
+	const float rootT = intersectRayBox(origin, invDirection, maxT, nodes[0].boxMin, nodes[0].boxMax);
+	if (rootT >= 0.f) {
+		stack.push_back(StackEntry{ 0, rootT });
+	}
+
+	while (!stack.empty()) {
+		const StackEntry entry = stack.back();
+		stack.pop_back();
+
+		// A closer hit was found after the node was pushed.
+		if (entry.t > hit.t) {
+			continue;
+		}
+
+		const Node &node = nodes[entry.node];
+		if (node.isLeaf()) {
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+				float t = intersectRayBox(origin, invDirection, hit.t, boxes[i].min, boxes[i].max);
+				if (t < 0.f) {
+					continue;
+				}
+
+				if (intersect && !intersect(primitives[i], t)) {
+					continue;
+				}
+
+				if (t >= 0.f && t <= hit.t) {
+					hit.t = t;
+					hit.primitive = primitives[i];
+				}
+			}
+			continue;
+		}
+
+		// Visit the closer child first, so the hits in it prune the other one.
+		const uint32_t left = node.leftFirst;
+		const uint32_t right = node.leftFirst + 1;
+		const float leftT = intersectRayBox(origin, invDirection, hit.t, nodes[left].boxMin, nodes[left].boxMax);
+		const float rightT = intersectRayBox(origin, invDirection, hit.t, nodes[right].boxMin, nodes[right].boxMax);
+		const bool leftFirst = leftT >= 0.f && (rightT < 0.f || leftT <= rightT);
+		const StackEntry nearEntry = leftFirst ? StackEntry{ left, leftT } : StackEntry{ right, rightT };
+		const StackEntry farEntry = leftFirst ? StackEntry{ right, rightT } : StackEntry{ left, leftT };
+		if (farEntry.t >= 0.f) {
+			stack.push_back(farEntry);
+		}
+		if (nearEntry.t >= 0.f) {
+			stack.push_back(nearEntry);
+		}
+	}
+
+	if (hit.primitive == INVALID_PRIMITIVE) {
+		hit.t = std::numeric_limits<float>::max();
+		return false;
+	}
+
+	return true;
+}
+
+int BVH::getDepth() const {
+	if (nodes.empty()) {
+		return 0;
+	}
+
+	int depth = 0;
+	Vector<std::pair<uint32_t, int>> stack;
+	stack.reserve(STACK_RESERVE);
+	stack.push_back({ 0, 1 });
+	while (!stack.empty()) {
+		const auto [nodeIndex, nodeDepth] = stack.back();
+		stack.pop_back();
+
+		const Node &node = nodes[nodeIndex];
+		if (node.isLeaf()) {
+			depth = std::max(depth, nodeDepth);
+		} else {
+			stack.push_back({ node.leftFirst, nodeDepth + 1 });
+			stack.push_back({ node.leftFirst + 1, nodeDepth + 1 });
+		}
+	}
+
+	return depth;
+}
+
+void BVH::updateLeafBoxes() {
+	const SizeType paddedSize = primitives.size() + 3;
+	Vector<float> *arrays[] = { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ };
+	for (auto *array : arrays) {
+		array->assign(paddedSize, 0.f);
+	}
+
+	for (SizeType i = 0; i < paddedSize; ++i) {
+		const bool valid = i < boxes.size() && boxes[i].min.x <= boxes[i].max.x && boxes[i].min.y <= boxes[i].max.y && boxes[i].min.z <= boxes[i].max.z;
+		if (!valid) {
+			extentX[i] = extentY[i] = extentZ[i] = -1.f;
+			continue;
+		}
+
+		const Vec3 center = boxes[i].getCenter();
+		const Vec3 extent = (boxes[i].max - boxes[i].min) * 0.5f;
+		centerX[i] = center.x;
+		centerY[i] = center.y;
+		centerZ[i] = center.z;
+		extentX[i] = extent.x;
+		extentY[i] = extent.y;
+		extentZ[i] = extent.z;
+	}
+}
+
+void BVH::updateNodeBox(Node &node) const {
+	AABB box;
+	for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+		box.add(boxes[i]);
+	}
+	node.boxMin = box.min;
+	node.boxMax = box.max;
+}
+
+BVH::Split BVH::findBestSplit(const Node &node) const {
+	AABB centroidBox;
+	for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+		centroidBox.add(centroids[i]);
+	}
+
+	struct Bin {
+		AABB box;
+		uint32_t count = 0;
+	};
+
+	Split best;
+	for (int axis = 0; axis < 3; ++axis) {
+		const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+		if (extent <= 0.f) {
+			continue;
+		}
+
+		Split split;
+		split.axis = axis;
+		split.binsMin = centroidBox.min[axis];
+		split.binsScale = SAH_BINS / extent;
+
+		Bin bins[SAH_BINS];
+		for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+			Bin &bin = bins[split.getBin(centroids[i][axis])];
+			bin.box.add(boxes[i]);
+			++bin.count;
+		}
+
+		// Sweep from the right to get the cost of the right side of each split, then from the left to finish it.
+		float rightCosts[SAH_BINS - 1];
+		AABB rightBox;
+		uint32_t rightCount = 0;
+		for (int b = SAH_BINS - 1; b > 0; --b) {
+			rightBox.add(bins[b].box);
+			rightCount += bins[b].count;
+			rightCosts[b - 1] = getLeafCost(rightCount, rightBox.getHalfArea());
+		}
+
+		AABB leftBox;
+		uint32_t leftCount = 0;
+		for (int b = 0; b < SAH_BINS - 1; ++b) {
+			leftBox.add(bins[b].box);
+			leftCount += bins[b].count;
+			if (leftCount == 0 || leftCount == node.count) {
+				continue;
+			}
+
+			const float cost = getLeafCost(leftCount, leftBox.getHalfArea()) + rightCosts[b];
+			if (cost < best.cost) {
+				best = split;
+				best.bin = b;
+				best.cost = cost;
+			}
+		}
+	}
+
+	return best;
+}
+
+void BVH::addSubtree(uint32_t nodeIndex, Vector<uint32_t> &result) const {
+	// The primitives of a subtree are continuous, they are between its leftmost and rightmost leaves.
+	uint32_t first = nodeIndex;
+	while (!nodes[first].isLeaf()) {
+		first = nodes[first].leftFirst;
+	}
+	uint32_t last = nodeIndex;
+	while (!nodes[last].isLeaf()) {
+		last = nodes[last].leftFirst + 1;
+	}
+
+	const uint32_t begin = nodes[first].leftFirst;
+	const uint32_t end = nodes[last].leftFirst + nodes[last].count;
+	result.insert(result.end(), primitives.begin() + begin, primitives.begin() + end);
+}
+
+} // namespace Dar
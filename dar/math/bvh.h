@@ -0,0 +1,134 @@
+#pragma once
+
+#include "math/dar_math.h"
+#include "utils/defines.h"
+
+#include <functional>
+
+namespace Dar {
+
+struct AABB {
+	Vec3 min = Vec3(std::numeric_limits<float>::max());
+	Vec3 max = Vec3(std::numeric_limits<float>::lowest());
+
+	void add(const Vec3 &p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void add(const AABB &box) {
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	Vec3 getCenter() const {
+		return (min + max) * 0.5f;
+	}
+
+	/// @return Half the surface area of the box, 0 for invalid boxes.
+	float getHalfArea() const {
+		const Vec3 d = glm::max(max - min, Vec3(0.f));
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+};
+
+/// Bounding volume hierarchy over axis-aligned boxes, f.e of the meshes of a scene.
+/// Built top-down with binned SAH. Nodes are 32 bytes and siblings are next to each other in memory,
+/// so the traversal reads both children of a node together.
+class BVH {
+public:
+	static constexpr uint32_t INVALID_PRIMITIVE = uint32_t(-1);
+
+	struct Node {
+		Vec3 boxMin;
+		uint32_t leftFirst = 0; ///< Index of the left child for inner nodes, the right one is next to it. Index of the first primitive for leaves.
+		Vec3 boxMax;
+		uint32_t count = 0; ///< Number of primitives of leaves, 0 for inner nodes.
+
+		bool isLeaf() const {
+			return count > 0;
+		}
+	};
+	static_assert(sizeof(Node) == 32);
+
+	struct RayHit {
+		uint32_t primitive = INVALID_PRIMITIVE;
+		float t = std::numeric_limits<float>::max(); ///< Distance to the hit in units of the ray direction.
+	};
+
+	/// Called for the primitives which boxes are hit by a ray.
+	/// @param primitive Index of the primitive in the boxes the BVH is built with.
+	/// @param t Receives the distance to the hit.
+	/// @return true if the primitive is hit.
+	using RayIntersector = std::function<bool(uint32_t primitive, float &t)>;
+
+	/// Build the hierarchy over the boxes of the primitives.
+	void build(const Vector<AABB> &boxes);
+
+	/// Update the boxes of the nodes for moved primitives, keeping the hierarchy.
+	/// Much faster than build(), but the quality of the tree degrades if the primitives move far from their neighbours.
+	/// @param boxes New boxes of the same primitives the BVH is built with.
+	void refit(const Vector<AABB> &boxes);
+
+	/// Find the primitives which boxes intersect a frustum.
+	/// @param planes Frustum planes, see extractFrustumPlanes().
+	/// @param result Receives the indices of the primitives. Not cleared.
+	void queryFrustum(const Vec4 planes[static_cast<int>(FrustumPlane::Count)], Vector<uint32_t> &result) const;
+
+	/// Find the primitives which boxes intersect a box.
+	/// @param result Receives the indices of the primitives. Not cleared.
+	void queryBox(const AABB &box, Vector<uint32_t> &result) const;
+
+	/// Find the primitives which boxes intersect a sphere.
+	/// @param result Receives the indices of the primitives. Not cleared.
+	void querySphere(const Vec3 &center, float radius, Vector<uint32_t> &result) const;
+
+	/// Find the closest primitive hit by a ray.
+	/// @param maxT Hits further than origin + direction * maxT are ignored.
+	/// @param intersect Optional. Exact intersection with the primitives. The boxes of the primitives are used if not given.
+	/// @return true if a primitive is hit.
+	bool raycast(const Vec3 &origin, const Vec3 &direction, float maxT, RayHit &hit, const RayIntersector &intersect = nullptr) const;
+
+	SizeType getNumPrimitives() const {
+		return primitives.size();
+	}
+
+	SizeType getNumNodes() const {
+		return nodes.size();
+	}
+
+	/// @return Depth of the deepest leaf. Used for checking the quality of the tree.
+	int getDepth() const;
+
+private:
+	/// Split of the primitives of a node along an axis, between two of the bins the centroids are sorted in.
+	struct Split {
+		int axis = -1;
+		int bin = 0; ///< Primitives in bins [0, bin] go to the left child.
+		float binsMin = 0.f; ///< Position of the first bin on the axis.
+		float binsScale = 0.f; ///< Number of bins per unit on the axis.
+		float cost = std::numeric_limits<float>::max();
+
+		int getBin(float centroid) const;
+	};
+
+	/// Copy the boxes of the primitives to the SoA arrays used by queryFrustum().
+	void updateLeafBoxes();
+
+	void updateNodeBox(Node &node) const;
+	Split findBestSplit(const Node &node) const;
+	void addSubtree(uint32_t nodeIndex, Vector<uint32_t> &result) const;
+
+	Vector<Node> nodes;
+	Vector<uint32_t> primitives; ///< Indices of the primitives in the order of the leaves.
+	Vector<AABB> boxes; ///< Boxes of the primitives in the order of the leaves.
+
+	/// Centers and extents of the boxes in SoA layout, so queryFrustum() tests the primitives of a leaf 4 at a time with SSE.
+	/// Padded with 3 boxes, so the primitives at the end of the last leaf are read 4 at a time as well.
+	/// Padding and invalid boxes have negative extents and are never visible.
+	Vector<float> centerX, centerY, centerZ;
+	Vector<float> extentX, extentY, extentZ;
+	Vector<Vec3> centroids; ///< Centroids of the primitives in the order of the leaves. Only needed while building.
+};
+
+} // namespace Dar
@@ -30,3 +30,31 @@ static inline Vec3 Vec3UnitY() {
 static inline Vec3 Vec3UnitZ() {
 	return Vec3(0.f, 0.f, 1.f);
 }
+
+enum class FrustumPlane : int {
+	Left = 0,
+	Right,
+	Bottom,
+	Top,
+	Near,
+	Far,
+
+	Count
+};
+
+/// Extract the planes of the frustum of a view-projection matrix(Gribb-Hartmann), for [0, 1] clip-space depth.
+/// @param planes Receives the normalized planes in world space. xyz is the normal pointing inside the frustum, w is the distance.
+///               A point p is inside the frustum if dot(plane.xyz, p) + plane.w >= 0 for all planes.
+static inline void extractFrustumPlanes(const Mat4 &viewProjection, Vec4 planes[static_cast<int>(FrustumPlane::Count)]) {
+	const Mat4 m = glm::transpose(viewProjection); // rows of the matrix
+	planes[static_cast<int>(FrustumPlane::Left)] = m[3] + m[0];
+	planes[static_cast<int>(FrustumPlane::Right)] = m[3] - m[0];
+	planes[static_cast<int>(FrustumPlane::Bottom)] = m[3] + m[1];
+	planes[static_cast<int>(FrustumPlane::Top)] = m[3] - m[1];
+	planes[static_cast<int>(FrustumPlane::Near)] = m[2];
+	planes[static_cast<int>(FrustumPlane::Far)] = m[3] - m[2];
+
+	for (int i = 0; i < static_cast<int>(FrustumPlane::Count); ++i) {
+		planes[i] /= glm::length(Vec3(planes[i]));
+	}
+}
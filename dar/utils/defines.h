@@ -6,6 +6,7 @@
 #include <cmath>
 #include <cstddef>
 #include <filesystem>
+#include <list>
 #include <memory>
 #include <random>
 #include <vector>
@@ -125,6 +126,12 @@ using Set = std::unordered_set<T>;
 template <class T>
 using UniquePtr = std::unique_ptr<T>;
 
+template <class T>
+using SharedPtr = std::shared_ptr<T>;
+
+template <class T>
+using List = std::list<T>;
+
 template <class T, SizeType N>
 using StaticArray = std::array<T, N>;
 
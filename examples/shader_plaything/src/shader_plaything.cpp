@@ -31,9 +31,24 @@
 // and use that instead of manually loading.
 // Problem is ResourceManager expects compressed, mip-mapped images.
 Dar::ImageData loadImage(const String &imgPath) {
+	// Pipelines are reloaded on every shader change, so keep the images in memory.
+	auto &imageCache = Dar::getResourceLibrary().getImageCache();
+	if (auto cached = imageCache.get(imgPath); cached.has_value()) {
+		return *cached;
+	}
+
 	Dar::ImageData result = {};
-	result.data = stbi_load(imgPath.c_str(), &result.header.width, &result.header.height, nullptr, 4);
+	uint8_t *data = stbi_load(imgPath.c_str(), &result.header.width, &result.header.height, nullptr, 4);
+	if (data == nullptr) {
+		return result;
+	}
+
+	result.data = Dar::ImageBuffer(data, [](uint8_t *p) { stbi_image_free(p); });
 	result.header.ncomp = 4;
+	result.header.size = static_cast<SizeType>(result.header.width) * result.header.height * result.header.ncomp;
+	result.header.filename = imgPath;
+
+	imageCache.put(imgPath, result);
 
 	return result;
 }
@@ -1,4 +1,4 @@
 @ECHO OFF
 SET SCRIPTDIR=%~dp0
 
-%SCRIPTDIR%\..\..\tools\resourcecompiler\resourcecompiler.exe %SCRIPTDIR%\res %SCRIPTDIR%\res
+%SCRIPTDIR%\..\..\tools\resourcecompiler\resourcecompiler.exe %SCRIPTDIR%\res %SCRIPTDIR%\res --compress
@@ -0,0 +1,37 @@
+#pragma once
+
+/// Time the build, refit and queries of Dar::BVH over random boxes scattered on a map, like the units of a RTS,
+/// with 10k, 100k and 1M boxes. Results of the queries are checked against testing all boxes.
+/// Timings and mismatches are logged.
+void runBVHBenchmarks();
+
+/// Time the build and the updates of a TransformHierarchy of 100k nodes, with all and with a few moved nodes.
+/// World matrices are checked against multiplying the local matrices up to the root.
+/// Timings and mismatches are logged. Must be called from inside a job.
+void runTransformHierarchyBenchmarks();
+
+/// Time updating the transforms and the visibility of 100k RTS units stored as Dar::World entities,
+/// with the systems running on the calling thread and on all threads of the job system.
+/// World matrices and visibility are checked against moving the units in a plain loop and testing the corners of their boxes.
+/// Timings and mismatches are logged. Must be called from inside a job.
+void runEntityBenchmarks();
+
+/// Time loading the Sponza scene from its json description, imported with assimp, and from the scene library compiled
+/// by the resource compiler. The vertices and the full detail meshes of both are checked to be the same.
+/// Timings and mismatches are logged. Skipped if the scene library is not compiled. Must be called from inside a job.
+void runSceneLoadBenchmarks();
+
+/// Time importing the Sponza scene with the meshes processed on the calling thread and on all threads of the job system.
+/// Both imports are checked to give the same scene library. Timings and mismatches are logged. Must be called from inside a job.
+void runSceneImportBenchmarks();
+
+/// Time generating the MikkTSpace tangents of all meshes of Sponza on the calling thread and on all threads of the job system.
+/// The time per million triangles is logged, and the vertices of both imports are checked to be the same. Must be called from inside a job.
+void runTangentBenchmarks();
+
+/// Log the post-transform vertex cache ACMR and ATVR of every Sponza mesh before and after the mesh optimization of the import,
+/// and the totals weighted by the triangles and the vertices. Must be called from inside a job.
+void runMeshOptimizerBenchmarks();
+
+/// Run all benchmarks. Must be called from inside a job.
+void runBenchmarks();
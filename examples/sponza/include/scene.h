@@ -1,14 +1,19 @@
 #pragma once
 
 #include "texture_utils.h"
+#include "transform_hierarchy.h"
+#include "vertex_format.h"
 
 #include "d3d12/command_list.h"
 #include "d3d12/descriptor_heap.h"
 #include "d3d12/resource_manager.h"
 #include "framework/camera.h"
 #include "graphics/renderer.h"
+#include "math/bvh.h"
 #include "math/dar_math.h"
 
+#include "reslib/resource_library.h"
+
 #include "gpu_cpu_common.hlsli"
 
 using MaterialId = SizeType;
@@ -18,6 +23,7 @@ using LightId = SizeType;
 using CameraId = SizeType;
 
 #define INVALID_MATERIAL_ID SizeType(-1)
+#define INVALID_MESH_ID SizeType(-1)
 #define INVALID_NODE_ID SizeType(-1)
 #define INVALID_LIGHT_ID SizeType(-1)
 #define INVALID_CAMERA_ID SizeType(-1)
@@ -42,6 +48,11 @@ struct BoundingSphere {
 	float radius;
 };
 
+struct CullingStats {
+	SizeType numDrawn = 0;
+	SizeType numCulled = 0;
+};
+
 struct BBox {
 	Vec3 pmin = BBox::invalidMinPoint();
 	Vec3 pmax = BBox::invalidMaxPoint();
@@ -76,20 +87,57 @@ struct BBox {
 	}
 };
 
+/// Index pools uploaded to the GPU. Meshes with few enough vertices use 16-bit indices.
+enum class IndexPool : int {
+	UInt16 = 0,
+	UInt32,
+
+	Count
+};
+
+/// Max number of vertices of a mesh using 16-bit indices. 0xffff is left out as it's the strip cut value.
+constexpr SizeType MAX_16BIT_INDEXED_VERTICES = 0xffff;
+
 struct Material {
 	MaterialId id = INVALID_MATERIAL_ID;
 	MaterialData materialData;
 };
 
+/// Max number of LODs of a mesh, including the full detail one.
+constexpr int MAX_MESH_LODS = 4;
+
+/// Max error in pixels of the LODs selected for drawing. \see Scene::selectLods.
+constexpr float MAX_LOD_SCREEN_ERROR = 1.f;
+
+/// Index range of a mesh at some level of detail. All LODs of a mesh use its vertices.
+struct MeshLod {
+	SizeType indexOffset = 0; ///< Offset of the first index of the LOD in Scene::indices.
+	SizeType numIndices = 0;
+	SizeType poolIndexOffset = 0; ///< Offset of the first index of the LOD in the index pool of its mesh.
+	float error = 0.f; ///< Max distance from the full detail mesh in object space.
+};
+
 struct Mesh {
 	Mat4 modelMatrix = Mat4(1.f);
 	mutable Dar::ResourceHandle meshDataHandle = INVALID_RESOURCE_HANDLE;
 	MaterialId mat = INVALID_MATERIAL_ID;
-	SizeType indexOffset = 0;
-	SizeType numIndices = 0;
+	MeshLod lods[MAX_MESH_LODS]; ///< From the most to the least detailed one. lods[0] is the full detail mesh.
+	int numLods = 1;
+	int lod = 0; ///< LOD used for drawing the mesh. \see Scene::selectLods.
+	SizeType baseVertex = 0; ///< Offset of the first vertex of the mesh. Indices of the mesh are relative to it.
+	SizeType numVertices = 0;
+	IndexPool indexPool = IndexPool::UInt32; ///< Pool holding the indices of the mesh on the GPU.
+	BBox box; ///< Bounding box of the mesh in object space.
+	BBox worldBox; ///< Bounding box of the mesh in world space. \see Scene::updateMeshBounds.
+	BoundingSphere worldSphere = {}; ///< Bounding sphere of worldBox.
+	Mat4 positionDequantization = Mat4(1.f); ///< Maps the positions in the vertex stream to object space. Identity unless the positions are packed.
 
 	void uploadMeshData(Dar::UploadHandle uploadHandle) const;
 
+	const MeshLod &getDrawnLod() const {
+		return lods[lod];
+	}
+
 private:
 	mutable Mat4 cache = Mat4(1.f);
 };
@@ -138,6 +186,7 @@ private:
 
 struct LightNode : Node {
 	LightData lightData;
+	Vec3 localDirection = Vec3(0.f); ///< Direction of the light relative to the transform of the node. \see Scene::updateTransforms.
 
 	LightNode() {
 		lightData.type = LightType::InvalidLight;
@@ -235,13 +284,21 @@ struct Vertex {
 // Scene structure. Not very cache friendly, especially with these nodes on the heap :/
 struct Scene {
 	Vector<Node*> nodes; ///< Vector with pointers to all nodes in the scene
+	Vector<NodeId> modelIndices; ///< Indices of the models in the nodes vector
 	Vector<LightId> lightIndices; ///< Indices of the lights in the nodes vector
 	Vector<CameraId> cameraIndices; ///< Indices of the cameras in the nodes vector
+	TransformHierarchy transforms; ///< Local and world transforms of the nodes. \see buildTransformHierarchy.
+	Vector<TransformId> nodeTransforms; ///< Transform of each node in the nodes vector.
+	Vector<Mat4> meshLocalMatrices; ///< Transform of each mesh relative to the node of its model.
 	Vector<Mesh> meshes; ///< Vector will all the meshes in the scene.
 	Vector<Material> materials; ///< Vector with all materials in the scene
 	Vector<TextureDesc> textureDescs; ///< Vector with all textures in the scene. Meshes could share texture ids.
-	Vector<Vertex> vertices; ///< All vertices in the scene.
-	Vector<unsigned int> indices; ///< All indices for all meshes, indexing in the vertices array.
+	Vector<Vertex> vertices; ///< All vertices in the scene. Kept at full precision for the CPU.
+	Vector<unsigned int> indices; ///< All indices for all meshes, relative to the base vertex of their mesh.
+	Vector<Byte> indexPools[static_cast<int>(IndexPool::Count)]; ///< Indices uploaded to the GPU, split by their size. \see buildIndexPools.
+	Dar::IndexBuffer indexBuffers[static_cast<int>(IndexPool::Count)]; ///< GPU buffers of the index pools. Bound by the draws of the meshes using them.
+	Vector<Byte> vertexStreams[static_cast<int>(VertexStream::Count)]; ///< Vertices uploaded to the GPU, in the layout given by vertexFormat. \see buildVertexStreams.
+	VertexFormat vertexFormat;
 	Vector<Dar::TextureResource> textures;
 	Dar::DataBufferResource materialsBuffer; ///< GPU buffer holding all materials' data.
 	Dar::DataBufferResource lightsBuffer; ///< GPU buffer holding all lights' data.
@@ -260,15 +317,7 @@ struct Scene {
 			return false;
 		}
 
-		const auto camIdx = cameraIndices[activeCameraIdx];
-		Node *baseCamNode = nodes[camIdx];
-
-		CameraNode *camNode = dynamic_cast<CameraNode *>(baseCamNode);
-		if (camNode == nullptr) {
-			return false;
-		}
-
-		controller.setCamera(camNode->getCamera());
+		controller.setCamera(getCameraNode(activeCameraIdx)->getCamera());
 		return true;
 	}
 
@@ -276,6 +325,30 @@ struct Scene {
 		return lightIndices.size();
 	}
 
+	/// @param lightIndex Index in lightIndices.
+	LightNode *getLightNode(SizeType lightIndex) const {
+		Node *node = nodes[lightIndices[lightIndex]];
+		dassert(node->getNodeType() == NodeType::Light);
+		return static_cast<LightNode*>(node);
+	}
+
+	/// @param cameraIndex Index in cameraIndices.
+	CameraNode *getCameraNode(SizeType cameraIndex) const {
+		Node *node = nodes[cameraIndices[cameraIndex]];
+		dassert(node->getNodeType() == NodeType::Camera);
+		return static_cast<CameraNode*>(node);
+	}
+
+	NodeId addNewModel(ModelNode *model) {
+		NodeId id = nodes.size();
+
+		model->id = id;
+		nodes.push_back(model);
+		modelIndices.push_back(id);
+
+		return id;
+	}
+
 	LightId addNewLight(LightNode *l) {
 		LightId id = nodes.size();
 
@@ -334,28 +407,28 @@ struct Scene {
 		return textureDescs[id];
 	}
 
-	const void *getVertexBuffer() const {
-		return &vertices[0];
+	const void *getVertexStream(VertexStream stream) const {
+		return vertexStreams[static_cast<int>(stream)].data();
 	}
 
-	const void *getIndexBuffer() const {
-		return &indices[0];
+	const void *getIndexPool(IndexPool pool) const {
+		return indexPools[static_cast<int>(pool)].data();
 	}
 
-	const UINT getVertexBufferSize() const {
-		SizeType sz = vertices.size() == 0 ? 0 : vertices.size() * sizeof(vertices[0]);
+	const UINT getVertexStreamSize(VertexStream stream) const {
+		SizeType sz = vertexStreams[static_cast<int>(stream)].size();
 		dassert(sz < ((SizeType(1) << 32) - 1));
 		return static_cast<UINT>(sz);
 	}
 
-	const UINT getIndexBufferSize() const {
-		SizeType sz = indices.size() == 0 ? 0 : indices.size() * sizeof(indices[0]);
+	const UINT getIndexPoolSize(IndexPool pool) const {
+		SizeType sz = indexPools[static_cast<int>(pool)].size();
 		dassert(sz < ((SizeType(1) << 32) - 1));
 		return static_cast<UINT>(sz);
 	}
 
 	Dar::Camera *getRenderCamera() {
-		return dynamic_cast<CameraNode *>(nodes[cameraIndices[renderCamera]])->getCamera();
+		return getCameraNode(renderCamera)->getCamera();
 	}
 
 	const SizeType getNumNodes() const {
@@ -372,6 +445,15 @@ struct Scene {
 
 	bool uploadSceneData(Dar::UploadHandle uploadHandle);
 
+	/// Split the vertices into the streams uploaded to the GPU, packing the ones the format asks for.
+	/// Packed positions are quantized to the bounds of their mesh, so the dequantization of the meshes is updated as well.
+	/// Logs the max error of the packed attributes.
+	void buildVertexStreams(const VertexFormat &format);
+
+	/// Split the indices into a 16-bit pool for the meshes with at most MAX_16BIT_INDEXED_VERTICES vertices
+	/// and a 32-bit pool for the rest.
+	void buildIndexPools();
+
 	bool hadChangesSinceLastCheck() const {
 		bool result = changesSinceLastCheck;
 		changesSinceLastCheck = false;
@@ -379,6 +461,78 @@ struct Scene {
 		return result;
 	}
 
+	/// Build the transform hierarchy from the children of the nodes. The local transforms are seeded from
+	/// the current model matrices of the meshes and the positions of the lights and cameras, so the first
+	/// updateTransforms() leaves the scene as it was loaded.
+	/// @return false if the children of the nodes form a cycle.
+	bool buildTransformHierarchy();
+
+	/// Set the transform of a node relative to its parent. Applied to the meshes of the node and its descendants by updateTransforms().
+	void setNodeLocalTransform(NodeId id, const Mat4 &localMatrix) {
+		transforms.setLocalMatrix(nodeTransforms[id], localMatrix);
+	}
+
+	const Mat4 &getNodeWorldTransform(NodeId id) const {
+		return transforms.getWorldMatrix(nodeTransforms[id]);
+	}
+
+	/// Propagate the changed local transforms of the nodes, update the model matrices of the meshes of the moved models,
+	/// the positions and directions of the moved lights and the positions of the moved cameras, and refit the bounds of the meshes.
+	/// Must be called from inside a job.
+	void updateTransforms();
+
+	/// Compute the world-space bounds of the meshes used for culling, picking, LOD selection and texture streaming.
+	/// Should be called after the model matrices of the meshes change. The BVH of the meshes is refit
+	/// if the number of meshes is the same as the last time, and rebuilt otherwise.
+	void updateMeshBounds();
+
+	/// Find the closest mesh hit by a ray. Triangles of the full detail LODs are tested.
+	/// @param origin Origin of the ray in world space.
+	/// @param direction Direction of the ray in world space.
+	/// @return Id of the mesh or INVALID_MESH_ID if no mesh is hit.
+	MeshId pickMesh(const Vec3 &origin, const Vec3 &direction) const;
+
+	/// Find the meshes which bounding boxes intersect a sphere, f.e the units in some range.
+	/// @param result Receives the ids of the meshes. Not cleared.
+	void queryMeshesInRange(const Vec3 &center, float radius, Vector<MeshId> &result) const;
+
+	const Dar::BVH &getMeshBVH() const {
+		return meshBVH;
+	}
+
+	const CullingStats &getCameraCullingStats() const {
+		return cullingStats[0];
+	}
+
+	const CullingStats &getShadowMapCullingStats(int shadowMapPassIndex) const {
+		return cullingStats[1 + shadowMapPassIndex];
+	}
+
+	/// Select the least detailed LOD of each mesh which error, projected on the screen, is at most MAX_LOD_SCREEN_ERROR pixels.
+	/// @param cam Camera used for projecting the errors of the LODs.
+	/// @param viewportHeight Height in pixels of the viewport.
+	void selectLods(const Dar::Camera &cam, int viewportHeight);
+
+	SizeType getNumSelectedTriangles() const {
+		return numSelectedTriangles;
+	}
+
+	/// Request more detailed texture mips based on the screen-space size of the meshes using them
+	/// and replace the textures for which the streaming requests have finished.
+	/// If the requests don't fit in the memory budget, textures with more detailed mips than needed are recreated without them.
+	/// @param cam Camera used for estimating the screen-space size of the meshes.
+	/// @param viewportHeight Height in pixels of the viewport.
+	/// @param frameCount Number of frames rendered so far. Used for releasing textures no longer in use by the GPU.
+	void updateTextureStreaming(const Dar::Camera &cam, int viewportHeight, Dar::UploadHandle uploadHandle, SizeType frameCount);
+
+	/// Wait for the mips of the textures being evicted to be read and drop them.
+	/// @note Must be called from inside a job before the scene is destroyed.
+	void cancelTextureEvictions();
+
+	/// Replace the textures of hot reloaded images. See Dar::ResourceLibrary::pollHotReload().
+	/// @param frameCount Number of frames rendered so far. Used for releasing textures no longer in use by the GPU.
+	void reloadTextures(const Vector<String> &imageNames, Dar::UploadHandle uploadHandle, SizeType frameCount);
+
 	void prepareFrameData(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle);
 	void prepareFrameDataForShadowMap(int shadowMapPassIndex, Dar::FrameData &frameData, Dar::UploadHandle uploadHandle);
 
@@ -391,13 +545,44 @@ private:
 
 	// update view-projection matrices for moving lightcasters
 	void updateLightData(Dar::UploadHandle uploadHandle);
-	void drawMeshes(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle);
+	void addMaterialsAndTextures(Dar::FrameData &frameData);
+
+	/// Draw the meshes intersecting the frustum with the given planes.
+	/// @param stats Receives the number of drawn and culled meshes.
+	void drawMeshes(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle, const Vec4 planes[static_cast<int>(FrustumPlane::Count)], CullingStats &stats);
+
+	/// Request the needed mips of the textures with more detailed mips than needed, until `memoryToFree` bytes would be freed.
+	/// The mips are read in the background and the textures are recreated with them by applyTextureEvictions().
+	/// @param neededMips Most detailed mip-level needed by the meshes for each texture.
+	void evictTextureMips(const Vector<int> &neededMips, SizeType memoryToFree);
+
+	/// Recreate the textures evicted by the last evictTextureMips() once their mips are read.
+	void applyTextureEvictions(Dar::UploadHandle uploadHandle, SizeType frameCount);
+
+	void releaseRetiredTextures(SizeType frameCount);
+	void initImageName2TextureId();
 
 	//void draw(Dar::FrameData &frameData) const;
 	//void drawNodeImpl(Node *node, Dar::FrameData &frameData, const Scene &scene, DynamicBitset &drawnNodes) const;
 
 private:
+	struct RetiredTexture {
+		Dar::TextureResource texture;
+		SizeType frameRetired;
+	};
+
+	struct TextureEviction {
+		TextureId id;
+		int firstMip; ///< Most detailed mip-level of the texture when the eviction was requested.
+	};
+
 	Dar::HeapHandle texturesHeap; ///< Heap of the memory holding the textures' data
+	Vector<int> textureFirstMips; ///< Most detailed mip-level currently present for each texture.
+	Vector<RetiredTexture> retiredTextures; ///< Textures replaced by streamed or hot reloaded ones, waiting for the GPU to stop using them.
+	Vector<Dar::ImageDataRequest> evictionRequests; ///< Mips of the evicted textures being read. Must not be touched while evictionFence is pending.
+	Vector<TextureEviction> evictions; ///< Texture of each request in evictionRequests.
+	Dar::JobSystem::Fence *evictionFence = nullptr;
+	Map<String, TextureId> imageName2TextureId; ///< Used for matching streamed and hot reloaded images to textures.
 
 	bool texturesNeedUpdate; ///< Indicates textures have been changed and need to be reuploaded to the GPU.
 	bool lightsNeedUpdate; ///< Indicates lights have been changed and need to be reuploaded to the GPU.
@@ -405,4 +590,11 @@ private:
 	mutable bool changesSinceLastCheck; ///< Check if any changes in the textures/lights/materials was done since the last read of this value.
 
 	mutable LightId lightcasterId = LightId(-1);
+
+	SizeType numSelectedTriangles = 0; ///< Triangles of the LODs picked by the last selectLods().
+
+	Dar::BVH meshBVH; ///< Hierarchy over the world-space bounds of the meshes. \see updateMeshBounds.
+	Vector<uint32_t> visibleMeshIds; ///< Meshes intersecting the frustum of the current pass.
+	Vector<uint8_t> visibleMeshes; ///< Result of culling the meshes for the current pass.
+	CullingStats cullingStats[1 + MAX_SHADOW_MAPS_COUNT]; ///< Stats of the camera pass followed by the ones of the shadow map passes.
 };
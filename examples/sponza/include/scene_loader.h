@@ -2,6 +2,8 @@
 
 #include "utils/defines.h"
 
+#include "vertex_format.h"
+
 struct Scene;
 
 enum class SceneLoaderError : int {
@@ -17,8 +19,11 @@ enum SceneLoaderFlags : int {
 	sceneLoaderFlags_overrideGenTangents = 1 << 0,
 };
 
+/// Load a scene and build its vertex streams.
+/// @param vertexFormat Format of the vertex streams uploaded to the GPU. \see Scene::buildVertexStreams.
 SceneLoaderError loadScene(
 	const String &path,
 	Scene &scene,
-	SceneLoaderFlags flags = sceneLoaderFlags_none
+	SceneLoaderFlags flags = sceneLoaderFlags_none,
+	const VertexFormat &vertexFormat = VertexFormat::full()
 );
@@ -128,8 +128,7 @@ private:
 	Dar::Renderer renderer;
 	Dar::FramePipeline mainPipeline;
 
-	Dar::VertexBuffer vertexBuffer;
-	Dar::IndexBuffer indexBuffer;
+	Dar::VertexBuffer vertexBuffers[static_cast<int>(VertexStream::Count)]; ///< One for each vertex stream, bound to the input slot of the stream.
 
 	StaticArray<Dar::RenderTarget, static_cast<SizeType>(GBuffer::Count)> gBufferRTs;
 	Dar::RenderTarget lightPassRT;
@@ -163,6 +162,7 @@ private:
 
 	// Scene
 	Scene scene;
+	const VertexFormat vertexFormat = VertexFormat::packed(); ///< Format of the vertex streams. The pipeline's input layouts are created for it.
 
 	FPSCameraController *camControl = nullptr;
 	FPSCameraController fpsModeControl = { nullptr, 200.f };
@@ -171,5 +171,9 @@ private:
 	// Debugging
 	const char *gBufferLabels[9] = {"Render", "Diffuse", "Normals", "Metalness", "Roughness", "Occlusion", "Position", "Depth Map", "Shadow Map"};
 	bool editMode;
+	MeshId selectedMesh = INVALID_MESH_ID; ///< Mesh picked with the mouse in edit mode.
 	bool pause = false; ///< Pause all updates
+
+	// Hot reload
+	double lastHotReloadPoll = 0.; ///< Total time of the last check for resources changed by `resourcecompiler --watch`.
 };
@@ -4,6 +4,8 @@
 #include "graphics/d3d12/texture_res.h"
 #include "utils/defines.h"
 
+#include "reslib/img_data.h"
+
 using TextureId = unsigned int;
 #define INVALID_TEXTURE_ID (unsigned int)(-1)
 
@@ -18,5 +20,15 @@ bool uploadTextureData(
 	Vector<Dar::TextureResource> &textures,
 	Dar::HeapHandle &texturesHeap,
 	// TODO: just don't generate mips for texture that do not need them :)
-	bool forceNoMips // Ignore any mip-maps if present
+	bool forceNoMips, // Ignore any mip-maps if present
+	Vector<int> *firstMips = nullptr // If not null, only the initial mips of the textures are loaded when texture streaming is enabled. Receives the most detailed mip-level of each texture.
+);
+
+/// Create a texture holding the mip chain present in imgData and upload it.
+/// Any resource previously held by texture is released, so make sure it's not in use by the GPU.
+bool uploadStreamedTextureData(
+	Dar::ImageData &imgData,
+	Dar::UploadHandle uploadHandle,
+	Dar::TextureResource &texture,
+	const String &name
 );
\ No newline at end of file
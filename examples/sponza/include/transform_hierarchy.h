@@ -0,0 +1,67 @@
+#pragma once
+
+#include "math/dar_math.h"
+#include "utils/defines.h"
+
+using TransformId = uint32_t;
+
+#define INVALID_TRANSFORM_ID TransformId(-1)
+
+/// Transforms of the scene nodes in SoA layout.
+/// Transforms are sorted by their depth in the hierarchy, so parents are always before their children
+/// and all transforms of a level are next to each other. World matrices are propagated with one pass
+/// over the arrays, level by level, and the levels are split between the threads of the job system.
+class TransformHierarchy {
+public:
+	/// Build the hierarchy. Local matrices start as identity.
+	/// @param parents Index of the parent of each node, or INVALID_TRANSFORM_ID for the roots.
+	/// @param nodeTransforms Receives the transform of each node.
+	/// @return false if the parents contain a cycle or an out of range index.
+	bool build(const Vector<TransformId> &parents, Vector<TransformId> &nodeTransforms);
+
+	void setLocalMatrix(TransformId id, const Mat4 &matrix) {
+		localMatrices[id] = matrix;
+		dirty[id] = 1;
+	}
+
+	const Mat4 &getLocalMatrix(TransformId id) const {
+		return localMatrices[id];
+	}
+
+	/// World matrices are valid after update().
+	const Mat4 &getWorldMatrix(TransformId id) const {
+		return worldMatrices[id];
+	}
+
+	/// @return true if the world matrix changed in the last update().
+	bool hasChanged(TransformId id) const {
+		return changed[id] != 0;
+	}
+
+	TransformId getParent(TransformId id) const {
+		return parents[id];
+	}
+
+	/// Propagate the changed local matrices to the world matrices of the transforms and all their descendants.
+	/// Levels with enough transforms are processed in parallel, so this must be called from inside a job.
+	/// @return Number of world matrices which changed.
+	SizeType update();
+
+	SizeType getNumTransforms() const {
+		return parents.size();
+	}
+
+	SizeType getNumLevels() const {
+		return levelOffsets.empty() ? 0 : levelOffsets.size() - 1;
+	}
+
+private:
+	void updateRange(SizeType begin, SizeType end);
+
+	Vector<TransformId> parents; ///< Parent of each transform, or INVALID_TRANSFORM_ID for the roots.
+	Vector<Mat4> localMatrices; ///< Transforms relative to the parents.
+	Vector<Mat4> worldMatrices; ///< Transforms relative to the world.
+	Vector<uint8_t> dirty; ///< Local matrices changed since the last update().
+	Vector<uint8_t> changed; ///< World matrices changed in the last update().
+	Vector<SizeType> levelOffsets; ///< Index of the first transform of each level, followed by the number of transforms.
+};
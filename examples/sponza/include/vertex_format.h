@@ -0,0 +1,55 @@
+#pragma once
+
+#include "math/dar_math.h"
+#include "utils/defines.h"
+
+#include "reslib/vertex_packing.h"
+
+/// Vertices are uploaded to the GPU split in streams, so passes fetch only the attributes they use.
+/// Stream i is bound to input slot i.
+enum class VertexStream : int {
+	Position = 0, ///< Read by all passes.
+	UV, ///< Read by all passes, as the shadow map pass alpha tests the base color.
+	TangentFrame, ///< Normal and tangent. Read only by the passes shading the surface.
+
+	Count
+};
+
+/// Precision of the attributes in a vertex stream.
+enum class AttributePrecision : int {
+	Full = 0, ///< 32-bit floats, as in Vertex.
+	Packed, ///< Positions are 16-bit unorm relative to the mesh bounds, normals and tangents are octahedral encoded 16-bit snorm, uvs are half floats.
+};
+
+/// Precision of each of the vertex streams. Streams are packed independently,
+/// so f.e scenes with large tiling uvs could keep them at full precision.
+struct VertexFormat {
+	AttributePrecision precision[static_cast<int>(VertexStream::Count)] = {};
+
+	static VertexFormat full() {
+		return VertexFormat{};
+	}
+
+	static VertexFormat packed() {
+		VertexFormat format;
+		for (auto &p : format.precision) {
+			p = AttributePrecision::Packed;
+		}
+		return format;
+	}
+
+	AttributePrecision get(VertexStream stream) const {
+		return precision[static_cast<int>(stream)];
+	}
+
+	bool isPacked(VertexStream stream) const {
+		return get(stream) == AttributePrecision::Packed;
+	}
+};
+
+/// Size in bytes of a single vertex in the stream. Packed attributes are encoded with Dar::VertexPacking.
+UINT getVertexStride(const VertexFormat &format, VertexStream stream);
+
+/// Matrix transforming the [0, 1] positions the shaders read to positions inside the bounds.
+/// Multiplied into the model matrix of the mesh, so the shaders don't decode the positions.
+Mat4 getPositionDequantization(const Vec3 &boxMin, const Vec3 &boxSize);
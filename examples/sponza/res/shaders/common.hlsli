@@ -27,4 +27,15 @@ float4 getColorFromTexture(uint textureIndex, uint indexOffset, float2 uv, Textu
 	return color;
 }
 
+// Inverse of the octahedral encoding of the packed vertices. See octahedralEncode in reslib/vertex_packing.h
+float3 octahedralDecode(float2 e) {
+	float3 v = float3(e, 1.f - abs(e.x) - abs(e.y));
+	if (v.z < 0.f) {
+		const float2 signNotZero = float2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+		v.xy = (1.f - abs(v.yx)) * signNotZero;
+	}
+
+	return normalize(v);
+}
+
 #endif // COMMON_HLSLI
@@ -1,3 +1,5 @@
+// @keywords NORMAL_MAPPING
+
 #include "common.hlsli"
 
 struct PSInput
@@ -38,7 +40,7 @@ PSOutput main(PSInput IN) : SV_Target
 	output.albedo.xyz = pow(output.albedo.xyz, 2.2);
 
 	float3 normal = 0.f;
-	if (sceneData.withNormalMapping && material.normalsIndex != INVALID_TEXTURE_INDEX) {
+	if (NORMAL_MAPPING && material.normalsIndex != INVALID_TEXTURE_INDEX) {
 		float3 texNormal = getColorFromTexture(material.normalsIndex, TEXTURE_BUFFERS_START, IN.uv, TextureUsage::NormalMap).rgb;
 		texNormal = texNormal * (255.f/127.f) - 128.f/127.f; // [0;1] -> [-1;1]
 
@@ -1,10 +1,17 @@
+// @keywords PACKED_TANGENT_FRAME
+
 #include "common.hlsli"
 
 struct VSInput
 {
-	float3 position : POSITION0;
+	float4 position : POSITION0; // w is the bitangent sign, 1 for unpacked positions.
+#if PACKED_TANGENT_FRAME
+	float2 normal : NORMAL; // octahedral encoded
+	float2 tangent : TANGENT; // octahedral encoded
+#else
 	float3 normal : NORMAL;
 	float3 tangent : TANGENT;
+#endif
 	float2 uv : TEXCOORD;
 };
 
@@ -20,14 +27,22 @@ VSOutput main(VSInput IN)
 {
 	VSOutput result;
 	
-	float4 worldPos = mul(meshData.modelMatrix, float4(IN.position, 1.f));
+	float4 worldPos = mul(meshData.modelMatrix, float4(IN.position.xyz, 1.f));
 	result.position = mul(sceneData.viewProjection, worldPos);
 
-	const float3 N = normalize(mul(meshData.normalMatrix, float4(IN.normal, 0.f)).xyz);
+#if PACKED_TANGENT_FRAME
+	const float3 normal = octahedralDecode(IN.normal);
+	const float3 tangent = octahedralDecode(IN.tangent);
+#else
+	const float3 normal = IN.normal;
+	const float3 tangent = IN.tangent;
+#endif
+
+	const float3 N = normalize(mul(meshData.normalMatrix, float4(normal, 0.f)).xyz);
 
-	float3 T = normalize(mul(meshData.normalMatrix, float4(IN.tangent, 0.f)).xyz);
+	float3 T = normalize(mul(meshData.normalMatrix, float4(tangent, 0.f)).xyz);
 	T = normalize(T - N * dot(T, N));
-	const float3 B = normalize(cross(N, T));
+	const float3 B = normalize(cross(N, T)) * (IN.position.w * 2.f - 1.f);
 
 	result.TBN = float3x3(T, B, N);
 
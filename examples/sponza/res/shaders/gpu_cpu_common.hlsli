@@ -23,9 +23,7 @@ struct ShaderRenderData {
 
 	// Options
 	int showGBuffer;
-	int withNormalMapping;
-	int spotLightON;
-	int fxaaON;
+	int spotLightON; // only read by shaders not declaring the SPOT_LIGHT keyword
 	int darken;
 };
 
@@ -15,6 +15,16 @@ static const uint GBUFFER_NORMALS_INDEX = 1;
 static const uint GBUFFER_MRO_INDEX = 2;
 static const uint GBUFFER_POSITION_INDEX = 3;
 
+// Shaders declaring the SPOT_LIGHT keyword have a variant for each state of the spot light.
+// The rest of them check it at runtime.
+bool isSpotLightON() {
+#ifdef SPOT_LIGHT
+	return SPOT_LIGHT;
+#else
+	return sceneData.spotLightON;
+#endif
+}
+
 struct LightColors {
 	float3 diffuse;
 	float3 specular;
@@ -189,7 +199,7 @@ float4 evalLights(Material material) {
 			lighting += shadowFactor * evalOutputRadiance(material, light.diffuse, N, V, L, 1.f, roughness);
 		}
 		
-		if (light.type == LightType::Spot && sceneData.spotLightON) {
+		if (light.type == LightType::Spot && isSpotLightON()) {
 			const float3 lightDir = normalize(light.position - material.position);
 			const float3 spotDir = -normalize(light.direction);
 			const float theta = dot(lightDir, spotDir);
@@ -1,3 +1,5 @@
+// @keywords SPOT_LIGHT
+
 #include "lighting_common.hlsli"
 
 struct PSInput {
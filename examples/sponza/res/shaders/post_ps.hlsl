@@ -1,3 +1,5 @@
+// @keywords FXAA
+
 #include "common.hlsli"
 #include "fxaa.hlsli"
 
@@ -44,7 +46,7 @@ float4 main(PSInput IN) : SV_TARGET{
 	float4 hud = hudTex.Load(p);
 
 	float4 color = 0.f;
-	if (sceneData.fxaaON && !sceneData.darken) {
+	if (FXAA && !sceneData.darken) {
 		color = fxaaFilter(renderTex, IN.uv);
 		return lerp(color, hud, hud.a);
 	}
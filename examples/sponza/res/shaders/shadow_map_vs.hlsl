@@ -1,10 +1,9 @@
 #include "common.hlsli"
 
+// Only the position and uv streams are bound, see VertexStream
 struct VSInput
 {
 	float3 position : POSITION0;
-	float3 normal : NORMAL;
-	float3 tangent : TANGENT;
 	float2 uv : TEXCOORD;
 };
 
@@ -0,0 +1,739 @@
+#include "benchmarks.h"
+
+#include "scene.h"
+#include "scene_loader.h"
+#include "transform_hierarchy.h"
+
+#include "async/job_system.h"
+#include "framework/ecs.h"
+#include "math/bvh.h"
+#include "utils/logger.h"
+#include "utils/timer.h"
+
+#include "reslib/mesh_optimizer.h"
+#include "reslib/scene_importer.h"
+
+#include <algorithm>
+#include <random>
+
+/// Number of queries of each type timed for each size.
+constexpr int NUM_BENCHMARK_QUERIES = 1000;
+
+/// Number of nodes of the benchmarked transform hierarchy.
+constexpr SizeType NUM_BENCHMARK_TRANSFORMS = 100'000;
+
+/// Number of entities of the entity benchmark.
+constexpr SizeType NUM_BENCHMARK_ENTITIES = 100'000;
+
+/// Number of frames of updates timed by the entity benchmark.
+constexpr int NUM_BENCHMARK_FRAMES = 100;
+
+/// Time in ms the entity benchmark should update the transforms and the visibility of all entities in, with 8 threads.
+constexpr double ENTITY_FRAME_TIME_TARGET = 1.;
+
+/// Number of times each scene benchmark loads the scene. The fastest load is reported, so the file cache is warm for all paths.
+constexpr int NUM_BENCHMARK_SCENE_LOADS = 3;
+
+/// Scene description imported with assimp and the scene library the resource compiler builds from it.
+constexpr const char *SPONZA_SCENE_JSON = "res\\scenes\\sponza.json";
+constexpr const char *SPONZA_SCENE_SCNLIB = "res\\scenes\\sponza.scnlib";
+
+/// Number of the timed queries which results are also checked against testing all boxes.
+constexpr int NUM_VALIDATED_QUERIES = 100;
+
+static bool isBoxInFrustum(const Dar::AABB &box, const Vec4 planes[static_cast<int>(FrustumPlane::Count)]) {
+	const Vec3 center = box.getCenter();
+	const Vec3 extent = (box.max - box.min) * 0.5f;
+	for (int p = 0; p < static_cast<int>(FrustumPlane::Count); ++p) {
+		const float distance = glm::dot(Vec3(planes[p]), center) + planes[p].w;
+		const float radius = glm::dot(glm::abs(Vec3(planes[p])), extent);
+		if (distance + radius < 0.f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool isBoxInSphere(const Dar::AABB &box, const Vec3 &center, float radius) {
+	const Vec3 offset = center - glm::clamp(center, box.min, box.max);
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+/// @return true if a query returned exactly the expected primitives, in any order.
+/// @param expected Indices of the expected primitives in increasing order.
+static bool isSameResult(Vector<uint32_t> result, const Vector<uint32_t> &expected) {
+	std::sort(result.begin(), result.end());
+	return result == expected;
+}
+
+/// @return Distance to the closest box hit by the ray, or -1 if none is hit.
+static float raycastBoxes(const Vector<Dar::AABB> &boxes, const Vec3 &origin, const Vec3 &direction) {
+	const Vec3 invDirection = 1.f / direction;
+
+	float closest = -1.f;
+	for (const Dar::AABB &box : boxes) {
+		const Vec3 t0 = (box.min - origin) * invDirection;
+		const Vec3 t1 = (box.max - origin) * invDirection;
+		const Vec3 tNear = glm::min(t0, t1);
+		const Vec3 tFar = glm::max(t0, t1);
+		const float tEnter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+		const float tExit = glm::min(glm::min(tFar.x, tFar.y), tFar.z);
+		if (tEnter <= tExit && (closest < 0.f || tEnter < closest)) {
+			closest = tEnter;
+		}
+	}
+	return closest;
+}
+
+static void runBVHBenchmark(SizeType numBoxes) {
+	std::mt19937 generator(static_cast<unsigned int>(numBoxes));
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	// Keep the density of the units the same for all sizes.
+	const float mapSize = glm::sqrt(float(numBoxes)) * 10.f;
+	auto randomBox = [&]() {
+		const Vec3 center{ uniform(generator) * mapSize, uniform(generator) * 5.f, uniform(generator) * mapSize };
+		const Vec3 extent = Vec3{ 0.5f } + Vec3{ uniform(generator), uniform(generator), uniform(generator) } * 2.f;
+		return Dar::AABB{ center - extent, center + extent };
+	};
+
+	Vector<Dar::AABB> boxes(numBoxes);
+	for (Dar::AABB &box : boxes) {
+		box = randomBox();
+	}
+
+	Dar::BVH bvh;
+	Dar::Timer timer;
+	bvh.build(boxes);
+	const double buildTime = timer.time();
+
+	// Move the units a bit, as in a frame of the game.
+	for (Dar::AABB &box : boxes) {
+		const Vec3 offset{ uniform(generator) - 0.5f, 0.f, uniform(generator) - 0.5f };
+		box.min += offset;
+		box.max += offset;
+	}
+
+	timer.restart();
+	bvh.refit(boxes);
+	const double refitTime = timer.time();
+
+	// Frustum queries from RTS-like cameras looking down at the map.
+	SizeType numMismatches = 0;
+	SizeType numFrustumResults = 0;
+	Vector<uint32_t> result;
+	Vector<uint32_t> expected;
+	double frustumTime = 0.;
+	for (int i = 0; i < NUM_BENCHMARK_QUERIES; ++i) {
+		const Vec3 target{ uniform(generator) * mapSize, 0.f, uniform(generator) * mapSize };
+		const Mat4 view = glm::lookAt(target + Vec3{ 0.f, 100.f, -100.f }, target, Vec3UnitY());
+		const Mat4 projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 1.f, 500.f);
+		Vec4 planes[static_cast<int>(FrustumPlane::Count)];
+		extractFrustumPlanes(projection * view, planes);
+
+		result.clear();
+		timer.restart();
+		bvh.queryFrustum(planes, result);
+		frustumTime += timer.time();
+		numFrustumResults += result.size();
+
+		if (i < NUM_VALIDATED_QUERIES) {
+			expected.clear();
+			for (uint32_t j = 0; j < numBoxes; ++j) {
+				if (isBoxInFrustum(boxes[j], planes)) {
+					expected.push_back(j);
+				}
+			}
+			numMismatches += !isSameResult(result, expected);
+		}
+	}
+
+	// Picking rays from above the map.
+	double rayTime = 0.;
+	for (int i = 0; i < NUM_BENCHMARK_QUERIES; ++i) {
+		const Vec3 origin{ uniform(generator) * mapSize, 100.f, uniform(generator) * mapSize };
+		const Vec3 direction = glm::normalize(Vec3{ uniform(generator) - 0.5f, -1.f, uniform(generator) - 0.5f });
+
+		Dar::BVH::RayHit hit;
+		timer.restart();
+		const bool isHit = bvh.raycast(origin, direction, std::numeric_limits<float>::max(), hit);
+		rayTime += timer.time();
+
+		if (i < NUM_VALIDATED_QUERIES) {
+			const float expected = raycastBoxes(boxes, origin, direction);
+			const bool mismatch = isHit ? glm::abs(expected - hit.t) > 1e-3f : expected >= 0.f;
+			numMismatches += mismatch;
+		}
+	}
+
+	// Range queries, f.e the units in the attack range of another unit.
+	double rangeTime = 0.;
+	SizeType numRangeResults = 0;
+	for (int i = 0; i < NUM_BENCHMARK_QUERIES; ++i) {
+		const Vec3 center{ uniform(generator) * mapSize, 0.f, uniform(generator) * mapSize };
+		const float radius = 20.f;
+
+		result.clear();
+		timer.restart();
+		bvh.querySphere(center, radius, result);
+		rangeTime += timer.time();
+		numRangeResults += result.size();
+
+		if (i < NUM_VALIDATED_QUERIES) {
+			expected.clear();
+			for (uint32_t j = 0; j < numBoxes; ++j) {
+				if (isBoxInSphere(boxes[j], center, radius)) {
+					expected.push_back(j);
+				}
+			}
+			numMismatches += !isSameResult(result, expected);
+		}
+	}
+
+	LOG_FMT(
+		Info,
+		"BVH of %llu boxes: %llu nodes, depth %d. Build %.2fms, refit %.2fms. "
+		"Per query: frustum %.4fms(%llu boxes), ray %.4fms, range %.4fms(%llu boxes)",
+		numBoxes, bvh.getNumNodes(), bvh.getDepth(), buildTime, refitTime,
+		frustumTime / NUM_BENCHMARK_QUERIES, numFrustumResults / NUM_BENCHMARK_QUERIES,
+		rayTime / NUM_BENCHMARK_QUERIES,
+		rangeTime / NUM_BENCHMARK_QUERIES, numRangeResults / NUM_BENCHMARK_QUERIES
+	);
+
+	if (numMismatches > 0) {
+		LOG_FMT(Error, "BVH of %llu boxes: %llu of %d validated queries differ from testing all boxes!", numBoxes, numMismatches, 3 * NUM_VALIDATED_QUERIES);
+	}
+}
+
+void runBVHBenchmarks() {
+	const SizeType sizes[] = { 10'000, 100'000, 1'000'000 };
+	for (SizeType numBoxes : sizes) {
+		runBVHBenchmark(numBoxes);
+	}
+}
+
+/// @return World matrix of a transform computed by multiplying the local matrices up to the root.
+static Mat4 computeWorldMatrix(const TransformHierarchy &hierarchy, TransformId id) {
+	Mat4 result = hierarchy.getLocalMatrix(id);
+	for (TransformId parent = hierarchy.getParent(id); parent != INVALID_TRANSFORM_ID; parent = hierarchy.getParent(parent)) {
+		result = hierarchy.getLocalMatrix(parent) * result;
+	}
+	return result;
+}
+
+static bool isMatrixEqual(const Mat4 &a, const Mat4 &b) {
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			if (glm::abs(a[i][j] - b[i][j]) > 1e-3f * glm::max(1.f, glm::abs(b[i][j]))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void runTransformHierarchyBenchmarks() {
+	std::mt19937 generator(static_cast<unsigned int>(NUM_BENCHMARK_TRANSFORMS));
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	// Armies of units with a few attached parts each, like turrets and weapons, under a handful of roots.
+	Vector<TransformId> parents(NUM_BENCHMARK_TRANSFORMS);
+	for (SizeType i = 0; i < NUM_BENCHMARK_TRANSFORMS; ++i) {
+		if (i < 16) {
+			parents[i] = INVALID_TRANSFORM_ID;
+		} else if (i % 4 == 0) {
+			parents[i] = static_cast<TransformId>(generator() % 16);
+		} else {
+			parents[i] = static_cast<TransformId>(i - 1);
+		}
+	}
+
+	auto randomMatrix = [&]() {
+		const Vec3 translation{ uniform(generator) * 10.f, uniform(generator), uniform(generator) * 10.f };
+		return glm::rotate(glm::translate(Mat4(1.f), translation), uniform(generator) * glm::two_pi<float>(), Vec3UnitY());
+	};
+
+	TransformHierarchy hierarchy;
+	Vector<TransformId> nodeTransforms;
+	Dar::Timer timer;
+	if (!hierarchy.build(parents, nodeTransforms)) {
+		LOG(Error, "Failed to build the benchmarked transform hierarchy!");
+		return;
+	}
+	const double buildTime = timer.time();
+
+	for (SizeType i = 0; i < NUM_BENCHMARK_TRANSFORMS; ++i) {
+		hierarchy.setLocalMatrix(static_cast<TransformId>(i), randomMatrix());
+	}
+
+	timer.restart();
+	const SizeType numFullChanged = hierarchy.update();
+	const double fullUpdateTime = timer.time();
+
+	// Move 1% of the units, as in a frame of the game.
+	for (SizeType i = 0; i < NUM_BENCHMARK_TRANSFORMS / 100; ++i) {
+		hierarchy.setLocalMatrix(static_cast<TransformId>(generator() % NUM_BENCHMARK_TRANSFORMS), randomMatrix());
+	}
+
+	timer.restart();
+	const SizeType numPartialChanged = hierarchy.update();
+	const double partialUpdateTime = timer.time();
+
+	timer.restart();
+	const SizeType numStaticChanged = hierarchy.update();
+	const double staticUpdateTime = timer.time();
+
+	SizeType numMismatches = 0;
+	for (int i = 0; i < NUM_VALIDATED_QUERIES; ++i) {
+		const TransformId id = static_cast<TransformId>(generator() % NUM_BENCHMARK_TRANSFORMS);
+		numMismatches += !isMatrixEqual(hierarchy.getWorldMatrix(id), computeWorldMatrix(hierarchy, id));
+	}
+
+	LOG_FMT(
+		Info,
+		"Transform hierarchy of %llu nodes, %llu levels: build %.2fms. "
+		"Update of all nodes %.2fms(%llu changed), of 1%% of the nodes %.2fms(%llu changed), without changes %.2fms(%llu changed)",
+		NUM_BENCHMARK_TRANSFORMS, hierarchy.getNumLevels(), buildTime,
+		fullUpdateTime, numFullChanged, partialUpdateTime, numPartialChanged, staticUpdateTime, numStaticChanged
+	);
+
+	if (numMismatches > 0) {
+		LOG_FMT(Error, "Transform hierarchy: %llu of %d validated world matrices differ from multiplying the local matrices!", numMismatches, NUM_VALIDATED_QUERIES);
+	}
+}
+
+/// Units only turn around the Y axis, so the transform keeps the cosine and the sine of the yaw instead of a world matrix.
+/// That is 24 bytes instead of 80, so both systems read and write less memory per unit. \see getUnitMatrix.
+struct UnitTransform {
+	Vec3 position;
+	float yaw = 0.f;
+	Vec2 rotation = Vec2{ 1.f, 0.f }; ///< Cosine and sine of the yaw.
+};
+
+struct UnitMovement {
+	Vec3 velocity;
+	float turnRate = 0.f;
+};
+
+/// Box of the unit in its local space. Visibility is all the frame needs, so the world box isn't stored.
+struct UnitVisibility {
+	Vec3 localCenter;
+	Vec3 localExtent;
+	uint8_t visible = 0;
+};
+
+static Mat4 getUnitMatrix(const UnitTransform &transform) {
+	// Same as rotating the translation matrix around the Y axis, without the generic rotation.
+	const float c = transform.rotation.x;
+	const float s = transform.rotation.y;
+	return Mat4{
+		Vec4{ c, 0.f, -s, 0.f },
+		Vec4{ 0.f, 1.f, 0.f, 0.f },
+		Vec4{ s, 0.f, c, 0.f },
+		Vec4{ transform.position, 1.f }
+	};
+}
+
+static void moveUnit(UnitTransform &transform, const UnitMovement &movement, float deltaTime) {
+	transform.position += movement.velocity * deltaTime;
+	transform.yaw += movement.turnRate * deltaTime;
+	transform.rotation = Vec2{ glm::cos(transform.yaw), glm::sin(transform.yaw) };
+}
+
+/// Frustum planes with the absolute values of their normals precomputed, for testing many boxes.
+struct Frustum {
+	Vec4 planes[static_cast<int>(FrustumPlane::Count)];
+	Vec3 absNormals[static_cast<int>(FrustumPlane::Count)];
+
+	explicit Frustum(const Mat4 &viewProjection) {
+		extractFrustumPlanes(viewProjection, planes);
+		for (int p = 0; p < static_cast<int>(FrustumPlane::Count); ++p) {
+			absNormals[p] = glm::abs(Vec3(planes[p]));
+		}
+	}
+
+	/// Tests all planes without early outs. Most units are outside of a random plane, so branching per plane mispredicts often.
+	bool isBoxVisible(const Vec3 &center, const Vec3 &extent) const {
+		bool visible = true;
+		for (int p = 0; p < static_cast<int>(FrustumPlane::Count); ++p) {
+			visible &= glm::dot(Vec3(planes[p]), center) + planes[p].w + glm::dot(absNormals[p], extent) >= 0.f;
+		}
+		return visible;
+	}
+};
+
+static void updateUnitVisibility(const UnitTransform &transform, UnitVisibility &visibility, const Frustum &frustum) {
+	// Rotate the center and project the extents on the axes of the rotated box, as getUnitMatrix() would.
+	const float c = transform.rotation.x;
+	const float s = transform.rotation.y;
+	const Vec3 &localCenter = visibility.localCenter;
+	const Vec3 &extent = visibility.localExtent;
+	const Vec3 center = transform.position + Vec3{ c * localCenter.x + s * localCenter.z, localCenter.y, c * localCenter.z - s * localCenter.x };
+	const Vec3 worldExtent = Vec3{ glm::abs(c) * extent.x + glm::abs(s) * extent.z, extent.y, glm::abs(s) * extent.x + glm::abs(c) * extent.z };
+
+	visibility.visible = frustum.isBoxVisible(center, worldExtent);
+}
+
+/// State of a unit kept outside of the world, for checking the systems against a plain loop over all units.
+struct ReferenceUnit {
+	Vec3 position;
+	float yaw;
+	Vec3 velocity;
+	float turnRate;
+	Dar::AABB localBox;
+};
+
+/// @return AABB of the transformed corners of the box.
+static Dar::AABB transformBox(const Dar::AABB &box, const Mat4 &m) {
+	Dar::AABB result;
+	for (int i = 0; i < 8; ++i) {
+		const Vec3 corner = { (i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z };
+		result.add(Vec3(m * Vec4(corner, 1.f)));
+	}
+	return result;
+}
+
+void runEntityBenchmarks() {
+	std::mt19937 generator(static_cast<unsigned int>(NUM_BENCHMARK_ENTITIES));
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	const float mapSize = glm::sqrt(float(NUM_BENCHMARK_ENTITIES)) * 10.f;
+
+	Dar::World world;
+	world.getPool<UnitTransform>().reserve(NUM_BENCHMARK_ENTITIES);
+	world.getPool<UnitMovement>().reserve(NUM_BENCHMARK_ENTITIES);
+	world.getPool<UnitVisibility>().reserve(NUM_BENCHMARK_ENTITIES);
+
+	Vector<ReferenceUnit> referenceUnits(NUM_BENCHMARK_ENTITIES);
+
+	Dar::Timer timer;
+	for (SizeType i = 0; i < NUM_BENCHMARK_ENTITIES; ++i) {
+		ReferenceUnit &ref = referenceUnits[i];
+		ref.position = Vec3{ uniform(generator) * mapSize, 0.f, uniform(generator) * mapSize };
+		ref.yaw = uniform(generator) * glm::two_pi<float>();
+
+		// A fourth of the units are buildings, which do not move.
+		const bool building = i % 4 == 0;
+		ref.velocity = building ? Vec3{ 0.f } : Vec3{ uniform(generator) - 0.5f, 0.f, uniform(generator) - 0.5f } * 10.f;
+		ref.turnRate = building ? 0.f : uniform(generator) - 0.5f;
+
+		const Vec3 extent = Vec3{ 0.5f } + Vec3{ uniform(generator), uniform(generator), uniform(generator) } * 2.f;
+		ref.localBox = Dar::AABB{ -extent, extent };
+	}
+
+	Vector<Dar::Entity> units(NUM_BENCHMARK_ENTITIES);
+	for (SizeType i = 0; i < NUM_BENCHMARK_ENTITIES; ++i) {
+		const ReferenceUnit &ref = referenceUnits[i];
+		const Dar::Entity unit = world.createEntity();
+		units[i] = unit;
+
+		// The movement system doesn't touch the buildings, so their rotation is set once here.
+		world.addComponent(unit, UnitTransform{ ref.position, ref.yaw, Vec2{ glm::cos(ref.yaw), glm::sin(ref.yaw) } });
+
+		if (i % 4 != 0) {
+			world.addComponent(unit, UnitMovement{ ref.velocity, ref.turnRate });
+		}
+
+		world.addComponent(unit, UnitVisibility{ ref.localBox.getCenter(), (ref.localBox.max - ref.localBox.min) * 0.5f });
+	}
+
+	// Buildings have no movement, so the transforms of the moving units are put first in the order of their movements.
+	// Both systems then read all pools sequentially.
+	world.sortPool<UnitTransform, UnitMovement>();
+	world.sortPool<UnitVisibility, UnitTransform>();
+	const double createTime = timer.time();
+
+	const Mat4 view = glm::lookAt(Vec3{ mapSize * 0.5f, 100.f, mapSize * 0.5f - 100.f }, Vec3{ mapSize * 0.5f, 0.f, mapSize * 0.5f }, Vec3UnitY());
+	const Mat4 projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 1.f, 1000.f);
+	const Frustum frustum(projection * view);
+
+	const float deltaTime = 1.f / 60.f;
+
+	// Half of the frames run the systems on the calling thread only, for comparing with the parallel ones.
+	double serialTransformTime = 0.;
+	double serialVisibilityTime = 0.;
+	for (int frame = 0; frame < NUM_BENCHMARK_FRAMES / 2; ++frame) {
+		timer.restart();
+		world.forEach<UnitMovement, UnitTransform>([deltaTime](Dar::Entity, const UnitMovement &movement, UnitTransform &transform) {
+			moveUnit(transform, movement, deltaTime);
+		});
+		serialTransformTime += timer.time();
+
+		timer.restart();
+		world.forEach<UnitVisibility, UnitTransform>([&frustum](Dar::Entity, UnitVisibility &visibility, const UnitTransform &transform) {
+			updateUnitVisibility(transform, visibility, frustum);
+		});
+		serialVisibilityTime += timer.time();
+	}
+
+	double transformTime = 0.;
+	double visibilityTime = 0.;
+	for (int frame = NUM_BENCHMARK_FRAMES / 2; frame < NUM_BENCHMARK_FRAMES; ++frame) {
+		timer.restart();
+		world.parallelForEach<UnitMovement, UnitTransform>([deltaTime](Dar::Entity, const UnitMovement &movement, UnitTransform &transform) {
+			moveUnit(transform, movement, deltaTime);
+		});
+		transformTime += timer.time();
+
+		timer.restart();
+		world.parallelForEach<UnitVisibility, UnitTransform>([&frustum](Dar::Entity, UnitVisibility &visibility, const UnitTransform &transform) {
+			updateUnitVisibility(transform, visibility, frustum);
+		});
+		visibilityTime += timer.time();
+	}
+
+	// Check the systems against moving all units in a plain loop and testing the corners of their boxes against the frustum.
+	// Units closer to a plane than the precision of the two computations are not counted.
+	Vec4 planes[static_cast<int>(FrustumPlane::Count)];
+	extractFrustumPlanes(projection * view, planes);
+
+	const float tolerance = 1e-3f * mapSize;
+	SizeType numMismatches = 0;
+	SizeType numVisible = 0;
+	for (SizeType i = 0; i < NUM_BENCHMARK_ENTITIES; ++i) {
+		ReferenceUnit &ref = referenceUnits[i];
+		for (int frame = 0; frame < NUM_BENCHMARK_FRAMES; ++frame) {
+			ref.position += ref.velocity * deltaTime;
+			ref.yaw += ref.turnRate * deltaTime;
+		}
+
+		const Mat4 worldMatrix = glm::rotate(glm::translate(Mat4(1.f), ref.position), ref.yaw, Vec3UnitY());
+		const Dar::AABB worldBox = transformBox(ref.localBox, worldMatrix);
+		const bool visible = isBoxInFrustum(worldBox, planes);
+		const bool ambiguous =
+			isBoxInFrustum(Dar::AABB{ worldBox.min - tolerance, worldBox.max + tolerance }, planes) !=
+			isBoxInFrustum(Dar::AABB{ worldBox.min + tolerance, worldBox.max - tolerance }, planes);
+
+		const UnitTransform *transform = world.getComponent<UnitTransform>(units[i]);
+		const UnitVisibility *visibility = world.getComponent<UnitVisibility>(units[i]);
+
+		const bool matrixMismatch = !isMatrixEqual(getUnitMatrix(*transform), worldMatrix);
+		const bool visibilityMismatch = !ambiguous && (visibility->visible != 0) != visible;
+		numMismatches += matrixMismatch || visibilityMismatch;
+		numVisible += visibility->visible;
+	}
+
+	const double parallelFrameTime = (transformTime + visibilityTime) / (NUM_BENCHMARK_FRAMES - NUM_BENCHMARK_FRAMES / 2);
+	LOG_FMT(
+		Info,
+		"%llu entities: created in %.2fms. Per frame on 1 thread: transforms %.3fms, visibility %.3fms. "
+		"Per frame on %d threads: transforms %.3fms, visibility %.3fms(%llu visible)",
+		world.getNumEntities(), createTime,
+		serialTransformTime / (NUM_BENCHMARK_FRAMES / 2), serialVisibilityTime / (NUM_BENCHMARK_FRAMES / 2),
+		Dar::JobSystem::getNumThreads(), transformTime / (NUM_BENCHMARK_FRAMES - NUM_BENCHMARK_FRAMES / 2),
+		visibilityTime / (NUM_BENCHMARK_FRAMES - NUM_BENCHMARK_FRAMES / 2), numVisible
+	);
+
+	if (parallelFrameTime > ENTITY_FRAME_TIME_TARGET) {
+		LOG_FMT(
+			Warning,
+			"Entities: transforms and visibility took %.3fms per frame on %d threads, over the %.1fms target!",
+			parallelFrameTime, Dar::JobSystem::getNumThreads(), ENTITY_FRAME_TIME_TARGET
+		);
+	}
+
+	if (numMismatches > 0) {
+		LOG_FMT(Error, "Entities: world matrix or visibility of %llu entities differs from the reference loop!", numMismatches);
+	}
+}
+
+/// Load a scene NUM_BENCHMARK_SCENE_LOADS times.
+/// @param scene Receives the scene of the last load.
+/// @return Time of the fastest load in ms, or -1 if a load failed.
+static double timeSceneLoad(const char *path, UniquePtr<Scene> &scene) {
+	double minTime = -1.;
+	for (int i = 0; i < NUM_BENCHMARK_SCENE_LOADS; ++i) {
+		// Loading expects an empty scene
+		scene = std::make_unique<Scene>();
+
+		Dar::Timer timer;
+		if (loadScene(path, *scene) != SceneLoaderError::Success) {
+			LOG_FMT(Error, "Scene load benchmark failed to load %s!", path);
+			return -1.;
+		}
+
+		const double time = timer.time();
+		minTime = minTime < 0. ? time : std::min(minTime, time);
+	}
+	return minTime;
+}
+
+void runSceneLoadBenchmarks() {
+	if (!fs::exists(SPONZA_SCENE_SCNLIB)) {
+		LOG_FMT(Warning, "Skipping the scene load benchmark, as %s is not compiled. Run the resource compiler first.", SPONZA_SCENE_SCNLIB);
+		return;
+	}
+
+	UniquePtr<Scene> importedScene, mappedScene;
+	const double importTime = timeSceneLoad(SPONZA_SCENE_JSON, importedScene);
+	const double mappedTime = timeSceneLoad(SPONZA_SCENE_SCNLIB, mappedScene);
+	if (importTime < 0. || mappedTime < 0.) {
+		return;
+	}
+
+	const Scene &imported = *importedScene;
+	const Scene &mapped = *mappedScene;
+
+	// The scene library also has the LODs and the meshlets, but the vertices and the full detail meshes are the same.
+	bool same = imported.vertices.size() == mapped.vertices.size() && imported.meshes.size() == mapped.meshes.size() &&
+		memcmp(imported.vertices.data(), mapped.vertices.data(), imported.vertices.size() * sizeof(Vertex)) == 0;
+	for (SizeType i = 0; same && i < imported.meshes.size(); ++i) {
+		const MeshLod &a = imported.meshes[i].lods[0];
+		const MeshLod &b = mapped.meshes[i].lods[0];
+		same = a.numIndices == b.numIndices && std::equal(
+			imported.indices.begin() + a.indexOffset, imported.indices.begin() + a.indexOffset + a.numIndices, mapped.indices.begin() + b.indexOffset
+		);
+	}
+
+	LOG_FMT(
+		Info,
+		"Sponza load: json with assimp %.2fms, scene library %.2fms(%.1fx faster). %llu vertices, %llu meshes",
+		importTime, mappedTime, importTime / std::max(mappedTime, 1e-3), mapped.vertices.size(), mapped.meshes.size()
+	);
+
+	if (!same) {
+		LOG_FMT(Error, "Sponza load: the vertices or the indices of %s differ from importing %s!", SPONZA_SCENE_SCNLIB, SPONZA_SCENE_JSON);
+	}
+}
+
+template <class T>
+static bool isSameSection(const Vector<T> &a, const Vector<T> &b) {
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+/// @return true if the scenes would be written to the same scnlib.
+static bool isSameSceneData(const Dar::ScnLib::SceneData &a, const Dar::ScnLib::SceneData &b) {
+	return isSameSection(a.vertices, b.vertices) && isSameSection(a.indices, b.indices) && isSameSection(a.meshes, b.meshes) &&
+		isSameSection(a.materials, b.materials) && isSameSection(a.textures, b.textures) && isSameSection(a.lights, b.lights) &&
+		isSameSection(a.cameras, b.cameras) && isSameSection(a.nodes, b.nodes) && isSameSection(a.children, b.children) &&
+		isSameSection(a.strings, b.strings) && isSameSection(a.meshlets, b.meshlets) &&
+		isSameSection(a.meshletVertices, b.meshletVertices) && isSameSection(a.meshletTriangles, b.meshletTriangles);
+}
+
+void runSceneImportBenchmarks() {
+	// Same as the resource compiler, so all stages of the import are timed.
+	const auto flags = Dar::ScnLib::ImportFlags(Dar::ScnLib::importFlags_buildMeshlets | Dar::ScnLib::importFlags_generateLods);
+
+	Dar::ScnLib::SceneData serialScene, parallelScene;
+	Dar::ScnLib::ImportStats serialStats, parallelStats;
+
+	Dar::Timer timer;
+	if (!Dar::ScnLib::importScene(SPONZA_SCENE_JSON, serialScene, Dar::ScnLib::ImportFlags(flags | Dar::ScnLib::importFlags_singleThreaded), nullptr, &serialStats)) {
+		LOG_FMT(Error, "Scene import benchmark failed to import %s!", SPONZA_SCENE_JSON);
+		return;
+	}
+	const double serialTime = timer.time();
+
+	timer.restart();
+	if (!Dar::ScnLib::importScene(SPONZA_SCENE_JSON, parallelScene, flags, nullptr, &parallelStats)) {
+		LOG_FMT(Error, "Scene import benchmark failed to import %s!", SPONZA_SCENE_JSON);
+		return;
+	}
+	const double parallelTime = timer.time();
+
+	LOG_FMT(
+		Info,
+		"Sponza import: on 1 thread %.2fms(assimp %.2fms, meshes %.2fms), on %d threads %.2fms(assimp %.2fms, meshes %.2fms)",
+		serialTime, serialStats.readTime, serialStats.processTime,
+		Dar::JobSystem::getNumThreads(), parallelTime, parallelStats.readTime, parallelStats.processTime
+	);
+
+	if (!isSameSceneData(serialScene, parallelScene)) {
+		LOG(Error, "Sponza import: the parallel import differs from the import on 1 thread!");
+	}
+}
+
+void runTangentBenchmarks() {
+	// Generate the tangents of all meshes, not only of the ones missing them.
+	const auto flags = Dar::ScnLib::importFlags_overrideGenTangents;
+
+	Dar::ScnLib::SceneData serialScene, parallelScene;
+	Dar::ScnLib::ImportStats serialStats, parallelStats;
+	if (!Dar::ScnLib::importScene(SPONZA_SCENE_JSON, serialScene, Dar::ScnLib::ImportFlags(flags | Dar::ScnLib::importFlags_singleThreaded), nullptr, &serialStats) ||
+		!Dar::ScnLib::importScene(SPONZA_SCENE_JSON, parallelScene, flags, nullptr, &parallelStats)) {
+		LOG_FMT(Error, "Tangent benchmark failed to import %s!", SPONZA_SCENE_JSON);
+		return;
+	}
+
+	const double millionTriangles = std::max(parallelStats.numTangentTriangles, SizeType(1)) * 1e-6;
+	LOG_FMT(
+		Info,
+		"Sponza tangents of %llu triangles: on 1 thread %.2fms(%.2fms per million triangles), on %d threads %.2fms(%.2fms per million triangles)",
+		parallelStats.numTangentTriangles, serialStats.tangentsTime, serialStats.tangentsTime / millionTriangles,
+		Dar::JobSystem::getNumThreads(), parallelStats.tangentsTime, parallelStats.tangentsTime / millionTriangles
+	);
+
+	if (!isSameSection(serialScene.vertices, parallelScene.vertices)) {
+		LOG(Error, "Sponza tangents: the tangents generated in parallel differ from the ones generated on 1 thread!");
+	}
+}
+
+void runMeshOptimizerBenchmarks() {
+	Dar::ScnLib::SceneData scene;
+	Dar::ScnLib::ImportStats stats;
+	if (!Dar::ScnLib::importScene(SPONZA_SCENE_JSON, scene, Dar::ScnLib::importFlags_none, nullptr, &stats)) {
+		LOG_FMT(Error, "Mesh optimizer benchmark failed to import %s!", SPONZA_SCENE_JSON);
+		return;
+	}
+
+	if (stats.cacheStatsBefore.size() != scene.meshes.size() || stats.cacheStatsAfter.size() != scene.meshes.size()) {
+		LOG(Error, "Mesh optimizer benchmark: the import has no vertex cache stats for some meshes!");
+		return;
+	}
+
+	// Totals are weighted by the triangles and the vertices of the meshes.
+	Dar::MeshOptimizer::VertexCacheStats totalBefore, totalAfter;
+	SizeType totalTriangles = 0, totalVertices = 0;
+	SizeType numMismatches = 0, numWorse = 0;
+	for (SizeType i = 0; i < scene.meshes.size(); ++i) {
+		const Dar::ScnLib::Mesh &mesh = scene.meshes[i];
+		const Dar::MeshOptimizer::VertexCacheStats &before = stats.cacheStatsBefore[i];
+		const Dar::MeshOptimizer::VertexCacheStats &after = stats.cacheStatsAfter[i];
+
+		// The stats after the optimization should be the ones of the indices in the scene.
+		const auto actual = Dar::MeshOptimizer::analyzeVertexCache(scene.indices.data() + mesh.indexOffset, mesh.numIndices, mesh.numVertices);
+		numMismatches += actual.acmr != after.acmr || actual.atvr != after.atvr;
+		numWorse += after.acmr > before.acmr;
+
+		const SizeType numTriangles = mesh.numIndices / 3;
+		LOG_FMT(
+			Info,
+			"Sponza mesh %llu(%llu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+			i, numTriangles, before.acmr, after.acmr, before.atvr, after.atvr
+		);
+
+		totalBefore.acmr += before.acmr * numTriangles;
+		totalAfter.acmr += after.acmr * numTriangles;
+		totalBefore.atvr += before.atvr * mesh.numVertices;
+		totalAfter.atvr += after.atvr * mesh.numVertices;
+		totalTriangles += numTriangles;
+		totalVertices += mesh.numVertices;
+	}
+
+	totalTriangles = std::max(totalTriangles, SizeType(1));
+	totalVertices = std::max(totalVertices, SizeType(1));
+	LOG_FMT(
+		Info,
+		"Sponza mesh optimization of %llu meshes in %.2fms: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+		scene.meshes.size(), stats.optimizeTime,
+		totalBefore.acmr / totalTriangles, totalAfter.acmr / totalTriangles, totalBefore.atvr / totalVertices, totalAfter.atvr / totalVertices
+	);
+
+	if (numWorse > 0) {
+		LOG_FMT(Warning, "Sponza mesh optimization: ACMR of %llu meshes got worse!", numWorse);
+	}
+
+	if (numMismatches > 0) {
+		LOG_FMT(Error, "Sponza mesh optimization: the reported stats of %llu meshes differ from analyzing their indices!", numMismatches);
+	}
+}
+
+void runBenchmarks() {
+	runBVHBenchmarks();
+	runTransformHierarchyBenchmarks();
+	runEntityBenchmarks();
+	runSceneLoadBenchmarks();
+	runSceneImportBenchmarks();
+	runTangentBenchmarks();
+	runMeshOptimizerBenchmarks();
+}
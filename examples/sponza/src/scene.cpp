@@ -1,18 +1,23 @@
 #include "scene.h"
 
 #include "utils/logger.h"
+#include "utils/profile.h"
 #include "utils/timer.h"
 
 #include "reslib/img_data.h"
 #include "reslib/resource_library.h"
 
+#include <algorithm>
+#include <climits>
+
 void Mesh::uploadMeshData(Dar::UploadHandle uploadHandle) const {
 	// Only upload the data if needed
 	if (modelMatrix == cache && meshDataHandle != INVALID_RESOURCE_HANDLE) {
 		return;
 	}
 
-	MeshData md = { modelMatrix, glm::transpose(glm::inverse(modelMatrix)), static_cast<unsigned int>(mat) };
+	// Packed positions are dequantized by the model matrix. Normals are not packed relative to the bounds, so they use the original one.
+	MeshData md = { modelMatrix * positionDequantization, glm::transpose(glm::inverse(modelMatrix)), static_cast<unsigned int>(mat) };
 
 	Dar::ResourceManager &resManager = Dar::getResourceManager();
 	if (meshDataHandle != INVALID_RESOURCE_HANDLE) {
@@ -45,9 +50,11 @@ void ModelNode::draw(Dar::FrameData &frameData, const Scene &scene) const {
 
 	for (SizeType i = startMesh; i < startMesh + numMeshes; ++i) {
 		const Mesh &mesh = scene.meshes[i];
+		const MeshLod &lod = mesh.getDrawnLod();
 
+		frameData.addRenderCommand(Dar::RenderCommandSetIndexBuffer(scene.indexBuffers[static_cast<int>(mesh.indexPool)]));
 		frameData.addRenderCommand(Dar::RenderCommandSetConstantBuffer(mesh.meshDataHandle, static_cast<UINT>(DefaultConstantBufferView::MeshData), false));
-		frameData.addRenderCommand(Dar::RenderCommandDrawIndexedInstanced(static_cast<UINT>(mesh.numIndices), 1, static_cast<UINT>(mesh.indexOffset), 0, 0));
+		frameData.addRenderCommand(Dar::RenderCommandDrawIndexedInstanced(static_cast<UINT>(lod.numIndices), 1, static_cast<UINT>(lod.poolIndexOffset), static_cast<UINT>(mesh.baseVertex), 0));
 	}
 }
 
@@ -78,9 +85,24 @@ bool Scene::uploadSceneData(Dar::UploadHandle uploadHandle) {
 		return true;
 	}
 
+	if (texturesNeedUpdate) {
+		for (auto &retired : retiredTextures) {
+			retired.texture.deinit();
+		}
+		retiredTextures.clear();
+		imageName2TextureId.clear();
+
+		// All textures are recreated, so the memory of the old ones is returned to the streaming budget.
+		auto &reslib = Dar::getResourceLibrary();
+		for (TextureId id = 0; id < textureFirstMips.size(); ++id) {
+			reslib.releaseImage(fs::path(textureDescs[id].path).string());
+		}
+		textureFirstMips.clear();
+	}
+
 	// TODO: try using placed resources for lights and materials OR small textures
 	if (texturesNeedUpdate) {
-		if (!uploadTextureData(textureDescs, uploadHandle, textures, texturesHeap, false)) {
+		if (!uploadTextureData(textureDescs, uploadHandle, textures, texturesHeap, false, &textureFirstMips)) {
 			LOG(Error, "Failed to upload texture data!");
 			return false;
 		}
@@ -129,13 +151,657 @@ bool Scene::uploadSceneData(Dar::UploadHandle uploadHandle) {
 //	}
 //}
 
-void Scene::prepareFrameData(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle) {
-	frameData.addDataBufferResource(materialsBuffer);
-	for (int i = 0; i < textures.size(); ++i) {
-		frameData.addTextureResource(textures[i]);
+void Scene::updateTextureStreaming(const Dar::Camera &cam, int viewportHeight, Dar::UploadHandle uploadHandle, SizeType frameCount) {
+	DAR_OPTICK_EVENT("Scene::updateTextureStreaming");
+
+	releaseRetiredTextures(frameCount);
+
+	auto &reslib = Dar::getResourceLibrary();
+	if (!reslib.getTextureStreaming().enabled || textureFirstMips.size() != textures.size()) {
+		return;
+	}
+
+	applyTextureEvictions(uploadHandle, frameCount);
+
+	initImageName2TextureId();
+
+	// Replace the textures with the ones containing the newly streamed mips.
+	Dar::ImageData imgData;
+	while (reslib.popStreamedImage(imgData)) {
+		auto it = imageName2TextureId.find(imgData.header.filename);
+		bool used = false;
+		if (it != imageName2TextureId.end() && imgData.firstMip < textureFirstMips[it->second]) {
+			const TextureId id = it->second;
+
+			Dar::TextureResource streamed;
+			if (uploadStreamedTextureData(imgData, uploadHandle, streamed, textures[id].getName())) {
+				retiredTextures.push_back(RetiredTexture{ textures[id], frameCount });
+				textures[id] = streamed;
+				textureFirstMips[id] = imgData.firstMip;
+				used = true;
+			}
+		}
+
+		// The streamed mips are already accounted as resident, so give them back if they didn't make it into a texture.
+		if (!used) {
+			if (it != imageName2TextureId.end()) {
+				reslib.releaseImageMips(imgData.header.filename, textureFirstMips[it->second]);
+			} else {
+				reslib.releaseImage(imgData.header.filename);
+			}
+		}
+
+		// Data is already copied to the upload buffer
+		imgData.deinit();
+	}
+
+	// Estimate the most detailed mip needed for each texture from the projected size of the meshes using it.
+	// We assume the UV-space of a mesh covers its texture once.
+	Vector<int> neededMips(textures.size(), INT_MAX);
+	const Vec3 camPos = cam.getPos();
+	for (const Mesh &mesh : meshes) {
+		if (mesh.mat == INVALID_MATERIAL_ID) {
+			continue;
+		}
+
+		const BoundingSphere &sphere = mesh.worldSphere;
+
+		const float distance = glm::length(sphere.center - camPos) - sphere.radius;
+		const float projectedSize = cam.getProjectedSize(2.f * sphere.radius, distance, viewportHeight);
+
+		const MaterialData &md = getMaterial(mesh.mat).materialData;
+		const TextureId texIds[] = { md.baseColorIndex, md.normalsIndex, md.metallicRoughnessIndex, md.ambientOcclusionIndex };
+		for (TextureId id : texIds) {
+			if (id == INVALID_TEXTURE_ID || id >= textures.size()) {
+				continue;
+			}
+
+			const int fullSize = glm::max(textures[id].getWidth(), textures[id].getHeight()) << textureFirstMips[id];
+			const int mip = static_cast<int>(glm::max(0.f, glm::floor(glm::log2(fullSize / glm::max(projectedSize, 1.f)))));
+			neededMips[id] = glm::min(neededMips[id], mip);
+			if (mip < textureFirstMips[id]) {
+				reslib.requestImageMips(fs::path(textureDescs[id].path).string(), mip, projectedSize);
+			}
+		}
+	}
+
+	const SizeType missingMemory = reslib.kickStreamingRequests();
+	if (missingMemory > 0) {
+		evictTextureMips(neededMips, missingMemory);
+	}
+}
+
+void Scene::evictTextureMips(const Vector<int> &neededMips, SizeType memoryToFree) {
+	DAR_OPTICK_EVENT("Scene::evictTextureMips");
+
+	// The requests of the previous eviction are still being read.
+	if (evictionFence != nullptr) {
+		return;
+	}
+
+	auto &reslib = Dar::getResourceLibrary();
+
+	struct EvictCandidate {
+		TextureId id;
+		int mip;
+		SizeType freedMemory;
+	};
+
+	// Textures with mips more detailed than needed. The coarsest mips are always kept.
+	Vector<EvictCandidate> candidates;
+	for (TextureId id = 0; id < textures.size(); ++id) {
+		if (id >= neededMips.size() || neededMips[id] <= textureFirstMips[id]) {
+			continue;
+		}
+
+		const int mip = glm::min(neededMips[id], reslib.getInitialMip(fs::path(textureDescs[id].path).string()));
+		if (mip <= textureFirstMips[id]) {
+			continue;
+		}
+
+		// BC7 uses a byte per texel. The coarser mips are ignored, since they are a fraction of the most detailed one.
+		const int levels = mip - textureFirstMips[id];
+		const SizeType width = textures[id].getWidth();
+		const SizeType height = textures[id].getHeight();
+		candidates.push_back(EvictCandidate{ id, mip, width * height - (width >> levels) * (height >> levels) });
+	}
+
+	std::sort(
+		candidates.begin(),
+		candidates.end(),
+		[](const EvictCandidate &a, const EvictCandidate &b) {
+			return a.freedMemory > b.freedMemory;
+		}
+	);
+
+	// Recreating a texture reads its remaining mips, so only a few are evicted at a time.
+	const int maxEvictions = reslib.getTextureStreaming().maxRequestsInFlight;
+	SizeType freedMemory = 0;
+	evictionRequests.clear();
+	evictions.clear();
+	for (int i = 0; i < candidates.size() && i < maxEvictions && freedMemory < memoryToFree; ++i) {
+		const TextureId id = candidates[i].id;
+
+		Dar::ImageDataRequest request;
+		request.imageName = fs::path(textureDescs[id].path).string();
+		request.firstMip = candidates[i].mip;
+		evictionRequests.push_back(request);
+		evictions.push_back(TextureEviction{ id, textureFirstMips[id] });
+
+		freedMemory += candidates[i].freedMemory;
+	}
+
+	if (!evictionRequests.empty()) {
+		reslib.requestImageData(evictionRequests.data(), static_cast<int>(evictionRequests.size()), &evictionFence);
+	}
+}
+
+void Scene::applyTextureEvictions(Dar::UploadHandle uploadHandle, SizeType frameCount) {
+	DAR_OPTICK_EVENT("Scene::applyTextureEvictions");
+
+	if (evictionFence == nullptr || !Dar::JobSystem::probeFence(evictionFence)) {
+		return;
+	}
+
+	Dar::JobSystem::waitFenceAndFree(evictionFence);
+
+	auto &reslib = Dar::getResourceLibrary();
+	for (int i = 0; i < evictionRequests.size(); ++i) {
+		auto &request = evictionRequests[i];
+		const TextureId id = evictions[i].id;
+
+		// Only mips that are actually dropped free memory. The texture could also have been
+		// replaced by a streamed one while the mips were read, in which case the eviction is stale.
+		const bool evicted = request.success
+			&& request.imgData.firstMip == request.firstMip
+			&& textureFirstMips[id] == evictions[i].firstMip
+			&& request.imgData.firstMip > textureFirstMips[id];
+
+		Dar::TextureResource texture;
+		if (evicted && uploadStreamedTextureData(request.imgData, uploadHandle, texture, textures[id].getName())) {
+			retiredTextures.push_back(RetiredTexture{ textures[id], frameCount });
+			textures[id] = texture;
+			textureFirstMips[id] = request.imgData.firstMip;
+			reslib.releaseImageMips(request.imageName, request.imgData.firstMip);
+		}
+
+		// Data is already copied to the upload buffer
+		request.imgData.deinit();
+	}
+
+	evictionRequests.clear();
+	evictions.clear();
+}
+
+void Scene::cancelTextureEvictions() {
+	// The I/O thread writes into the requests until the fence is signaled.
+	Dar::JobSystem::waitFenceAndFree(evictionFence);
+
+	evictionRequests.clear();
+	evictions.clear();
+}
+
+bool Scene::buildTransformHierarchy() {
+	Vector<TransformId> parents(nodes.size(), INVALID_TRANSFORM_ID);
+	for (NodeId i = 0; i < nodes.size(); ++i) {
+		for (NodeId child : nodes[i]->children) {
+			// Nodes with more than one parent would be transformed by only one of them.
+			if (child >= nodes.size() || parents[child] != INVALID_TRANSFORM_ID) {
+				return false;
+			}
+			parents[child] = static_cast<TransformId>(i);
+		}
+	}
+
+	if (!transforms.build(parents, nodeTransforms)) {
+		return false;
+	}
+
+	// The transforms of the loaded scene are in world space. Models take the transform of their first mesh
+	// and the rest of their meshes are placed relative to it. Lights and cameras only have positions.
+	Vector<Mat4> worldMatrices(nodes.size(), Mat4(1.f));
+	meshLocalMatrices.assign(meshes.size(), Mat4(1.f));
+	for (NodeId i = 0; i < nodes.size(); ++i) {
+		switch (nodes[i]->getNodeType()) {
+		case NodeType::Model: {
+			const ModelNode *model = static_cast<const ModelNode*>(nodes[i]);
+			if (model->numMeshes == 0) {
+				break;
+			}
+
+			worldMatrices[i] = meshes[model->startMesh].modelMatrix;
+			const Mat4 invWorld = glm::inverse(worldMatrices[i]);
+			for (MeshId m = model->startMesh; m < model->startMesh + model->numMeshes; ++m) {
+				meshLocalMatrices[m] = invWorld * meshes[m].modelMatrix;
+			}
+			break;
+		}
+		case NodeType::Light: {
+			LightNode *light = static_cast<LightNode*>(nodes[i]);
+			worldMatrices[i] = glm::translate(Mat4(1.f), light->lightData.position);
+			light->localDirection = light->lightData.direction;
+			break;
+		}
+		case NodeType::Camera:
+			worldMatrices[i] = glm::translate(Mat4(1.f), static_cast<CameraNode*>(nodes[i])->getCamera()->getPos());
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (NodeId i = 0; i < nodes.size(); ++i) {
+		const TransformId parent = parents[i];
+		const Mat4 localMatrix = parent == INVALID_TRANSFORM_ID ? worldMatrices[i] : glm::inverse(worldMatrices[parent]) * worldMatrices[i];
+		transforms.setLocalMatrix(nodeTransforms[i], localMatrix);
+	}
+
+	return true;
+}
+
+void Scene::updateTransforms() {
+	DAR_OPTICK_EVENT("Scene::updateTransforms");
+
+	if (transforms.update() == 0) {
+		return;
+	}
+
+	for (NodeId id : modelIndices) {
+		const TransformId transform = nodeTransforms[id];
+		if (!transforms.hasChanged(transform)) {
+			continue;
+		}
+
+		const ModelNode *model = static_cast<const ModelNode*>(nodes[id]);
+		const Mat4 &worldMatrix = transforms.getWorldMatrix(transform);
+		for (MeshId i = model->startMesh; i < model->startMesh + model->numMeshes; ++i) {
+			meshes[i].modelMatrix = worldMatrix * meshLocalMatrices[i];
+		}
+	}
+
+	for (LightId id : lightIndices) {
+		const TransformId transform = nodeTransforms[id];
+		if (!transforms.hasChanged(transform)) {
+			continue;
+		}
+
+		LightNode *light = static_cast<LightNode*>(nodes[id]);
+		const Mat4 &worldMatrix = transforms.getWorldMatrix(transform);
+		light->lightData.position = Vec3(worldMatrix[3]);
+		if (light->localDirection != Vec3(0.f)) {
+			light->lightData.direction = glm::normalize(Mat3(worldMatrix) * light->localDirection);
+		}
+
+		lightsNeedUpdate = changesSinceLastCheck = true;
+	}
+
+	// Only the position of the cameras follows their nodes, the orientation is left to the camera controllers.
+	for (CameraId id : cameraIndices) {
+		const TransformId transform = nodeTransforms[id];
+		if (!transforms.hasChanged(transform)) {
+			continue;
+		}
+
+		Dar::Camera *camera = static_cast<CameraNode*>(nodes[id])->getCamera();
+		camera->move(Vec3(transforms.getWorldMatrix(transform)[3]) - camera->getPos());
+	}
+
+	updateMeshBounds();
+}
+
+void Scene::updateMeshBounds() {
+	DAR_OPTICK_EVENT("Scene::updateMeshBounds");
+
+	Vector<Dar::AABB> worldBoxes(meshes.size());
+	for (SizeType i = 0; i < meshes.size(); ++i) {
+		Mesh &mesh = meshes[i];
+		mesh.worldBox = BBox::invalidBBox();
+		for (int j = 0; j < 8; ++j) {
+			const Vec3 corner = {
+				(j & 1) ? mesh.box.pmax.x : mesh.box.pmin.x,
+				(j & 2) ? mesh.box.pmax.y : mesh.box.pmin.y,
+				(j & 4) ? mesh.box.pmax.z : mesh.box.pmin.z
+			};
+			mesh.worldBox.addPoint(Vec3(mesh.modelMatrix * Vec4(corner, 1.f)));
+		}
+
+		mesh.worldSphere = mesh.worldBox.getBoundingSphere();
+		worldBoxes[i] = Dar::AABB{ mesh.worldBox.pmin, mesh.worldBox.pmax };
+	}
+
+	if (meshBVH.getNumPrimitives() == meshes.size()) {
+		meshBVH.refit(worldBoxes);
+		return;
+	}
+
+	Dar::Timer timer;
+	meshBVH.build(worldBoxes);
+	LOG_FMT(Info, "Built the BVH of %llu meshes in %.2fms. %llu nodes, depth %d", meshes.size(), timer.time(), meshBVH.getNumNodes(), meshBVH.getDepth());
+}
+
+/// Möller-Trumbore ray-triangle intersection.
+/// @return true if the ray hits the triangle, t receives the distance to the hit in units of the ray direction.
+static bool intersectRayTriangle(const Vec3 &origin, const Vec3 &direction, const Vec3 &p0, const Vec3 &p1, const Vec3 &p2, float &t) {
+	const Vec3 edge1 = p1 - p0;
+	const Vec3 edge2 = p2 - p0;
+	const Vec3 pvec = glm::cross(direction, edge2);
+	const float det = glm::dot(edge1, pvec);
+	if (glm::abs(det) < 1e-12f) {
+		return false;
+	}
+
+	const float invDet = 1.f / det;
+	const Vec3 tvec = origin - p0;
+	const float u = glm::dot(tvec, pvec) * invDet;
+	if (u < 0.f || u > 1.f) {
+		return false;
+	}
+
+	const Vec3 qvec = glm::cross(tvec, edge1);
+	const float v = glm::dot(direction, qvec) * invDet;
+	if (v < 0.f || u + v > 1.f) {
+		return false;
+	}
+
+	t = glm::dot(edge2, qvec) * invDet;
+	return t >= 0.f;
+}
+
+MeshId Scene::pickMesh(const Vec3 &origin, const Vec3 &direction) const {
+	DAR_OPTICK_EVENT("Scene::pickMesh");
+
+	// Triangles are tested in object space. The ray direction isn't normalized there,
+	// so the distances are in units of the world-space direction and can be compared between meshes.
+	auto intersectMesh = [this, &origin, &direction](uint32_t meshId, float &t) {
+		const Mesh &mesh = meshes[meshId];
+		const Mat4 invModel = glm::inverse(mesh.modelMatrix);
+		const Vec3 objectOrigin = Vec3(invModel * Vec4(origin, 1.f));
+		const Vec3 objectDirection = Vec3(invModel * Vec4(direction, 0.f));
+
+		const MeshLod &lod = mesh.lods[0];
+		const unsigned int *meshIndices = indices.data() + lod.indexOffset;
+		const Vertex *meshVertices = vertices.data() + mesh.baseVertex;
+
+		bool hit = false;
+		t = std::numeric_limits<float>::max();
+		for (SizeType i = 0; i + 2 < lod.numIndices; i += 3) {
+			float triangleT;
+			const bool triangleHit = intersectRayTriangle(
+				objectOrigin,
+				objectDirection,
+				meshVertices[meshIndices[i + 0]].pos,
+				meshVertices[meshIndices[i + 1]].pos,
+				meshVertices[meshIndices[i + 2]].pos,
+				triangleT
+			);
+
+			if (triangleHit && triangleT < t) {
+				t = triangleT;
+				hit = true;
+			}
+		}
+
+		return hit;
+	};
+
+	Dar::BVH::RayHit hit;
+	if (!meshBVH.raycast(origin, direction, std::numeric_limits<float>::max(), hit, intersectMesh)) {
+		return INVALID_MESH_ID;
 	}
 
-	drawMeshes(frameData, uploadHandle);
+	return hit.primitive;
+}
+
+void Scene::queryMeshesInRange(const Vec3 &center, float radius, Vector<MeshId> &result) const {
+	Vector<uint32_t> meshIds;
+	meshBVH.querySphere(center, radius, meshIds);
+	result.insert(result.end(), meshIds.begin(), meshIds.end());
+}
+
+void Scene::selectLods(const Dar::Camera &cam, int viewportHeight) {
+	DAR_OPTICK_EVENT("Scene::selectLods");
+
+	const Vec3 camPos = cam.getPos();
+	numSelectedTriangles = 0;
+	for (Mesh &mesh : meshes) {
+		const BoundingSphere &sphere = mesh.worldSphere;
+		const float distance = glm::length(sphere.center - camPos) - sphere.radius;
+
+		// Errors are in object space, so scale them by the largest scale of the model matrix.
+		const float scale = glm::max(glm::length(Vec3(mesh.modelMatrix[0])), glm::max(glm::length(Vec3(mesh.modelMatrix[1])), glm::length(Vec3(mesh.modelMatrix[2]))));
+
+		// Errors grow with the LODs, so stop at the first one with too big error.
+		mesh.lod = 0;
+		while (mesh.lod + 1 < mesh.numLods) {
+			const float projectedError = cam.getProjectedSize(mesh.lods[mesh.lod + 1].error * scale, distance, viewportHeight);
+			if (projectedError > MAX_LOD_SCREEN_ERROR) {
+				break;
+			}
+			++mesh.lod;
+		}
+
+		numSelectedTriangles += mesh.getDrawnLod().numIndices / 3;
+	}
+}
+
+void Scene::reloadTextures(const Vector<String> &imageNames, Dar::UploadHandle uploadHandle, SizeType frameCount) {
+	auto &reslib = Dar::getResourceLibrary();
+
+	initImageName2TextureId();
+	for (const auto &imageName : imageNames) {
+		auto it = imageName2TextureId.find(imageName);
+		if (it == imageName2TextureId.end()) {
+			continue;
+		}
+
+		// Keep the mips that are currently streamed in.
+		const TextureId id = it->second;
+		const int firstMip = id < textureFirstMips.size() ? textureFirstMips[id] : 0;
+		Dar::ImageData imgData = reslib.getImageData(imageName, firstMip);
+
+		Dar::TextureResource reloaded;
+		if (imgData.data != nullptr && uploadStreamedTextureData(imgData, uploadHandle, reloaded, textures[id].getName())) {
+			retiredTextures.push_back(RetiredTexture{ textures[id], frameCount });
+			textures[id] = reloaded;
+		}
+
+		// Data is already copied to the upload buffer
+		imgData.deinit();
+	}
+}
+
+void Scene::releaseRetiredTextures(SizeType frameCount) {
+	// Release the textures the GPU is surely done with.
+	for (int i = 0; i < retiredTextures.size();) {
+		if (retiredTextures[i].frameRetired + Dar::FRAME_COUNT < frameCount) {
+			retiredTextures[i].texture.deinit();
+			retiredTextures[i] = retiredTextures.back();
+			retiredTextures.pop_back();
+		} else {
+			++i;
+		}
+	}
+}
+
+void Scene::initImageName2TextureId() {
+	if (!imageName2TextureId.empty()) {
+		return;
+	}
+
+	for (const auto &desc : textureDescs) {
+		imageName2TextureId[fs::path(desc.path).string()] = desc.id;
+	}
+}
+
+void Scene::buildVertexStreams(const VertexFormat &format) {
+	using namespace Dar::VertexPacking;
+
+	Dar::Timer timer;
+
+	vertexFormat = format;
+	const SizeType numVertices = vertices.size();
+
+	// Packed positions are relative to the bounds of their mesh. Meshes sharing vertices are merged
+	// into groups using the bounds of all of them, so the shared vertices decode the same in every mesh.
+	Vector<MeshId> meshGroups(meshes.size());
+	for (MeshId i = 0; i < meshes.size(); ++i) {
+		meshGroups[i] = i;
+	}
+
+	auto findGroup = [&meshGroups](MeshId m) {
+		while (meshGroups[m] != m) {
+			meshGroups[m] = meshGroups[meshGroups[m]];
+			m = meshGroups[m];
+		}
+		return m;
+	};
+
+	Vector<MeshId> vertexMeshes(numVertices, MeshId(-1));
+	for (MeshId i = 0; i < meshes.size(); ++i) {
+		const Mesh &mesh = meshes[i];
+		const MeshLod &lod = mesh.lods[0];
+		for (SizeType j = lod.indexOffset; j < lod.indexOffset + lod.numIndices; ++j) {
+			MeshId &vertexMesh = vertexMeshes[mesh.baseVertex + indices[j]];
+			if (vertexMesh == MeshId(-1)) {
+				vertexMesh = i;
+			} else {
+				meshGroups[findGroup(i)] = findGroup(vertexMesh);
+			}
+		}
+	}
+
+	Vector<BBox> groupBoxes(meshes.size(), BBox::invalidBBox());
+	for (SizeType i = 0; i < numVertices; ++i) {
+		if (vertexMeshes[i] != MeshId(-1)) {
+			groupBoxes[findGroup(vertexMeshes[i])].addPoint(vertices[i].pos);
+		}
+	}
+
+	const bool packedPositions = format.isPacked(VertexStream::Position);
+	for (MeshId i = 0; i < meshes.size(); ++i) {
+		const BBox &box = groupBoxes[findGroup(i)];
+		const bool validBox = box.pmin.x <= box.pmax.x;
+		meshes[i].positionDequantization = packedPositions && validBox ? getPositionDequantization(box.pmin, box.pmax - box.pmin) : Mat4(1.f);
+	}
+
+	for (int i = 0; i < static_cast<int>(VertexStream::Count); ++i) {
+		vertexStreams[i].resize(numVertices * getVertexStride(format, static_cast<VertexStream>(i)));
+	}
+
+	Byte *positions = vertexStreams[static_cast<int>(VertexStream::Position)].data();
+	Byte *uvs = vertexStreams[static_cast<int>(VertexStream::UV)].data();
+	Byte *tangentFrames = vertexStreams[static_cast<int>(VertexStream::TangentFrame)].data();
+
+	// Max errors of the packed attributes, checked with the same helpers the CPU uses for decoding
+	float maxPositionError = 0.f; // relative to the size of the bounds
+	float maxNormalError = 0.f; // in radians
+	float maxTangentError = 0.f; // in radians
+	float maxUVError = 0.f; // relative to the uv coordinate
+
+	auto angleBetween = [](const Vec3 &a, const Vec3 &b) {
+		// acos of the dot product isn't precise enough for small angles
+		return glm::atan(glm::length(glm::cross(a, b)), glm::dot(a, b));
+	};
+
+	for (SizeType i = 0; i < numVertices; ++i) {
+		const Vertex &v = vertices[i];
+
+		if (packedPositions) {
+			BBox box = vertexMeshes[i] != MeshId(-1) ? groupBoxes[findGroup(vertexMeshes[i])] : BBox{ v.pos, v.pos };
+			const Vec3 boxSize = box.pmax - box.pmin;
+
+			// The bitangent sign is not part of Vertex, so it's always positive for now.
+			const PackedPosition packed = packPosition(v.pos, box.pmin, boxSize, 1.f);
+			memcpy(positions + i * sizeof(PackedPosition), &packed, sizeof(PackedPosition));
+
+			const Vec3 error = glm::abs(unpackPosition(packed, box.pmin, boxSize) - v.pos) / glm::max(boxSize, Vec3(1e-6f));
+			maxPositionError = glm::max(maxPositionError, glm::max(error.x, glm::max(error.y, error.z)));
+		} else {
+			memcpy(positions + i * sizeof(Vec3), &v.pos, sizeof(Vec3));
+		}
+
+		if (format.isPacked(VertexStream::UV)) {
+			const PackedUV packed = packUV(v.uv);
+			memcpy(uvs + i * sizeof(PackedUV), &packed, sizeof(PackedUV));
+
+			const Vec2 error = glm::abs(unpackUV(packed) - v.uv) / glm::max(glm::abs(v.uv), Vec2(1e-3f));
+			maxUVError = glm::max(maxUVError, glm::max(error.x, error.y));
+		} else {
+			memcpy(uvs + i * sizeof(Vec2), &v.uv, sizeof(Vec2));
+		}
+
+		if (format.isPacked(VertexStream::TangentFrame)) {
+			const PackedTangentFrame packed = packTangentFrame(v.normal, v.tangent);
+			memcpy(tangentFrames + i * sizeof(PackedTangentFrame), &packed, sizeof(PackedTangentFrame));
+
+			Vec3 normal, tangent;
+			unpackTangentFrame(packed, normal, tangent);
+			maxNormalError = glm::max(maxNormalError, angleBetween(normal, v.normal));
+			maxTangentError = glm::max(maxTangentError, angleBetween(tangent, v.tangent));
+		} else {
+			memcpy(tangentFrames + i * 2 * sizeof(Vec3), &v.normal, sizeof(Vec3));
+			memcpy(tangentFrames + i * 2 * sizeof(Vec3) + sizeof(Vec3), &v.tangent, sizeof(Vec3));
+		}
+	}
+
+	SizeType vertexSize = 0;
+	for (int i = 0; i < static_cast<int>(VertexStream::Count); ++i) {
+		vertexSize += getVertexStride(format, static_cast<VertexStream>(i));
+	}
+
+	LOG_FMT(
+		Info,
+		"Built vertex streams in %.2fms. %llu bytes per vertex(%llu unpacked). Max errors: position %.7f(bound %.7f), normal %.4f deg, tangent %.4f deg, uv %.5f(bound %.5f)",
+		timer.time(), vertexSize, sizeof(Vertex), maxPositionError, POSITION_QUANTIZATION_ERROR, glm::degrees(maxNormalError), glm::degrees(maxTangentError), maxUVError, UV_QUANTIZATION_ERROR
+	);
+}
+
+void Scene::buildIndexPools() {
+	SizeType poolSizes[static_cast<int>(IndexPool::Count)] = {};
+	SizeType numMeshes16 = 0;
+	for (auto &mesh : meshes) {
+		mesh.indexPool = mesh.numVertices <= MAX_16BIT_INDEXED_VERTICES ? IndexPool::UInt16 : IndexPool::UInt32;
+		for (int i = 0; i < mesh.numLods; ++i) {
+			mesh.lods[i].poolIndexOffset = poolSizes[static_cast<int>(mesh.indexPool)];
+			poolSizes[static_cast<int>(mesh.indexPool)] += mesh.lods[i].numIndices;
+		}
+		numMeshes16 += mesh.indexPool == IndexPool::UInt16;
+	}
+
+	auto &pool16 = indexPools[static_cast<int>(IndexPool::UInt16)];
+	auto &pool32 = indexPools[static_cast<int>(IndexPool::UInt32)];
+	pool16.resize(poolSizes[static_cast<int>(IndexPool::UInt16)] * sizeof(uint16_t));
+	pool32.resize(poolSizes[static_cast<int>(IndexPool::UInt32)] * sizeof(uint32_t));
+
+	uint16_t *indices16 = reinterpret_cast<uint16_t*>(pool16.data());
+	uint32_t *indices32 = reinterpret_cast<uint32_t*>(pool32.data());
+	for (const auto &mesh : meshes) {
+		for (int i = 0; i < mesh.numLods; ++i) {
+			const MeshLod &lod = mesh.lods[i];
+			const unsigned int *src = indices.data() + lod.indexOffset;
+			if (mesh.indexPool == IndexPool::UInt16) {
+				for (SizeType j = 0; j < lod.numIndices; ++j) {
+					indices16[lod.poolIndexOffset + j] = static_cast<uint16_t>(src[j]);
+				}
+			} else {
+				memcpy(indices32 + lod.poolIndexOffset, src, lod.numIndices * sizeof(uint32_t));
+			}
+		}
+	}
+
+	LOG_FMT(
+		Info,
+		"Built index pools. %llu of %llu meshes use 16-bit indices. %.2fMB of indices instead of %.2fMB",
+		numMeshes16, meshes.size(), (pool16.size() + pool32.size()) / (1024.f * 1024.f), indices.size() * sizeof(uint32_t) / (1024.f * 1024.f)
+	);
+}
+
+void Scene::prepareFrameData(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle) {
+	addMaterialsAndTextures(frameData);
+
+	Vec4 planes[static_cast<int>(FrustumPlane::Count)];
+	getRenderCamera()->getFrustumPlanes(planes);
+	drawMeshes(frameData, uploadHandle, planes, cullingStats[0]);
 }
 
 void Scene::prepareFrameDataForShadowMap(int shadowMapPassIndex, Dar::FrameData & frameData, Dar::UploadHandle uploadHandle) {
@@ -143,7 +809,10 @@ void Scene::prepareFrameDataForShadowMap(int shadowMapPassIndex, Dar::FrameData
 		updateLightData(uploadHandle);
 	}
 
-	if (getLightcaster(shadowMapPassIndex) == nullptr) {
+	CullingStats &stats = cullingStats[1 + shadowMapPassIndex];
+	const LightNode *lightcaster = getLightcaster(shadowMapPassIndex);
+	if (lightcaster == nullptr) {
+		stats = CullingStats{};
 		return;
 	}
 
@@ -158,8 +827,13 @@ void Scene::prepareFrameDataForShadowMap(int shadowMapPassIndex, Dar::FrameData
 			false
 		)
 	);
-	
-	prepareFrameData(frameData, uploadHandle);
+
+	addMaterialsAndTextures(frameData);
+
+	// Meshes outside of the light's frustum don't cast shadows in the shadow map.
+	Vec4 planes[static_cast<int>(FrustumPlane::Count)];
+	extractFrustumPlanes(lightcaster->lightData.viewProjection, planes);
+	drawMeshes(frameData, uploadHandle, planes, stats);
 }
 
 LightId Scene::getLightcasterId(int lightcasterIndex) const {
@@ -169,7 +843,7 @@ LightId Scene::getLightcasterId(int lightcasterIndex) const {
 LightNode* Scene::getLightcaster(int lightcasterIndex) const {
 	auto id = getLightcasterId(lightcasterIndex);
 	if (id < lightIndices.size()) {
-		return dynamic_cast<LightNode *>(nodes[lightIndices[id]]);
+		return getLightNode(id);
 	}
 
 	return nullptr;
@@ -182,8 +856,7 @@ void Scene::updateLightData(Dar::UploadHandle uploadHandle) {
 
 	int lcasterId = 0;
 	for (int i = 0; i < lightIndices.size(); ++i) {
-		auto light = dynamic_cast<LightNode *>(nodes[lightIndices[i]]);
-		auto &gpuLight = light->lightData;
+		auto &gpuLight = getLightNode(i)->lightData;
 		gpuLight.shadowMapIndexOffset = -1;
 		switch (gpuLight.type) {
 		case LightType::Directional:
@@ -244,16 +917,49 @@ void Scene::updateLightData(Dar::UploadHandle uploadHandle) {
 	}
 }
 
-void Scene::drawMeshes(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle) {
+void Scene::addMaterialsAndTextures(Dar::FrameData &frameData) {
+	frameData.addDataBufferResource(materialsBuffer);
+	for (int i = 0; i < textures.size(); ++i) {
+		frameData.addTextureResource(textures[i]);
+	}
+}
+
+void Scene::drawMeshes(Dar::FrameData &frameData, Dar::UploadHandle uploadHandle, const Vec4 planes[static_cast<int>(FrustumPlane::Count)], CullingStats &stats) {
+	DAR_OPTICK_EVENT("Scene::drawMeshes");
+
 	for (SizeType i = 0; i < meshes.size(); ++i) {
 		meshes[i].uploadMeshData(uploadHandle);
 	}
 
-	for (SizeType i = 0; i < meshes.size(); ++i) {
-		const Mesh &mesh = meshes[i];
+	visibleMeshIds.clear();
+	meshBVH.queryFrustum(planes, visibleMeshIds);
 
-		frameData.addRenderCommand(Dar::RenderCommandSetConstantBuffer(mesh.meshDataHandle, static_cast<UINT>(DefaultConstantBufferView::MeshData), false));
-		frameData.addRenderCommand(Dar::RenderCommandDrawIndexedInstanced(static_cast<UINT>(mesh.numIndices), 1, static_cast<UINT>(mesh.indexOffset), 0, 0));
+	visibleMeshes.assign(meshes.size(), 0);
+	for (uint32_t meshId : visibleMeshIds) {
+		visibleMeshes[meshId] = 1;
+	}
+
+	stats.numDrawn = visibleMeshIds.size();
+	stats.numCulled = meshes.size() - stats.numDrawn;
+
+	// Draw the meshes of each index pool together, so the index buffer is switched only once
+	for (int pool = 0; pool < static_cast<int>(IndexPool::Count); ++pool) {
+		if (indexPools[pool].empty()) {
+			continue;
+		}
+
+		frameData.addRenderCommand(Dar::RenderCommandSetIndexBuffer(indexBuffers[pool]));
+
+		for (SizeType i = 0; i < meshes.size(); ++i) {
+			const Mesh &mesh = meshes[i];
+			if (static_cast<int>(mesh.indexPool) != pool || !visibleMeshes[i]) {
+				continue;
+			}
+
+			const MeshLod &lod = mesh.getDrawnLod();
+			frameData.addRenderCommand(Dar::RenderCommandSetConstantBuffer(mesh.meshDataHandle, static_cast<UINT>(DefaultConstantBufferView::MeshData), false));
+			frameData.addRenderCommand(Dar::RenderCommandDrawIndexedInstanced(static_cast<UINT>(lod.numIndices), 1, static_cast<UINT>(lod.poolIndexOffset), static_cast<UINT>(mesh.baseVertex), 0));
+		}
 	}
 }
 
@@ -270,11 +976,7 @@ bool Scene::uploadLightData(Dar::UploadHandle uploadHandle) {
 	}
 
 	for (int i = 0; i < numLights; ++i) {
-		LightId currLightIdx = lightIndices[i];
-
-		LightNode *light = dynamic_cast<LightNode *>(nodes[currLightIdx]);
-		dassert(light);
-		LightData &gpuLight = light->lightData;
+		LightData &gpuLight = getLightNode(i)->lightData;
 		memcpy(lightsMemory + i * sizeof(LightData), &gpuLight, sizeof(LightData));
 	}
 
@@ -8,8 +8,10 @@
 #include "d3d12/resource_manager.h"
 #include "utils/profile.h"
 #include "utils/random.h"
+#include "utils/timer.h"
 #include "utils/utils.h"
 
+#include "benchmarks.h"
 #include "scene.h"
 #include "scene_loader.h"
 
@@ -17,6 +19,15 @@
 
 #include "GLFW/glfw3.h" // keyboard input
 
+// Shader keywords. Bits follow the order of the @keywords declarations in the shaders, starting from the vertex shader.
+constexpr UINT32 DEFERRED_KEYWORD_PACKED_TANGENT_FRAME = 1 << 0; // Fixed when the pipeline is created, see Sponza::vertexFormat.
+constexpr UINT32 DEFERRED_KEYWORD_NORMAL_MAPPING = 1 << 1;
+constexpr UINT32 LIGHTING_KEYWORD_SPOT_LIGHT = 1 << 0;
+constexpr UINT32 POST_KEYWORD_FXAA = 1 << 0;
+
+// Seconds between checks for hot reloaded resources.
+constexpr double HOT_RELOAD_POLL_INTERVAL = 0.1;
+
 Sponza::Sponza(const UINT w, const UINT h, const String &windowTitle) : Dar::App(w, h, windowTitle.c_str()) {
 	editMode = false;
 	camControl = editMode ? &editModeControl : &fpsModeControl;
@@ -42,6 +53,11 @@ bool Sponza::initImpl() {
 		LOG(Info, "Sponza::init");
 
 		auto &resLibrary = Dar::getResourceLibrary();
+
+		// Only the coarsest mips are loaded initially. Finer ones are streamed in based on the camera view.
+		Dar::TextureStreamingSettings streamingSettings = {};
+		streamingSettings.enabled = true;
+		resLibrary.setTextureStreaming(streamingSettings);
 		resLibrary.LoadTextureData();
 
 		app->renderer.init(app->device, true /* renderToScreen */);
@@ -103,6 +119,7 @@ void Sponza::deinit() {
 	LOG(Info, "Sponza::deinit");
 	
 	flush();
+	scene.cancelTextureEvictions();
 	renderer.deinit();
 	Super::deinit();
 
@@ -129,8 +146,8 @@ void Sponza::updateMainLoop() {
 			// Wanted to create an abstraction for scene node animations but would have taken too much time.
 			LightData *pointLight = nullptr;
 			for (int i = 0; i < scene.getNumLights(); ++i) {
-				auto light = dynamic_cast<LightNode *>(scene.nodes[scene.lightIndices[i]]);
-				if (light && light->lightData.type == LightType::Point) {
+				auto light = scene.getLightNode(i);
+				if (light->lightData.type == LightType::Point) {
 					pointLight = &light->lightData;
 					//break;
 				}
@@ -148,15 +165,34 @@ void Sponza::updateMainLoop() {
 	auto uploadHandle = resManager->beginNewUpload();
 	uploadShaderRenderData(uploadHandle);
 
+	scene.updateTransforms();
+	scene.selectLods(*scene.getRenderCamera(), height);
+	scene.updateTextureStreaming(*scene.getRenderCamera(), height, uploadHandle, renderer.getNumRenderedFrames());
+
+	// Pick up resources changed by `resourcecompiler --watch`
+	if (getTotalTime() - lastHotReloadPoll > HOT_RELOAD_POLL_INTERVAL) {
+		lastHotReloadPoll = getTotalTime();
+
+		Dar::HotReloadChanges changes;
+		if (Dar::getResourceLibrary().pollHotReload(changes)) {
+			Dar::Timer timer;
+			renderer.reloadShaders(changes.shaders);
+			scene.reloadTextures(changes.textures, uploadHandle, renderer.getNumRenderedFrames());
+			LOG_FMT(Info, "Swapped %llu shaders and %llu textures in %.2fms", changes.shaders.size(), changes.textures.size(), timer.time());
+		}
+	}
+
 	// TODO: If the app state is changed we need to disable using the same commands.
 	const auto frameIndex = renderer.getBackbufferIndex();
 	Dar::FrameData& fd = frameData[frameIndex];
-	fd.setIndexBuffer(&indexBuffer);
-	fd.setVertexBuffer(&vertexBuffer);
+	fd.setVertexBuffers(vertexBuffers, static_cast<int>(VertexStream::Count));
 	fd.addConstResource(sceneDataHandle[frameIndex].getHandle(), static_cast<int>(DefaultConstantBufferView::SceneData));
 
+	const Dar::RenderSettings &rs = renderer.getSettings();
+
 	// Deferred pass:
 	fd.startNewPass();
+	fd.setShaderVariant(rs.enableNormalMapping ? DEFERRED_KEYWORD_NORMAL_MAPPING : 0);
 	scene.prepareFrameData(fd, uploadHandle);
 
 	// Shadow map pass:
@@ -167,6 +203,7 @@ void Sponza::updateMainLoop() {
 
 	// Lighting pass:
 	fd.startNewPass();
+	fd.setShaderVariant(rs.spotLightON ? LIGHTING_KEYWORD_SPOT_LIGHT : 0);
 	fd.addDataBufferResource(scene.lightsBuffer);
 	fd.addTextureResource(depthBuffer.getTexture());
 	for (int i = 0; i < MAX_SHADOW_MAPS_COUNT; ++i) {
@@ -179,6 +216,7 @@ void Sponza::updateMainLoop() {
 
 	// Post-process pass
 	fd.startNewPass();
+	fd.setShaderVariant(rs.enableFXAA ? POST_KEYWORD_FXAA : 0);
 	fd.addTextureResource(lightPassRT.getTextureResource(frameIndex));
 	fd.addTextureResource(depthBuffer.getTexture());
 	fd.addTextureResource(hud.getTexture());
@@ -210,6 +248,20 @@ void Sponza::drawUI() {
 	ImGui::Begin("Stats", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 		ImGui::Text("FPS: %.2f", getFPS());
 		ImGui::Text("Frame Time: %.2f", getFrameTime());
+		auto &resLibrary = Dar::getResourceLibrary();
+		auto &imageCache = resLibrary.getImageCache();
+		ImGui::Text("Resident texture memory: %.2f MB", resLibrary.getResidentTextureMemory() / (1024.f * 1024.f));
+		ImGui::Text("Image cache: %.2f MB, %llu hits, %llu misses", imageCache.getSize() / (1024.f * 1024.f), imageCache.getNumHits(), imageCache.getNumMisses());
+		ImGui::Text("Triangles: %llu", scene.getNumSelectedTriangles());
+		const CullingStats &cameraStats = scene.getCameraCullingStats();
+		ImGui::Text("Camera pass: %llu drawn, %llu culled meshes", cameraStats.numDrawn, cameraStats.numCulled);
+		for (int i = 0; i < MAX_SHADOW_MAPS_COUNT; ++i) {
+			const CullingStats &shadowStats = scene.getShadowMapCullingStats(i);
+			ImGui::Text("Shadow map %d pass: %llu drawn, %llu culled meshes", i, shadowStats.numDrawn, shadowStats.numCulled);
+		}
+		if (selectedMesh != INVALID_MESH_ID) {
+			ImGui::Text("Selected mesh: %llu", selectedMesh);
+		}
 		ImGui::Text("Camera FOV: %.2f", cam.getFOV());
 		ImGui::Text("Camera Speed: %.2f", camControl->getSpeed());
 		Vec3 pos = cam.getPos();
@@ -236,6 +288,7 @@ void Sponza::drawUI() {
 		ImGui::Text("[f] - Toggle spotlight");
 		ImGui::Text("[p] - Toggle fullscreen mode");
 		ImGui::Text("[v] - Toggle V-Sync mode");
+		ImGui::Text("[b] - Run the benchmarks");
 		winPos = ImGui::GetWindowPos();
 		winSize = ImGui::GetWindowSize();
 	ImGui::End();
@@ -255,6 +308,7 @@ void Sponza::drawUI() {
 	ImGui::Begin("FPS Edit Mode Camera Controls", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 		ImGui::Text("[alt] - Hold for movement and rotation of camera");
 		ImGui::Text("[mouse scroll] - Zoom/unzoom");
+		ImGui::Text("[left click] - Select a mesh");
 		winPos = ImGui::GetWindowPos();
 		winSize = ImGui::GetWindowSize();
 	ImGui::End();
@@ -352,6 +406,10 @@ void Sponza::onKeyboardInput(int /*key*/, int /*action*/) {
 		rs.vSyncEnabled = !rs.vSyncEnabled;
 	}
 
+	if (queryPressed(GLFW_KEY_B)) {
+		runBenchmarks();
+	}
+
 	if (queryPressed(GLFW_KEY_GRAVE_ACCENT)) {
 		rs.showGBuffer = 0;
 	}
@@ -371,6 +429,13 @@ void Sponza::onMouseButton(int button, int action, int /*mods*/) {
 				quit();
 			}
 		}
+		return;
+	}
+
+	if (editMode && button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
+		Vec3 origin, direction;
+		camControl->getCamera().getViewRay(Vec2{ mousePos.x / getWidth(), mousePos.y / getHeight() }, origin, direction);
+		selectedMesh = scene.pickMesh(origin, direction);
 	}
 }
 
@@ -421,12 +486,10 @@ bool Sponza::loadAssets() {
 	}
 
 	LOG_FMT(Info, "Sponza::loadScene");
-	// TODO: load the scene in binary format + run MikkTSpace on the tangents in a preprocess step.
-	//       During runtime we should only read the bin scene and upload the data to the gpu.
-	// MikkTSpace tangents give slightly better results than the tangents in the gltf file.
-	//SceneLoaderError sceneLoadErr = loadScene("res\\scenes\\Sponza\\glTF\\Sponza.gltf", scene, sceneLoaderFlags_overrideGenTangents);
-	// .. but the algorithm is too slow for run-time evaluation.
-	SceneLoaderError sceneLoadErr = loadScene("res\\scenes\\sponza.json", scene, sceneLoaderFlags_none);
+	// The scene compiled by the resource compiler is only mapped and copied to the GPU.
+	// Importing the json scene runs assimp and MikkTSpace, so it is kept only as a fallback.
+	const char *scenePath = fs::exists("res\\scenes\\sponza.scnlib") ? "res\\scenes\\sponza.scnlib" : "res\\scenes\\sponza.json";
+	SceneLoaderError sceneLoadErr = loadScene(scenePath, scene, sceneLoaderFlags_none, vertexFormat);
 	LOG_FMT(Info, "Sponza::loadScene SUCCESS");
 
 	if (sceneLoadErr != SceneLoaderError::Success) {
@@ -527,9 +590,7 @@ void Sponza::uploadShaderRenderData(Dar::UploadHandle uploadHandle) {
 	sceneData.cameraDir = Vec4{ glm::normalize(cam.getCameraZ()), 1.f };
 	sceneData.numLights = static_cast<int>(scene.getNumLights());
 	sceneData.showGBuffer = rs.showGBuffer;
-	sceneData.withNormalMapping = rs.enableNormalMapping;
 	sceneData.spotLightON = rs.spotLightON;
-	sceneData.fxaaON = rs.enableFXAA;
 	sceneData.invWidth = 1.f / width;
 	sceneData.invHeight = 1.f / height;
 	sceneData.nearPlane = cam.getNearPlane();
@@ -548,15 +609,38 @@ void Sponza::uploadShaderRenderData(Dar::UploadHandle uploadHandle) {
 	sceneDataHandle[frameIndex].upload(uploadHandle, &sceneData);
 }
 
+/// Input layouts of the vertex streams in the given format. Stream i is read from input slot i.
+/// @param depthOnly Only the positions and uvs, for the passes writing just the depth.
+static Vector<D3D12_INPUT_ELEMENT_DESC> getInputLayouts(const VertexFormat &format, bool depthOnly) {
+	auto element = [](const char *semantic, DXGI_FORMAT dxgiFormat, VertexStream stream) {
+		return D3D12_INPUT_ELEMENT_DESC{ semantic, 0, dxgiFormat, static_cast<UINT>(stream), D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 };
+	};
+
+	Vector<D3D12_INPUT_ELEMENT_DESC> result;
+
+	// Packed positions are read as [0, 1] and dequantized by the model matrix. Their w is the bitangent sign.
+	const bool packedPositions = format.isPacked(VertexStream::Position);
+	result.push_back(element("POSITION", packedPositions ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT, VertexStream::Position));
+
+	const bool packedUVs = format.isPacked(VertexStream::UV);
+	result.push_back(element("TEXCOORD", packedUVs ? DXGI_FORMAT_R16G16_FLOAT : DXGI_FORMAT_R32G32_FLOAT, VertexStream::UV));
+
+	if (!depthOnly) {
+		// Packed normals and tangents are octahedral encoded, decoded by the PACKED_TANGENT_FRAME variant of the shader
+		const DXGI_FORMAT tangentFrameFormat = format.isPacked(VertexStream::TangentFrame) ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+		result.push_back(element("NORMAL", tangentFrameFormat, VertexStream::TangentFrame));
+		result.push_back(element("TANGENT", tangentFrameFormat, VertexStream::TangentFrame));
+	}
+
+	return result;
+}
+
 bool Sponza::loadMainPipeline() {
 	LOG_FMT(Info, "Sponza::loadMainPipeline");
 
-	D3D12_INPUT_ELEMENT_DESC inputLayouts[] = {
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-	};
+	Vector<D3D12_INPUT_ELEMENT_DESC> inputLayouts = getInputLayouts(vertexFormat, false);
+	// Shadow maps are alpha tested, so besides the positions they only read the uvs.
+	Vector<D3D12_INPUT_ELEMENT_DESC> shadowMapInputLayouts = getInputLayouts(vertexFormat, true);
 
 	D3D12_STATIC_SAMPLER_DESC staticSamplers[]{
 		CD3DX12_STATIC_SAMPLER_DESC{ 0, D3D12_FILTER_ANISOTROPIC },
@@ -577,10 +661,12 @@ bool Sponza::loadMainPipeline() {
 	Dar::PipelineStateDesc deferredPSDesc = {};
 	deferredPSDesc.shaderName = "deferred";
 	deferredPSDesc.shadersMask = Dar::shaderInfoFlags_useVertex;
-	deferredPSDesc.inputLayouts = inputLayouts;
+	deferredPSDesc.shaderVariant = vertexFormat.isPacked(VertexStream::TangentFrame) ? DEFERRED_KEYWORD_PACKED_TANGENT_FRAME : 0;
+	deferredPSDesc.variantKeywords = DEFERRED_KEYWORD_NORMAL_MAPPING;
+	deferredPSDesc.inputLayouts = inputLayouts.data();
 	deferredPSDesc.staticSamplerDescs = staticSamplers;
 	deferredPSDesc.numStaticSamplers = _countof(staticSamplers);
-	deferredPSDesc.numInputLayouts = _countof(inputLayouts);
+	deferredPSDesc.numInputLayouts = static_cast<UINT>(inputLayouts.size());
 	deferredPSDesc.depthStencilBufferFormat = depthBuffer.getFormatAsDepthBuffer();
 	deferredPSDesc.numConstantBufferViews = static_cast<UINT>(DefaultConstantBufferView::Count);
 	deferredPSDesc.numRenderTargets = static_cast<UINT>(GBuffer::Count);
@@ -599,10 +685,10 @@ bool Sponza::loadMainPipeline() {
 		Dar::PipelineStateDesc shadowMapPSDesc = {};
 		shadowMapPSDesc.shaderName = "shadow_map";
 		shadowMapPSDesc.shadersMask = Dar::shaderInfoFlags_useVertex;
-		shadowMapPSDesc.inputLayouts = inputLayouts;
+		shadowMapPSDesc.inputLayouts = shadowMapInputLayouts.data();
 		shadowMapPSDesc.staticSamplerDescs = staticSamplers;
 		shadowMapPSDesc.numStaticSamplers = _countof(staticSamplers);
-		shadowMapPSDesc.numInputLayouts = _countof(inputLayouts);
+		shadowMapPSDesc.numInputLayouts = static_cast<UINT>(shadowMapInputLayouts.size());
 		shadowMapPSDesc.depthStencilBufferFormat = shadowMapBuffer[i].getFormatAsDepthBuffer();
 		shadowMapPSDesc.numConstantBufferViews = static_cast<UINT>(ShadowMapConstantBufferView::Count);
 		shadowMapPSDesc.numRenderTargets = 0;
@@ -616,6 +702,7 @@ bool Sponza::loadMainPipeline() {
 	Dar::PipelineStateDesc lightingPSDesc = {};
 	lightingPSDesc.shaderName = "lighting";
 	lightingPSDesc.shadersMask = Dar::shaderInfoFlags_useVertex;
+	lightingPSDesc.variantKeywords = LIGHTING_KEYWORD_SPOT_LIGHT;
 	lightingPSDesc.staticSamplerDescs = staticSamplers;
 	lightingPSDesc.numStaticSamplers = _countof(staticSamplers);
 	lightingPSDesc.numConstantBufferViews = static_cast<unsigned int>(DefaultConstantBufferView::Count);
@@ -629,6 +716,7 @@ bool Sponza::loadMainPipeline() {
 	Dar::PipelineStateDesc postPSDesc = {};
 	postPSDesc.shaderName = "post";
 	postPSDesc.shadersMask = Dar::shaderInfoFlags_useVertex;
+	postPSDesc.variantKeywords = POST_KEYWORD_FXAA;
 	postPSDesc.staticSamplerDescs = staticSamplers;
 	postPSDesc.numStaticSamplers = _countof(staticSamplers);
 	postPSDesc.numConstantBufferViews = static_cast<unsigned int>(DefaultConstantBufferView::Count);
@@ -649,22 +737,41 @@ bool Sponza::loadMainPipeline() {
 bool Sponza::prepareVertexIndexBuffers(Dar::UploadHandle uploadHandle) {
 	LOG_FMT(Info, "Sponza::prepareVertexIndexBuffers");
 
-	Dar::VertexIndexBufferDesc vertexDesc = {};
-	vertexDesc.data = scene.getVertexBuffer();
-	vertexDesc.size = scene.getVertexBufferSize();
-	vertexDesc.name = "VertexBuffer";
-	vertexDesc.vertexBufferStride = sizeof(Vertex);
-	if (!vertexBuffer.init(vertexDesc, uploadHandle)) {
-		return false;
+	const char *streamNames[] = { "VertexPositions", "VertexUVs", "VertexTangentFrames" };
+	static_assert(_countof(streamNames) == static_cast<int>(VertexStream::Count));
+
+	for (int i = 0; i < static_cast<int>(VertexStream::Count); ++i) {
+		const auto stream = static_cast<VertexStream>(i);
+
+		Dar::VertexIndexBufferDesc vertexDesc = {};
+		vertexDesc.data = scene.getVertexStream(stream);
+		vertexDesc.size = scene.getVertexStreamSize(stream);
+		vertexDesc.name = streamNames[i];
+		vertexDesc.vertexBufferStride = getVertexStride(vertexFormat, stream);
+		if (!vertexBuffers[i].init(vertexDesc, uploadHandle)) {
+			return false;
+		}
 	}
 
-	Dar::VertexIndexBufferDesc indexDesc = {};
-	indexDesc.data = scene.getIndexBuffer();
-	indexDesc.size = scene.getIndexBufferSize();
-	indexDesc.name = "IndexBuffer";
-	indexDesc.indexBufferFormat = DXGI_FORMAT_R32_UINT;
-	if (!indexBuffer.init(indexDesc, uploadHandle)) {
-		return false;
+	// Index buffers are owned by the scene, as its draws switch between them.
+	const char *poolNames[] = { "IndexBuffer16", "IndexBuffer32" };
+	const DXGI_FORMAT poolFormats[] = { DXGI_FORMAT_R16_UINT, DXGI_FORMAT_R32_UINT };
+	static_assert(_countof(poolNames) == static_cast<int>(IndexPool::Count));
+
+	for (int i = 0; i < static_cast<int>(IndexPool::Count); ++i) {
+		const auto pool = static_cast<IndexPool>(i);
+		if (scene.getIndexPoolSize(pool) == 0) {
+			continue;
+		}
+
+		Dar::VertexIndexBufferDesc indexDesc = {};
+		indexDesc.data = scene.getIndexPool(pool);
+		indexDesc.size = scene.getIndexPoolSize(pool);
+		indexDesc.name = poolNames[i];
+		indexDesc.indexBufferFormat = poolFormats[i];
+		if (!scene.indexBuffers[i].init(indexDesc, uploadHandle)) {
+			return false;
+		}
 	}
 
 	LOG_FMT(Info, "Sponza::prepareVertexIndexBuffers SUCCESS");
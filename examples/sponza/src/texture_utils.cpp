@@ -1,12 +1,25 @@
 #include "texture_utils.h"
 #include "reslib/resource_library.h"
+#include "utils/timer.h"
+
+Dar::TextureInitData getTextureInitData(const Dar::ImageData &imgData) {
+	Dar::TextureInitData texInitData = {};
+	texInitData.width = std::max(1, imgData.header.width >> imgData.firstMip);
+	texInitData.height = std::max(1, imgData.header.height >> imgData.firstMip);
+	texInitData.mipLevels = std::max(1, imgData.header.mipMapCount - imgData.firstMip);
+	// TODO: We don't need BC7 for normal maps, etc
+	texInitData.format = DXGI_FORMAT_BC7_UNORM;
+
+	return texInitData;
+}
 
 bool uploadTextureData(
 	Vector<TextureDesc> &textureDescs,
 	Dar::UploadHandle uploadHandle,
 	Vector<Dar::TextureResource> &textures,
 	Dar::HeapHandle &texturesHeap,
-	bool forceNoMips
+	bool forceNoMips,
+	Vector<int> *firstMips
 ) {
 	SizeType numTextures = textureDescs.size();
 
@@ -24,43 +37,58 @@ bool uploadTextureData(
 	auto &resManager = Dar::getResourceManager();
 	Vector<Dar::ImageData> texData(numTextures);
 	Vector<Dar::ResourceInitData> resInitDatas(numTextures);
+	Dar::Timer loadTimer;
+
+	// Load all the textures in a single batch, so the reads are sorted and merged by the I/O thread.
+	Vector<Dar::ImageDataRequest> requests(numTextures);
 	for (int i = 0; i < numTextures; ++i) {
-		const TextureDesc &tex = textureDescs[i];
+		requests[i].imageName = fs::path(textureDescs[i].path).string();
+		requests[i].firstMip = (firstMips && !forceNoMips) ? reslib.getInitialMip(requests[i].imageName) : 0;
+	}
+
+	Dar::JobSystem::Fence *ioFence = nullptr;
+	reslib.requestImageData(requests.data(), static_cast<int>(numTextures), &ioFence);
+	Dar::JobSystem::waitFenceAndFree(ioFence);
 
+	for (int i = 0; i < numTextures; ++i) {
 		Dar::ImageData &td = texData[i];
-		td = reslib.getImageData(fs::path(tex.path).string());
+		if (requests[i].success) {
+			td = requests[i].imgData;
+		}
 
 		if (forceNoMips) {
 			td.header.mipMapCount = 1;
+			td.firstMip = 0;
 		}
 
 		// Load some default texture
 		if (td.header.width <= 0 || td.header.height <= 0 || td.header.ncomp != 4) {
+			td.deinit();
 			td.header.filename = "DEFAULT";
 			td.header.width = 1;
 			td.header.height = 1;
 			td.header.ncomp = 1;
-			td.deinit();
-			td.data = new uint8_t[4];
-			memset(td.data, 0xFF00FFFF, sizeof(int)); // magenta
+			td.header.mipMapCount = 1;
+			td.data = Dar::allocateImageBuffer(sizeof(int));
+			memset(td.data.get(), 0xFF00FFFF, sizeof(int)); // magenta
 		}
 
 		char textureName[32] = "";
 		snprintf(textureName, 32, "Texture[%d]", i);
 
-		Dar::TextureInitData texInitData = {};
-		texInitData.width = td.header.width;
-		texInitData.height = td.header.height;
-		texInitData.mipLevels = td.header.mipMapCount;
-		// TODO: We don't need BC7 for normal maps, etc
-		texInitData.format = DXGI_FORMAT_BC7_UNORM;
+		if (firstMips) {
+			firstMips->resize(numTextures);
+			(*firstMips)[i] = td.firstMip;
+		}
 
 		Dar::ResourceInitData &resInitData = resInitDatas[i];
 		resInitData.init(Dar::ResourceType::TextureBuffer);
-		resInitData.textureData = texInitData;
+		resInitData.textureData = getTextureInitData(td);
 		resInitData.name = textureName;
 	}
 
+	LOG_FMT(Info, "Loaded data for %llu textures in %.2fms", numTextures, loadTimer.time());
+
 	resManager.createHeap(resInitDatas, texturesHeap);
 
 	if (texturesHeap == INVALID_HEAP_HANDLE) {
@@ -71,7 +99,28 @@ bool uploadTextureData(
 	for (int i = 0; i < numTextures; ++i) {
 		textures[i].init(resInitDatas[i].textureData, Dar::TextureResourceType::ShaderResource, resInitDatas[i].name, texturesHeap);
 		std::ignore = textures[i].upload(uploadHandle, texData[i]);
+
+		// The data is already copied to the upload buffer.
+		texData[i].deinit();
 	}
 
 	return true;
 }
+
+bool uploadStreamedTextureData(
+	Dar::ImageData &imgData,
+	Dar::UploadHandle uploadHandle,
+	Dar::TextureResource &texture,
+	const String &name
+) {
+	Dar::TextureInitData texInitData = getTextureInitData(imgData);
+
+	// Streamed textures are committed resources, since their size changes
+	// every time more detailed mips are streamed in.
+	if (!texture.init(texInitData, Dar::TextureResourceType::ShaderResource, name)) {
+		LOG_FMT(Error, "Failed to create streamed texture %s!", name.c_str());
+		return false;
+	}
+
+	return texture.upload(uploadHandle, imgData) != 0;
+}
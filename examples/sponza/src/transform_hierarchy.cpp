@@ -0,0 +1,136 @@
+#include "transform_hierarchy.h"
+
+#include "async/job_system.h"
+
+/// Levels with less transforms are updated on the calling thread.
+constexpr SizeType MIN_PARALLEL_LEVEL_SIZE = 4096;
+
+/// Min number of transforms updated by a job.
+constexpr SizeType MIN_TRANSFORMS_PER_JOB = 1024;
+
+bool TransformHierarchy::build(const Vector<TransformId> &nodeParents, Vector<TransformId> &nodeTransforms) {
+	const SizeType numNodes = nodeParents.size();
+
+	// Children of each node in CSR layout, for walking the hierarchy top-down.
+	Vector<uint32_t> childOffsets(numNodes + 1, 0);
+	for (SizeType i = 0; i < numNodes; ++i) {
+		const TransformId parent = nodeParents[i];
+		if (parent == INVALID_TRANSFORM_ID) {
+			continue;
+		}
+
+		if (parent >= numNodes) {
+			return false;
+		}
+		++childOffsets[parent + 1];
+	}
+	for (SizeType i = 0; i < numNodes; ++i) {
+		childOffsets[i + 1] += childOffsets[i];
+	}
+
+	Vector<uint32_t> children(childOffsets[numNodes]);
+	Vector<uint32_t> childEnds(childOffsets.begin(), childOffsets.end() - 1);
+	for (SizeType i = 0; i < numNodes; ++i) {
+		if (nodeParents[i] != INVALID_TRANSFORM_ID) {
+			children[childEnds[nodeParents[i]]++] = static_cast<uint32_t>(i);
+		}
+	}
+
+	// Breadth-first order puts the nodes of each level together.
+	Vector<uint32_t> order;
+	order.reserve(numNodes);
+	for (SizeType i = 0; i < numNodes; ++i) {
+		if (nodeParents[i] == INVALID_TRANSFORM_ID) {
+			order.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	levelOffsets.clear();
+	SizeType levelBegin = 0;
+	while (levelBegin < order.size()) {
+		levelOffsets.push_back(levelBegin);
+
+		const SizeType levelEnd = order.size();
+		for (SizeType i = levelBegin; i < levelEnd; ++i) {
+			const uint32_t node = order[i];
+			order.insert(order.end(), children.begin() + childOffsets[node], children.begin() + childOffsets[node + 1]);
+		}
+		levelBegin = levelEnd;
+	}
+	levelOffsets.push_back(order.size());
+
+	// Nodes in a cycle are never reached from a root.
+	if (order.size() != numNodes) {
+		levelOffsets.clear();
+		return false;
+	}
+
+	nodeTransforms.resize(numNodes);
+	for (SizeType i = 0; i < numNodes; ++i) {
+		nodeTransforms[order[i]] = static_cast<TransformId>(i);
+	}
+
+	parents.resize(numNodes);
+	for (SizeType i = 0; i < numNodes; ++i) {
+		const TransformId parent = nodeParents[order[i]];
+		parents[i] = parent == INVALID_TRANSFORM_ID ? INVALID_TRANSFORM_ID : nodeTransforms[parent];
+	}
+
+	// All transforms are reported as changed by the first update.
+	localMatrices.assign(numNodes, Mat4(1.f));
+	worldMatrices.assign(numNodes, Mat4(1.f));
+	dirty.assign(numNodes, 1);
+	changed.assign(numNodes, 0);
+
+	return true;
+}
+
+SizeType TransformHierarchy::update() {
+	const SizeType numLevels = getNumLevels();
+	for (SizeType level = 0; level < numLevels; ++level) {
+		const SizeType begin = levelOffsets[level];
+		const SizeType end = levelOffsets[level + 1];
+		if (end - begin < MIN_PARALLEL_LEVEL_SIZE) {
+			updateRange(begin, end);
+			continue;
+		}
+
+		struct UpdateLevelParams {
+			TransformHierarchy *hierarchy;
+			SizeType begin;
+		} params = { this, begin };
+
+		Dar::JobSystem::parallelFor(
+			end - begin,
+			MIN_TRANSFORMS_PER_JOB,
+			[](SizeType begin, SizeType end, void *param) {
+				auto params = reinterpret_cast<UpdateLevelParams*>(param);
+				params->hierarchy->updateRange(params->begin + begin, params->begin + end);
+			},
+			&params
+		);
+	}
+
+	SizeType numChanged = 0;
+	for (uint8_t c : changed) {
+		numChanged += c;
+	}
+
+	return numChanged;
+}
+
+void TransformHierarchy::updateRange(SizeType begin, SizeType end) {
+	// Parents are in the previous levels, so they are already up to date.
+	for (SizeType i = begin; i < end; ++i) {
+		const TransformId parent = parents[i];
+		const bool parentChanged = parent != INVALID_TRANSFORM_ID && changed[parent];
+		changed[i] = dirty[i] || parentChanged;
+		dirty[i] = 0;
+
+		if (!changed[i]) {
+			continue;
+		}
+
+		worldMatrices[i] = parent == INVALID_TRANSFORM_ID ? localMatrices[i] : worldMatrices[parent] * localMatrices[i];
+	}
+}
@@ -0,0 +1,20 @@
+#include "vertex_format.h"
+
+UINT getVertexStride(const VertexFormat &format, VertexStream stream) {
+	const bool packed = format.isPacked(stream);
+	switch (stream) {
+	case VertexStream::Position:
+		return packed ? sizeof(Dar::VertexPacking::PackedPosition) : sizeof(Vec3);
+	case VertexStream::UV:
+		return packed ? sizeof(Dar::VertexPacking::PackedUV) : sizeof(Vec2);
+	case VertexStream::TangentFrame:
+		return packed ? sizeof(Dar::VertexPacking::PackedTangentFrame) : 2 * sizeof(Vec3);
+	default:
+		dassert(false);
+		return 0;
+	}
+}
+
+Mat4 getPositionDequantization(const Vec3 &boxMin, const Vec3 &boxSize) {
+	return glm::translate(Mat4(1.f), boxMin) * glm::scale(Mat4(1.f), boxSize);
+}
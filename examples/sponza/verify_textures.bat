@@ -0,0 +1,4 @@
+@ECHO OFF
+SET SCRIPTDIR=%~dp0
+
+%SCRIPTDIR%\..\..\tools\resourcecompiler\resourcecompiler.exe verify %SCRIPTDIR%\res\textures %SCRIPTDIR%\res\textures\textures.txlib %*
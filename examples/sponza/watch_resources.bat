@@ -0,0 +1,5 @@
+@ECHO OFF
+SET SCRIPTDIR=%~dp0
+
+REM Pass --delta-dir <res folder of the running sponza.exe> to hot reload into it.
+%SCRIPTDIR%\..\..\tools\resourcecompiler\resourcecompiler.exe %SCRIPTDIR%\res %SCRIPTDIR%\res --compress --watch %*
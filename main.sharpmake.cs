@@ -120,6 +120,9 @@ class ResourceManagerLib : BaseProject
 		base.ConfigureAll(conf, target);
 		conf.Output = Configuration.OutputType.Lib;
 		conf.LibraryFiles.Add("nvtt.lib");
+
+		// Scenes are imported with assimp. Projects importing scenes link it themselves.
+		conf.IncludePaths.Add(@"[project.SharpmakeCsPath]/third_party/assimp/include");
 	}
 }
 
@@ -144,6 +147,16 @@ class ResourceCompiler : BaseProject
 
 		conf.AddPrivateDependency<ResourceManagerLib>(target);
 		conf.AddPrivateDependency<DarLibrary>(target);
+		conf.AddPrivateDependency<MikkTSpaceLib>(target);
+
+		if (target.Optimization == Optimization.Debug)
+		{
+			conf.LibraryFiles.Add("assimpd.lib");
+		}
+		else
+		{
+			conf.LibraryFiles.Add("assimp.lib");
+		}
 	}
 }
 
@@ -372,6 +385,8 @@ class SponzaProject : BaseProject
 		);
 		conf.TargetCopyFilesToSubDirectory.Add(new KeyValuePair<string, string>(
 				@"[project.SourceRootPath]/res/scenes/sponza.json", "res/scenes/"));
+		conf.TargetCopyFilesToSubDirectory.Add(new KeyValuePair<string, string>(
+				@"[project.SourceRootPath]/res/sponza.scnlib", "res/scenes/"));
 
 		conf.AddPrivateDependency<DarLibrary>(target);
 		conf.AddPrivateDependency<MikkTSpaceLib>(target);
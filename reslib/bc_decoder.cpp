@@ -0,0 +1,427 @@
+#include "bc_decoder.h"
+
+#include "async/job_system.h"
+
+#include <emmintrin.h>
+
+namespace Dar {
+
+namespace BCn {
+
+/// ==========================================================================
+/// BC7 tables. See the BC7 format specification.
+/// ==========================================================================
+
+/// Subset of each pixel for the 2-subset partitions. Bit i is the subset of pixel i.
+static constexpr uint16_t BC7_PARTITIONS_2[64] = {
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+};
+
+/// Subset of each pixel for the 3-subset partitions. Bits [2i, 2i + 1] are the subset of pixel i.
+static constexpr uint32_t BC7_PARTITIONS_3[64] = {
+	0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+	0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+	0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+	0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+	0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+	0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+	0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+	0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+};
+
+/// Anchor pixel of the second subset of the 2-subset partitions.
+static constexpr uint8_t BC7_ANCHORS_2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,
+	 2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,
+	 2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2,
+	15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+/// Anchor pixel of the second subset of the 3-subset partitions.
+static constexpr uint8_t BC7_ANCHORS_3_SECOND[64] = {
+	 3,  3, 15, 15,  8,  3, 15, 15,
+	 8,  8,  6,  6,  6,  5,  3,  3,
+	 3,  3,  8, 15,  3,  3,  6, 10,
+	 5,  8,  8,  6,  8,  5, 15, 15,
+	 8, 15,  3,  5,  6, 10,  8, 15,
+	15,  3, 15,  5, 15, 15, 15, 15,
+	 3, 15,  5,  5,  5,  8,  5, 10,
+	 5, 10,  8, 13, 15, 12,  3,  3,
+};
+
+/// Anchor pixel of the third subset of the 3-subset partitions.
+static constexpr uint8_t BC7_ANCHORS_3_THIRD[64] = {
+	15,  8,  8,  3, 15, 15,  3,  8,
+	15, 15, 15, 15, 15, 15, 15,  8,
+	15,  8, 15,  3, 15,  8, 15,  8,
+	 3, 15,  6, 10, 15, 15, 10,  8,
+	15,  3, 15, 10, 10,  8,  9, 10,
+	 6, 15,  8, 15,  3,  6,  6,  8,
+	15,  3, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15,  3, 15, 15,  8,
+};
+
+static constexpr uint16_t BC7_WEIGHTS_2[4] = { 0, 21, 43, 64 };
+static constexpr uint16_t BC7_WEIGHTS_3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static constexpr uint16_t BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Mode {
+	int numSubsets;
+	int partitionBits;
+	int rotationBits;
+	int indexSelectionBits;
+	int colorBits;
+	int alphaBits;
+	int endpointPBits; ///< Unique p-bit per endpoint
+	int sharedPBits; ///< P-bit shared between the endpoints of a subset
+	int indexBits;
+	int secondaryIndexBits;
+};
+
+static constexpr BC7Mode BC7_MODES[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+/// Reads the bits of a block starting from the least significant one.
+struct BitReader {
+	uint64_t lo;
+	uint64_t hi;
+	int pos = 0;
+
+	explicit BitReader(const uint8_t *block) {
+		memcpy(&lo, block, sizeof(uint64_t));
+		memcpy(&hi, block + sizeof(uint64_t), sizeof(uint64_t));
+	}
+
+	uint32_t read(int numBits) {
+		if (numBits == 0) {
+			return 0;
+		}
+
+		const uint64_t mask = (uint64_t(1) << numBits) - 1;
+		uint64_t value;
+		if (pos >= 64) {
+			value = hi >> (pos - 64);
+		} else if (pos + numBits <= 64) {
+			value = lo >> pos;
+		} else {
+			value = (lo >> pos) | (hi << (64 - pos));
+		}
+
+		pos += numBits;
+		return static_cast<uint32_t>(value & mask);
+	}
+};
+
+/// Expand a value with numBits bits to 8 bits by replicating its high bits in the low ones.
+static uint8_t unquantize(uint32_t value, int numBits) {
+	value <<= (8 - numBits);
+	return static_cast<uint8_t>(value | (value >> numBits));
+}
+
+/// Compute all interpolated colors between two RGBA8 endpoints, two at a time.
+/// @param palette Receives numWeights RGBA8 colors.
+static void interpolatePalette(const uint8_t e0[4], const uint8_t e1[4], const uint16_t *weights, int numWeights, uint32_t *palette) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(32);
+	const __m128i sixtyFour = _mm_set1_epi16(64);
+
+	uint32_t e0Packed, e1Packed;
+	memcpy(&e0Packed, e0, sizeof(uint32_t));
+	memcpy(&e1Packed, e1, sizeof(uint32_t));
+
+	// Two copies of each endpoint, one per interpolated color
+	const __m128i a = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(e0Packed)), zero);
+	const __m128i b = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(e1Packed)), zero);
+
+	for (int i = 0; i < numWeights; i += 2) {
+		const __m128i w = _mm_set_epi16(
+			weights[i + 1], weights[i + 1], weights[i + 1], weights[i + 1],
+			weights[i], weights[i], weights[i], weights[i]
+		);
+		__m128i c = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(sixtyFour, w)), _mm_mullo_epi16(b, w));
+		c = _mm_srli_epi16(_mm_add_epi16(c, round), 6);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(palette + i), _mm_packus_epi16(c, zero));
+	}
+}
+
+static const uint16_t* getWeights(int indexBits) {
+	switch (indexBits) {
+	case 2:
+		return BC7_WEIGHTS_2;
+	case 3:
+		return BC7_WEIGHTS_3;
+	default:
+		return BC7_WEIGHTS_4;
+	}
+}
+
+static void writeBlock(const uint32_t pixels[16], uint8_t *rgba, SizeType pitch) {
+	for (int y = 0; y < 4; ++y) {
+		memcpy(rgba + y * pitch, pixels + y * 4, 4 * sizeof(uint32_t));
+	}
+}
+
+void decodeBC7Block(const uint8_t *block, uint8_t *rgba, SizeType pitch) {
+	uint32_t pixels[16];
+
+	int modeIdx = 0;
+	while (modeIdx < 8 && (block[0] & (1 << modeIdx)) == 0) {
+		++modeIdx;
+	}
+
+	if (modeIdx == 8) {
+		memset(pixels, 0, sizeof(pixels));
+		writeBlock(pixels, rgba, pitch);
+		return;
+	}
+
+	const BC7Mode &mode = BC7_MODES[modeIdx];
+	BitReader bits(block);
+	bits.read(modeIdx + 1);
+
+	const uint32_t partition = bits.read(mode.partitionBits);
+	const uint32_t rotation = bits.read(mode.rotationBits);
+	const uint32_t indexSelection = bits.read(mode.indexSelectionBits);
+
+	const int numEndpoints = mode.numSubsets * 2;
+	uint8_t endpoints[6][4] = {};
+	for (int c = 0; c < 3; ++c) {
+		for (int e = 0; e < numEndpoints; ++e) {
+			endpoints[e][c] = static_cast<uint8_t>(bits.read(mode.colorBits));
+		}
+	}
+
+	for (int e = 0; e < numEndpoints; ++e) {
+		endpoints[e][3] = static_cast<uint8_t>(mode.alphaBits ? bits.read(mode.alphaBits) : 255);
+	}
+
+	uint32_t pBits[6] = {};
+	if (mode.endpointPBits) {
+		for (int e = 0; e < numEndpoints; ++e) {
+			pBits[e] = bits.read(1);
+		}
+	} else if (mode.sharedPBits) {
+		for (int s = 0; s < mode.numSubsets; ++s) {
+			pBits[s * 2] = pBits[s * 2 + 1] = bits.read(1);
+		}
+	}
+
+	const bool hasPBits = mode.endpointPBits || mode.sharedPBits;
+	for (int e = 0; e < numEndpoints; ++e) {
+		for (int c = 0; c < 4; ++c) {
+			const int channelBits = c < 3 ? mode.colorBits : mode.alphaBits;
+			if (channelBits == 0) {
+				continue;
+			}
+
+			if (hasPBits) {
+				endpoints[e][c] = unquantize((endpoints[e][c] << 1) | pBits[e], channelBits + 1);
+			} else {
+				endpoints[e][c] = unquantize(endpoints[e][c], channelBits);
+			}
+		}
+	}
+
+	// Subset of each pixel and the anchors whose index has an implicit 0 high bit
+	uint32_t subsets = 0;
+	uint32_t anchorMask = 1;
+	if (mode.numSubsets == 2) {
+		const uint32_t p = BC7_PARTITIONS_2[partition];
+		for (int i = 0; i < 16; ++i) {
+			subsets |= ((p >> i) & 1) << (i * 2);
+		}
+		anchorMask |= 1 << BC7_ANCHORS_2[partition];
+	} else if (mode.numSubsets == 3) {
+		subsets = BC7_PARTITIONS_3[partition];
+		anchorMask |= 1 << BC7_ANCHORS_3_SECOND[partition];
+		anchorMask |= 1 << BC7_ANCHORS_3_THIRD[partition];
+	}
+
+	uint8_t indices[16];
+	for (int i = 0; i < 16; ++i) {
+		indices[i] = static_cast<uint8_t>(bits.read(mode.indexBits - ((anchorMask >> i) & 1)));
+	}
+
+	if (mode.secondaryIndexBits == 0) {
+		uint32_t palettes[3][16];
+		const uint16_t *weights = getWeights(mode.indexBits);
+		for (int s = 0; s < mode.numSubsets; ++s) {
+			interpolatePalette(endpoints[s * 2], endpoints[s * 2 + 1], weights, 1 << mode.indexBits, palettes[s]);
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			pixels[i] = palettes[(subsets >> (i * 2)) & 3][indices[i]];
+		}
+	} else {
+		// Modes 4 and 5 have separate indices for the color and the alpha.
+		uint8_t secondaryIndices[16];
+		for (int i = 0; i < 16; ++i) {
+			secondaryIndices[i] = static_cast<uint8_t>(bits.read(mode.secondaryIndexBits - (i == 0)));
+		}
+
+		int colorIndexBits = mode.indexBits;
+		int alphaIndexBits = mode.secondaryIndexBits;
+		const uint8_t *colorIndices = indices;
+		const uint8_t *alphaIndices = secondaryIndices;
+		if (indexSelection) {
+			std::swap(colorIndexBits, alphaIndexBits);
+			std::swap(colorIndices, alphaIndices);
+		}
+
+		uint32_t colorPalette[8];
+		uint32_t alphaPalette[8];
+		interpolatePalette(endpoints[0], endpoints[1], getWeights(colorIndexBits), 1 << colorIndexBits, colorPalette);
+		interpolatePalette(endpoints[0], endpoints[1], getWeights(alphaIndexBits), 1 << alphaIndexBits, alphaPalette);
+
+		for (int i = 0; i < 16; ++i) {
+			pixels[i] = (colorPalette[colorIndices[i]] & 0x00FFFFFF) | (alphaPalette[alphaIndices[i]] & 0xFF000000);
+		}
+
+		if (rotation != 0) {
+			// Swap the alpha with the rotated channel
+			const int shift = (rotation - 1) * 8;
+			for (int i = 0; i < 16; ++i) {
+				const uint32_t alpha = pixels[i] >> 24;
+				const uint32_t channel = (pixels[i] >> shift) & 0xFF;
+				pixels[i] &= ~((0xFFu << shift) | 0xFF000000u);
+				pixels[i] |= (alpha << shift) | (channel << 24);
+			}
+		}
+	}
+
+	writeBlock(pixels, rgba, pitch);
+}
+
+/// ==========================================================================
+/// BC1
+/// ==========================================================================
+
+static uint32_t unpack565(uint16_t c) {
+	const uint32_t r = unquantize((c >> 11) & 0x1F, 5);
+	const uint32_t g = unquantize((c >> 5) & 0x3F, 6);
+	const uint32_t b = unquantize(c & 0x1F, 5);
+	return r | (g << 8) | (b << 16) | 0xFF000000;
+}
+
+void decodeBC1Block(const uint8_t *block, uint8_t *rgba, SizeType pitch) {
+	uint16_t c0, c1;
+	uint32_t indices;
+	memcpy(&c0, block, sizeof(uint16_t));
+	memcpy(&c1, block + 2, sizeof(uint16_t));
+	memcpy(&indices, block + 4, sizeof(uint32_t));
+
+	uint32_t palette[4];
+	palette[0] = unpack565(c0);
+	palette[1] = unpack565(c1);
+
+	const uint8_t *p0 = reinterpret_cast<const uint8_t*>(&palette[0]);
+	const uint8_t *p1 = reinterpret_cast<const uint8_t*>(&palette[1]);
+	uint8_t *p2 = reinterpret_cast<uint8_t*>(&palette[2]);
+	uint8_t *p3 = reinterpret_cast<uint8_t*>(&palette[3]);
+	for (int c = 0; c < 3; ++c) {
+		if (c0 > c1) {
+			p2[c] = static_cast<uint8_t>((2 * p0[c] + p1[c] + 1) / 3);
+			p3[c] = static_cast<uint8_t>((p0[c] + 2 * p1[c] + 1) / 3);
+		} else {
+			p2[c] = static_cast<uint8_t>((p0[c] + p1[c] + 1) / 2);
+			p3[c] = 0;
+		}
+	}
+	p2[3] = 255;
+	p3[3] = c0 > c1 ? 255 : 0;
+
+	uint32_t pixels[16];
+	for (int i = 0; i < 16; ++i) {
+		pixels[i] = palette[(indices >> (i * 2)) & 3];
+	}
+
+	writeBlock(pixels, rgba, pitch);
+}
+
+/// ==========================================================================
+/// Surfaces
+/// ==========================================================================
+
+SizeType getBlockSize(BCFormat format) {
+	return format == BCFormat::BC1 ? 8 : 16;
+}
+
+SizeType getSurfaceSize(BCFormat format, int width, int height) {
+	const SizeType numBlocksX = (std::max(width, 1) + 3) / 4;
+	const SizeType numBlocksY = (std::max(height, 1) + 3) / 4;
+	return numBlocksX * numBlocksY * getBlockSize(format);
+}
+
+void decodeSurface(BCFormat format, const uint8_t *data, int width, int height, uint8_t *rgba) {
+	struct DecodeParams {
+		BCFormat format;
+		const uint8_t *data;
+		uint8_t *rgba;
+		int width;
+		int height;
+		SizeType numBlocksX;
+	} params = { format, data, rgba, width, height, SizeType(width + 3) / 4 };
+
+	const SizeType numBlocksY = SizeType(height + 3) / 4;
+
+	// Big enough ranges, so small mips are decoded inline
+	constexpr SizeType MIN_BLOCKS_PER_JOB = 4096;
+	const SizeType minRows = std::max(SizeType(1), MIN_BLOCKS_PER_JOB / std::max(params.numBlocksX, SizeType(1)));
+
+	JobSystem::parallelFor(
+		numBlocksY,
+		minRows,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<DecodeParams*>(param);
+			const SizeType blockSize = getBlockSize(p->format);
+			const SizeType pitch = SizeType(p->width) * 4;
+			auto decodeBlock = p->format == BCFormat::BC1 ? decodeBC1Block : decodeBC7Block;
+
+			uint8_t partial[4 * 4 * 4];
+			for (SizeType by = begin; by < end; ++by) {
+				const uint8_t *block = p->data + by * p->numBlocksX * blockSize;
+				const int y = static_cast<int>(by * 4);
+				const int rows = std::min(4, p->height - y);
+				for (SizeType bx = 0; bx < p->numBlocksX; ++bx, block += blockSize) {
+					const int x = static_cast<int>(bx * 4);
+					const int cols = std::min(4, p->width - x);
+					uint8_t *dst = p->rgba + y * pitch + x * 4;
+					if (rows == 4 && cols == 4) {
+						decodeBlock(block, dst, pitch);
+						continue;
+					}
+
+					// Blocks on the edge of surfaces with sizes not multiple of 4
+					decodeBlock(block, partial, 4 * 4);
+					for (int r = 0; r < rows; ++r) {
+						memcpy(dst + r * pitch, partial + r * 4 * 4, cols * 4);
+					}
+				}
+			}
+		},
+		&params
+	);
+}
+
+} // namespace BCn
+
+} // namespace Dar
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace BCn {
+
+enum class BCFormat {
+	BC1 = 0,
+	BC7,
+};
+
+/// Size in bytes of a 4x4 block of the given format.
+SizeType getBlockSize(BCFormat format);
+
+/// Size in bytes of a whole surface of the given format.
+SizeType getSurfaceSize(BCFormat format, int width, int height);
+
+/// Decode a single BC1 block into 4x4 RGBA8 pixels.
+/// @param rgba Destination of the top-left pixel of the block.
+/// @param pitch Distance in bytes between the rows of the destination.
+void decodeBC1Block(const uint8_t *block, uint8_t *rgba, SizeType pitch);
+
+/// Decode a single BC7 block into 4x4 RGBA8 pixels.
+/// Blocks with invalid mode are decoded as transparent black, the same way the GPU does it.
+/// @param rgba Destination of the top-left pixel of the block.
+/// @param pitch Distance in bytes between the rows of the destination.
+void decodeBC7Block(const uint8_t *block, uint8_t *rgba, SizeType pitch);
+
+/// Decode a whole BCn surface into tightly packed RGBA8 pixels.
+/// Rows of blocks are decoded in parallel on the job system.
+/// @note Big surfaces must be decoded from inside a job. See JobSystem::parallelFor.
+/// @param data Block data of the surface, f.e a single mip-level of a txlib image.
+/// @param rgba Output buffer of at least width * height * 4 bytes.
+void decodeSurface(BCFormat format, const uint8_t *data, int width, int height, uint8_t *rgba);
+
+} // namespace BCn
+
+} // namespace Dar
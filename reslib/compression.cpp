@@ -0,0 +1,187 @@
+#include "compression.h"
+
+namespace Dar {
+
+namespace Compression {
+
+constexpr SizeType MIN_MATCH = 4;
+constexpr SizeType LAST_LITERALS = 5; ///< The last bytes of a block are always literals.
+constexpr SizeType MF_LIMIT = 12; ///< A match can't start in the last MF_LIMIT bytes of a block.
+constexpr SizeType MAX_OFFSET = 65535;
+constexpr int HASH_LOG = 16;
+
+uint32_t read32(const uint8_t *p) {
+	uint32_t res;
+	memcpy(&res, p, sizeof(uint32_t));
+	return res;
+}
+
+uint32_t hash(uint32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - HASH_LOG);
+}
+
+uint8_t *writeLength(uint8_t *op, SizeType len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = static_cast<uint8_t>(len);
+
+	return op;
+}
+
+SizeType compressBound(SizeType srcSize) {
+	return srcSize + srcSize / 255 + 16;
+}
+
+SizeType compress(const uint8_t *src, SizeType srcSize, uint8_t *dst, SizeType dstCapacity) {
+	Vector<uint32_t> hashTable(SizeType(1) << HASH_LOG, 0);
+
+	uint8_t *op = dst;
+	uint8_t *const opEnd = dst + dstCapacity;
+
+	auto emitSequence = [&op, opEnd](const uint8_t *literals, SizeType numLiterals, SizeType offset, SizeType matchLen) -> bool {
+		// token + literal length + literals + offset + match length
+		const SizeType maxSize = 1 + numLiterals / 255 + 1 + numLiterals + 2 + matchLen / 255 + 1;
+		if (SizeType(opEnd - op) < maxSize) {
+			return false;
+		}
+
+		uint8_t *token = op++;
+		*token = static_cast<uint8_t>(std::min<SizeType>(numLiterals, 15) << 4);
+		if (numLiterals >= 15) {
+			op = writeLength(op, numLiterals - 15);
+		}
+
+		memcpy(op, literals, numLiterals);
+		op += numLiterals;
+
+		// The last sequence has only literals
+		if (matchLen == 0) {
+			return true;
+		}
+
+		*op++ = static_cast<uint8_t>(offset & 0xFF);
+		*op++ = static_cast<uint8_t>(offset >> 8);
+
+		const SizeType len = matchLen - MIN_MATCH;
+		*token |= static_cast<uint8_t>(std::min<SizeType>(len, 15));
+		if (len >= 15) {
+			op = writeLength(op, len - 15);
+		}
+
+		return true;
+	};
+
+	SizeType ip = 0;
+	SizeType anchor = 0;
+	if (srcSize > MF_LIMIT) {
+		const SizeType matchLimit = srcSize - LAST_LITERALS;
+		while (ip < srcSize - MF_LIMIT) {
+			const uint32_t sequence = read32(src + ip);
+			const uint32_t h = hash(sequence);
+			const SizeType ref = hashTable[h];
+			hashTable[h] = static_cast<uint32_t>(ip);
+
+			if (ref >= ip || ip - ref > MAX_OFFSET || read32(src + ref) != sequence) {
+				++ip;
+				continue;
+			}
+
+			SizeType matchLen = MIN_MATCH;
+			while (ip + matchLen < matchLimit && src[ref + matchLen] == src[ip + matchLen]) {
+				++matchLen;
+			}
+
+			if (!emitSequence(src + anchor, ip - anchor, ip - ref, matchLen)) {
+				return 0;
+			}
+
+			ip += matchLen;
+			anchor = ip;
+		}
+	}
+
+	if (!emitSequence(src + anchor, srcSize - anchor, 0, 0)) {
+		return 0;
+	}
+
+	return static_cast<SizeType>(op - dst);
+}
+
+bool decompress(const uint8_t *src, SizeType srcSize, uint8_t *dst, SizeType dstSize) {
+	SizeType ip = 0;
+	SizeType op = 0;
+
+	auto readLength = [src, srcSize, &ip](SizeType &len) -> bool {
+		uint8_t b;
+		do {
+			if (ip >= srcSize) {
+				return false;
+			}
+			b = src[ip++];
+			len += b;
+		} while (b == 255);
+
+		return true;
+	};
+
+	while (ip < srcSize) {
+		const uint8_t token = src[ip++];
+
+		SizeType numLiterals = token >> 4;
+		if (numLiterals == 15 && !readLength(numLiterals)) {
+			return false;
+		}
+
+		if (ip + numLiterals > srcSize || op + numLiterals > dstSize) {
+			return false;
+		}
+
+		memcpy(dst + op, src + ip, numLiterals);
+		ip += numLiterals;
+		op += numLiterals;
+
+		// Last sequence
+		if (ip == srcSize) {
+			break;
+		}
+
+		if (ip + 2 > srcSize) {
+			return false;
+		}
+
+		const SizeType offset = SizeType(src[ip]) | (SizeType(src[ip + 1]) << 8);
+		ip += 2;
+		if (offset == 0 || offset > op) {
+			return false;
+		}
+
+		SizeType matchLen = token & 15;
+		if (matchLen == 15 && !readLength(matchLen)) {
+			return false;
+		}
+		matchLen += MIN_MATCH;
+
+		if (op + matchLen > dstSize) {
+			return false;
+		}
+
+		const uint8_t *match = dst + op - offset;
+		if (offset >= matchLen) {
+			memcpy(dst + op, match, matchLen);
+		} else {
+			// Overlapping match, i.e repeated pattern
+			for (SizeType i = 0; i < matchLen; ++i) {
+				dst[op + i] = match[i];
+			}
+		}
+		op += matchLen;
+	}
+
+	return op == dstSize;
+}
+
+} // namespace Compression
+
+} // namespace Dar
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace Compression {
+
+/// Worst-case size of the compressed data for an input of srcSize bytes.
+SizeType compressBound(SizeType srcSize);
+
+/// Compress data using the LZ4 block format.
+/// BCn data is already compressed, so this is meant to be a fast to decode
+/// layer on top of it, not a replacement.
+/// @param dst Output buffer. Should be at least compressBound(srcSize) bytes.
+/// @return Size of the compressed data. 0 if it didn't fit in dst.
+SizeType compress(const uint8_t *src, SizeType srcSize, uint8_t *dst, SizeType dstCapacity);
+
+/// Decompress data compressed with compress().
+/// @param dstSize Exact size of the decompressed data.
+/// @return false if the compressed data is corrupted.
+bool decompress(const uint8_t *src, SizeType srcSize, uint8_t *dst, SizeType dstSize);
+
+} // namespace Compression
+
+} // namespace Dar
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+constexpr uint64_t HASH_SEED = 0xCBF29CE484222325ull;
+
+/// 64-bit FNV-1a hash of the given data.
+/// Pass the result of a previous call as the seed to hash multiple pieces of data together.
+inline uint64_t hashData(const void *data, SizeType size, uint64_t seed = HASH_SEED) {
+	constexpr uint64_t FNV_PRIME = 0x100000001B3ull;
+
+	auto bytes = reinterpret_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (SizeType i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+} // namespace Dar
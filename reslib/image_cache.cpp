@@ -0,0 +1,91 @@
+#include "image_cache.h"
+
+namespace Dar {
+
+void ImageCache::setBudget(SizeType bytes) {
+	auto lock = cs.lock();
+	budget = bytes;
+	evictUnsafe();
+}
+
+Optional<ImageData> ImageCache::get(const String &key, int firstMip) {
+	auto lock = cs.lock();
+
+	auto it = entries.find(key);
+	if (it == entries.end() || it->second.img.firstMip > firstMip) {
+		++misses;
+		return std::nullopt;
+	}
+
+	++hits;
+	lru.splice(lru.begin(), lru, it->second.lruIt);
+
+	// Callers rely on getting exactly the mips they asked for, f.e. when recreating a texture with less mips.
+	return it->second.img.getMipChain(firstMip);
+}
+
+void ImageCache::put(const String &key, const ImageData &img) {
+	if (img.data == nullptr) {
+		return;
+	}
+
+	const SizeType imgSize = img.header.getMipChainSize(img.firstMip);
+
+	auto lock = cs.lock();
+	if (auto it = entries.find(key); it != entries.end()) {
+		removeUnsafe(it);
+	}
+
+	if (imgSize > budget) {
+		return;
+	}
+
+	lru.push_front(key);
+	entries[key] = Entry{ img, imgSize, lru.begin() };
+	size += imgSize;
+
+	evictUnsafe();
+}
+
+void ImageCache::remove(const String &key) {
+	auto lock = cs.lock();
+	if (auto it = entries.find(key); it != entries.end()) {
+		removeUnsafe(it);
+	}
+}
+
+void ImageCache::clear() {
+	auto lock = cs.lock();
+	entries.clear();
+	lru.clear();
+	size = 0;
+}
+
+SizeType ImageCache::getSize() const {
+	auto lock = cs.lock();
+	return size;
+}
+
+SizeType ImageCache::getNumHits() const {
+	auto lock = cs.lock();
+	return hits;
+}
+
+SizeType ImageCache::getNumMisses() const {
+	auto lock = cs.lock();
+	return misses;
+}
+
+void ImageCache::removeUnsafe(Map<String, Entry>::iterator it) {
+	size -= it->second.size;
+	lru.erase(it->second.lruIt);
+	entries.erase(it);
+}
+
+void ImageCache::evictUnsafe() {
+	while (size > budget && !lru.empty()) {
+		removeUnsafe(entries.find(lru.back()));
+	}
+}
+
+} // namespace Dar
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "async/async.h"
+#include "img_data.h"
+
+namespace Dar {
+
+/// LRU cache of loaded image data with a byte budget.
+/// Image buffers are refcounted, so evicting an image only drops the reference
+/// held by the cache. Memory is freed when all users release it as well.
+class ImageCache {
+public:
+	/// Set the max bytes of image data held by the cache. Evicts images if needed.
+	void setBudget(SizeType bytes);
+
+	/// Find a cached image.
+	/// @param firstMip Most detailed mip-level needed. Images with more mips satisfy the request as well.
+	/// @return The mip chain of the cached image starting at `firstMip` or std::nullopt on a miss.
+	Optional<ImageData> get(const String &key, int firstMip = 0);
+
+	/// Add an image to the cache, replacing any image with the same key.
+	void put(const String &key, const ImageData &img);
+
+	/// Remove an image from the cache.
+	void remove(const String &key);
+
+	void clear();
+
+	SizeType getSize() const;
+	SizeType getNumHits() const;
+	SizeType getNumMisses() const;
+
+private:
+	struct Entry {
+		ImageData img;
+		SizeType size;
+		List<String>::iterator lruIt;
+	};
+
+	void removeUnsafe(Map<String, Entry>::iterator it);
+	void evictUnsafe();
+
+	Map<String, Entry> entries;
+	List<String> lru; ///< Most recently used keys are in the front.
+	SizeType budget = SizeType(256) * 1024 * 1024;
+	SizeType size = 0;
+	SizeType hits = 0;
+	SizeType misses = 0;
+	mutable SpinLock cs;
+};
+
+} // namespace Dar
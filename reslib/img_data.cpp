@@ -1,30 +1,165 @@
 #include "img_data.h"
 
+#include "compression.h"
+
+#include "async/async.h"
+#include "async/job_system.h"
+
+#include <bit>
 #include <fstream>
 
 namespace Dar {
 
+/// Pool of image buffers. Sizes are rounded up to one of 4 steps per power of two
+/// so buffers of similarly sized images could be reused, wasting at most 25% memory.
+struct ImageBufferPool {
+	static constexpr SizeType MIN_BUFFER_SIZE = 4 * 1024;
+	static constexpr SizeType MAX_POOLED_BYTES = 128 * 1024 * 1024;
+
+	~ImageBufferPool() {
+		trim();
+	}
+
+	ImageBuffer allocate(SizeType size) {
+		const SizeType bufferSize = roundSize(size);
+
+		uint8_t *ptr = nullptr;
+		{
+			auto lock = cs.lock();
+			if (auto it = freeBuffers.find(bufferSize); it != freeBuffers.end() && !it->second.empty()) {
+				ptr = it->second.back();
+				it->second.pop_back();
+				pooledBytes -= bufferSize;
+			}
+		}
+
+		if (ptr == nullptr) {
+			ptr = new uint8_t[bufferSize];
+		}
+
+		return ImageBuffer(ptr, [this, bufferSize](uint8_t *p) { release(p, bufferSize); });
+	}
+
+	void trim() {
+		auto lock = cs.lock();
+		for (auto &[size, buffers] : freeBuffers) {
+			for (auto ptr : buffers) {
+				delete[] ptr;
+			}
+		}
+
+		freeBuffers.clear();
+		pooledBytes = 0;
+	}
+
+private:
+	static SizeType roundSize(SizeType size) {
+		size = std::max(size, MIN_BUFFER_SIZE);
+
+		const SizeType highBit = std::bit_floor(size);
+		const SizeType step = highBit / 4;
+
+		return (size + step - 1) / step * step;
+	}
+
+	void release(uint8_t *ptr, SizeType bufferSize) {
+		{
+			auto lock = cs.lock();
+			if (pooledBytes + bufferSize <= MAX_POOLED_BYTES) {
+				freeBuffers[bufferSize].push_back(ptr);
+				pooledBytes += bufferSize;
+				return;
+			}
+		}
+
+		delete[] ptr;
+	}
+
+	Map<SizeType, Vector<uint8_t*>> freeBuffers;
+	SizeType pooledBytes = 0;
+	SpinLock cs;
+};
+
+static ImageBufferPool imageBufferPool;
+
+ImageBuffer allocateImageBuffer(SizeType size) {
+	return imageBufferPool.allocate(size);
+}
+
+void trimImageBufferPool() {
+	imageBufferPool.trim();
+}
+
 void ImageData::deinit() {
-	delete data;
 	data = nullptr;
 
 	header = {};
+	firstMip = 0;
+}
+
+ImageData ImageData::getMipChain(int mip) const {
+	mip = std::max(firstMip, std::min(mip, header.mipMapCount - 1));
+	if (mip == firstMip || data == nullptr) {
+		return *this;
+	}
+
+	ImageData chain{ .header = header, .firstMip = mip };
+	chain.data = ImageBuffer(data, data.get() + getMipOffset(mip));
+
+	return chain;
+}
+
+void ImageHeader::getStoredRange(int firstMip, SizeType &offset, SizeType &storedSize) const {
+	const SizeType chainSize = getMipChainSize(firstMip);
+	if (compression == ImageCompression::None || chunks.empty()) {
+		// Mips are stored from the most detailed to the coarsest one, so the chain is a suffix of the image data.
+		offset = size - chainSize;
+		storedSize = chainSize;
+		return;
+	}
+
+	// Chunks don't cross mip boundaries so the mip chain is a suffix of the chunks.
+	const SizeType dataStart = size - chainSize;
+	SizeType firstChunk = 0;
+	while (firstChunk + 1 < chunks.size() && chunks[firstChunk].dataOffset < dataStart) {
+		++firstChunk;
+	}
+
+	offset = chunks[firstChunk].storedOffset;
+	storedSize = getStoredSize() - offset;
 }
 
-bool ImageData::loadFromStream(std::ifstream& ifs, SizeType pos) {
-	auto size = header.size;
-	if (size == 0) {
+bool ImageData::loadFromStream(std::ifstream& ifs, SizeType pos, int mip) {
+	if (header.size == 0) {
 		LOG_FMT(Error, "Trying to load image %s with 0 size!", header.filename.c_str());
 		return false;
 	}
 
-	data = new uint8_t[size];
+	firstMip = std::max(0, std::min(mip, header.mipMapCount - 1));
+
+	SizeType storedOffset = 0;
+	SizeType storedSize = 0;
+	header.getStoredRange(firstMip, storedOffset, storedSize);
+	ifs.seekg(pos + storedOffset, std::ios::beg);
+
+	if (header.compression != ImageCompression::None) {
+		Vector<uint8_t> stored(storedSize);
+		ifs.read(reinterpret_cast<char*>(stored.data()), storedSize);
+		if (ifs.fail()) {
+			LOG_FMT(Error, "Failed to read compressed image %s!", header.filename.c_str());
+			return false;
+		}
+
+		return loadFromMemory(stored.data(), storedSize, firstMip);
+	}
+
+	auto size = storedSize;
+	data = allocateImageBuffer(size);
 
-	ifs.seekg(pos, std::ios::beg);
 	SizeType offset = 0;
 	while (size > 0 && !ifs.eof()) {
 		SizeType chunk = size > 4096 ? 4096 : size;
-		ifs.read(reinterpret_cast<char*>(data + offset), chunk);
+		ifs.read(reinterpret_cast<char*>(data.get() + offset), chunk);
 		size -= chunk;
 		offset += chunk;
 	}
@@ -32,4 +167,83 @@ bool ImageData::loadFromStream(std::ifstream& ifs, SizeType pos) {
 	return true;
 }
 
+bool ImageData::loadFromMemory(const uint8_t *stored, SizeType storedSize, int mip) {
+	if (header.size == 0) {
+		LOG_FMT(Error, "Trying to load image %s with 0 size!", header.filename.c_str());
+		return false;
+	}
+
+	firstMip = std::max(0, std::min(mip, header.mipMapCount - 1));
+
+	const SizeType size = header.getMipChainSize(firstMip);
+	data = allocateImageBuffer(size);
+
+	if (header.compression == ImageCompression::None) {
+		if (storedSize != size) {
+			LOG_FMT(Error, "Invalid stored data size for image %s!", header.filename.c_str());
+		} else {
+			memcpy(data.get(), stored, size);
+			return true;
+		}
+	} else if (decompress(stored, storedSize)) {
+		return true;
+	}
+
+	data = nullptr;
+
+	return false;
+}
+
+bool ImageData::decompress(const uint8_t *stored, SizeType storedSize) {
+	const SizeType dataStart = header.size - header.getMipChainSize(firstMip);
+
+	SizeType storedStart = 0;
+	SizeType expectedSize = 0;
+	header.getStoredRange(firstMip, storedStart, expectedSize);
+	if (storedSize != expectedSize) {
+		LOG_FMT(Error, "Invalid stored data size for compressed image %s!", header.filename.c_str());
+		return false;
+	}
+
+	SizeType firstChunk = 0;
+	while (header.chunks[firstChunk].storedOffset < storedStart) {
+		++firstChunk;
+	}
+
+	struct DecompressParams {
+		const ImageChunk *chunks;
+		const uint8_t *stored;
+		uint8_t *data;
+		SizeType storedStart;
+		SizeType dataStart;
+		Atomic<int> errors;
+	} params = { header.chunks.data() + firstChunk, stored, data.get(), storedStart, dataStart, 0 };
+
+	JobSystem::parallelFor(
+		header.chunks.size() - firstChunk,
+		1,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<DecompressParams*>(param);
+			for (SizeType i = begin; i < end; ++i) {
+				const ImageChunk &c = p->chunks[i];
+				const uint8_t *src = p->stored + (c.storedOffset - p->storedStart);
+				uint8_t *dst = p->data + (c.dataOffset - p->dataStart);
+				if (c.storedSize == c.size) {
+					memcpy(dst, src, c.size);
+				} else if (!Compression::decompress(src, c.storedSize, dst, c.size)) {
+					++p->errors;
+				}
+			}
+		},
+		&params
+	);
+
+	if (params.errors > 0) {
+		LOG_FMT(Error, "Corrupted data in compressed image %s!", header.filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
 } // namespace Dar
@@ -4,6 +4,21 @@
 
 namespace Dar {
 
+/// Compression applied on top of the BCn data when stored in a txlib.
+enum class ImageCompression : uint32_t {
+	None = 0,
+	LZ4,
+};
+
+/// Independently compressed chunk of image data. Chunks never cross mip boundaries,
+/// so any mip chain could be decompressed without touching the more detailed mips.
+struct ImageChunk {
+	SizeType storedOffset = 0; ///< Offset of the compressed chunk from the beginning of the stored image data.
+	SizeType dataOffset = 0; ///< Offset of the chunk in the decompressed image data.
+	uint32_t storedSize = 0; ///< Size of the compressed chunk. If equal to size the chunk is stored uncompressed.
+	uint32_t size = 0; ///< Size of the chunk after decompression.
+};
+
 struct ImageHeader {
 	Vector<SizeType> mipOffsets; ///< Offsets in data for each mip-level
 	String filename;
@@ -12,19 +27,84 @@ struct ImageHeader {
 	int height = 0;
 	int ncomp = 0;
 	int mipMapCount = 0;
+	ImageCompression compression = ImageCompression::None;
+	Vector<ImageChunk> chunks; ///< Chunks of the stored data. Empty if the image is not compressed.
+
+	/// Size in bytes of the image data as stored in the txlib.
+	SizeType getStoredSize() const {
+		if (compression == ImageCompression::None || chunks.empty()) {
+			return size;
+		}
+
+		return chunks.back().storedOffset + chunks.back().storedSize;
+	}
+
+	/// Range of the stored image data needed for loading the mip chain starting at mip-level `firstMip`.
+	/// @param offset Receives the offset of the range from the beginning of the stored image data.
+	/// @param storedSize Receives the size of the range.
+	void getStoredRange(int firstMip, SizeType &offset, SizeType &storedSize) const;
+
+	/// Size in bytes of the mip chain starting at mip-level `firstMip`.
+	SizeType getMipChainSize(int firstMip) const {
+		if (firstMip <= 0 || mipOffsets.empty()) {
+			return size;
+		}
+
+		return size - mipOffsets[std::min(firstMip, mipMapCount - 1)];
+	}
 };
 
+using ImageBuffer = SharedPtr<uint8_t[]>;
+
+/// Allocate a refcounted buffer for image data. When the last reference to it is released
+/// the memory is returned to a pool and reused by later allocations of similar size.
+ImageBuffer allocateImageBuffer(SizeType size);
+
+/// Free the unused memory kept in the image buffer pool.
+void trimImageBufferPool();
+
 // TODO: We could do any processing here:
 // loading/generating mips, BCn/other compression, etc.
 // Also store that metadata in the image header and write it to file in the serde module.
 // TODO: see Compressonator SDK
 struct ImageData {
 	ImageHeader header = {};
-	uint8_t *data = nullptr;
+	ImageBuffer data = nullptr; ///< Refcounted, so copies of the ImageData share the same buffer.
+	int firstMip = 0; ///< Most detailed mip-level present in data. Mips [firstMip, mipMapCount) are loaded.
 
+	/// Release this reference to the image data.
 	void deinit();
 
-	bool loadFromStream(std::ifstream& ifs, SizeType pos);
+	/// Get the mip chain starting at mip-level `mip` without copying it.
+	/// The result shares the buffer with this image, so the whole buffer is kept alive by it.
+	/// @param mip Most detailed mip-level of the result. Must be >= firstMip.
+	ImageData getMipChain(int mip) const;
+
+	/// Load the mip chain starting at `mip` from a txlib stream.
+	/// Compressed images are decompressed in parallel on the job system.
+	/// @note Must be called from inside a job if the image is compressed.
+	/// @param pos Position in the stream where the stored data of the image begins.
+	/// @param mip Most detailed mip-level to load. Coarser mips are always loaded with it.
+	bool loadFromStream(std::ifstream& ifs, SizeType pos, int mip = 0);
+
+	/// Load the mip chain starting at `mip` from its stored data in memory.
+	/// @note Must be called from inside a job if the image is compressed.
+	/// @param stored Stored data of the mip chain as given by ImageHeader::getStoredRange().
+	/// @param storedSize Size of the stored data.
+	/// @param mip Most detailed mip-level to load. Coarser mips are always loaded with it.
+	bool loadFromMemory(const uint8_t *stored, SizeType storedSize, int mip = 0);
+
+	/// @return Offset in data of the given mip-level. Only valid for mip >= firstMip.
+	SizeType getMipOffset(int mip) const {
+		if (header.mipOffsets.empty()) {
+			return 0;
+		}
+
+		return header.mipOffsets[mip] - header.mipOffsets[firstMip];
+	}
+
+private:
+	bool decompress(const uint8_t *stored, SizeType storedSize);
 };
 
 } // namespace Dar
@@ -0,0 +1,331 @@
+#include "mesh_optimizer.h"
+
+#include "dar/math/dar_math.h"
+
+#include <algorithm>
+
+namespace Dar {
+
+namespace MeshOptimizer {
+
+constexpr uint32_t INVALID_VERTEX = uint32_t(-1);
+
+/// Size of the LRU cache the Forsyth's scores are computed for.
+constexpr int FORSYTH_CACHE_SIZE = 32;
+
+/// Simulate a FIFO cache and call onTriangle(triangle, misses) for each triangle.
+template <typename Callback>
+static void simulateFifoCache(const uint32_t *indices, SizeType numIndices, SizeType numVertices, int cacheSize, Callback onTriangle) {
+	// Vertex is in the cache if it entered it less than cacheSize misses ago.
+	Vector<uint32_t> timestamps(numVertices, 0);
+	uint32_t time = cacheSize + 1;
+
+	for (SizeType i = 0; i + 2 < numIndices; i += 3) {
+		int misses = 0;
+		for (int j = 0; j < 3; ++j) {
+			const uint32_t v = indices[i + j];
+			if (time - timestamps[v] > uint32_t(cacheSize)) {
+				timestamps[v] = time++;
+				++misses;
+			}
+		}
+
+		onTriangle(i / 3, misses);
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, SizeType numIndices, SizeType numVertices, int cacheSize) {
+	VertexCacheStats stats;
+	const SizeType numTriangles = numIndices / 3;
+	if (numTriangles == 0) {
+		return stats;
+	}
+
+	SizeType misses = 0;
+	simulateFifoCache(indices, numIndices, numVertices, cacheSize, [&misses](SizeType, int triangleMisses) {
+		misses += triangleMisses;
+	});
+
+	Vector<bool> referenced(numVertices, false);
+	SizeType numReferenced = 0;
+	for (SizeType i = 0; i < numIndices; ++i) {
+		if (!referenced[indices[i]]) {
+			referenced[indices[i]] = true;
+			++numReferenced;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / numTriangles;
+	stats.atvr = static_cast<float>(misses) / numReferenced;
+
+	return stats;
+}
+
+static float getVertexScore(int cachePosition, uint32_t liveTriangles) {
+	if (liveTriangles == 0) {
+		return -1.f;
+	}
+
+	float score = 0.f;
+	if (cachePosition >= 0) {
+		// The last triangle's vertices get a fixed score, so its vertices aren't preferred over ones a bit further in the cache.
+		if (cachePosition < 3) {
+			score = 0.75f;
+		} else {
+			score = powf(1.f - float(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+		}
+	}
+
+	// Prefer vertices with few triangles left, so they leave the working set sooner.
+	score += 2.f / sqrtf(float(liveTriangles));
+
+	return score;
+}
+
+void optimizeVertexCache(uint32_t *indices, SizeType numIndices, SizeType numVertices) {
+	const SizeType numTriangles = numIndices / 3;
+	if (numTriangles <= 1) {
+		return;
+	}
+
+	// Triangles using each vertex. The live ones are at the beginning of each vertex's range.
+	Vector<uint32_t> liveTriangles(numVertices, 0);
+	for (SizeType i = 0; i < numTriangles * 3; ++i) {
+		++liveTriangles[indices[i]];
+	}
+
+	Vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+	for (SizeType v = 0; v < numVertices; ++v) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	Vector<uint32_t> adjacency(numTriangles * 3);
+	Vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (SizeType i = 0; i < numTriangles * 3; ++i) {
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	Vector<int> cachePositions(numVertices, -1);
+	Vector<float> vertexScores(numVertices);
+	for (SizeType v = 0; v < numVertices; ++v) {
+		vertexScores[v] = getVertexScore(-1, liveTriangles[v]);
+	}
+
+	auto getTriangleScore = [&](SizeType t) {
+		return vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	};
+
+	Vector<float> triangleScores(numTriangles);
+	Vector<bool> emitted(numTriangles, false);
+	SizeType best = 0;
+	for (SizeType t = 0; t < numTriangles; ++t) {
+		triangleScores[t] = getTriangleScore(t);
+		if (triangleScores[t] > triangleScores[best]) {
+			best = t;
+		}
+	}
+
+	Vector<uint32_t> result;
+	result.reserve(numTriangles * 3);
+
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	SizeType nextUnemitted = 0; ///< Used when no triangle of the vertices in the cache is left.
+
+	while (best != SizeType(-1)) {
+		emitted[best] = true;
+		const uint32_t *tri = indices + best * 3;
+		result.insert(result.end(), tri, tri + 3);
+
+		// Remove the triangle from the live triangles of its vertices
+		for (int i = 0; i < 3; ++i) {
+			const uint32_t v = tri[i];
+			uint32_t *triangles = adjacency.data() + adjacencyOffsets[v];
+			for (uint32_t j = 0; j < liveTriangles[v]; ++j) {
+				if (triangles[j] == best) {
+					std::swap(triangles[j], triangles[liveTriangles[v] - 1]);
+					--liveTriangles[v];
+					break;
+				}
+			}
+		}
+
+		// Move the triangle's vertices to the front of the cache
+		uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int i = 0; i < 3; ++i) {
+			if (std::find(newCache, newCache + newCount, tri[i]) == newCache + newCount) {
+				newCache[newCount++] = tri[i];
+			}
+		}
+
+		for (int i = 0; i < cacheCount; ++i) {
+			if (std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount) {
+				newCache[newCount++] = cache[i];
+			}
+		}
+
+		// Vertices pushed out of the cache are rescored as well
+		for (int i = 0; i < newCount; ++i) {
+			const uint32_t v = newCache[i];
+			cachePositions[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+			vertexScores[v] = getVertexScore(cachePositions[v], liveTriangles[v]);
+		}
+
+		cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheCount, cache);
+
+		// Only triangles of the vertices in the cache changed their score
+		best = SizeType(-1);
+		float bestScore = -1.f;
+		for (int i = 0; i < newCount; ++i) {
+			const uint32_t v = newCache[i];
+			const uint32_t *triangles = adjacency.data() + adjacencyOffsets[v];
+			for (uint32_t j = 0; j < liveTriangles[v]; ++j) {
+				const uint32_t t = triangles[j];
+				triangleScores[t] = getTriangleScore(t);
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					best = t;
+				}
+			}
+		}
+
+		if (best == SizeType(-1)) {
+			while (nextUnemitted < numTriangles && emitted[nextUnemitted]) {
+				++nextUnemitted;
+			}
+
+			if (nextUnemitted < numTriangles) {
+				best = nextUnemitted;
+			}
+		}
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, SizeType numIndices, const void *positions, SizeType numVertices, SizeType stride, float threshold) {
+	const SizeType numTriangles = numIndices / 3;
+	if (numTriangles <= 1) {
+		return;
+	}
+
+	auto getPosition = [positions, stride](uint32_t v) {
+		const float *p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + v * stride);
+		return Vec3{ p[0], p[1], p[2] };
+	};
+
+	// A cluster begins where all vertices of a triangle miss the cache, so reordering
+	// the clusters doesn't change the misses much.
+	Vector<SizeType> clusterStarts;
+	simulateFifoCache(indices, numTriangles * 3, numVertices, VERTEX_CACHE_SIZE, [&clusterStarts](SizeType triangle, int misses) {
+		if (triangle == 0 || misses == 3) {
+			clusterStarts.push_back(triangle);
+		}
+	});
+
+	const SizeType numClusters = clusterStarts.size();
+	if (numClusters <= 1) {
+		return;
+	}
+
+	clusterStarts.push_back(numTriangles);
+
+	// Area weighted centroid and normal of each cluster
+	Vector<Vec3> clusterCentroids(numClusters, Vec3(0.f));
+	Vector<Vec3> clusterNormals(numClusters, Vec3(0.f));
+	Vec3 meshCentroid = Vec3(0.f);
+	float meshArea = 0.f;
+	for (SizeType c = 0; c < numClusters; ++c) {
+		float clusterArea = 0.f;
+		for (SizeType t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+			const Vec3 p0 = getPosition(indices[t * 3 + 0]);
+			const Vec3 p1 = getPosition(indices[t * 3 + 1]);
+			const Vec3 p2 = getPosition(indices[t * 3 + 2]);
+
+			const Vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float area = glm::length(normal);
+			const Vec3 centroid = (p0 + p1 + p2) / 3.f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += clusterCentroids[c];
+		meshArea += clusterArea;
+
+		if (clusterArea > 0.f) {
+			clusterCentroids[c] /= clusterArea;
+		}
+
+		const float normalLength = glm::length(clusterNormals[c]);
+		if (normalLength > 0.f) {
+			clusterNormals[c] /= normalLength;
+		}
+	}
+
+	if (meshArea > 0.f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters facing away from the center of the mesh are likely in front of the others
+	Vector<float> sortKeys(numClusters);
+	Vector<SizeType> order(numClusters);
+	for (SizeType c = 0; c < numClusters; ++c) {
+		sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+		order[c] = c;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](SizeType a, SizeType b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	Vector<uint32_t> result;
+	result.reserve(numTriangles * 3);
+	for (SizeType c : order) {
+		result.insert(result.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+	}
+
+	const float oldACMR = analyzeVertexCache(indices, numTriangles * 3, numVertices).acmr;
+	const float newACMR = analyzeVertexCache(result.data(), result.size(), numVertices).acmr;
+	if (newACMR <= oldACMR * threshold) {
+		std::copy(result.begin(), result.end(), indices);
+	}
+}
+
+void optimizeVertexFetch(void *vertices, SizeType numVertices, SizeType vertexSize, uint32_t *indices, SizeType numIndices) {
+	if (numVertices == 0) {
+		return;
+	}
+
+	Vector<uint32_t> remap(numVertices, INVALID_VERTEX);
+	uint32_t nextVertex = 0;
+	for (SizeType i = 0; i < numIndices; ++i) {
+		uint32_t &v = remap[indices[i]];
+		if (v == INVALID_VERTEX) {
+			v = nextVertex++;
+		}
+
+		indices[i] = v;
+	}
+
+	for (SizeType v = 0; v < numVertices; ++v) {
+		if (remap[v] == INVALID_VERTEX) {
+			remap[v] = nextVertex++;
+		}
+	}
+
+	uint8_t *data = reinterpret_cast<uint8_t*>(vertices);
+	Vector<uint8_t> reordered(numVertices * vertexSize);
+	for (SizeType v = 0; v < numVertices; ++v) {
+		memcpy(reordered.data() + remap[v] * vertexSize, data + v * vertexSize, vertexSize);
+	}
+
+	memcpy(data, reordered.data(), reordered.size());
+}
+
+} // namespace MeshOptimizer
+
+} // namespace Dar
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace MeshOptimizer {
+
+/// Size of the FIFO cache used for analyzing the meshes. Close to the post-transform cache of current GPUs.
+constexpr int VERTEX_CACHE_SIZE = 16;
+
+/// Default max ratio between the ACMR of the overdraw optimized and the vertex cache optimized index buffer.
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+struct VertexCacheStats {
+	float acmr = 0.f; ///< Average cache miss ratio - transformed vertices per triangle. 0.5 in the best case, 3 in the worst.
+	float atvr = 0.f; ///< Average transformed vertex ratio - transformed vertices per referenced vertex. 1 in the best case.
+};
+
+/// Simulate a FIFO post-transform vertex cache for the given triangle list.
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, SizeType numIndices, SizeType numVertices, int cacheSize = VERTEX_CACHE_SIZE);
+
+/// Reorder the triangles for better post-transform vertex cache utilization. Tom Forsyth's
+/// linear-speed vertex cache optimization is used, so it doesn't depend on the exact cache size of the GPU.
+/// @param indices Triangle list, reordered in place.
+void optimizeVertexCache(uint32_t *indices, SizeType numIndices, SizeType numVertices);
+
+/// Reorder clusters of triangles so the ones facing outwards of the mesh are drawn first and occlude the rest.
+/// Clusters are the runs of triangles between vertex cache flushes, so the vertex cache efficiency is mostly kept.
+/// Should be called after optimizeVertexCache().
+/// @param indices Triangle list, reordered in place.
+/// @param positions Pointer to the position(3 floats) of the first vertex.
+/// @param stride Distance between the positions of two vertices in bytes.
+/// @param threshold The new order is kept only if its ACMR is at most threshold times the old one.
+void optimizeOverdraw(uint32_t *indices, SizeType numIndices, const void *positions, SizeType numVertices, SizeType stride, float threshold = OVERDRAW_THRESHOLD);
+
+/// Reorder the vertices in the order they are first used by the triangles, so vertex fetching
+/// reads memory mostly linearly. Vertices which are not referenced are moved to the end.
+/// Should be called after the triangles are reordered.
+/// @param vertices Vertices, reordered in place.
+/// @param vertexSize Size of a single vertex in bytes.
+/// @param indices Triangle list, remapped in place.
+void optimizeVertexFetch(void *vertices, SizeType numVertices, SizeType vertexSize, uint32_t *indices, SizeType numIndices);
+
+} // namespace MeshOptimizer
+
+} // namespace Dar
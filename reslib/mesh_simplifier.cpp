@@ -0,0 +1,379 @@
+#include "mesh_simplifier.h"
+
+#include "dar/math/dar_math.h"
+
+#include <algorithm>
+
+namespace Dar {
+
+namespace MeshSimplifier {
+
+/// Collapses are rejected if they rotate the normal of a triangle by more than acos(MIN_NORMAL_DOT).
+constexpr float MIN_NORMAL_DOT = 0.25f;
+
+/// Symmetric 4x4 matrix of the squared distance to a set of planes, weighted by the area of their triangles.
+struct Quadric {
+	double a00 = 0., a01 = 0., a02 = 0., a11 = 0., a12 = 0., a22 = 0.;
+	double b0 = 0., b1 = 0., b2 = 0.;
+	double c = 0.;
+	double weight = 0.;
+
+	static Quadric fromPlane(const Vec3 &n, float d, float weight) {
+		Quadric q;
+		q.a00 = double(n.x) * n.x * weight;
+		q.a01 = double(n.x) * n.y * weight;
+		q.a02 = double(n.x) * n.z * weight;
+		q.a11 = double(n.y) * n.y * weight;
+		q.a12 = double(n.y) * n.z * weight;
+		q.a22 = double(n.z) * n.z * weight;
+		q.b0 = double(n.x) * d * weight;
+		q.b1 = double(n.y) * d * weight;
+		q.b2 = double(n.z) * d * weight;
+		q.c = double(d) * d * weight;
+		q.weight = weight;
+		return q;
+	}
+
+	void add(const Quadric &q) {
+		a00 += q.a00; a01 += q.a01; a02 += q.a02;
+		a11 += q.a11; a12 += q.a12; a22 += q.a22;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		weight += q.weight;
+	}
+
+	/// @return Root of the average squared distance of p to the planes. Used for ordering the collapses.
+	float getError(const Vec3 &p) const {
+		if (weight <= 0.) {
+			return 0.f;
+		}
+
+		const double x = p.x, y = p.y, z = p.z;
+		const double error =
+			a00 * x * x + a11 * y * y + a22 * z * z +
+			2. * (a01 * x * y + a02 * x * z + a12 * y * z) +
+			2. * (b0 * x + b1 * y + b2 * z) +
+			c;
+
+		return float(sqrt(std::max(error / weight, 0.)));
+	}
+};
+
+/// Collapse of the vertex from into the vertex to.
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	float error;
+};
+
+static Vec3 getPosition(const void *positions, SizeType stride, uint32_t v) {
+	const float *p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + v * stride);
+	return Vec3{ p[0], p[1], p[2] };
+}
+
+/// Mark the vertices which should not move - the ones on attribute seams and on the borders of the mesh.
+static void findLockedVertices(const uint32_t *indices, SizeType numIndices, const Vector<Vec3> &points, Vector<bool> &locked) {
+	const SizeType numVertices = points.size();
+
+	// Vertices with equal positions are grouped under the first of them.
+	Vector<uint32_t> sorted(numVertices);
+	for (SizeType i = 0; i < numVertices; ++i) {
+		sorted[i] = static_cast<uint32_t>(i);
+	}
+	auto lessPosition = [&points](uint32_t a, uint32_t b) {
+		const Vec3 &pa = points[a];
+		const Vec3 &pb = points[b];
+		return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : (pa.z != pb.z ? pa.z < pb.z : a < b));
+	};
+	std::sort(sorted.begin(), sorted.end(), lessPosition);
+
+	Vector<uint32_t> group(numVertices);
+	for (SizeType i = 0; i < numVertices;) {
+		SizeType j = i + 1;
+		while (j < numVertices && points[sorted[j]] == points[sorted[i]]) {
+			++j;
+		}
+
+		for (SizeType k = i; k < j; ++k) {
+			group[sorted[k]] = sorted[i];
+			locked[sorted[k]] = j - i > 1;
+		}
+		i = j;
+	}
+
+	// Edges are compared by position, so edges along seams are not borders.
+	Set<uint64_t> edges;
+	auto edgeKey = [](uint32_t a, uint32_t b) {
+		return (uint64_t(a) << 32) | b;
+	};
+	for (SizeType i = 0; i + 2 < numIndices; i += 3) {
+		for (int j = 0; j < 3; ++j) {
+			edges.insert(edgeKey(group[indices[i + j]], group[indices[i + (j + 1) % 3]]));
+		}
+	}
+
+	for (SizeType i = 0; i + 2 < numIndices; i += 3) {
+		for (int j = 0; j < 3; ++j) {
+			const uint32_t a = indices[i + j];
+			const uint32_t b = indices[i + (j + 1) % 3];
+			if (edges.find(edgeKey(group[b], group[a])) == edges.end()) {
+				locked[a] = locked[b] = true;
+			}
+		}
+	}
+}
+
+/// Get the vertices sharing a triangle with v, in increasing order.
+static void getNeighbours(uint32_t v, const uint32_t *indices, const Vector<uint32_t> &adjacencyOffsets, const Vector<uint32_t> &adjacency, Vector<uint32_t> &neighbours) {
+	neighbours.clear();
+	for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+		const uint32_t *triangle = indices + adjacency[a] * 3;
+		for (int j = 0; j < 3; ++j) {
+			if (triangle[j] != v) {
+				neighbours.push_back(triangle[j]);
+			}
+		}
+	}
+
+	std::sort(neighbours.begin(), neighbours.end());
+	neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
+
+/// @return true if replacing the vertex from with the vertex to keeps the topology of the mesh
+///         and the orientation of the triangles around it.
+/// @param fromNeighbours, toNeighbours Scratch memory.
+static bool isCollapseValid(
+	const Collapse &collapse,
+	const uint32_t *indices,
+	const Vector<uint32_t> &adjacencyOffsets,
+	const Vector<uint32_t> &adjacency,
+	const Vector<Vec3> &points,
+	Vector<uint32_t> &fromNeighbours,
+	Vector<uint32_t> &toNeighbours
+) {
+	// Link condition. An edge inside a manifold has 2 vertices opposite to it. More common neighbours mean
+	// the collapse would pinch the surface, creating non-manifold edges or fold-overs.
+	getNeighbours(collapse.from, indices, adjacencyOffsets, adjacency, fromNeighbours);
+	getNeighbours(collapse.to, indices, adjacencyOffsets, adjacency, toNeighbours);
+
+	int numCommonNeighbours = 0;
+	for (SizeType i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();) {
+		if (fromNeighbours[i] < toNeighbours[j]) {
+			++i;
+		} else if (fromNeighbours[i] > toNeighbours[j]) {
+			++j;
+		} else {
+			++numCommonNeighbours;
+			++i;
+			++j;
+		}
+	}
+
+	if (numCommonNeighbours > 2) {
+		return false;
+	}
+
+	for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a) {
+		const uint32_t *triangle = indices + adjacency[a] * 3;
+		if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+			// Becomes degenerate and is removed
+			continue;
+		}
+
+		Vec3 p[3], q[3];
+		for (int j = 0; j < 3; ++j) {
+			p[j] = points[triangle[j]];
+			q[j] = triangle[j] == collapse.from ? points[collapse.to] : p[j];
+		}
+
+		const Vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+		const Vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+		if (glm::dot(n0, n1) < MIN_NORMAL_DOT * glm::length(n0) * glm::length(n1)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+SizeType simplify(
+	uint32_t *destination,
+	const uint32_t *indices,
+	SizeType numIndices,
+	const void *positions,
+	SizeType numVertices,
+	SizeType stride,
+	SizeType targetNumIndices,
+	float targetError,
+	float *resultError
+) {
+	numIndices -= numIndices % 3;
+	if (destination != indices) {
+		memcpy(destination, indices, numIndices * sizeof(uint32_t));
+	}
+
+	float error = 0.f;
+	if (numIndices <= targetNumIndices || numVertices == 0) {
+		if (resultError) {
+			*resultError = error;
+		}
+		return numIndices;
+	}
+
+	Vector<Vec3> points(numVertices);
+	for (SizeType i = 0; i < numVertices; ++i) {
+		points[i] = getPosition(positions, stride, static_cast<uint32_t>(i));
+	}
+
+	Vector<bool> locked(numVertices, false);
+	findLockedVertices(destination, numIndices, points, locked);
+
+	// The quadrics only order the collapses. The error of the result is bounded by the distance of each vertex to the planes
+	// of the original triangles around it and around all vertices collapsed into it, so each vertex keeps a list of them.
+	Vector<Quadric> quadrics(numVertices);
+	Vector<Vec4> planes;
+	Vector<Vector<uint32_t>> vertexPlanes(numVertices);
+	Vector<float> vertexErrors(numVertices, 0.f);
+	for (SizeType i = 0; i < numIndices; i += 3) {
+		const Vec3 &p0 = points[destination[i + 0]];
+		const Vec3 &p1 = points[destination[i + 1]];
+		const Vec3 &p2 = points[destination[i + 2]];
+
+		const Vec3 n = glm::cross(p1 - p0, p2 - p0);
+		const float length = glm::length(n);
+		if (length <= std::numeric_limits<float>::min()) {
+			continue;
+		}
+
+		const Vec3 normal = n / length;
+		const Quadric q = Quadric::fromPlane(normal, -glm::dot(normal, p0), length * 0.5f);
+		for (int j = 0; j < 3; ++j) {
+			quadrics[destination[i + j]].add(q);
+			vertexPlanes[destination[i + j]].push_back(static_cast<uint32_t>(planes.size()));
+		}
+		planes.push_back(Vec4{ normal, -glm::dot(normal, p0) });
+	}
+
+	// Error of a collapse - the max distance of the kept vertex to the planes collected by both vertices.
+	auto getCollapseError = [&](const Collapse &collapse) {
+		const Vec3 &p = points[collapse.to];
+		float maxDistance = vertexErrors[collapse.to];
+		for (uint32_t plane : vertexPlanes[collapse.from]) {
+			maxDistance = std::max(maxDistance, glm::abs(glm::dot(Vec3(planes[plane]), p) + planes[plane].w));
+		}
+		return maxDistance;
+	};
+
+	Vector<uint32_t> adjacencyOffsets(numVertices + 1);
+	Vector<uint32_t> adjacency;
+	Vector<Collapse> collapses;
+	Vector<uint32_t> remap(numVertices);
+	Vector<bool> touched(numVertices);
+	Vector<uint32_t> fromNeighbours, toNeighbours;
+
+	// Each pass collapses the cheapest edges not touching each other, then the triangles are rebuilt.
+	while (numIndices > targetNumIndices) {
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (SizeType i = 0; i < numIndices; ++i) {
+			++adjacencyOffsets[destination[i] + 1];
+		}
+		for (SizeType v = 0; v < numVertices; ++v) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+
+		adjacency.resize(numIndices);
+		Vector<uint32_t> adjacencyEnds(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (SizeType i = 0; i < numIndices; ++i) {
+			adjacency[adjacencyEnds[destination[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		collapses.clear();
+		for (SizeType i = 0; i < numIndices; i += 3) {
+			for (int j = 0; j < 3; ++j) {
+				const uint32_t a = destination[i + j];
+				const uint32_t b = destination[i + (j + 1) % 3];
+				if (!locked[a]) {
+					collapses.push_back(Collapse{ a, b, quadrics[a].getError(points[b]) });
+				}
+				if (!locked[b]) {
+					collapses.push_back(Collapse{ b, a, quadrics[b].getError(points[a]) });
+				}
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+			return a.error < b.error;
+		});
+
+		for (SizeType v = 0; v < numVertices; ++v) {
+			remap[v] = static_cast<uint32_t>(v);
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		// Each collapse removes about 2 triangles, stop before going far below the target.
+		SizeType expectedNumIndices = numIndices;
+		SizeType numCollapses = 0;
+		for (const Collapse &collapse : collapses) {
+			// The quadric error is the root of an average of squared distances, so it never exceeds the max distance.
+			if (collapse.error > targetError || expectedNumIndices <= targetNumIndices) {
+				break;
+			}
+
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			if (!isCollapseValid(collapse, destination, adjacencyOffsets, adjacency, points, fromNeighbours, toNeighbours)) {
+				continue;
+			}
+
+			const float collapseError = getCollapseError(collapse);
+			if (collapseError > targetError) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			vertexErrors[collapse.to] = collapseError;
+			vertexPlanes[collapse.to].insert(vertexPlanes[collapse.to].end(), vertexPlanes[collapse.from].begin(), vertexPlanes[collapse.from].end());
+			vertexPlanes[collapse.from] = {};
+
+			// Triangles around the collapsed vertex have changed, so their vertices wait for the next pass.
+			for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a) {
+				const uint32_t *triangle = destination + adjacency[a] * 3;
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+
+			error = std::max(error, collapseError);
+			expectedNumIndices -= std::min(expectedNumIndices, SizeType(6));
+			++numCollapses;
+		}
+
+		if (numCollapses == 0) {
+			break;
+		}
+
+		SizeType writeIndex = 0;
+		for (SizeType i = 0; i < numIndices; i += 3) {
+			const uint32_t a = remap[destination[i + 0]];
+			const uint32_t b = remap[destination[i + 1]];
+			const uint32_t c = remap[destination[i + 2]];
+			if (a != b && b != c && a != c) {
+				destination[writeIndex++] = a;
+				destination[writeIndex++] = b;
+				destination[writeIndex++] = c;
+			}
+		}
+		numIndices = writeIndex;
+	}
+
+	if (resultError) {
+		*resultError = error;
+	}
+
+	return numIndices;
+}
+
+} // namespace MeshSimplifier
+
+} // namespace Dar
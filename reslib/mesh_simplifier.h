@@ -0,0 +1,37 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace MeshSimplifier {
+
+/// Simplify a triangle list by collapsing the edges with the smallest quadric error(Garland-Heckbert) first.
+/// Edges are collapsed into one of their vertices, so no new vertices are created and the vertex buffer is shared with the input.
+/// Vertices sharing their position with other vertices are attribute seams(UV seams, hard normals), so they are never moved.
+/// Vertices on the borders of the mesh are never moved either. Collapses flipping or overly rotating triangles are rejected,
+/// as well as the ones failing the link condition, since they would make the mesh non-manifold.
+/// @param destination Receives the simplified triangle list. Should have space for numIndices indices. Can be the same as indices.
+/// @param indices Triangle list.
+/// @param positions Pointer to the position(3 floats) of the first vertex.
+/// @param stride Distance between the positions of two vertices in bytes.
+/// @param targetNumIndices Simplification stops when the mesh has at most this many indices.
+/// @param targetError Collapses with bigger error are not done. Distance in the units of the positions.
+/// @param resultError Optional. Receives the error of the simplified mesh - the max distance of its vertices to the planes
+///                    of the original triangles around the vertices collapsed into them, in the units of the positions.
+/// @return Number of indices written to destination.
+SizeType simplify(
+	uint32_t *destination,
+	const uint32_t *indices,
+	SizeType numIndices,
+	const void *positions,
+	SizeType numVertices,
+	SizeType stride,
+	SizeType targetNumIndices,
+	float targetError,
+	float *resultError = nullptr
+);
+
+} // namespace MeshSimplifier
+
+} // namespace Dar
@@ -0,0 +1,364 @@
+#include "meshlets.h"
+
+#include <algorithm>
+#include <array>
+
+namespace Dar {
+
+namespace Meshlets {
+
+using ScnLib::MAX_MESHLET_VERTICES;
+using ScnLib::MAX_MESHLET_TRIANGLES;
+
+constexpr uint32_t INVALID_TRIANGLE = uint32_t(-1);
+constexpr uint8_t INVALID_LOCAL_INDEX = 0xff;
+static_assert(MAX_MESHLET_VERTICES < INVALID_LOCAL_INDEX);
+
+/// Cones which normals are spread out more than acos(MIN_CONE_DOT) around the axis can't cull anything useful.
+constexpr float MIN_CONE_DOT = 0.1f;
+
+static Vec3 getPosition(const void *positions, SizeType stride, uint32_t v) {
+	const float *p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + v * stride);
+	return Vec3{ p[0], p[1], p[2] };
+}
+
+/// Normal of the front face(clockwise winding in the left-handed space of the scene).
+/// @return false for degenerate triangles.
+static bool getTriangleNormal(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2, Vec3 &normal) {
+	const Vec3 n = glm::cross(p1 - p0, p2 - p0);
+	const float length = glm::length(n);
+	if (length <= std::numeric_limits<float>::min()) {
+		return false;
+	}
+
+	normal = n / length;
+	return true;
+}
+
+void computeMeshletBounds(Meshlet &meshlet, const MeshletData &data, const void *positions, SizeType stride) {
+	const uint32_t *vertices = data.vertices.data() + meshlet.vertexOffset;
+	const uint8_t *triangles = data.triangles.data() + meshlet.triangleOffset;
+
+	Vec3 boxMin(std::numeric_limits<float>::max());
+	Vec3 boxMax(std::numeric_limits<float>::lowest());
+	for (uint32_t i = 0; i < meshlet.numVertices; ++i) {
+		const Vec3 p = getPosition(positions, stride, vertices[i]);
+		boxMin = glm::min(boxMin, p);
+		boxMax = glm::max(boxMax, p);
+	}
+
+	meshlet.center = (boxMin + boxMax) * 0.5f;
+	meshlet.radius = 0.f;
+	for (uint32_t i = 0; i < meshlet.numVertices; ++i) {
+		meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, getPosition(positions, stride, vertices[i])));
+	}
+
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneAxis = Vec3(0.f);
+	meshlet.coneCutoff = 1.f;
+
+	Vec3 normals[MAX_MESHLET_TRIANGLES];
+	Vec3 corners[MAX_MESHLET_TRIANGLES];
+	uint32_t numNormals = 0;
+	Vec3 axis(0.f);
+	for (uint32_t t = 0; t < meshlet.numTriangles; ++t) {
+		const Vec3 p0 = getPosition(positions, stride, vertices[triangles[t * 3 + 0]]);
+		const Vec3 p1 = getPosition(positions, stride, vertices[triangles[t * 3 + 1]]);
+		const Vec3 p2 = getPosition(positions, stride, vertices[triangles[t * 3 + 2]]);
+
+		Vec3 normal;
+		if (!getTriangleNormal(p0, p1, p2, normal)) {
+			continue;
+		}
+
+		normals[numNormals] = normal;
+		corners[numNormals] = p0;
+		++numNormals;
+		axis += normal;
+	}
+
+	const float axisLength = glm::length(axis);
+	if (numNormals == 0 || axisLength <= std::numeric_limits<float>::min()) {
+		return;
+	}
+	axis /= axisLength;
+
+	float minDot = 1.f;
+	for (uint32_t i = 0; i < numNormals; ++i) {
+		minDot = std::min(minDot, glm::dot(axis, normals[i]));
+	}
+
+	if (minDot <= MIN_CONE_DOT) {
+		return;
+	}
+
+	// Move the apex back along the axis until it is behind the planes of all triangles, so
+	// a camera inside the negative cone from the apex is behind all of them.
+	float maxT = 0.f;
+	for (uint32_t i = 0; i < numNormals; ++i) {
+		const float t = glm::dot(meshlet.center - corners[i], normals[i]) / glm::dot(axis, normals[i]);
+		maxT = std::max(maxT, t);
+	}
+
+	meshlet.coneApex = meshlet.center - axis * maxT;
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = sqrtf(1.f - minDot * minDot);
+}
+
+void buildMeshlets(const uint32_t *indices, SizeType numIndices, const void *positions, SizeType numVertices, SizeType stride, MeshletData &data) {
+	data = MeshletData{};
+
+	const SizeType numTriangles = numIndices / 3;
+	if (numTriangles == 0) {
+		return;
+	}
+
+	// Triangles using each vertex
+	Vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+	for (SizeType i = 0; i < numTriangles * 3; ++i) {
+		++adjacencyOffsets[indices[i] + 1];
+	}
+	for (SizeType v = 0; v < numVertices; ++v) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+
+	Vector<uint32_t> adjacency(numTriangles * 3);
+	Vector<uint32_t> adjacencyEnds(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (SizeType i = 0; i < numTriangles * 3; ++i) {
+		adjacency[adjacencyEnds[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	Vector<Vec3> centroids(numTriangles);
+	for (SizeType t = 0; t < numTriangles; ++t) {
+		const Vec3 p0 = getPosition(positions, stride, indices[t * 3 + 0]);
+		const Vec3 p1 = getPosition(positions, stride, indices[t * 3 + 1]);
+		const Vec3 p2 = getPosition(positions, stride, indices[t * 3 + 2]);
+		centroids[t] = (p0 + p1 + p2) / 3.f;
+	}
+
+	Vector<bool> emitted(numTriangles, false);
+	Vector<uint8_t> localIndices(numVertices, INVALID_LOCAL_INDEX); ///< Index of the vertex in the current meshlet.
+
+	Meshlet meshlet;
+	Vec3 centroidSum(0.f);
+
+	auto countNewVertices = [&](uint32_t t) {
+		uint32_t count = 0;
+		for (int j = 0; j < 3; ++j) {
+			count += localIndices[indices[t * 3 + j]] == INVALID_LOCAL_INDEX;
+		}
+		return count;
+	};
+
+	auto addTriangle = [&](uint32_t t) {
+		for (int j = 0; j < 3; ++j) {
+			const uint32_t v = indices[t * 3 + j];
+			if (localIndices[v] == INVALID_LOCAL_INDEX) {
+				localIndices[v] = static_cast<uint8_t>(meshlet.numVertices++);
+				data.vertices.push_back(v);
+			}
+			data.triangles.push_back(localIndices[v]);
+		}
+
+		++meshlet.numTriangles;
+		centroidSum += centroids[t];
+		emitted[t] = true;
+	};
+
+	auto finishMeshlet = [&]() {
+		if (meshlet.numTriangles == 0) {
+			return;
+		}
+
+		for (uint32_t i = 0; i < meshlet.numVertices; ++i) {
+			localIndices[data.vertices[meshlet.vertexOffset + i]] = INVALID_LOCAL_INDEX;
+		}
+
+		computeMeshletBounds(meshlet, data, positions, stride);
+		data.meshlets.push_back(meshlet);
+
+		meshlet = Meshlet{};
+		meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+		centroidSum = Vec3(0.f);
+	};
+
+	SizeType seed = 0;
+	for (SizeType numEmitted = 0; numEmitted < numTriangles; ++numEmitted) {
+		// Best of the triangles sharing a vertex with the meshlet
+		uint32_t best = INVALID_TRIANGLE;
+		uint32_t bestNewVertices = 4;
+		float bestDistance = std::numeric_limits<float>::max();
+		const Vec3 meshletCentroid = centroidSum / float(std::max(meshlet.numTriangles, 1u));
+		for (uint32_t i = 0; i < meshlet.numVertices; ++i) {
+			const uint32_t v = data.vertices[meshlet.vertexOffset + i];
+			for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+				const uint32_t t = adjacency[a];
+				if (emitted[t]) {
+					continue;
+				}
+
+				const uint32_t newVertices = countNewVertices(t);
+				const Vec3 offset = centroids[t] - meshletCentroid;
+				const float distance = glm::dot(offset, offset);
+				if (newVertices < bestNewVertices || (newVertices == bestNewVertices && distance < bestDistance)) {
+					best = t;
+					bestNewVertices = newVertices;
+					bestDistance = distance;
+				}
+			}
+		}
+
+		// Nothing connected to the meshlet, continue with the next triangle in the input order
+		if (best == INVALID_TRIANGLE) {
+			while (emitted[seed]) {
+				++seed;
+			}
+			best = static_cast<uint32_t>(seed);
+			bestNewVertices = countNewVertices(best);
+		}
+
+		// All other candidates add at least as many vertices, so none of them fits either.
+		if (meshlet.numVertices + bestNewVertices > MAX_MESHLET_VERTICES || meshlet.numTriangles + 1 > MAX_MESHLET_TRIANGLES) {
+			finishMeshlet();
+		}
+
+		addTriangle(best);
+	}
+
+	finishMeshlet();
+}
+
+bool isMeshletCulled(const Meshlet &meshlet, const Vec3 &cameraPos, const Vec4 *planes, int numPlanes) {
+	for (int i = 0; i < numPlanes; ++i) {
+		if (glm::dot(Vec3(planes[i]), meshlet.center) + planes[i].w < -meshlet.radius) {
+			return true;
+		}
+	}
+
+	if (meshlet.coneCutoff >= 1.f) {
+		return false;
+	}
+
+	return glm::dot(glm::normalize(meshlet.coneApex - cameraPos), meshlet.coneAxis) >= meshlet.coneCutoff;
+}
+
+ValidationStats validateMeshlets(const MeshletData &data, const uint32_t *indices, SizeType numIndices, const void *positions, SizeType stride) {
+	ValidationStats stats;
+
+	// Triangles are compared after rotating their smallest index to the front, which keeps the winding.
+	using Triangle = std::array<uint32_t, 3>;
+	auto makeTriangle = [](uint32_t a, uint32_t b, uint32_t c) -> Triangle {
+		if (b < a && b < c) {
+			return { b, c, a };
+		}
+		if (c < a && c < b) {
+			return { c, a, b };
+		}
+		return { a, b, c };
+	};
+
+	Vector<Triangle> expected;
+	expected.reserve(numIndices / 3);
+	for (SizeType i = 0; i + 2 < numIndices; i += 3) {
+		expected.push_back(makeTriangle(indices[i], indices[i + 1], indices[i + 2]));
+	}
+
+	Vector<Triangle> actual;
+	actual.reserve(numIndices / 3);
+	for (SizeType m = 0; m < data.meshlets.size(); ++m) {
+		const Meshlet &meshlet = data.meshlets[m];
+		if (meshlet.numVertices > MAX_MESHLET_VERTICES || meshlet.numTriangles > MAX_MESHLET_TRIANGLES ||
+			meshlet.vertexOffset + meshlet.numVertices > data.vertices.size() ||
+			meshlet.triangleOffset + meshlet.numTriangles * 3 > data.triangles.size()) {
+			LOG_FMT(Error, "Meshlet %llu is out of bounds!", m);
+			++stats.numErrors;
+			continue;
+		}
+
+		const uint32_t *vertices = data.vertices.data() + meshlet.vertexOffset;
+		const uint8_t *triangles = data.triangles.data() + meshlet.triangleOffset;
+		for (uint32_t t = 0; t < meshlet.numTriangles * 3; t += 3) {
+			if (triangles[t] >= meshlet.numVertices || triangles[t + 1] >= meshlet.numVertices || triangles[t + 2] >= meshlet.numVertices) {
+				LOG_FMT(Error, "Meshlet %llu has an invalid triangle!", m);
+				++stats.numErrors;
+				continue;
+			}
+			actual.push_back(makeTriangle(vertices[triangles[t]], vertices[triangles[t + 1]], vertices[triangles[t + 2]]));
+		}
+	}
+
+	std::sort(expected.begin(), expected.end());
+	std::sort(actual.begin(), actual.end());
+	if (expected != actual) {
+		LOG_FMT(Error, "Meshlets contain %llu triangles which differ from the %llu triangles of the mesh!", actual.size(), expected.size());
+		++stats.numErrors;
+	}
+
+	// Cameras are placed in all 26 directions around the meshlet and inside its negative cone.
+	Vec3 directions[26];
+	int numDirections = 0;
+	for (int x = -1; x <= 1; ++x) {
+		for (int y = -1; y <= 1; ++y) {
+			for (int z = -1; z <= 1; ++z) {
+				if (x != 0 || y != 0 || z != 0) {
+					directions[numDirections++] = glm::normalize(Vec3(float(x), float(y), float(z)));
+				}
+			}
+		}
+	}
+
+	constexpr float distances[] = { 0.5f, 1.5f, 4.f, 16.f };
+
+	for (SizeType m = 0; m < data.meshlets.size(); ++m) {
+		const Meshlet &meshlet = data.meshlets[m];
+		const uint32_t *vertices = data.vertices.data() + meshlet.vertexOffset;
+		const uint8_t *triangles = data.triangles.data() + meshlet.triangleOffset;
+		const float scale = std::max(meshlet.radius, 1e-3f);
+
+		for (uint32_t i = 0; i < meshlet.numVertices; ++i) {
+			const float distance = glm::distance(meshlet.center, getPosition(positions, stride, vertices[i]));
+			if (distance > meshlet.radius + scale * 1e-4f) {
+				LOG_FMT(Error, "Bounding sphere of meshlet %llu doesn't contain vertex %u!", m, vertices[i]);
+				++stats.numErrors;
+				break;
+			}
+		}
+
+		auto testCamera = [&](const Vec3 &cameraPos) {
+			++stats.numTests;
+			if (!isMeshletCulled(meshlet, cameraPos)) {
+				return;
+			}
+
+			++stats.numCulled;
+			for (uint32_t t = 0; t < meshlet.numTriangles; ++t) {
+				const Vec3 p0 = getPosition(positions, stride, vertices[triangles[t * 3 + 0]]);
+				const Vec3 p1 = getPosition(positions, stride, vertices[triangles[t * 3 + 1]]);
+				const Vec3 p2 = getPosition(positions, stride, vertices[triangles[t * 3 + 2]]);
+
+				Vec3 normal;
+				if (getTriangleNormal(p0, p1, p2, normal) && glm::dot(cameraPos - p0, normal) > scale * 1e-4f) {
+					LOG_FMT(Error, "Meshlet %llu is culled while its triangle %u is frontfacing!", m, t);
+					++stats.numErrors;
+					return;
+				}
+			}
+		};
+
+		for (float distance : distances) {
+			for (int i = 0; i < numDirections; ++i) {
+				testCamera(meshlet.center + directions[i] * distance * scale);
+			}
+			if (meshlet.coneCutoff < 1.f) {
+				testCamera(meshlet.coneApex - meshlet.coneAxis * distance * scale);
+			}
+		}
+	}
+
+	return stats;
+}
+
+} // namespace Meshlets
+
+} // namespace Dar
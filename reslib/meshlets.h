@@ -0,0 +1,55 @@
+#pragma once
+
+#include "scene_lib.h"
+
+namespace Dar {
+
+namespace Meshlets {
+
+using ScnLib::Meshlet;
+
+/// Meshlets of a single mesh. Offsets of the meshlets are relative to the vectors here.
+struct MeshletData {
+	Vector<Meshlet> meshlets;
+	Vector<uint32_t> vertices; ///< Vertex indices of the meshlets.
+	Vector<uint8_t> triangles; ///< 3 indices per triangle into the vertices of its meshlet.
+};
+
+/// Results of validateMeshlets().
+struct ValidationStats {
+	SizeType numTests = 0; ///< Number of meshlet-camera pairs tested with the cone.
+	SizeType numCulled = 0; ///< Number of tests in which the cone culled the meshlet.
+	SizeType numErrors = 0; ///< Number of broken invariants. 0 for valid meshlets.
+};
+
+/// Split a triangle list into meshlets of at most ScnLib::MAX_MESHLET_VERTICES vertices and ScnLib::MAX_MESHLET_TRIANGLES triangles.
+/// Meshlets are grown greedily over the triangles sharing vertices with them, preferring the ones adding the fewest
+/// new vertices and then the ones closest to the meshlet, so meshlets are compact and have tight bounds.
+/// A new meshlet is seeded with the first triangle not in a meshlet yet, so the input order should be spatially
+/// coherent, f.e after MeshOptimizer::optimizeVertexCache().
+/// Bounding spheres and normal cones of the meshlets are computed as well. \see computeMeshletBounds.
+/// @param indices Triangle list.
+/// @param positions Pointer to the position(3 floats) of the first vertex.
+/// @param stride Distance between the positions of two vertices in bytes.
+/// @param data Receives the meshlets.
+void buildMeshlets(const uint32_t *indices, SizeType numIndices, const void *positions, SizeType numVertices, SizeType stride, MeshletData &data);
+
+/// Compute the bounding sphere and the normal cone of a meshlet which vertices and triangles are already set.
+void computeMeshletBounds(Meshlet &meshlet, const MeshletData &data, const void *positions, SizeType stride);
+
+/// Reference culling of a meshlet on the CPU. Mirrors what an amplification shader would do with the meshlet data.
+/// @param cameraPos Position of the camera in the object space of the mesh.
+/// @param planes Optional. Planes(xyz - normal pointing inside, w - distance) of the frustum in the object space of the mesh.
+/// @return true if the meshlet is completely outside the frustum or all of its triangles are backfacing.
+bool isMeshletCulled(const Meshlet &meshlet, const Vec3 &cameraPos, const Vec4 *planes = nullptr, int numPlanes = 0);
+
+/// Check the meshlets against brute force:
+/// - the meshlets contain exactly the triangles of the mesh with the same winding and respect the limits;
+/// - the bounding spheres contain all vertices of their meshlets;
+/// - for cameras all around each meshlet, all triangles of the meshlet are backfacing whenever the cone culls it.
+/// Errors are logged.
+ValidationStats validateMeshlets(const MeshletData &data, const uint32_t *indices, SizeType numIndices, const void *positions, SizeType stride);
+
+} // namespace Meshlets
+
+} // namespace Dar
@@ -0,0 +1,438 @@
+#include "mip_generator.h"
+
+#include "async/job_system.h"
+
+#include <cmath>
+#include <numbers>
+
+#include <xmmintrin.h>
+
+namespace Dar {
+
+namespace MipGen {
+
+/// ==========================================================================
+/// Filters
+/// ==========================================================================
+
+static constexpr float KAISER_ALPHA = 4.f;
+
+/// Support radius of a filter in destination pixels.
+static float getFilterRadius(MipFilter filter) {
+	switch (filter) {
+	case MipFilter::Box:
+		return 0.5f;
+	case MipFilter::Kaiser:
+	case MipFilter::Lanczos:
+	default:
+		return 3.f;
+	}
+}
+
+static float sinc(float x) {
+	if (std::abs(x) < 1e-5f) {
+		return 1.f;
+	}
+
+	const float px = std::numbers::pi_v<float> * x;
+	return std::sin(px) / px;
+}
+
+/// Zeroth order modified Bessel function of the first kind.
+static float bessel0(float x) {
+	float sum = 1.f;
+	float term = 1.f;
+	for (int k = 1; k < 32 && term > sum * 1e-8f; ++k) {
+		const float t = x / (2.f * k);
+		term *= t * t;
+		sum += term;
+	}
+
+	return sum;
+}
+
+static float evaluateFilter(MipFilter filter, float x) {
+	const float radius = getFilterRadius(filter);
+	x = std::abs(x);
+	if (x > radius) {
+		return 0.f;
+	}
+
+	switch (filter) {
+	case MipFilter::Box:
+		return 1.f;
+	case MipFilter::Kaiser: {
+		const float t = x / radius;
+		return sinc(x) * bessel0(KAISER_ALPHA * std::sqrt(1.f - t * t)) / bessel0(KAISER_ALPHA);
+	}
+	case MipFilter::Lanczos:
+	default:
+		return sinc(x) * sinc(x / radius);
+	}
+}
+
+/// Weights of the source pixels contributing to each destination pixel along one axis.
+struct FilterTaps {
+	Vector<int> start; ///< First source pixel for each destination pixel. Could be out of the source bounds.
+	Vector<float> weights; ///< numTaps weights for each destination pixel.
+	int numTaps = 0;
+	bool uniform = false; ///< Exact 2:1 reduction. All pixels share the weights of the first one and start 2 pixels apart.
+};
+
+static FilterTaps computeFilterTaps(MipFilter filter, int srcSize, int dstSize) {
+	const float scale = float(srcSize) / dstSize;
+	const float srcRadius = getFilterRadius(filter) * scale;
+
+	FilterTaps taps;
+	taps.numTaps = static_cast<int>(std::ceil(2.f * srcRadius)) + 1;
+	taps.uniform = srcSize == 2 * dstSize;
+	taps.start.resize(dstSize);
+	taps.weights.resize(SizeType(dstSize) * taps.numTaps);
+
+	for (int x = 0; x < dstSize; ++x) {
+		const float center = (x + 0.5f) * scale;
+		const int start = static_cast<int>(std::floor(center - srcRadius));
+		float *weights = taps.weights.data() + SizeType(x) * taps.numTaps;
+
+		float sum = 0.f;
+		for (int k = 0; k < taps.numTaps; ++k) {
+			weights[k] = evaluateFilter(filter, (start + k + 0.5f - center) / scale);
+			sum += weights[k];
+		}
+
+		for (int k = 0; k < taps.numTaps; ++k) {
+			weights[k] /= sum;
+		}
+
+		taps.start[x] = start;
+	}
+
+	return taps;
+}
+
+/// ==========================================================================
+/// Color conversions
+/// ==========================================================================
+
+static float srgbToLinear(float c) {
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+static float saturate(float v) {
+	return std::min(std::max(v, 0.f), 1.f);
+}
+
+struct ConvertParams {
+	const MipLevel *src;
+	MipLevel *dst;
+	const MipSettings *settings;
+};
+
+/// Convert mip 0 to linear space with premultiplied alpha.
+static void toWorkingSpace(const MipLevel &src, MipLevel &dst, const MipSettings &settings) {
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.data.resize(src.data.size());
+
+	ConvertParams params = { &src, &dst, &settings };
+	JobSystem::parallelFor(
+		src.height,
+		64,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<ConvertParams*>(param);
+			const bool srgb = p->settings->srgb && !p->settings->normalMap;
+			const bool premultiply = p->settings->hasAlpha && !p->settings->normalMap;
+			const SizeType width = p->src->width;
+			const float *alpha = p->src->channel(3);
+			for (int c = 0; c < 4; ++c) {
+				const float *src = p->src->channel(c);
+				float *dst = p->dst->channel(c);
+				for (SizeType i = begin * width; i < end * width; ++i) {
+					float v = src[i];
+					if (c < 3) {
+						v = srgb ? srgbToLinear(saturate(v)) : v;
+						v = premultiply ? v * saturate(alpha[i]) : v;
+					}
+					dst[i] = v;
+				}
+			}
+		},
+		&params
+	);
+}
+
+/// Convert a filtered mip back to the encoding of the source image.
+static void fromWorkingSpace(const MipLevel &src, MipLevel &dst, const MipSettings &settings) {
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.data.resize(src.data.size());
+
+	ConvertParams params = { &src, &dst, &settings };
+	JobSystem::parallelFor(
+		src.height,
+		64,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<ConvertParams*>(param);
+			const bool srgb = p->settings->srgb && !p->settings->normalMap;
+			const bool premultiplied = p->settings->hasAlpha && !p->settings->normalMap;
+			const SizeType width = p->src->width;
+			const float *src[4] = { p->src->channel(0), p->src->channel(1), p->src->channel(2), p->src->channel(3) };
+			float *dst[4] = { p->dst->channel(0), p->dst->channel(1), p->dst->channel(2), p->dst->channel(3) };
+			for (SizeType i = begin * width; i < end * width; ++i) {
+				const float alpha = saturate(src[3][i]);
+				float rgb[3] = { src[0][i], src[1][i], src[2][i] };
+				if (premultiplied) {
+					const float invAlpha = alpha > 1e-6f ? 1.f / alpha : 0.f;
+					for (float &v : rgb) {
+						v *= invAlpha;
+					}
+				}
+
+				if (p->settings->normalMap) {
+					float n[3] = { rgb[0] * 2.f - 1.f, rgb[1] * 2.f - 1.f, rgb[2] * 2.f - 1.f };
+					const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					if (len > 1e-6f) {
+						for (int c = 0; c < 3; ++c) {
+							rgb[c] = n[c] / len * 0.5f + 0.5f;
+						}
+					}
+				}
+
+				for (int c = 0; c < 3; ++c) {
+					dst[c][i] = srgb ? linearToSrgb(saturate(rgb[c])) : saturate(rgb[c]);
+				}
+				dst[3][i] = alpha;
+			}
+		},
+		&params
+	);
+}
+
+/// ==========================================================================
+/// Alpha coverage
+/// ==========================================================================
+
+static float computeAlphaCoverage(const float *alpha, SizeType count, float alphaRef, float scale = 1.f) {
+	SizeType numPassing = 0;
+	for (SizeType i = 0; i < count; ++i) {
+		numPassing += alpha[i] * scale > alphaRef;
+	}
+
+	return float(numPassing) / count;
+}
+
+/// Find the alpha scale for which the alpha test coverage matches the desired one and apply it.
+static void scaleAlphaToCoverage(float *alpha, SizeType count, float alphaRef, float coverage) {
+	float minScale = 0.f;
+	float maxScale = 64.f;
+	for (int i = 0; i < 16; ++i) {
+		const float scale = (minScale + maxScale) * 0.5f;
+		if (computeAlphaCoverage(alpha, count, alphaRef, scale) < coverage) {
+			minScale = scale;
+		} else {
+			maxScale = scale;
+		}
+	}
+
+	const float scale = (minScale + maxScale) * 0.5f;
+	for (SizeType i = 0; i < count; ++i) {
+		alpha[i] = saturate(alpha[i] * scale);
+	}
+}
+
+/// ==========================================================================
+/// Downsampling
+/// ==========================================================================
+
+struct DownsampleParams {
+	const MipLevel *src;
+	MipLevel *dst;
+	Vector<float> *tmp; ///< Result of the horizontal pass. dst.width x src.height for each channel.
+	const FilterTaps *tapsX;
+	const FilterTaps *tapsY;
+};
+
+static void filterRow(const float *row, int srcWidth, float *out, int dstWidth, const FilterTaps &taps, Vector<float> &padded) {
+	// Pad the row with the edge pixels, so the taps never go out of bounds.
+	// The right side has 8 more pixels for the unaligned SSE loads.
+	const int margin = taps.numTaps + 1;
+	padded.resize(SizeType(srcWidth) + 2 * margin + 8);
+	std::fill(padded.begin(), padded.begin() + margin, row[0]);
+	memcpy(padded.data() + margin, row, srcWidth * sizeof(float));
+	std::fill(padded.begin() + margin + srcWidth, padded.end(), row[srcWidth - 1]);
+
+	const float *src = padded.data() + margin;
+
+	int x = 0;
+	if (taps.uniform) {
+		// 4 destination pixels at once. Their source pixels are 2 apart, so take
+		// the even elements of 8 consecutive source pixels for each tap.
+		const float *weights = taps.weights.data();
+		for (; x + 4 <= dstWidth; x += 4) {
+			const float *base = src + taps.start[x];
+			__m128 acc = _mm_setzero_ps();
+			for (int k = 0; k < taps.numTaps; ++k) {
+				const __m128 lo = _mm_loadu_ps(base + k);
+				const __m128 hi = _mm_loadu_ps(base + k + 4);
+				const __m128 even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+				acc = _mm_add_ps(acc, _mm_mul_ps(even, _mm_set1_ps(weights[k])));
+			}
+			_mm_storeu_ps(out + x, acc);
+		}
+	}
+
+	for (; x < dstWidth; ++x) {
+		const float *weights = taps.weights.data() + SizeType(x) * taps.numTaps;
+		const float *base = src + taps.start[x];
+		float acc = 0.f;
+		for (int k = 0; k < taps.numTaps; ++k) {
+			acc += base[k] * weights[k];
+		}
+		out[x] = acc;
+	}
+}
+
+static void downsample(const MipLevel &src, MipLevel &dst, MipFilter filter, Vector<float> &tmp) {
+	const FilterTaps tapsX = computeFilterTaps(filter, src.width, dst.width);
+	const FilterTaps tapsY = computeFilterTaps(filter, src.height, dst.height);
+
+	dst.data.resize(SizeType(dst.width) * dst.height * 4);
+	tmp.resize(SizeType(dst.width) * src.height * 4);
+
+	DownsampleParams params = { &src, &dst, &tmp, &tapsX, &tapsY };
+
+	// Horizontal pass over the rows of all channels
+	JobSystem::parallelFor(
+		SizeType(src.height) * 4,
+		64,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<DownsampleParams*>(param);
+			Vector<float> padded;
+			for (SizeType r = begin; r < end; ++r) {
+				const float *row = p->src->data.data() + r * p->src->width;
+				float *out = p->tmp->data() + r * p->dst->width;
+				filterRow(row, p->src->width, out, p->dst->width, *p->tapsX, padded);
+			}
+		},
+		&params
+	);
+
+	// Vertical pass. Whole rows are weighted and summed, so 4 pixels are processed at once.
+	JobSystem::parallelFor(
+		SizeType(dst.height) * 4,
+		64,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<DownsampleParams*>(param);
+			const FilterTaps &taps = *p->tapsY;
+			const int width = p->dst->width;
+			const int srcHeight = p->src->height;
+			const int dstHeight = p->dst->height;
+			for (SizeType r = begin; r < end; ++r) {
+				const int c = static_cast<int>(r / dstHeight);
+				const int y = static_cast<int>(r % dstHeight);
+				const float *channel = p->tmp->data() + SizeType(c) * width * srcHeight;
+				const float *weights = taps.weights.data() + SizeType(y) * taps.numTaps;
+				float *out = p->dst->data.data() + r * width;
+
+				int x = 0;
+				for (; x + 4 <= width; x += 4) {
+					__m128 acc = _mm_setzero_ps();
+					for (int k = 0; k < taps.numTaps; ++k) {
+						const int srcY = std::min(std::max(taps.start[y] + k, 0), srcHeight - 1);
+						const __m128 v = _mm_loadu_ps(channel + SizeType(srcY) * width + x);
+						acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(weights[k])));
+					}
+					_mm_storeu_ps(out + x, acc);
+				}
+
+				for (; x < width; ++x) {
+					float acc = 0.f;
+					for (int k = 0; k < taps.numTaps; ++k) {
+						const int srcY = std::min(std::max(taps.start[y] + k, 0), srcHeight - 1);
+						acc += channel[SizeType(srcY) * width + x] * weights[k];
+					}
+					out[x] = acc;
+				}
+			}
+		},
+		&params
+	);
+}
+
+/// ==========================================================================
+/// Public
+/// ==========================================================================
+
+int getMipCount(int width, int height) {
+	int count = 1;
+	while (width > 1 || height > 1) {
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		++count;
+	}
+
+	return count;
+}
+
+MipSettings detectMipSettings(const MipLevel &img, bool hasAlpha) {
+	MipSettings settings;
+	settings.hasAlpha = hasAlpha;
+
+	// Sample at most ~64K pixels
+	const SizeType numPixels = SizeType(img.width) * img.height;
+	const SizeType step = std::max(SizeType(1), numPixels / (64 * 1024));
+
+	SizeType numSamples = 0;
+	SizeType numUnitVectors = 0;
+	for (SizeType i = 0; i < numPixels; i += step, ++numSamples) {
+		const float x = img.channel(0)[i] * 2.f - 1.f;
+		const float y = img.channel(1)[i] * 2.f - 1.f;
+		const float z = img.channel(2)[i] * 2.f - 1.f;
+		const float len = std::sqrt(x * x + y * y + z * z);
+		numUnitVectors += std::abs(len - 1.f) < 0.15f && z > 0.2f;
+	}
+
+	settings.normalMap = numSamples > 0 && numUnitVectors > numSamples * 9 / 10;
+	settings.srgb = !settings.normalMap;
+
+	return settings;
+}
+
+void generateMipChain(const MipLevel &img, const MipSettings &settings, Vector<MipLevel> &mips) {
+	const int mipCount = getMipCount(img.width, img.height);
+	mips.resize(mipCount);
+	mips[0] = img;
+
+	const SizeType numPixels = SizeType(img.width) * img.height;
+	const bool preserveCoverage = settings.hasAlpha && settings.preserveAlphaCoverage && !settings.normalMap;
+	const float coverage = preserveCoverage ? computeAlphaCoverage(img.channel(3), numPixels, settings.alphaRef) : 1.f;
+
+	MipLevel current;
+	MipLevel next;
+	Vector<float> tmp;
+	toWorkingSpace(img, current, settings);
+
+	for (int mip = 1; mip < mipCount; ++mip) {
+		next.width = std::max(1, current.width / 2);
+		next.height = std::max(1, current.height / 2);
+		downsample(current, next, settings.filter, tmp);
+
+		MipLevel &out = mips[mip];
+		fromWorkingSpace(next, out, settings);
+
+		// Fully opaque or transparent images don't need it.
+		if (preserveCoverage && coverage > 0.f && coverage < 1.f) {
+			scaleAlphaToCoverage(out.channel(3), SizeType(out.width) * out.height, settings.alphaRef, coverage);
+		}
+
+		std::swap(current, next);
+	}
+}
+
+} // namespace MipGen
+
+} // namespace Dar
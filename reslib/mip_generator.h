@@ -0,0 +1,59 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace MipGen {
+
+enum class MipFilter {
+	Box = 0,
+	Kaiser, ///< Kaiser windowed sinc. Sharp with little ringing.
+	Lanczos, ///< Lanczos3. Sharpest, but rings more than Kaiser.
+};
+
+struct MipSettings {
+	MipFilter filter = MipFilter::Kaiser;
+	bool srgb = true; ///< RGB channels are sRGB encoded. Filtering is always done in linear space.
+	bool normalMap = false; ///< RGB encodes unit vectors which are renormalized after filtering.
+	bool hasAlpha = false; ///< Color is premultiplied by alpha while filtering so transparent pixels don't bleed.
+	bool preserveAlphaCoverage = true; ///< Scale the alpha of each mip so the ratio of pixels passing the alpha test matches mip 0.
+	float alphaRef = 0.5f; ///< Alpha test threshold used for preserving the coverage.
+};
+
+/// Surface with float channels stored non-interleaved, i.e all reds first, then all greens, etc.
+/// Same layout as nvtt::Surface, so mips could be passed directly to nvtt.
+struct MipLevel {
+	Vector<float> data; ///< 4 * width * height floats
+	int width = 0;
+	int height = 0;
+
+	const float* channel(int c) const {
+		return data.data() + SizeType(c) * width * height;
+	}
+
+	float* channel(int c) {
+		return data.data() + SizeType(c) * width * height;
+	}
+};
+
+/// Number of mip-levels in a full chain down to 1x1.
+int getMipCount(int width, int height);
+
+/// Guess the settings for an image by its content, f.e tangent space normal maps
+/// are detected by their texels being unit vectors pointing mostly towards +Z.
+/// @param img Mip 0 of the image.
+/// @param hasAlpha Whether the image file has alpha channel.
+MipSettings detectMipSettings(const MipLevel &img, bool hasAlpha);
+
+/// Generate the full mip chain of an image down to 1x1. Each mip is generated from
+/// the previous one in linear space with premultiplied alpha and converted back to
+/// the encoding of the source image. Rows are filtered in parallel on the job system using SSE.
+/// @note Big images must be processed from inside a job. See JobSystem::parallelFor.
+/// @param img Mip 0 of the image with channels in [0, 1].
+/// @param mips Receives all the mips, including a copy of mip 0.
+void generateMipChain(const MipLevel &img, const MipSettings &settings, Vector<MipLevel> &mips);
+
+} // namespace MipGen
+
+} // namespace Dar
@@ -1,5 +1,11 @@
 #include "resource_library.h"
 
+#include "hash.h"
+
+#include "utils/profile.h"
+#include "utils/timer.h"
+
+#include <algorithm>
 #include <fstream>
 
 namespace Dar {
@@ -21,20 +27,25 @@ void ResourceLibrary::LoadTextureData() {
 
 	SizeType offset = 0;
 	for (auto &imgh : header.headers) {
-		ImageData data{ .header = imgh, .data = nullptr };
-		imageName2Data.insert({ imgh.filename, ImagePos{.data = data, .pos = header.imgDataStartPos + offset } });
+		imageName2Data.insert({ imgh.filename, ImagePos{.header = imgh, .pos = header.imgDataStartPos + offset } });
 
-		offset += imgh.size;
+		offset += imgh.getStoredSize();
 	}
 
 	initTextureData = true;
 }
 
-ImageData ResourceLibrary::getImageData(const String &imageName) const {
+ImageData ResourceLibrary::getImageData(const String &imageName, int firstMip) const {
 	if (auto it = imageName2Data.find(imageName); it != imageName2Data.end()) {
-		auto& img = it->second.data;
-		if (img.data != nullptr) {
-			return img;
+		if (auto reloaded = getReloadedImage(imageName, firstMip); reloaded.has_value()) {
+			return *reloaded;
+		}
+
+		auto &imgPos = it->second;
+		if (auto cached = imageCache.get(imageName, firstMip); cached.has_value()) {
+			// The mips could have been released since the image was cached.
+			updateResidency(imgPos, cached->firstMip);
+			return *cached;
 		}
 
 		std::ifstream ifs(".\\res\\textures\\textures.txlib", std::ios::binary | std::ios::in);
@@ -42,11 +53,15 @@ ImageData ResourceLibrary::getImageData(const String &imageName) const {
 			LOG(Error, "Failed to load textures.txlib file!");
 			return ImageData{};
 		}
-		
-		if (!img.loadFromStream(ifs, it->second.pos)) {
+
+		ImageData img{ .header = imgPos.header };
+		if (!img.loadFromStream(ifs, imgPos.pos, firstMip)) {
 			return ImageData{};
 		}
 
+		imageCache.put(imageName, img);
+		updateResidency(imgPos, img.firstMip);
+
 		return img;
 	} else {
 		LOG_FMT(Error, "Unknown texture file %s!", imageName.c_str());
@@ -55,6 +70,438 @@ ImageData ResourceLibrary::getImageData(const String &imageName) const {
 	return ImageData{};
 }
 
+ImageCache& ResourceLibrary::getImageCache() const {
+	return imageCache;
+}
+
+void ResourceLibrary::setTextureStreaming(const TextureStreamingSettings &settings) {
+	auto lock = streamingLock.lock();
+	streamingSettings = settings;
+}
+
+const TextureStreamingSettings& ResourceLibrary::getTextureStreaming() const {
+	return streamingSettings;
+}
+
+int ResourceLibrary::getInitialMip(const String &imageName) const {
+	if (!streamingSettings.enabled) {
+		return 0;
+	}
+
+	if (auto it = imageName2Data.find(imageName); it != imageName2Data.end()) {
+		const auto &header = it->second.header;
+		return std::max(0, header.mipMapCount - streamingSettings.numResidentMips);
+	}
+
+	return 0;
+}
+
+void ResourceLibrary::requestImageMips(const String &imageName, int mip, float priority) {
+	if (!streamingSettings.enabled) {
+		return;
+	}
+
+	auto lock = streamingLock.lock();
+	for (auto &req : pendingRequests) {
+		if (req.imageName == imageName) {
+			req.mip = std::min(req.mip, mip);
+			req.priority = std::max(req.priority, priority);
+			return;
+		}
+	}
+
+	pendingRequests.push_back(MipStreamRequest{ imageName, mip, priority });
+}
+
+SizeType ResourceLibrary::kickStreamingRequests() {
+	DAR_OPTICK_EVENT("ResourceLibrary::kickStreamingRequests");
+
+	SizeType missingMemory = 0;
+	auto streamBatch = new MipStreamBatch;
+	{
+		auto lock = streamingLock.lock();
+
+		std::sort(
+			pendingRequests.begin(),
+			pendingRequests.end(),
+			[](const MipStreamRequest &a, const MipStreamRequest &b) {
+				return a.priority > b.priority;
+			}
+		);
+
+		for (const auto &req : pendingRequests) {
+			if (requestsInFlight >= streamingSettings.maxRequestsInFlight) {
+				break;
+			}
+
+			auto it = imageName2Data.find(req.imageName);
+			if (it == imageName2Data.end()) {
+				continue;
+			}
+
+			auto &imgPos = it->second;
+			const auto &header = imgPos.header;
+			const int mip = std::max(0, std::min(req.mip, header.mipMapCount - 1));
+			if (imgPos.requestedMip != -1 || (imgPos.residentMip != -1 && mip >= imgPos.residentMip)) {
+				continue;
+			}
+
+			const SizeType residentSize = imgPos.residentMip == -1 ? 0 : header.getMipChainSize(imgPos.residentMip);
+			const SizeType cost = header.getMipChainSize(mip) - residentSize;
+			if (residentTextureMemory + cost > streamingSettings.memoryBudget) {
+				missingMemory += cost;
+				continue;
+			}
+
+			// Reserve the memory up-front so requests in flight are accounted for in the budget.
+			residentTextureMemory += cost;
+			imgPos.requestedMip = mip;
+			++requestsInFlight;
+
+			ImageDataRequest imgRequest;
+			imgRequest.imageName = req.imageName;
+			imgRequest.firstMip = mip;
+			streamBatch->requests.push_back(imgRequest);
+			streamBatch->costs.push_back(cost);
+		}
+
+		pendingRequests.clear();
+	}
+
+	if (streamBatch->requests.empty()) {
+		delete streamBatch;
+		return missingMemory;
+	}
+
+	IOBatch batch;
+	batch.requests = streamBatch->requests.data();
+	batch.numRequests = static_cast<int>(streamBatch->requests.size());
+	batch.streamBatch = streamBatch;
+	pushIOBatch(batch);
+
+	return missingMemory;
+}
+
+void ResourceLibrary::releaseImageMips(const String &imageName, int firstMip) {
+	auto it = imageName2Data.find(imageName);
+	if (it == imageName2Data.end()) {
+		return;
+	}
+
+	auto lock = streamingLock.lock();
+
+	auto &imgPos = it->second;
+	const auto &header = imgPos.header;
+	if (imgPos.residentMip == -1 || firstMip <= imgPos.residentMip) {
+		return;
+	}
+
+	const SizeType releasedSize = firstMip >= header.mipMapCount ? 0 : header.getMipChainSize(firstMip);
+	residentTextureMemory -= header.getMipChainSize(imgPos.residentMip) - releasedSize;
+	imgPos.residentMip = firstMip >= header.mipMapCount ? -1 : firstMip;
+}
+
+void ResourceLibrary::releaseImage(const String &imageName) {
+	if (auto it = imageName2Data.find(imageName); it != imageName2Data.end()) {
+		releaseImageMips(imageName, it->second.header.mipMapCount);
+	}
+}
+
+bool ResourceLibrary::popStreamedImage(ImageData &imgData) {
+	auto lock = streamingLock.lock();
+	if (streamedImages.empty()) {
+		return false;
+	}
+
+	imgData = streamedImages.back();
+	streamedImages.pop_back();
+
+	return true;
+}
+
+SizeType ResourceLibrary::getResidentTextureMemory() const {
+	auto lock = streamingLock.lock();
+	return residentTextureMemory;
+}
+
+void ResourceLibrary::updateResidency(ImagePos &imgPos, int mip) const {
+	auto lock = streamingLock.lock();
+
+	const auto &header = imgPos.header;
+	const SizeType residentSize = imgPos.residentMip == -1 ? 0 : header.getMipChainSize(imgPos.residentMip);
+	if (imgPos.residentMip != -1 && mip >= imgPos.residentMip) {
+		return;
+	}
+
+	residentTextureMemory += header.getMipChainSize(mip) - residentSize;
+	imgPos.residentMip = mip;
+}
+
+void ResourceLibrary::requestImageData(ImageDataRequest *requests, int numRequests, JobSystem::Fence **fence) {
+	JobSystem::prepareFence(fence, 1);
+
+	if (numRequests <= 0) {
+		JobSystem::signalFence(fence ? *fence : nullptr);
+		return;
+	}
+
+	IOBatch batch;
+	batch.requests = requests;
+	batch.numRequests = numRequests;
+	batch.fence = fence ? *fence : nullptr;
+	pushIOBatch(batch);
+}
+
+void ResourceLibrary::pushIOBatch(const IOBatch &batch) {
+	{
+		auto lock = ioThreadLock.lock();
+		if (!ioThread.joinable()) {
+			ioThread = std::thread([this]() { ioThreadLoop(); });
+		}
+	}
+
+	while (!ioBatches.push(batch)) {
+		YieldProcessor();
+	}
+}
+
+void ResourceLibrary::ioThreadLoop() {
+	DAR_OPTICK_THREAD("I/O Thread");
+
+	HANDLE file = CreateFileW(
+		L".\\res\\textures\\textures.txlib",
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED,
+		nullptr
+	);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		LOG(Error, "I/O thread failed to open textures.txlib file!");
+	}
+
+	while (stopIOThread.load() == 0) {
+		ioBatches.waitForData(0);
+
+		IOBatch batch;
+		while (ioBatches.pop(batch)) {
+			if (batch.requests == nullptr) {
+				// Woken up for stopping
+				continue;
+			}
+
+			processIOBatch(file, batch);
+		}
+	}
+
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+	}
+}
+
+void ResourceLibrary::processIOBatch(HANDLE file, const IOBatch &batch) {
+	DAR_OPTICK_EVENT("ResourceLibrary::processIOBatch");
+
+	// Neighbouring requests closer than this are read together.
+	constexpr SizeType MAX_READ_GAP = 64 * 1024;
+	constexpr SizeType MAX_READ_SIZE = 64 * 1024 * 1024;
+	constexpr SizeType MAX_READS_IN_FLIGHT = 8;
+
+	auto batchData = new IOBatchData;
+	batchData->reslib = this;
+	batchData->batch = batch;
+	batchData->locations.resize(batch.numRequests);
+
+	struct StoredRange {
+		SizeType offset;
+		SizeType size;
+		int request;
+	};
+
+	Vector<StoredRange> ranges;
+	ranges.reserve(batch.numRequests);
+	for (int i = 0; i < batch.numRequests; ++i) {
+		auto &req = batch.requests[i];
+		req.success = false;
+
+		auto it = imageName2Data.find(req.imageName);
+		if (it == imageName2Data.end()) {
+			LOG_FMT(Error, "Unknown texture file %s!", req.imageName.c_str());
+			continue;
+		}
+
+		// The stored data of reloaded images is already in memory. Only copy it here, it's decoded with the rest of the batch.
+		IORead reloaded;
+		if (readReloadedImage(req.imageName, req.firstMip, req.imgData.header, reloaded.data)) {
+			reloaded.success = true;
+			batchData->locations[i] = IORequestLocation{ static_cast<int>(batchData->reads.size()), 0, reloaded.data.size(), true };
+			batchData->reads.push_back(std::move(reloaded));
+			continue;
+		}
+
+		if (auto cached = imageCache.get(req.imageName, req.firstMip); cached.has_value()) {
+			req.imgData = *cached;
+			req.success = true;
+			continue;
+		}
+
+		const auto &header = it->second.header;
+		if (header.size == 0) {
+			continue;
+		}
+
+		req.imgData.header = header;
+		req.firstMip = std::max(0, std::min(req.firstMip, header.mipMapCount - 1));
+
+		SizeType offset = 0;
+		SizeType size = 0;
+		header.getStoredRange(req.firstMip, offset, size);
+		ranges.push_back(StoredRange{ it->second.pos + offset, size, i });
+	}
+
+	std::sort(
+		ranges.begin(),
+		ranges.end(),
+		[](const StoredRange &a, const StoredRange &b) {
+			return a.offset < b.offset;
+		}
+	);
+
+	// Coalesce the requests into as few sequential reads as possible.
+	auto &reads = batchData->reads;
+	const SizeType firstFileRead = reads.size();
+	Vector<SizeType> readSizes(firstFileRead, 0);
+	for (const auto &range : ranges) {
+		if (reads.size() > firstFileRead) {
+			IORead &last = reads.back();
+			SizeType &lastSize = readSizes.back();
+			const SizeType end = range.offset + range.size;
+			if (range.offset <= last.offset + lastSize + MAX_READ_GAP && end - last.offset <= MAX_READ_SIZE) {
+				lastSize = std::max(lastSize, end - last.offset);
+				batchData->locations[range.request] = IORequestLocation{ static_cast<int>(reads.size() - 1), range.offset - last.offset, range.size };
+				continue;
+			}
+		}
+
+		IORead read;
+		read.offset = range.offset;
+		reads.push_back(read);
+		readSizes.push_back(range.size);
+		batchData->locations[range.request] = IORequestLocation{ static_cast<int>(reads.size() - 1), 0, range.size };
+	}
+
+	// Keep a few overlapped reads in flight so the disk always has work.
+	for (SizeType first = firstFileRead; first < reads.size(); first += MAX_READS_IN_FLIGHT) {
+		const SizeType last = std::min(reads.size(), first + MAX_READS_IN_FLIGHT);
+
+		OVERLAPPED overlapped[MAX_READS_IN_FLIGHT] = {};
+		bool pending[MAX_READS_IN_FLIGHT] = {};
+		for (SizeType i = first; i < last; ++i) {
+			IORead &read = reads[i];
+			read.data.resize(readSizes[i]);
+
+			OVERLAPPED &ov = overlapped[i - first];
+			ov.Offset = static_cast<DWORD>(read.offset & 0xFFFFFFFF);
+			ov.OffsetHigh = static_cast<DWORD>(read.offset >> 32);
+			ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+			if (file == INVALID_HANDLE_VALUE || ov.hEvent == NULL) {
+				continue;
+			}
+
+			const BOOL res = ReadFile(file, read.data.data(), static_cast<DWORD>(read.data.size()), nullptr, &ov);
+			pending[i - first] = res || GetLastError() == ERROR_IO_PENDING;
+		}
+
+		for (SizeType i = first; i < last; ++i) {
+			IORead &read = reads[i];
+			OVERLAPPED &ov = overlapped[i - first];
+
+			DWORD bytesRead = 0;
+			if (pending[i - first] && GetOverlappedResult(file, &ov, &bytesRead, TRUE)) {
+				read.success = bytesRead == read.data.size();
+			}
+
+			if (!read.success) {
+				LOG_FMT(Error, "Failed to read %llu bytes at offset %llu from textures.txlib!", read.data.size(), read.offset);
+			}
+
+			if (ov.hEvent != NULL) {
+				CloseHandle(ov.hEvent);
+			}
+		}
+	}
+
+	// Decompression and copying is done on the job system, so the I/O thread could continue with the next batch.
+	JobSystem::JobDecl decodeJob = { decodeIOBatchJob, batchData };
+	JobSystem::kickJobs(&decodeJob, 1, nullptr, JobSystem::JobType::NonWindows);
+}
+
+void ResourceLibrary::decodeIOBatchJob(void *param) {
+	DAR_OPTICK_EVENT("ResourceLibrary::decodeIOBatchJob");
+
+	auto batchData = reinterpret_cast<IOBatchData*>(param);
+	auto reslib = batchData->reslib;
+	auto &batch = batchData->batch;
+
+	for (int i = 0; i < batch.numRequests; ++i) {
+		auto &req = batch.requests[i];
+		const auto &location = batchData->locations[i];
+		if (req.success || location.read == -1 || !batchData->reads[location.read].success) {
+			continue;
+		}
+
+		const uint8_t *stored = batchData->reads[location.read].data.data() + location.offset;
+		req.success = req.imgData.loadFromMemory(stored, location.size, req.firstMip);
+		if (!req.success && location.reloaded) {
+			LOG_FMT(Error, "Failed to decode hot reloaded texture %s!", req.imageName.c_str());
+		}
+		if (req.success && !location.reloaded) {
+			reslib->imageCache.put(req.imageName, req.imgData);
+		}
+	}
+
+	if (batch.streamBatch != nullptr) {
+		auto lock = reslib->streamingLock.lock();
+		for (int i = 0; i < batch.numRequests; ++i) {
+			auto &req = batch.requests[i];
+			auto &imgPos = reslib->imageName2Data.find(req.imageName)->second;
+
+			--reslib->requestsInFlight;
+			imgPos.requestedMip = -1;
+			if (req.success) {
+				// Mips could have been released while the request was in flight, so the reserved memory is
+				// replaced by the actual difference from the resident mips.
+				const auto &header = imgPos.header;
+				const SizeType residentSize = imgPos.residentMip == -1 ? 0 : header.getMipChainSize(imgPos.residentMip);
+				reslib->residentTextureMemory -= batch.streamBatch->costs[i] + residentSize;
+				reslib->residentTextureMemory += header.getMipChainSize(req.imgData.firstMip);
+
+				imgPos.residentMip = req.imgData.firstMip;
+				reslib->streamedImages.push_back(req.imgData);
+			} else {
+				LOG_FMT(Error, "Failed to stream mips of texture %s!", req.imageName.c_str());
+				reslib->residentTextureMemory -= batch.streamBatch->costs[i];
+			}
+		}
+
+		delete batch.streamBatch;
+	} else {
+		for (int i = 0; i < batch.numRequests; ++i) {
+			auto &req = batch.requests[i];
+			if (req.success) {
+				reslib->updateResidency(reslib->imageName2Data.find(req.imageName)->second, req.imgData.firstMip);
+			}
+		}
+
+		JobSystem::signalFence(batch.fence);
+	}
+
+	delete batchData;
+}
+
 void ResourceLibrary::LoadShaderData() {
 	if (initShaderData) {
 		return;
@@ -64,29 +511,312 @@ void ResourceLibrary::LoadShaderData() {
 		return;
 	}
 
-	auto compiled = ShaderCompiler::readBlob(".\\res\\shaders\\shaders.shlib");
+	if (!mapShaderLibrary(L".\\res\\shaders\\shaders.shlib")) {
+		auto compiled = ShaderCompiler::readBlob(".\\res\\shaders\\shaders.shlib");
 
-	for (auto shader : compiled) {
-		addShader(shader);
+		for (auto shader : compiled) {
+			addShader(shader);
+		}
 	}
 
 	initShaderData = true;
 }
 
-void ResourceLibrary::addShader(ShaderCompiler::CompiledShader shader) {
-	if (auto it = shaders.find(shader.name); it != shaders.end()) {
-		it->second = shader.blob;
-	} else {
-		shaders.insert({ shader.name, shader.blob });
+bool ResourceLibrary::mapShaderLibrary(const WString &path) {
+	shaderLibFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (shaderLibFile == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(shaderLibFile, &fileSize);
+
+	shaderLibMapping = CreateFileMappingW(shaderLibFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (shaderLibMapping != nullptr) {
+		shaderLibView = reinterpret_cast<const uint8_t*>(MapViewOfFile(shaderLibMapping, FILE_MAP_READ, 0, 0, 0));
+	}
+
+	Vector<ShaderCompiler::ShaderLibEntry> entries;
+	const SizeType size = static_cast<SizeType>(fileSize.QuadPart);
+	if (shaderLibView == nullptr || !ShaderCompiler::readShaderLibIndex(shaderLibView, size, entries)) {
+		unmapShaderLibrary();
+		return false;
+	}
+
+	if (dxcUtils == nullptr) {
+		DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(dxcUtils.GetAddressOf()));
+	}
+
+	auto lock = shadersLock.lock();
+	for (auto &entry : entries) {
+		shaders.insert_or_assign(entry.name, ShaderEntry{ shaderLibView + entry.offset, entry.size, entry.hash, nullptr });
 	}
+
+	LOG_FMT(Info, "Mapped shader library with %llu shaders", entries.size());
+
+	return true;
+}
+
+void ResourceLibrary::unmapShaderLibrary() {
+	if (shaderLibView != nullptr) {
+		UnmapViewOfFile(shaderLibView);
+		shaderLibView = nullptr;
+	}
+
+	if (shaderLibMapping != nullptr) {
+		CloseHandle(shaderLibMapping);
+		shaderLibMapping = nullptr;
+	}
+
+	if (shaderLibFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(shaderLibFile);
+		shaderLibFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+void ResourceLibrary::addShader(ShaderCompiler::CompiledShader shader) {
+	auto lock = shadersLock.lock();
+	shaders.insert_or_assign(shader.name, ShaderEntry{ nullptr, 0, 0, shader.blob });
 }
 
 IDxcBlob *ResourceLibrary::getShader(const String &name) const {
-	if (auto it = shaders.find(name); it != shaders.end()) {
-		return it->second.Get();
+	auto lock = shadersLock.lock();
+
+	auto it = shaders.find(name);
+	if (it == shaders.end()) {
+		return nullptr;
+	}
+
+	auto &entry = it->second;
+	if (entry.blob == nullptr && entry.data != nullptr) {
+		if (hashData(entry.data, entry.size) != entry.hash) {
+			LOG_FMT(Error, "Shader %s is corrupted!", name.c_str());
+			return nullptr;
+		}
+
+		ComPtr<IDxcBlobEncoding> blobEncoding;
+		if (SUCCEEDED(dxcUtils->CreateBlobFromPinned(entry.data, static_cast<UINT32>(entry.size), DXC_CP_ACP, blobEncoding.GetAddressOf()))) {
+			blobEncoding.As<IDxcBlob>(&entry.blob);
+		}
+	}
+
+	return entry.blob.Get();
+}
+
+/// @return 0 if the file doesn't exist.
+static uint64_t getLastWriteTime(const WString &path) {
+	WIN32_FILE_ATTRIBUTE_DATA data = {};
+	if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+		return 0;
+	}
+
+	return (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+/// @return Milliseconds passed since the given file time.
+static double getMillisecondsSince(uint64_t fileTime) {
+	FILETIME now = {};
+	GetSystemTimeAsFileTime(&now);
+	const uint64_t nowTime = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+	// File times are in 100ns intervals.
+	return nowTime > fileTime ? static_cast<double>(nowTime - fileTime) / 10000.0 : 0.0;
+}
+
+static bool readWholeFile(const WString &path, Vector<uint8_t> &data) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!ifs.good()) {
+		return false;
+	}
+
+	data.resize(static_cast<SizeType>(ifs.tellg()));
+	ifs.seekg(0, std::ios::beg);
+	ifs.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	return !ifs.fail();
+}
+
+bool ResourceLibrary::pollHotReload(HotReloadChanges &changes) {
+	DAR_OPTICK_EVENT("ResourceLibrary::pollHotReload");
+
+	const WString shadersDelta = L".\\res\\shaders.delta.shlib";
+	const WString texturesDelta = L".\\res\\textures.delta.txlib";
+
+	const SizeType numShaders = changes.shaders.size();
+	const SizeType numTextures = changes.textures.size();
+
+	// Deltas older than the library were written before it was last built.
+	const uint64_t shadersTime = getLastWriteTime(shadersDelta);
+	if (shadersTime > shadersDeltaTime && shadersTime > getLastWriteTime(L".\\res\\shaders\\shaders.shlib")) {
+		Timer timer;
+		if (applyShadersDelta(shadersDelta, changes)) {
+			shadersDeltaTime = shadersTime;
+			LOG_FMT(
+				Info,
+				"Hot reloaded %llu shaders in %.2fms, %.2fms after the delta was written",
+				changes.shaders.size() - numShaders, timer.time(), getMillisecondsSince(shadersTime)
+			);
+		}
+	}
+
+	const uint64_t texturesTime = getLastWriteTime(texturesDelta);
+	if (texturesTime > texturesDeltaTime && texturesTime > getLastWriteTime(L".\\res\\textures\\textures.txlib")) {
+		Timer timer;
+		if (applyTexturesDelta(texturesDelta, changes)) {
+			texturesDeltaTime = texturesTime;
+			LOG_FMT(
+				Info,
+				"Hot reloaded %llu textures in %.2fms, %.2fms after the delta was written",
+				changes.textures.size() - numTextures, timer.time(), getMillisecondsSince(texturesTime)
+			);
+		}
+	}
+
+	return changes.shaders.size() != numShaders || changes.textures.size() != numTextures;
+}
+
+bool ResourceLibrary::applyShadersDelta(const WString &path, HotReloadChanges &changes) {
+	// The delta could be rewritten at any moment, so it's read as a whole instead of mapped.
+	Vector<uint8_t> data;
+	Vector<ShaderCompiler::ShaderLibEntry> entries;
+	if (!readWholeFile(path, data) || !ShaderCompiler::readShaderLibIndex(data.data(), data.size(), entries)) {
+		LOG(Error, "Failed to read shaders delta!");
+		return false;
+	}
+
+	if (dxcUtils == nullptr) {
+		DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(dxcUtils.GetAddressOf()));
+	}
+
+	auto lock = shadersLock.lock();
+	for (auto &entry : entries) {
+		// Each delta contains all shaders changed since the watch started. Skip the ones already up to date.
+		auto it = shaders.find(entry.name);
+		if (it != shaders.end() && it->second.hash == entry.hash) {
+			continue;
+		}
+
+		if (hashData(data.data() + entry.offset, entry.size) != entry.hash) {
+			LOG_FMT(Error, "Shader %s in the delta is corrupted!", entry.name.c_str());
+			continue;
+		}
+
+		ComPtr<IDxcBlobEncoding> blobEncoding;
+		ComPtr<IDxcBlob> blob;
+		if (FAILED(dxcUtils->CreateBlob(data.data() + entry.offset, static_cast<UINT32>(entry.size), DXC_CP_ACP, blobEncoding.GetAddressOf()))) {
+			continue;
+		}
+		blobEncoding.As<IDxcBlob>(&blob);
+
+		shaders.insert_or_assign(entry.name, ShaderEntry{ nullptr, 0, entry.hash, blob });
+		changes.shaders.push_back(entry.name);
+	}
+
+	return true;
+}
+
+bool ResourceLibrary::applyTexturesDelta(const WString &path, HotReloadChanges &changes) {
+	// The delta could be rewritten at any moment, so the header is parsed from the same read as the image data.
+	Vector<uint8_t> data;
+	TxLib::Header header;
+	if (readWholeFile(path, data)) {
+		header = TxLib::readHeader(data.data(), data.size(), "textures.delta.txlib");
+	}
+
+	if (header.imgDataStartPos == TxLib::INVALID_IMG_DATA_POS) {
+		LOG(Error, "Failed to read textures delta!");
+		return false;
+	}
+
+	auto lock = reloadedImagesLock.lock();
+	SizeType pos = header.imgDataStartPos;
+	for (auto &imgh : header.headers) {
+		const SizeType storedSize = imgh.getStoredSize();
+		if (pos + storedSize > data.size()) {
+			LOG(Error, "Textures delta is corrupted!");
+			return false;
+		}
+
+		const uint8_t *stored = data.data() + pos;
+		pos += storedSize;
+
+		// The textures of the app are created from the textures in the library.
+		if (imageName2Data.find(imgh.filename) == imageName2Data.end()) {
+			LOG_FMT(Warning, "Texture %s is not in the texture library and can't be hot reloaded!", imgh.filename.c_str());
+			continue;
+		}
+
+		// Each delta contains all textures changed since the watch started. Skip the ones already up to date.
+		auto it = reloadedImages.find(imgh.filename);
+		if (it != reloadedImages.end() && it->second.stored.size() == storedSize && memcmp(it->second.stored.data(), stored, storedSize) == 0) {
+			continue;
+		}
+
+		reloadedImages[imgh.filename] = ReloadedImage{ imgh, Vector<uint8_t>(stored, stored + storedSize) };
+		imageCache.remove(imgh.filename);
+		changes.textures.push_back(imgh.filename);
+	}
+
+	return true;
+}
+
+Optional<ImageData> ResourceLibrary::getReloadedImage(const String &imageName, int firstMip) const {
+	auto lock = reloadedImagesLock.lock();
+
+	auto it = reloadedImages.find(imageName);
+	if (it == reloadedImages.end()) {
+		return std::nullopt;
+	}
+
+	const auto &reloaded = it->second;
+	firstMip = std::max(0, std::min(firstMip, reloaded.header.mipMapCount - 1));
+
+	SizeType offset = 0;
+	SizeType size = 0;
+	reloaded.header.getStoredRange(firstMip, offset, size);
+
+	ImageData img{ .header = reloaded.header };
+	if (!img.loadFromMemory(reloaded.stored.data() + offset, size, firstMip)) {
+		LOG_FMT(Error, "Failed to decode hot reloaded texture %s!", imageName.c_str());
+		return ImageData{};
+	}
+
+	return img;
+}
+
+bool ResourceLibrary::readReloadedImage(const String &imageName, int &firstMip, ImageHeader &header, Vector<uint8_t> &stored) const {
+	auto lock = reloadedImagesLock.lock();
+
+	auto it = reloadedImages.find(imageName);
+	if (it == reloadedImages.end()) {
+		return false;
+	}
+
+	const auto &reloaded = it->second;
+	firstMip = std::max(0, std::min(firstMip, reloaded.header.mipMapCount - 1));
+
+	SizeType offset = 0;
+	SizeType size = 0;
+	reloaded.header.getStoredRange(firstMip, offset, size);
+
+	header = reloaded.header;
+	stored.assign(reloaded.stored.begin() + offset, reloaded.stored.begin() + offset + size);
+
+	return true;
+}
+
+ResourceLibrary::~ResourceLibrary() {
+	if (ioThread.joinable()) {
+		++stopIOThread;
+		while (!ioBatches.push(IOBatch{})) {
+			YieldProcessor();
+		}
+		ioThread.join();
 	}
 
-	return nullptr;
+	// Blobs of the shader library point into the mapping
+	shaders.clear();
+	unmapShaderLibrary();
 }
 
 static ResourceLibrary *reslib = nullptr;
@@ -104,6 +834,8 @@ ResourceLibrary& getResourceLibrary() {
 void deinitResourceLibrary() {
 	delete reslib;
 	reslib = nullptr;
+
+	trimImageBufferPool();
 }
 
 } // namespace Dar
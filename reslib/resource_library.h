@@ -1,33 +1,229 @@
 #pragma once
 
 #include "async/async.h"
+#include "async/job_system.h"
+#include "image_cache.h"
 #include "serde.h"
 
+#include <thread>
+
 namespace Dar {
 
+struct TextureStreamingSettings {
+	SizeType memoryBudget = SizeType(512) * 1024 * 1024; ///< Max bytes of texture data allowed to be resident at the same time.
+	int numResidentMips = 4; ///< Number of the coarsest mip-levels loaded up-front for each texture.
+	int maxRequestsInFlight = 8; ///< Max number of mip chains that are being read at the same time.
+	bool enabled = false;
+};
+
+/// Request for loading image data through ResourceLibrary::requestImageData().
+struct ImageDataRequest {
+	String imageName;
+	int firstMip = 0; ///< Most detailed mip-level to load.
+	ImageData imgData; ///< Receives the loaded data.
+	bool success = false;
+};
+
+/// Resources replaced by ResourceLibrary::pollHotReload().
+struct HotReloadChanges {
+	Vector<String> shaders; ///< Names of the replaced shaders. Every variant is listed on its own.
+	Vector<String> textures; ///< Names of the replaced images.
+};
+
 class ResourceLibrary {
 public:
+	~ResourceLibrary();
+
 	// Texture resources
 	void LoadTextureData();
-	ImageData getImageData(const String &imageName) const;
+
+	/// Load the mip chain of an image starting at mip-level `firstMip`.
+	/// Served from the image cache if possible.
+	ImageData getImageData(const String &imageName, int firstMip = 0) const;
+
+	/// Cache of loaded images. Could be used for caching images not coming from the txlib as well.
+	ImageCache& getImageCache() const;
+
+	/// Asynchronously load a batch of images. The requests are sorted by their position in the txlib
+	/// and neighbouring ones are merged into large sequential reads done on a dedicated I/O thread,
+	/// so no fiber is blocked on the disk.
+	/// @param requests Requests to be served. Must be kept alive until the fence is signaled.
+	/// @param fence Signaled once all requests are done. Wait on it with JobSystem::waitFence(AndFree).
+	void requestImageData(ImageDataRequest *requests, int numRequests, JobSystem::Fence **fence);
+
+	/// Texture streaming.
+	/// When enabled textures should be first loaded with only their coarsest mips(see getInitialMip()).
+	/// More detailed mips are then requested via requestImageMips() and read in the background
+	/// through the job system. Finished requests are polled with popStreamedImage().
+	void setTextureStreaming(const TextureStreamingSettings &settings);
+	const TextureStreamingSettings& getTextureStreaming() const;
+
+	/// @return The most detailed mip-level that should be loaded initially for the image.
+	///         Always 0 if streaming is disabled.
+	int getInitialMip(const String &imageName) const;
+
+	/// Request the mip chain of `imageName` starting at `mip` to be streamed in.
+	/// @param priority Requests with higher priority are served first. Usually the screen-space
+	///                 size of the geometry that uses the image.
+	void requestImageMips(const String &imageName, int mip, float priority);
+
+	/// Kick jobs for the pending requests with highest priority that fit in the memory budget.
+	/// Pending requests that were not served are dropped. They are expected to be re-requested.
+	/// @return Bytes needed by the requests which didn't fit in the memory budget. Mips that are no longer needed
+	///         should be released with releaseImageMips() to make space for them.
+	SizeType kickStreamingRequests();
+
+	/// Notify that the mips more detailed than `firstMip` of the image are no longer resident,
+	/// f.e the texture using them was recreated with less mips. Their memory is returned to the streaming budget.
+	void releaseImageMips(const String &imageName, int firstMip);
+
+	/// Notify that none of the mips of the image is resident anymore.
+	void releaseImage(const String &imageName);
+
+	/// Pop a finished streaming request.
+	/// @return false if there are no finished requests.
+	bool popStreamedImage(ImageData &imgData);
+
+	/// @return Number of bytes of texture data that are currently resident.
+	SizeType getResidentTextureMemory() const;
 
 	// Shader resources
+
+	/// Memory-map the shader library. Shaders are not loaded until they are used.
+	/// Libraries in the old, non-indexed, format are loaded whole.
 	void LoadShaderData();
 	void addShader(ShaderCompiler::CompiledShader shader);
+
+	/// Get a shader by name. Shaders from the shader library are created on first use
+	/// and point directly into the mapped file, so they are valid while the library is alive.
 	IDxcBlob *getShader(const String &name) const;
 
+	// Hot reload
+
+	/// Apply the delta libraries written by `resourcecompiler --watch` found in the res folder.
+	/// A delta is applied if it's newer than both the library it patches and the last applied delta.
+	/// Shaders are replaced in place, so pipeline states using them need to be recreated(see Renderer::reloadShaders()).
+	/// Replaced images are served by getImageData() and requestImageData() from then on.
+	/// Only checks the modification time of the deltas if there are no new ones, so it could be called every frame.
+	/// @return true if any resource was replaced.
+	bool pollHotReload(HotReloadChanges &changes);
+
 	// TODO: other resources...
 
 private:
 	ResourceLibrary() = default;
 
 	struct ImagePos {
-		ImageData data;
+		ImageHeader header;
 		SizeType pos;
+		int residentMip = -1; ///< Most detailed mip-level handed out so far. -1 if the image is not loaded.
+		int requestedMip = -1; ///< Mip-level of the streaming request in flight. -1 if there is none.
+	};
+
+	struct MipStreamRequest {
+		String imageName;
+		int mip;
+		float priority;
 	};
 
-	Map<String, ComPtr<IDxcBlob>> shaders;
+	struct MipStreamBatch {
+		Vector<ImageDataRequest> requests;
+		Vector<SizeType> costs; ///< Bytes reserved in the memory budget for each request.
+	};
+
+	struct IOBatch {
+		ImageDataRequest *requests = nullptr;
+		int numRequests = 0;
+		JobSystem::Fence *fence = nullptr; ///< Signaled when the batch is done.
+		MipStreamBatch *streamBatch = nullptr; ///< Set for batches of mip streaming requests.
+	};
+
+	/// A single sequential read, possibly serving multiple requests.
+	struct IORead {
+		Vector<uint8_t> data;
+		SizeType offset = 0; ///< Offset in the txlib file.
+		bool success = false;
+	};
+
+	/// Where the stored data of a request is found after the reads of a batch are done.
+	struct IORequestLocation {
+		int read = -1;
+		SizeType offset = 0; ///< Offset in the data of the read.
+		SizeType size = 0;
+		bool reloaded = false; ///< The data comes from a textures delta. Such images are not cached.
+	};
+
+	struct IOBatchData {
+		ResourceLibrary *reslib;
+		IOBatch batch;
+		Vector<IORead> reads;
+		Vector<IORequestLocation> locations;
+	};
+
+	struct ShaderEntry {
+		const uint8_t *data = nullptr; ///< DXIL in the mapped shader library. nullptr for shaders added with addShader().
+		SizeType size = 0;
+		uint64_t hash = 0;
+		ComPtr<IDxcBlob> blob; ///< Created on first use for shaders in the shader library.
+	};
+
+	/// Image replaced by a textures delta.
+	struct ReloadedImage {
+		ImageHeader header;
+		Vector<uint8_t> stored; ///< Stored data of the whole mip chain.
+	};
+
+	bool mapShaderLibrary(const WString &path);
+	void unmapShaderLibrary();
+
+	void updateResidency(ImagePos &img, int mip) const;
+
+	void pushIOBatch(const IOBatch &batch);
+	void ioThreadLoop();
+	void processIOBatch(HANDLE file, const IOBatch &batch);
+
+	static void decodeIOBatchJob(void *param);
+
+	bool applyShadersDelta(const WString &path, HotReloadChanges &changes);
+	bool applyTexturesDelta(const WString &path, HotReloadChanges &changes);
+
+	/// @return nullopt if the image was not replaced by a delta.
+	Optional<ImageData> getReloadedImage(const String &imageName, int firstMip) const;
+
+	/// Copy the stored data of a reloaded image starting from firstMip, without decoding it.
+	/// Used by the I/O thread, which can't wait for the jobs decoding the image.
+	/// @param firstMip Clamped to the mip-levels of the reloaded image.
+	/// @return false if the image was not replaced by a delta.
+	bool readReloadedImage(const String &imageName, int &firstMip, ImageHeader &header, Vector<uint8_t> &stored) const;
+
+	mutable Map<String, ShaderEntry> shaders;
+	mutable SpinLock shadersLock;
+	ComPtr<IDxcUtils> dxcUtils;
+	HANDLE shaderLibFile = INVALID_HANDLE_VALUE;
+	HANDLE shaderLibMapping = nullptr;
+	const uint8_t *shaderLibView = nullptr;
 	mutable Map<String, ImagePos> imageName2Data;
+	mutable ImageCache imageCache;
+
+	// Streaming
+	TextureStreamingSettings streamingSettings;
+	Vector<MipStreamRequest> pendingRequests;
+	Vector<ImageData> streamedImages;
+	mutable SizeType residentTextureMemory = 0;
+	int requestsInFlight = 0;
+	mutable SpinLock streamingLock;
+
+	// Hot reload
+	Map<String, ReloadedImage> reloadedImages;
+	mutable SpinLock reloadedImagesLock;
+	uint64_t shadersDeltaTime = 0; ///< Last write time of the last applied shaders delta.
+	uint64_t texturesDeltaTime = 0; ///< Last write time of the last applied textures delta.
+
+	// I/O
+	ThreadSafeQueue<IOBatch, 64, true> ioBatches;
+	std::thread ioThread;
+	Atomic<int> stopIOThread = 0;
+	SpinLock ioThreadLock;
 
 	SpinLock initializing;
 	bool initTextureData = false;
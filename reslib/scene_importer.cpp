@@ -0,0 +1,883 @@
+#include "scene_importer.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
+
+#include "assimp/Importer.hpp"
+#include "assimp/scene.h"
+#include "assimp/postprocess.h"
+#include "assimp/GltfMaterial.h"
+#include "MikkTSpace/mikktspace.h"
+#include "nlohmann/json.hpp"
+
+#include "async/job_system.h"
+#include "utils/timer.h"
+
+#include <algorithm>
+#include <fstream>
+
+#define USE_MIKKTSPACE
+
+namespace Dar {
+
+namespace ScnLib {
+
+/// Each LOD targets this ratio of the triangles of the previous one.
+constexpr float LOD_TRIANGLE_RATIO = 0.5f;
+
+/// LODs keeping more than this ratio of the triangles of the previous one are not worth it, so they are dropped.
+constexpr float LOD_MAX_KEPT_RATIO = 0.8f;
+
+/// Max error of the LODs relative to the diagonal of the mesh's bounding box.
+constexpr float LOD_MAX_RELATIVE_ERROR = 0.05f;
+
+struct MikkTSpaceMeshData {
+	Vertex *vertices; ///< First vertex of the mesh in the scene. Indices of the faces are relative to it.
+	aiMesh *mesh;
+};
+
+/// Helper structure for generating the tangents with the MikkTSpace algorithm
+/// as given by glTF2.0 specs.
+struct MikkTSpaceTangentSpaceGenerator {
+	void init(MikkTSpaceMeshData *meshData) {
+		tSpaceIface.m_getNumFaces = getNumFaces;
+		tSpaceIface.m_getNormal = getNormal;
+		tSpaceIface.m_getNumVerticesOfFace = getNumVerticesOfFace;
+		tSpaceIface.m_getPosition = getPosition;
+		tSpaceIface.m_getTexCoord = getTexCoord;
+		tSpaceIface.m_setTSpaceBasic = setTSpaceBasic;
+
+		tSpaceCtx.m_pInterface = &tSpaceIface;
+		tSpaceCtx.m_pUserData = reinterpret_cast<void*>(meshData);
+	}
+
+	tbool generateTangets() {
+		return genTangSpaceDefault(&tSpaceCtx);
+	}
+
+private:
+	SMikkTSpaceInterface tSpaceIface = {};
+	SMikkTSpaceContext tSpaceCtx = {};
+
+	static int getNumFaces(const SMikkTSpaceContext *pContext) {
+		MikkTSpaceMeshData *meshData = static_cast<MikkTSpaceMeshData *>(pContext->m_pUserData);
+		return meshData->mesh->mNumFaces;
+	}
+
+	static int getNumVerticesOfFace(const SMikkTSpaceContext */*pContext*/, const int /*iFace*/) {
+		return 3; // We always triangulate the imported mesh
+	}
+
+	static void getPosition(const SMikkTSpaceContext *pContext, float fvPosOut[], const int iFace, const int iVert) {
+		MikkTSpaceMeshData *meshData = static_cast<MikkTSpaceMeshData*>(pContext->m_pUserData);
+		aiMesh *mesh = meshData->mesh;
+		aiVector3D &v = mesh->mVertices[mesh->mFaces[iFace].mIndices[iVert]];
+		fvPosOut[0] = v.x;
+		fvPosOut[1] = v.y;
+		fvPosOut[2] = v.z;
+	}
+
+	static void getNormal(const SMikkTSpaceContext *pContext, float fvNormOut[], const int iFace, const int iVert) {
+		MikkTSpaceMeshData *meshData = static_cast<MikkTSpaceMeshData*>(pContext->m_pUserData);
+		aiMesh *mesh = meshData->mesh;
+		aiVector3D &v = mesh->mNormals[mesh->mFaces[iFace].mIndices[iVert]];
+		fvNormOut[0] = v.x;
+		fvNormOut[1] = v.y;
+		fvNormOut[2] = v.z;
+	}
+
+	static void getTexCoord(const SMikkTSpaceContext *pContext, float fvTexcOut[], const int iFace, const int iVert) {
+		MikkTSpaceMeshData *meshData = static_cast<MikkTSpaceMeshData*>(pContext->m_pUserData);
+		aiMesh *mesh = meshData->mesh;
+		aiVector3D &uv = mesh->mTextureCoords[0][mesh->mFaces[iFace].mIndices[iVert]];
+		fvTexcOut[0] = uv.x;
+		fvTexcOut[1] = uv.y;
+	}
+
+	static void setTSpaceBasic(const SMikkTSpaceContext *pContext, const float fvTangent[], const float /*fSign*/, const int iFace, const int iVert) {
+		MikkTSpaceMeshData *meshData = static_cast<MikkTSpaceMeshData*>(pContext->m_pUserData);
+		const aiMesh &mesh = *meshData->mesh;
+
+		Vertex &v = meshData->vertices[mesh.mFaces[iFace].mIndices[iVert]];
+		v.tangent.x = fvTangent[0];
+		v.tangent.y = fvTangent[1];
+		v.tangent.z = fvTangent[2];
+
+		// TODO: Ignore the sign for now. See if that's needed.
+		// v.tangentSign = fSign;
+	}
+};
+
+/// Mesh to be processed in the second pass of the import.
+/// Offsets are known up front, so meshes are processed in parallel into the presized vertex and index arrays.
+struct MeshTask {
+	aiMesh *mesh = nullptr;
+	uint32_t meshIndex = 0; ///< Index in SceneData::meshes.
+	SizeType vertexOffset = 0;
+	bool genTangents = false;
+	MeshOptimizer::VertexCacheStats statsBefore; ///< Vertex cache stats of the imported index order.
+	MeshOptimizer::VertexCacheStats statsAfter; ///< Vertex cache stats after optimizeMesh().
+	Vector<uint32_t> lodIndices[MAX_MESH_LODS]; ///< Indices of the LODs, moved into the scene after all meshes are done.
+	float lodErrors[MAX_MESH_LODS] = {};
+	Meshlets::MeshletData meshlets; ///< Meshlets of the mesh, moved into the scene after all meshes are done.
+	Meshlets::ValidationStats meshletStats;
+};
+
+/// State of the import of a single model.
+struct ImportContext {
+	const aiScene *assimpScene = nullptr;
+	SceneData *scene = nullptr;
+	ImportFlags flags = importFlags_none;
+	Vector<Vector<uint32_t>> children; ///< Children of each node. Flattened into SceneData::children at the end.
+	Map<unsigned int, uint32_t> materialIds; ///< Assimp material index to index in SceneData::materials.
+	Vector<MeshTask> meshTasks; ///< Meshes found by the first pass, in the order of SceneData::meshes.
+	SizeType vertexOffset = 0;
+	SizeType indexOffset = 0;
+	ImportStats stats;
+};
+
+static uint32_t loadTexture(aiMaterial *aiMat, aiTextureType aiType, SceneData &scene) {
+	const int matTypeCount = aiMat->GetTextureCount(aiType);
+	if (matTypeCount <= 0 && aiType != aiTextureType_METALNESS) {
+		return INVALID_INDEX;
+	}
+
+	// Only read the first texture, for now we won't export
+	// multiple textures per channel.
+	aiString path;
+
+	// Assimp + glTF pain
+	if (aiType == aiTextureType_METALNESS) {
+		aiMat->GetTexture(AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_METALLICROUGHNESS_TEXTURE, &path);
+	} else {
+		aiMat->GetTexture(aiType, 0, &path);
+	}
+
+	if (path.length <= 0) {
+		return INVALID_INDEX;
+	}
+
+	// Do not support embeded textures, yet.
+	if (*path.C_Str() == '*') {
+		dassert(false);
+		return INVALID_INDEX;
+	}
+
+	return scene.addTexture(path.C_Str());
+}
+
+static Vec3 aiVector3DToVec3(const aiVector3D &aiVec) {
+	return Vec3{ aiVec.x, aiVec.y, aiVec.z };
+};
+
+static Vec3 aiVector3DToVec3(const aiColor3D &aiVec) {
+	return Vec3{ aiVec.r, aiVec.g, aiVec.b };
+};
+
+static uint32_t readMaterialDataForMesh(aiMesh *mesh, ImportContext &ctx) {
+	auto matIdx = mesh->mMaterialIndex;
+	if (matIdx >= ctx.assimpScene->mNumMaterials) {
+		return INVALID_INDEX;
+	}
+
+	// Meshes sharing an assimp material share the material
+	auto it = ctx.materialIds.find(matIdx);
+	if (it != ctx.materialIds.end()) {
+		return it->second;
+	}
+
+	aiMaterial *aiMat = ctx.assimpScene->mMaterials[matIdx];
+	SceneData &scene = *ctx.scene;
+
+	// PBR model materials
+	Material material;
+	material.baseColorTexture = loadTexture(aiMat, aiTextureType_BASE_COLOR, scene);
+	material.normalsTexture = loadTexture(aiMat, aiTextureType_NORMALS, scene);
+	material.metallicRoughnessTexture = loadTexture(aiMat, aiTextureType_METALNESS, scene);
+	material.ambientOcclusionTexture = loadTexture(aiMat, aiTextureType_AMBIENT_OCCLUSION, scene);
+
+	ai_real metallicFactor, roughnessFactor;
+	aiVector3D baseColorFactor;
+	aiReturn result = aiMat->Get(AI_MATKEY_BASE_COLOR, baseColorFactor);
+	material.baseColorFactor = result == AI_SUCCESS ? aiVector3DToVec3(baseColorFactor) : Vec3(1.f);
+
+	result = aiMat->Get(AI_MATKEY_METALLIC_FACTOR, metallicFactor);
+	material.metallicFactor = result == AI_SUCCESS ? metallicFactor : 1.f;
+
+	result = aiMat->Get(AI_MATKEY_ROUGHNESS_FACTOR, roughnessFactor);
+	material.roughnessFactor = result == AI_SUCCESS ? roughnessFactor : 1.f;
+
+	const auto id = static_cast<uint32_t>(scene.materials.size());
+	scene.materials.push_back(material);
+	ctx.materialIds[matIdx] = id;
+
+	return id;
+}
+
+static uint32_t addNode(const Node &node, ImportContext &ctx) {
+	const auto id = static_cast<uint32_t>(ctx.scene->nodes.size());
+	ctx.scene->nodes.push_back(node);
+	ctx.children.emplace_back();
+
+	return id;
+}
+
+static void addLightsAndCameras(ImportContext &ctx) {
+	const aiScene *aiScene = ctx.assimpScene;
+	SceneData &scene = *ctx.scene;
+
+	for (unsigned int i = 0; i < aiScene->mNumLights; ++i) {
+		aiLight *aiL = aiScene->mLights[i];
+		if (aiL == nullptr) {
+			continue;
+		}
+
+		Light light;
+		switch (aiL->mType) {
+		case aiLightSource_DIRECTIONAL:
+			light.type = LightType::Directional;
+			break;
+		case aiLightSource_POINT:
+			light.type = LightType::Point;
+			break;
+		case aiLightSource_SPOT:
+			light.type = LightType::Spot;
+			break;
+		default:
+			continue;
+		}
+
+		light.position = aiVector3DToVec3(aiL->mPosition);
+		light.diffuse = aiVector3DToVec3(aiL->mColorDiffuse);
+		light.specular = aiVector3DToVec3(aiL->mColorSpecular);
+		light.ambient = aiVector3DToVec3(aiL->mColorAmbient);
+		light.direction = aiVector3DToVec3(aiL->mDirection);
+		light.attenuation = Vec3{ aiL->mAttenuationConstant, aiL->mAttenuationLinear, aiL->mAttenuationQuadratic };
+		light.innerAngleCutoff = cos(aiL->mAngleInnerCone);
+		light.outerAngleCutoff = cos(aiL->mAngleOuterCone);
+
+		Node node;
+		node.type = NodeType::Light;
+		node.index = static_cast<uint32_t>(scene.lights.size());
+		scene.lights.push_back(light);
+		addNode(node, ctx);
+	}
+
+	for (unsigned int i = 0; i < aiScene->mNumCameras; ++i) {
+		aiCamera *aiCam = aiScene->mCameras[i];
+		if (aiCam == nullptr) {
+			continue;
+		}
+
+		Camera cam;
+		cam.position = aiVector3DToVec3(aiCam->mPosition);
+		cam.nearPlane = aiCam->mClipPlaneNear;
+		cam.farPlane = aiCam->mClipPlaneFar;
+
+		if (std::fabs(aiCam->mOrthographicWidth) < 1e-6f) {
+			cam.type = CameraType::Perspective;
+			cam.fov = aiCam->mHorizontalFOV;
+			cam.aspectRatio = aiCam->mAspect;
+		} else {
+			cam.type = CameraType::Orthographic;
+			cam.width = 2 * aiCam->mOrthographicWidth;
+			cam.height = 2 * aiCam->mOrthographicWidth / aiCam->mAspect;
+		}
+
+		Node node;
+		node.type = NodeType::Camera;
+		node.index = static_cast<uint32_t>(scene.cameras.size());
+		scene.cameras.push_back(cam);
+		addNode(node, ctx);
+	}
+}
+
+/// First pass of the import. Walk the nodes, create the meshes, materials and textures
+/// in the order they are found and compute where the vertices and indices of each mesh go.
+static void traverseAssimpScene(aiNode *node, uint32_t parentNode, ImportContext &ctx) {
+	const aiScene *aiScene = ctx.assimpScene;
+	dassert(aiScene != nullptr);
+
+	if (node == nullptr || aiScene == nullptr) {
+		return;
+	}
+
+	SceneData &scene = *ctx.scene;
+
+	if (node == aiScene->mRootNode) {
+		addLightsAndCameras(ctx);
+	}
+
+	Node model;
+	model.type = NodeType::Model;
+	model.index = static_cast<uint32_t>(scene.meshes.size());
+	model.numMeshes = node->mNumMeshes;
+
+	for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
+		aiMesh *mesh = aiScene->mMeshes[node->mMeshes[i]];
+
+		MeshTask task;
+		task.mesh = mesh;
+		task.meshIndex = static_cast<uint32_t>(scene.meshes.size());
+		task.vertexOffset = ctx.vertexOffset;
+		task.genTangents = mesh->HasTextureCoords(0) && ((ctx.flags & importFlags_overrideGenTangents) || !mesh->HasTangentsAndBitangents());
+
+		// Setup the mesh
+		Mesh resMesh;
+		resMesh.indexOffset = static_cast<uint32_t>(ctx.indexOffset);
+		resMesh.baseVertex = static_cast<uint32_t>(ctx.vertexOffset);
+		resMesh.numVertices = mesh->mNumVertices;
+		resMesh.numIndices = 0;
+		for (unsigned int j = 0; j < mesh->mNumFaces; ++j) {
+			resMesh.numIndices += mesh->mFaces[j].mNumIndices;
+		}
+		resMesh.material = readMaterialDataForMesh(mesh, ctx);
+
+		scene.meshes.push_back(resMesh);
+		ctx.meshTasks.push_back(task);
+
+		// Make sure the next mesh knows where its vertices and indices begin
+		ctx.indexOffset += resMesh.numIndices;
+		ctx.vertexOffset += mesh->mNumVertices;
+	}
+
+	// Only nodes with meshes are part of the scene
+	uint32_t modelId = INVALID_INDEX;
+	if (node->mNumMeshes > 0) {
+		modelId = addNode(model, ctx);
+
+		if (parentNode != INVALID_INDEX) {
+			ctx.children[parentNode].push_back(modelId);
+		}
+	}
+
+	for (unsigned int i = 0; i < node->mNumChildren; ++i) {
+		traverseAssimpScene(node->mChildren[i], modelId, ctx);
+	}
+}
+
+/// Second pass of the import. Convert the vertices and indices of a mesh, generate the missing normals and tangents.
+/// Only the mesh's own range of the scene's arrays is written, so meshes are safe to process in parallel.
+static void processMesh(const MeshTask &task, SceneData &scene) {
+	aiMesh *mesh = task.mesh;
+	Mesh &resMesh = scene.meshes[task.meshIndex];
+	const bool genTangents = task.genTangents;
+
+	resMesh.boxMin = Vec3(1e20f);
+	resMesh.boxMax = Vec3(-1e20f);
+
+	// save vertex data for the mesh in the global scene structure
+	for (unsigned int j = 0; j < mesh->mNumVertices; ++j) {
+		Vertex &vertex = scene.vertices[task.vertexOffset + j];
+		vertex = {};
+		vertex.pos = aiVector3DToVec3(mesh->mVertices[j]);
+
+		if (mesh->HasTextureCoords(0)) {
+			vertex.uv.x = mesh->mTextureCoords[0][j].x;
+			vertex.uv.y = mesh->mTextureCoords[0][j].y;
+		}
+
+		if (mesh->HasNormals()) {
+			vertex.normal = aiVector3DToVec3(mesh->mNormals[j]);
+		}
+
+		if (mesh->HasTangentsAndBitangents() && !genTangents) {
+			vertex.tangent = aiVector3DToVec3(mesh->mTangents[j]);
+		}
+
+		resMesh.boxMin = glm::min(resMesh.boxMin, vertex.pos);
+		resMesh.boxMax = glm::max(resMesh.boxMax, vertex.pos);
+	}
+
+	// Read the mesh indices into the index buffer
+	SizeType index = resMesh.indexOffset;
+	for (unsigned int j = 0; j < mesh->mNumFaces; ++j) {
+		aiFace &face = mesh->mFaces[j];
+
+		// We should have triangulated the mesh already
+		dassert(face.mNumIndices == 3);
+
+		// Indices are relative to the first vertex of the mesh, see Mesh::baseVertex
+		for (unsigned int k = 0; k < face.mNumIndices; ++k) {
+			scene.indices[index++] = face.mIndices[k];
+		}
+
+		// Generate normals and tangents if the mesh doesn't contain them
+		if (!mesh->HasNormals() || !mesh->HasTangentsAndBitangents() || (genTangents && !mesh->HasNormals())) {
+			Vertex *v[3];
+			v[0] = &scene.vertices[task.vertexOffset + face.mIndices[0]];
+			v[1] = &scene.vertices[task.vertexOffset + face.mIndices[1]];
+			v[2] = &scene.vertices[task.vertexOffset + face.mIndices[2]];
+
+			Vec3 edge0 = v[1]->pos - v[0]->pos;
+			Vec3 edge1 = v[2]->pos - v[0]->pos;
+
+			if (!mesh->HasNormals()) {
+				v[0]->normal = v[1]->normal = v[2]->normal = glm::normalize(glm::cross(edge0, edge1));
+			}
+
+#ifndef USE_MIKKTSPACE
+			// Check for texture coordinates before generating the tangent vector
+			if (!mesh->HasTangentsAndBitangents() && mesh->HasTextureCoords(0)) {
+				Vec2 &uv0 = v[0]->uv;
+				Vec2 &uv1 = v[1]->uv;
+				Vec2 &uv2 = v[2]->uv;
+
+				Vec2 dUV0 = uv1 - uv0;
+				Vec2 dUV1 = uv2 - uv0;
+
+				v[0]->tangent.x = v[1]->tangent.x = v[2]->tangent.x = dUV1.y * edge0.x - dUV0.y * edge1.x;
+				v[0]->tangent.y = v[1]->tangent.y = v[2]->tangent.y = dUV1.y * edge0.y - dUV0.y * edge1.y;
+				v[0]->tangent.z = v[1]->tangent.z = v[2]->tangent.z = dUV1.y * edge0.z - dUV0.y * edge1.z;
+			}
+#endif // !USE_MIKKTSPACE
+		}
+	}
+}
+
+/// Generate the tangents of a mesh with MikkTSpace. Run after processMesh() as it overwrites
+/// the tangents of the mesh's vertices. Only the mesh's own vertices are written, so meshes are safe to process in parallel.
+static void generateMeshTangents(const MeshTask &task, SceneData &scene) {
+	dassert(task.genTangents);
+
+	MikkTSpaceMeshData meshData = {};
+	meshData.vertices = scene.vertices.data() + task.vertexOffset;
+	meshData.mesh = task.mesh;
+
+	MikkTSpaceTangentSpaceGenerator tangentGenerator = {};
+	tangentGenerator.init(&meshData);
+
+#pragma warning(suppress: 4189)
+	tbool result = tangentGenerator.generateTangets();
+	dassert(result);
+}
+
+/// Reorder the triangles and vertices of a mesh for the post-transform cache, overdraw and vertex fetch.
+/// Run after the tangents are generated, as MikkTSpace reads the faces of the assimp mesh.
+/// Only the mesh's own ranges are written, so meshes are safe to process in parallel.
+static void optimizeMesh(MeshTask &task, SceneData &scene) {
+	const Mesh &mesh = scene.meshes[task.meshIndex];
+	const SizeType numVertices = mesh.numVertices;
+	uint32_t *indices = scene.indices.data() + mesh.indexOffset;
+	Vertex *vertices = scene.vertices.data() + mesh.baseVertex;
+
+	task.statsBefore = MeshOptimizer::analyzeVertexCache(indices, mesh.numIndices, numVertices);
+
+	MeshOptimizer::optimizeVertexCache(indices, mesh.numIndices, numVertices);
+	MeshOptimizer::optimizeOverdraw(indices, mesh.numIndices, &vertices->pos, numVertices, sizeof(Vertex));
+	MeshOptimizer::optimizeVertexFetch(vertices, numVertices, sizeof(Vertex), indices, mesh.numIndices);
+
+	task.statsAfter = MeshOptimizer::analyzeVertexCache(indices, mesh.numIndices, numVertices);
+}
+
+/// Run after optimizeMesh(). Every LOD is simplified from the full detail mesh, so its error is measured against it.
+/// The LODs are kept in the task, as their sizes are not known up front.
+static void generateMeshLods(MeshTask &task, const SceneData &scene) {
+	const Mesh &mesh = scene.meshes[task.meshIndex];
+	const uint32_t *indices = scene.indices.data() + mesh.indexOffset;
+	const Vertex *vertices = scene.vertices.data() + mesh.baseVertex;
+	const float maxError = glm::length(mesh.boxMax - mesh.boxMin) * LOD_MAX_RELATIVE_ERROR;
+
+	SizeType prevNumIndices = mesh.numIndices;
+	float prevError = 0.f;
+	for (uint32_t i = 0; i < MAX_MESH_LODS; ++i) {
+		const SizeType targetNumIndices = SizeType(prevNumIndices * LOD_TRIANGLE_RATIO) / 3 * 3;
+
+		Vector<uint32_t> &lod = task.lodIndices[i];
+		lod.resize(mesh.numIndices);
+
+		float error = 0.f;
+		const SizeType numIndices = MeshSimplifier::simplify(
+			lod.data(), indices, mesh.numIndices, &vertices->pos, mesh.numVertices, sizeof(Vertex), targetNumIndices, maxError, &error
+		);
+
+		if (numIndices == 0 || numIndices > prevNumIndices * LOD_MAX_KEPT_RATIO) {
+			lod.clear();
+			break;
+		}
+
+		lod.resize(numIndices);
+		MeshOptimizer::optimizeVertexCache(lod.data(), numIndices, mesh.numVertices);
+
+		// Less detailed LODs never have smaller error, so the LOD selection can stop at the first one with too big error.
+		task.lodErrors[i] = prevError = std::max(error, prevError);
+		prevNumIndices = numIndices;
+	}
+}
+
+/// Run after optimizeMesh(), so the meshlets follow the optimized triangle order.
+/// The meshlets are kept in the task, as their count is not known up front.
+static void buildMeshMeshlets(MeshTask &task, const SceneData &scene) {
+	const Mesh &mesh = scene.meshes[task.meshIndex];
+	const uint32_t *indices = scene.indices.data() + mesh.indexOffset;
+	const Vertex *vertices = scene.vertices.data() + mesh.baseVertex;
+
+	Meshlets::buildMeshlets(indices, mesh.numIndices, &vertices->pos, mesh.numVertices, sizeof(Vertex), task.meshlets);
+	task.meshletStats = Meshlets::validateMeshlets(task.meshlets, indices, mesh.numIndices, &vertices->pos, sizeof(Vertex));
+}
+
+struct ProcessMeshesParams {
+	Vector<MeshTask> *tasks;
+	SceneData *scene;
+};
+
+static void processMeshes(SizeType begin, SizeType end, void *param) {
+	auto params = reinterpret_cast<ProcessMeshesParams*>(param);
+	for (SizeType i = begin; i < end; ++i) {
+		processMesh((*params->tasks)[i], *params->scene);
+	}
+}
+
+static void generateTangents(SizeType begin, SizeType end, void *param) {
+	auto params = reinterpret_cast<ProcessMeshesParams*>(param);
+	for (SizeType i = begin; i < end; ++i) {
+		generateMeshTangents((*params->tasks)[i], *params->scene);
+	}
+}
+
+static void optimizeMeshes(SizeType begin, SizeType end, void *param) {
+	auto params = reinterpret_cast<ProcessMeshesParams*>(param);
+	for (SizeType i = begin; i < end; ++i) {
+		optimizeMesh((*params->tasks)[i], *params->scene);
+	}
+}
+
+static void generateLods(SizeType begin, SizeType end, void *param) {
+	auto params = reinterpret_cast<ProcessMeshesParams*>(param);
+	for (SizeType i = begin; i < end; ++i) {
+		generateMeshLods((*params->tasks)[i], *params->scene);
+	}
+}
+
+static void buildMeshesMeshlets(SizeType begin, SizeType end, void *param) {
+	auto params = reinterpret_cast<ProcessMeshesParams*>(param);
+	for (SizeType i = begin; i < end; ++i) {
+		buildMeshMeshlets((*params->tasks)[i], *params->scene);
+	}
+}
+
+/// Call f for ranges of the mesh tasks on the job system, or for all of them on the calling thread with importFlags_singleThreaded.
+static void forEachMeshTask(const ImportContext &ctx, SizeType count, JobSystem::RangeFunction f, void *param) {
+	if (ctx.flags & importFlags_singleThreaded) {
+		f(0, count, param);
+	} else {
+		JobSystem::parallelFor(count, 1, f, param);
+	}
+}
+
+// TODO: make own importer implementation. Should be able to import .obj, gltf2 files.
+static bool importStatic(const fs::path &path, ImportContext &ctx) {
+	// Importers are not thread-safe, so use one per import. Scenes could be imported in parallel.
+	Assimp::Importer importer;
+	Timer timer;
+
+	const String ext = path.extension().string();
+	if (!importer.IsExtensionSupported(ext)) {
+		LOG_FMT(Error, "Unsupported model extension %s!", ext.c_str());
+		return false;
+	}
+
+	const aiScene *assimpScene = importer.ReadFile(
+		path.string(),
+		aiProcess_Triangulate |
+		aiProcess_OptimizeMeshes |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_CalcTangentSpace |
+		aiProcess_ConvertToLeftHanded
+	);
+	if (!assimpScene || assimpScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !assimpScene->mRootNode) {
+		LOG_FMT(Error, "Failed to import %s: %s", path.string().c_str(), importer.GetErrorString());
+		return false;
+	}
+
+	ctx.stats.readTime = timer.time();
+	timer.restart();
+
+	ctx.assimpScene = assimpScene;
+	traverseAssimpScene(assimpScene->mRootNode, INVALID_INDEX, ctx);
+	ctx.assimpScene = nullptr;
+
+	SceneData &scene = *ctx.scene;
+	scene.vertices.resize(ctx.vertexOffset);
+	scene.indices.resize(ctx.indexOffset);
+
+	ProcessMeshesParams params = { &ctx.meshTasks, &scene };
+	forEachMeshTask(ctx, ctx.meshTasks.size(), processMeshes, &params);
+
+	ctx.stats.processTime = timer.time();
+	LOG_FMT(Info, "Processed %llu meshes of %s in %.2fms", ctx.meshTasks.size(), path.filename().string().c_str(), ctx.stats.processTime);
+
+#ifdef USE_MIKKTSPACE
+	Vector<MeshTask> tangentTasks;
+	SizeType numTriangles = 0;
+	for (auto &task : ctx.meshTasks) {
+		if (task.genTangents) {
+			tangentTasks.push_back(task);
+			numTriangles += task.mesh->mNumFaces;
+		}
+	}
+
+	if (!tangentTasks.empty()) {
+		timer.restart();
+
+		ProcessMeshesParams tangentParams = { &tangentTasks, &scene };
+		forEachMeshTask(ctx, tangentTasks.size(), generateTangents, &tangentParams);
+
+		const double tangentsTime = timer.time();
+		ctx.stats.tangentsTime = tangentsTime;
+		ctx.stats.numTangentTriangles = numTriangles;
+		LOG_FMT(
+			Info,
+			"Generated tangents of %llu meshes(%llu triangles) in %.2fms, %.2fms per million triangles",
+			tangentTasks.size(), numTriangles, tangentsTime, tangentsTime * 1e6 / std::max(numTriangles, SizeType(1))
+		);
+	}
+#endif // USE_MIKKTSPACE
+
+	timer.restart();
+
+	forEachMeshTask(ctx, ctx.meshTasks.size(), optimizeMeshes, &params);
+
+	ctx.stats.optimizeTime = timer.time();
+	LOG_FMT(Info, "Optimized %llu meshes of %s in %.2fms", ctx.meshTasks.size(), path.filename().string().c_str(), ctx.stats.optimizeTime);
+
+	// Stats are weighted by the triangles and the vertices of the meshes for the totals
+	MeshOptimizer::VertexCacheStats totalBefore, totalAfter;
+	SizeType totalTriangles = 0, totalVertices = 0;
+	for (auto &task : ctx.meshTasks) {
+		const SizeType numTriangles = scene.meshes[task.meshIndex].numIndices / 3;
+		const SizeType numVertices = task.mesh->mNumVertices;
+		LOG_FMT(
+			Info,
+			"Mesh %u(%llu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+			task.meshIndex, numTriangles, task.statsBefore.acmr, task.statsAfter.acmr, task.statsBefore.atvr, task.statsAfter.atvr
+		);
+
+		ctx.stats.cacheStatsBefore.push_back(task.statsBefore);
+		ctx.stats.cacheStatsAfter.push_back(task.statsAfter);
+
+		totalBefore.acmr += task.statsBefore.acmr * numTriangles;
+		totalAfter.acmr += task.statsAfter.acmr * numTriangles;
+		totalBefore.atvr += task.statsBefore.atvr * numVertices;
+		totalAfter.atvr += task.statsAfter.atvr * numVertices;
+		totalTriangles += numTriangles;
+		totalVertices += numVertices;
+	}
+
+	if (totalTriangles > 0 && totalVertices > 0) {
+		LOG_FMT(
+			Info,
+			"%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+			path.filename().string().c_str(),
+			totalBefore.acmr / totalTriangles, totalAfter.acmr / totalTriangles, totalBefore.atvr / totalVertices, totalAfter.atvr / totalVertices
+		);
+	}
+
+	if (ctx.flags & importFlags_generateLods) {
+		timer.restart();
+
+		forEachMeshTask(ctx, ctx.meshTasks.size(), generateLods, &params);
+
+		const double lodsTime = timer.time();
+
+		// Offsets of the LODs are known only now, so they are moved into the scene serially.
+		SizeType numTriangles[MAX_MESH_LODS + 1] = {};
+		for (auto &task : ctx.meshTasks) {
+			Mesh &mesh = scene.meshes[task.meshIndex];
+			numTriangles[0] += mesh.numIndices / 3;
+
+			mesh.numLods = 0;
+			for (uint32_t i = 0; i < MAX_MESH_LODS && !task.lodIndices[i].empty(); ++i) {
+				MeshLod &lod = mesh.lods[mesh.numLods++];
+				lod.indexOffset = static_cast<uint32_t>(scene.indices.size());
+				lod.numIndices = static_cast<uint32_t>(task.lodIndices[i].size());
+				lod.error = task.lodErrors[i];
+				scene.indices.insert(scene.indices.end(), task.lodIndices[i].begin(), task.lodIndices[i].end());
+				numTriangles[i + 1] += lod.numIndices / 3;
+
+				task.lodIndices[i] = Vector<uint32_t>{};
+			}
+		}
+
+		static_assert(MAX_MESH_LODS == 3, "Update the log below!");
+		LOG_FMT(
+			Info,
+			"Generated LODs of %llu meshes of %s in %.2fms. Triangles per LOD: %llu, %llu, %llu, %llu",
+			ctx.meshTasks.size(), path.filename().string().c_str(), lodsTime, numTriangles[0], numTriangles[1], numTriangles[2], numTriangles[3]
+		);
+	}
+
+	if (ctx.flags & importFlags_buildMeshlets) {
+		timer.restart();
+
+		forEachMeshTask(ctx, ctx.meshTasks.size(), buildMeshesMeshlets, &params);
+
+		const double meshletsTime = timer.time();
+
+		// Offsets of the meshlets are known only now, so they are moved into the scene serially.
+		Meshlets::ValidationStats totalStats;
+		for (auto &task : ctx.meshTasks) {
+			Meshlets::MeshletData &data = task.meshlets;
+			Mesh &mesh = scene.meshes[task.meshIndex];
+			mesh.meshletOffset = static_cast<uint32_t>(scene.meshlets.size());
+			mesh.numMeshlets = static_cast<uint32_t>(data.meshlets.size());
+
+			const uint32_t vertexOffset = static_cast<uint32_t>(scene.meshletVertices.size());
+			const uint32_t triangleOffset = static_cast<uint32_t>(scene.meshletTriangles.size());
+			for (auto &meshlet : data.meshlets) {
+				meshlet.vertexOffset += vertexOffset;
+				meshlet.triangleOffset += triangleOffset;
+			}
+
+			scene.meshlets.insert(scene.meshlets.end(), data.meshlets.begin(), data.meshlets.end());
+			scene.meshletVertices.insert(scene.meshletVertices.end(), data.vertices.begin(), data.vertices.end());
+			scene.meshletTriangles.insert(scene.meshletTriangles.end(), data.triangles.begin(), data.triangles.end());
+
+			totalStats.numTests += task.meshletStats.numTests;
+			totalStats.numCulled += task.meshletStats.numCulled;
+			totalStats.numErrors += task.meshletStats.numErrors;
+
+			data = Meshlets::MeshletData{};
+		}
+
+		const SizeType numMeshlets = std::max(scene.meshlets.size(), SizeType(1));
+		LOG_FMT(
+			Info,
+			"Built %llu meshlets of %s in %.2fms, %.1f vertices and %.1f triangles per meshlet",
+			scene.meshlets.size(), path.filename().string().c_str(), meshletsTime,
+			float(scene.meshletVertices.size()) / numMeshlets, float(scene.meshletTriangles.size() / 3) / numMeshlets
+		);
+
+		if (totalStats.numErrors > 0) {
+			LOG_FMT(Error, "Meshlets of %s failed %llu validation checks!", path.filename().string().c_str(), totalStats.numErrors);
+			return false;
+		}
+
+		LOG_FMT(
+			Info,
+			"Validated the meshlets of %s: cone culled %llu of %llu test cameras with no frontfacing triangles",
+			path.filename().string().c_str(), totalStats.numCulled, totalStats.numTests
+		);
+	}
+
+	return true;
+}
+
+static Vec3 fromJson(const nlohmann::json &data) {
+	return Vec3{ data[0].get<float>(), data[1].get<float>(), data[2].get<float>() };
+}
+
+bool importScene(const fs::path &sceneFile, SceneData &outScene, ImportFlags flags, Vector<fs::path> *dependencies, ImportStats *stats) {
+	using json = nlohmann::json;
+
+	std::ifstream f(sceneFile);
+	if (!f.is_open()) {
+		LOG_FMT(Error, "Failed to open %s. Error: %s", sceneFile.string().c_str(), strerror(errno));
+		return false;
+	}
+
+	json data = json::parse(f, nullptr, false);
+	if (data.is_discarded()) {
+		LOG_FMT(Error, "Failed to parse %s!", sceneFile.string().c_str());
+		return false;
+	}
+
+	ImportContext ctx;
+	ctx.scene = &outScene;
+	ctx.flags = flags;
+
+	json scene = data["scene"];
+	const fs::path staticPath = sceneFile.parent_path() / scene["static"].get<String>();
+	if (!importStatic(staticPath, ctx)) {
+		return false;
+	}
+
+	if (stats) {
+		*stats = ctx.stats;
+	}
+
+	if (dependencies) {
+		// Assimp doesn't report the files it reads, so take everything next to the model.
+		std::error_code ec;
+		for (auto &entry : fs::directory_iterator{ staticPath.parent_path(), ec }) {
+			if (entry.is_regular_file()) {
+				dependencies->push_back(entry.path());
+			}
+		}
+	}
+
+	auto lights = scene["lights"];
+	for (auto &l : lights) {
+		json light = l["light"];
+		String lightType = light["type"];
+
+		Light res;
+		res.diffuse = fromJson(light["diffuse"]);
+		res.specular = fromJson(light["specular"]);
+		res.ambient = fromJson(light["ambient"]);
+
+		if (lightType == "directional") {
+			res.type = LightType::Directional;
+			res.direction = glm::normalize(fromJson(light["direction"]));
+		} else if (lightType == "spot") {
+			res.type = LightType::Spot;
+			res.innerAngleCutoff = cos(glm::radians(light["innerCutoff"].get<float>()));
+			res.outerAngleCutoff = cos(glm::radians(light["outerCutoff"].get<float>()));
+		} else if (lightType == "point") {
+			res.type = LightType::Point;
+			res.position = fromJson(light["position"]);
+			res.attenuation = fromJson(light["attenuation"]);
+		} else {
+			LOG_FMT(Warning, "Skipping light of unknown type %s", lightType.c_str());
+			continue;
+		}
+
+		Node node;
+		node.type = NodeType::Light;
+		node.index = static_cast<uint32_t>(outScene.lights.size());
+		outScene.lights.push_back(res);
+		addNode(node, ctx);
+	}
+
+	{
+		json camera = scene["camera"];
+		const String cameraType = camera["type"];
+
+		Camera cam;
+		cam.position = fromJson(camera["position"]);
+		cam.nearPlane = camera["nearPlane"].get<float>();
+		cam.farPlane = camera["farPlane"].get<float>();
+
+		if (cameraType == "perspective") {
+			cam.type = CameraType::Perspective;
+			cam.fov = camera["fov"].get<float>();
+			cam.keepXZPlane = 1;
+		}
+
+		if (cameraType == "orthographic") {
+			cam.type = CameraType::Orthographic;
+			cam.width = camera["rectWidth"].get<float>();
+			cam.height = camera["rectHeight"].get<float>();
+		}
+
+		Node node;
+		node.type = NodeType::Camera;
+		node.index = static_cast<uint32_t>(outScene.cameras.size());
+		outScene.cameras.push_back(cam);
+		addNode(node, ctx);
+	}
+
+	// Flatten the children of the nodes
+	for (SizeType i = 0; i < outScene.nodes.size(); ++i) {
+		Node &node = outScene.nodes[i];
+		node.firstChild = static_cast<uint32_t>(outScene.children.size());
+		node.numChildren = static_cast<uint32_t>(ctx.children[i].size());
+		outScene.children.insert(outScene.children.end(), ctx.children[i].begin(), ctx.children[i].end());
+	}
+
+	return true;
+}
+
+} // namespace ScnLib
+
+} // namespace Dar
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "mesh_optimizer.h"
+#include "scene_lib.h"
+
+namespace Dar {
+
+namespace ScnLib {
+
+enum ImportFlags : uint32_t {
+	importFlags_none = 0,
+	importFlags_overrideGenTangents = (1 << 0), ///< Generate the tangents even if the model contains them.
+	importFlags_buildMeshlets = (1 << 1), ///< Split the meshes into meshlets and validate their culling data. See Meshlets::buildMeshlets.
+	importFlags_generateLods = (1 << 2), ///< Generate simplified LODs of the meshes. See MeshSimplifier::simplify.
+	importFlags_singleThreaded = (1 << 3), ///< Process the meshes one by one on the calling thread, f.e for comparing with the parallel import.
+};
+
+/// Timings of the stages of an import in ms, f.e for benchmarks.
+struct ImportStats {
+	double readTime = 0.; ///< Reading the model with assimp.
+	double processTime = 0.; ///< Converting the vertices and the indices of the meshes.
+	double tangentsTime = 0.; ///< Generating the tangents with MikkTSpace.
+	SizeType numTangentTriangles = 0; ///< Triangles of the meshes which tangents are generated.
+	double optimizeTime = 0.; ///< Reordering the meshes for the vertex cache, overdraw and vertex fetch.
+	Vector<MeshOptimizer::VertexCacheStats> cacheStatsBefore; ///< Vertex cache stats of each mesh of SceneData::meshes, in the triangle order from assimp.
+	Vector<MeshOptimizer::VertexCacheStats> cacheStatsAfter; ///< Vertex cache stats of each mesh after the optimization.
+};
+
+/// Import a scene description(json) together with the model of its static geometry.
+/// Models are imported with assimp and the missing tangents are generated with MikkTSpace.
+/// Meshes are processed in parallel on the job system, the result is the same as processing them one by one. \see importFlags_singleThreaded.
+/// @note Must be called from inside a job. See JobSystem::parallelFor.
+/// @param sceneFile Path to the json scene description.
+/// @param scene Receives the imported scene.
+/// @param dependencies Optional. Receives the files the scene is read from - the model and the files next to it, f.e glTF buffers.
+/// @param stats Optional. Receives the timings of the import.
+/// @return true on success, false otherwise
+bool importScene(
+	const fs::path &sceneFile,
+	SceneData &scene,
+	ImportFlags flags = importFlags_none,
+	Vector<fs::path> *dependencies = nullptr,
+	ImportStats *stats = nullptr
+);
+
+} // namespace ScnLib
+
+} // namespace Dar
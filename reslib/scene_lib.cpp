@@ -0,0 +1,244 @@
+#include "scene_lib.h"
+
+#include <fstream>
+
+namespace Dar {
+
+namespace ScnLib {
+
+constexpr uint32_t SCNLIB_MAGIC = 0x534E4C42; // SNLB
+constexpr uint32_t SCNLIB_VERSION = 4;
+constexpr SizeType SCNLIB_ALIGNMENT = 16;
+
+enum class Section : uint32_t {
+	Vertices = 0,
+	Indices,
+	Meshes,
+	Materials,
+	Textures,
+	Lights,
+	Cameras,
+	Nodes,
+	Children,
+	Strings,
+	Meshlets,
+	MeshletVertices,
+	MeshletTriangles,
+
+	Count
+};
+
+struct SectionDesc {
+	uint64_t offset = 0; ///< Offset from the beginning of the file.
+	uint64_t count = 0; ///< Number of elements in the section.
+};
+
+struct Header {
+	uint32_t magic = SCNLIB_MAGIC;
+	uint32_t version = SCNLIB_VERSION;
+	SectionDesc sections[static_cast<int>(Section::Count)];
+};
+
+uint32_t SceneData::addTexture(const char *path) {
+	for (uint32_t i = 0; i < textures.size(); ++i) {
+		if (strcmp(strings.data() + textures[i].pathOffset, path) == 0) {
+			return i;
+		}
+	}
+
+	Texture texture;
+	texture.pathOffset = static_cast<uint32_t>(strings.size());
+	texture.pathLength = static_cast<uint32_t>(strlen(path));
+	strings.insert(strings.end(), path, path + texture.pathLength + 1);
+	textures.push_back(texture);
+
+	return static_cast<uint32_t>(textures.size()) - 1;
+}
+
+SceneView SceneData::getView() const {
+	SceneView view;
+	view.vertices = vertices.data();
+	view.indices = indices.data();
+	view.meshes = meshes.data();
+	view.materials = materials.data();
+	view.textures = textures.data();
+	view.lights = lights.data();
+	view.cameras = cameras.data();
+	view.nodes = nodes.data();
+	view.children = children.data();
+	view.strings = strings.data();
+	view.meshlets = meshlets.data();
+	view.meshletVertices = meshletVertices.data();
+	view.meshletTriangles = meshletTriangles.data();
+
+	view.numVertices = static_cast<uint32_t>(vertices.size());
+	view.numIndices = static_cast<uint32_t>(indices.size());
+	view.numMeshes = static_cast<uint32_t>(meshes.size());
+	view.numMaterials = static_cast<uint32_t>(materials.size());
+	view.numTextures = static_cast<uint32_t>(textures.size());
+	view.numLights = static_cast<uint32_t>(lights.size());
+	view.numCameras = static_cast<uint32_t>(cameras.size());
+	view.numNodes = static_cast<uint32_t>(nodes.size());
+	view.numChildren = static_cast<uint32_t>(children.size());
+	view.stringsSize = static_cast<uint32_t>(strings.size());
+	view.numMeshlets = static_cast<uint32_t>(meshlets.size());
+	view.numMeshletVertices = static_cast<uint32_t>(meshletVertices.size());
+	view.meshletTrianglesSize = static_cast<uint32_t>(meshletTriangles.size());
+
+	return view;
+}
+
+bool writeScene(const SceneData &scene, const fs::path &outputFile) {
+	std::ofstream ofs(outputFile, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!ofs.good()) {
+		LOG_FMT(Error, "Failed to open %s for writing!", outputFile.string().c_str());
+		return false;
+	}
+
+	struct SectionData {
+		const void *data;
+		SizeType count;
+		SizeType elementSize;
+	};
+
+	const SectionData sections[] = {
+		{ scene.vertices.data(), scene.vertices.size(), sizeof(Vertex) },
+		{ scene.indices.data(), scene.indices.size(), sizeof(uint32_t) },
+		{ scene.meshes.data(), scene.meshes.size(), sizeof(Mesh) },
+		{ scene.materials.data(), scene.materials.size(), sizeof(Material) },
+		{ scene.textures.data(), scene.textures.size(), sizeof(Texture) },
+		{ scene.lights.data(), scene.lights.size(), sizeof(Light) },
+		{ scene.cameras.data(), scene.cameras.size(), sizeof(Camera) },
+		{ scene.nodes.data(), scene.nodes.size(), sizeof(Node) },
+		{ scene.children.data(), scene.children.size(), sizeof(uint32_t) },
+		{ scene.strings.data(), scene.strings.size(), sizeof(char) },
+		{ scene.meshlets.data(), scene.meshlets.size(), sizeof(Meshlet) },
+		{ scene.meshletVertices.data(), scene.meshletVertices.size(), sizeof(uint32_t) },
+		{ scene.meshletTriangles.data(), scene.meshletTriangles.size(), sizeof(uint8_t) },
+	};
+	static_assert(_countof(sections) == static_cast<int>(Section::Count));
+
+	auto alignOffset = [](SizeType offset) {
+		return (offset + SCNLIB_ALIGNMENT - 1) & ~(SCNLIB_ALIGNMENT - 1);
+	};
+
+	Header header;
+	SizeType offset = alignOffset(sizeof(Header));
+	for (int i = 0; i < static_cast<int>(Section::Count); ++i) {
+		header.sections[i].offset = offset;
+		header.sections[i].count = sections[i].count;
+		offset = alignOffset(offset + sections[i].count * sections[i].elementSize);
+	}
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+	const char padding[SCNLIB_ALIGNMENT] = {};
+	SizeType pos = sizeof(Header);
+	for (int i = 0; i < static_cast<int>(Section::Count); ++i) {
+		ofs.write(padding, header.sections[i].offset - pos);
+
+		const SizeType size = sections[i].count * sections[i].elementSize;
+		ofs.write(reinterpret_cast<const char*>(sections[i].data), size);
+		pos = header.sections[i].offset + size;
+	}
+
+	ofs.close();
+	if (ofs.fail()) {
+		LOG_FMT(Error, "Failed to write %s!", outputFile.string().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool readSceneView(const uint8_t *data, SizeType size, SceneView &view) {
+	if (data == nullptr || size < sizeof(Header)) {
+		return false;
+	}
+
+	const Header *header = reinterpret_cast<const Header*>(data);
+	if (header->magic != SCNLIB_MAGIC || header->version != SCNLIB_VERSION) {
+		return false;
+	}
+
+	bool valid = true;
+	auto getSection = [&](Section section, SizeType elementSize, auto *&ptr, uint32_t &count) {
+		const SectionDesc &desc = header->sections[static_cast<int>(section)];
+		if (desc.offset % SCNLIB_ALIGNMENT != 0 || desc.offset > size || desc.count > (size - desc.offset) / elementSize) {
+			valid = false;
+			return;
+		}
+
+		ptr = reinterpret_cast<std::remove_reference_t<decltype(ptr)>>(data + desc.offset);
+		count = static_cast<uint32_t>(desc.count);
+	};
+
+	getSection(Section::Vertices, sizeof(Vertex), view.vertices, view.numVertices);
+	getSection(Section::Indices, sizeof(uint32_t), view.indices, view.numIndices);
+	getSection(Section::Meshes, sizeof(Mesh), view.meshes, view.numMeshes);
+	getSection(Section::Materials, sizeof(Material), view.materials, view.numMaterials);
+	getSection(Section::Textures, sizeof(Texture), view.textures, view.numTextures);
+	getSection(Section::Lights, sizeof(Light), view.lights, view.numLights);
+	getSection(Section::Cameras, sizeof(Camera), view.cameras, view.numCameras);
+	getSection(Section::Nodes, sizeof(Node), view.nodes, view.numNodes);
+	getSection(Section::Children, sizeof(uint32_t), view.children, view.numChildren);
+	getSection(Section::Strings, sizeof(char), view.strings, view.stringsSize);
+	getSection(Section::Meshlets, sizeof(Meshlet), view.meshlets, view.numMeshlets);
+	getSection(Section::MeshletVertices, sizeof(uint32_t), view.meshletVertices, view.numMeshletVertices);
+	getSection(Section::MeshletTriangles, sizeof(uint8_t), view.meshletTriangles, view.meshletTrianglesSize);
+
+	return valid;
+}
+
+MappedScene::~MappedScene() {
+	close();
+}
+
+bool MappedScene::open(const fs::path &path) {
+	close();
+
+	file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		LOG_FMT(Error, "Failed to open %s!", path.string().c_str());
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr) {
+		data = reinterpret_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+
+	if (data == nullptr || !readSceneView(data, static_cast<SizeType>(fileSize.QuadPart), view)) {
+		LOG_FMT(Error, "Invalid scene library %s!", path.string().c_str());
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedScene::close() {
+	view = SceneView{};
+
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+		data = nullptr;
+	}
+
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+}
+
+} // namespace ScnLib
+
+} // namespace Dar
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "dar/math/dar_math.h"
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace ScnLib {
+
+/// Binary scene format(scnlib). The file is a Header followed by the sections it points to.
+/// Each section is a tightly packed array of one of the POD structures below, aligned to 16 bytes,
+/// so a memory-mapped scnlib is used as it is without any parsing. See MappedScene.
+
+constexpr uint32_t INVALID_INDEX = uint32_t(-1);
+
+/// Limits of the meshlets. 124 triangles instead of 128 leave room for the per-primitive data of mesh shaders.
+constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+/// Max number of simplified LODs of a mesh, besides the full detail one.
+constexpr uint32_t MAX_MESH_LODS = 3;
+
+struct Vertex {
+	Vec3 pos;
+	Vec3 normal;
+	Vec3 tangent;
+	Vec2 uv;
+};
+
+/// Simplified version of a mesh. Uses the vertices of the mesh, so its indices are relative to the mesh's base vertex as well.
+struct MeshLod {
+	uint32_t indexOffset = 0; ///< Offset of the first index of the LOD in the index blob.
+	uint32_t numIndices = 0;
+	float error = 0.f; ///< Max distance of the LOD from the full detail mesh in object space.
+};
+
+struct Mesh {
+	uint32_t material = INVALID_INDEX;
+	uint32_t indexOffset = 0; ///< Offset of the first index of the mesh in the index blob.
+	uint32_t numIndices = 0;
+	uint32_t baseVertex = 0; ///< Offset of the first vertex of the mesh in the vertex blob. Indices of the mesh are relative to it.
+	uint32_t numVertices = 0;
+	uint32_t meshletOffset = 0; ///< Offset of the first meshlet of the mesh in the meshlets section.
+	uint32_t numMeshlets = 0; ///< 0 if the scene is built without meshlets.
+	uint32_t numLods = 0; ///< Number of simplified LODs, from the most to the least detailed one.
+	MeshLod lods[MAX_MESH_LODS];
+	Vec3 boxMin; ///< Bounding box of the mesh in object space.
+	Vec3 boxMax;
+};
+
+/// Cluster of at most MAX_MESHLET_TRIANGLES triangles of a mesh using at most MAX_MESHLET_VERTICES vertices.
+struct Meshlet {
+	uint32_t vertexOffset = 0; ///< Offset of the first vertex in the meshlet vertices section. The vertices are relative to the mesh's base vertex.
+	uint32_t triangleOffset = 0; ///< Offset of the first triangle in the meshlet triangles section, in bytes.
+	uint32_t numVertices = 0;
+	uint32_t numTriangles = 0; ///< Each triangle is 3 bytes indexing the vertices of the meshlet.
+	Vec3 center = Vec3(0.f); ///< Bounding sphere of the meshlet in object space.
+	float radius = 0.f;
+	Vec3 coneApex = Vec3(0.f); ///< Normal cone. The meshlet is backfacing if dot(normalize(coneApex - cameraPos), coneAxis) >= coneCutoff.
+	Vec3 coneAxis = Vec3(0.f);
+	float coneCutoff = 1.f; ///< 1 when the normals are too spread out for the cone to cull anything.
+};
+
+struct Material {
+	Vec3 baseColorFactor = Vec3(1.f);
+	float metallicFactor = 1.f;
+	float roughnessFactor = 1.f;
+	uint32_t baseColorTexture = INVALID_INDEX;
+	uint32_t normalsTexture = INVALID_INDEX;
+	uint32_t metallicRoughnessTexture = INVALID_INDEX;
+	uint32_t ambientOcclusionTexture = INVALID_INDEX;
+};
+
+/// Texture referenced by the materials. The texture data itself is in the txlib.
+struct Texture {
+	uint32_t pathOffset = 0; ///< Offset of the null-terminated path in the strings section.
+	uint32_t pathLength = 0;
+};
+
+enum class LightType : uint32_t {
+	Point = 0,
+	Directional,
+	Spot,
+};
+
+struct Light {
+	LightType type = LightType::Point;
+	Vec3 position = Vec3(0.f);
+	Vec3 diffuse = Vec3(0.f);
+	Vec3 ambient = Vec3(0.f);
+	Vec3 specular = Vec3(0.f);
+	Vec3 attenuation = Vec3(0.f);
+	Vec3 direction = Vec3(0.f);
+	float innerAngleCutoff = 0.f; ///< Cosine of the inner cone angle of spot lights.
+	float outerAngleCutoff = 0.f; ///< Cosine of the outer cone angle of spot lights.
+};
+
+enum class CameraType : uint32_t {
+	Perspective = 0,
+	Orthographic,
+};
+
+struct Camera {
+	CameraType type = CameraType::Perspective;
+	Vec3 position = Vec3(0.f);
+	float fov = 90.f;
+	float aspectRatio = 0.f; ///< 0 for using the aspect ratio of the viewport.
+	float width = 0.f; ///< Width of the render rectangle of orthographic cameras.
+	float height = 0.f; ///< Height of the render rectangle of orthographic cameras.
+	float nearPlane = 0.1f;
+	float farPlane = 1000.f;
+	uint32_t keepXZPlane = 0;
+};
+
+enum class NodeType : uint32_t {
+	Model = 0,
+	Light,
+	Camera,
+};
+
+/// Nodes are stored in the order the scene creates them, so their index is their id.
+struct Node {
+	NodeType type = NodeType::Model;
+	uint32_t index = 0; ///< First mesh of model nodes, index in the lights or cameras section otherwise.
+	uint32_t numMeshes = 0;
+	uint32_t firstChild = 0; ///< Offset of the children ids in the children section.
+	uint32_t numChildren = 0;
+};
+
+/// Non-owning view of the sections of a scene.
+struct SceneView {
+	const Vertex *vertices = nullptr;
+	const uint32_t *indices = nullptr;
+	const Mesh *meshes = nullptr;
+	const Material *materials = nullptr;
+	const Texture *textures = nullptr;
+	const Light *lights = nullptr;
+	const Camera *cameras = nullptr;
+	const Node *nodes = nullptr;
+	const uint32_t *children = nullptr;
+	const char *strings = nullptr;
+	const Meshlet *meshlets = nullptr;
+	const uint32_t *meshletVertices = nullptr;
+	const uint8_t *meshletTriangles = nullptr;
+
+	uint32_t numVertices = 0;
+	uint32_t numIndices = 0;
+	uint32_t numMeshes = 0;
+	uint32_t numMaterials = 0;
+	uint32_t numTextures = 0;
+	uint32_t numLights = 0;
+	uint32_t numCameras = 0;
+	uint32_t numNodes = 0;
+	uint32_t numChildren = 0;
+	uint32_t stringsSize = 0;
+	uint32_t numMeshlets = 0;
+	uint32_t numMeshletVertices = 0;
+	uint32_t meshletTrianglesSize = 0;
+
+	const char* getTexturePath(uint32_t texture) const {
+		dassert(texture < numTextures);
+		return strings + textures[texture].pathOffset;
+	}
+};
+
+/// Scene being built, f.e by importScene(). Its sections have the same layout as in the scnlib.
+struct SceneData {
+	Vector<Vertex> vertices;
+	Vector<uint32_t> indices;
+	Vector<Mesh> meshes;
+	Vector<Material> materials;
+	Vector<Texture> textures;
+	Vector<Light> lights;
+	Vector<Camera> cameras;
+	Vector<Node> nodes;
+	Vector<uint32_t> children;
+	Vector<char> strings;
+	Vector<Meshlet> meshlets;
+	Vector<uint32_t> meshletVertices;
+	Vector<uint8_t> meshletTriangles;
+
+	/// @return Index of the texture with the given path. Textures are added only once.
+	uint32_t addTexture(const char *path);
+
+	SceneView getView() const;
+};
+
+/// Write a scene into a scnlib.
+/// @return true on success, false otherwise
+bool writeScene(const SceneData &scene, const fs::path &outputFile);
+
+/// Check the header of a scnlib and find its sections.
+/// @param data Contents of the scnlib. Should be 16 byte aligned.
+/// @return false if the data is not a valid scnlib.
+bool readSceneView(const uint8_t *data, SizeType size, SceneView &view);
+
+/// Read-only memory mapping of a scnlib. The view points inside the mapping, so
+/// it is valid until the scene is closed.
+class MappedScene {
+public:
+	MappedScene() = default;
+	~MappedScene();
+
+	MappedScene(const MappedScene&) = delete;
+	MappedScene& operator=(const MappedScene&) = delete;
+
+	bool open(const fs::path &file);
+	void close();
+
+	const SceneView& getView() const {
+		return view;
+	}
+
+private:
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+	const uint8_t *data = nullptr;
+	SceneView view;
+};
+
+} // namespace ScnLib
+
+} // namespace Dar
@@ -1,5 +1,6 @@
 #include "serde.h"
 
+#include <algorithm>
 #include <fstream>
 
 #ifndef STB_IMAGE_IMPLEMENTATION
@@ -10,6 +11,14 @@
 
 #include "nvtt/nvtt.h"
 
+#include "compression.h"
+#include "hash.h"
+#include "mip_generator.h"
+
+#include "async/job_system.h"
+
+#include "utils/timer.h"
+
 namespace Dar {
 
 namespace TxLib {
@@ -33,6 +42,42 @@ String GetLastErrorAsString() {
 }
 
 constexpr uint32_t HEADER_END = 0xFAFAFAFA;
+constexpr uint32_t TXLIB_MAGIC = 0x54584C42; ///< Files without it are in the first, uncompressed, version of the format
+constexpr uint32_t TXLIB_VERSION = 2;
+constexpr SizeType COMPRESSION_CHUNK_SIZE = 256 * 1024;
+
+/// Split the image data into chunks not crossing mip boundaries and compress them.
+/// @param stored Receives the compressed data of the whole image.
+void compressImageData(ImageData &img, ImageCompression compression, Vector<uint8_t> &stored) {
+	auto &header = img.header;
+	header.compression = compression;
+	header.chunks.clear();
+	stored.clear();
+
+	Vector<uint8_t> compressed(Compression::compressBound(COMPRESSION_CHUNK_SIZE));
+	for (int mip = 0; mip < header.mipMapCount; ++mip) {
+		const SizeType mipStart = header.mipOffsets[mip];
+		const SizeType mipEnd = mip + 1 < header.mipMapCount ? header.mipOffsets[mip + 1] : header.size;
+		for (SizeType offset = mipStart; offset < mipEnd; offset += COMPRESSION_CHUNK_SIZE) {
+			ImageChunk chunk;
+			chunk.storedOffset = stored.size();
+			chunk.dataOffset = offset;
+			chunk.size = static_cast<uint32_t>(std::min(COMPRESSION_CHUNK_SIZE, mipEnd - offset));
+
+			const SizeType compressedSize = Compression::compress(img.data.get() + offset, chunk.size, compressed.data(), compressed.size());
+			if (compressedSize > 0 && compressedSize < chunk.size) {
+				chunk.storedSize = static_cast<uint32_t>(compressedSize);
+				stored.insert(stored.end(), compressed.begin(), compressed.begin() + compressedSize);
+			} else {
+				// Not worth it, store it as is
+				chunk.storedSize = chunk.size;
+				stored.insert(stored.end(), img.data.get() + offset, img.data.get() + offset + chunk.size);
+			}
+
+			header.chunks.push_back(chunk);
+		}
+	}
+}
 
 struct OutputHandler : nvtt::OutputHandler {
 	ImageData &buffer;
@@ -45,7 +90,7 @@ struct OutputHandler : nvtt::OutputHandler {
 	void beginImage(int size, int /*width*/, int /*height*/, int /*depth*/, int /*face*/, int miplevel) override {
 		if (miplevel == 0) {
 			bufSize = std::max(bufSize, static_cast<SizeType>(size * 1.35)); // wiggle-room, as mip-maped size is usually 1.33x the size of the image
-			buffer.data = new uint8_t[bufSize];
+			buffer.data = allocateImageBuffer(bufSize);
 		}
 
 		buffer.header.mipOffsets.push_back(offset);
@@ -56,7 +101,7 @@ struct OutputHandler : nvtt::OutputHandler {
 			return false;
 		}
 
-		memcpy(reinterpret_cast<void*>(buffer.data + offset), data, static_cast<SizeType>(size));
+		memcpy(reinterpret_cast<void*>(buffer.data.get() + offset), data, static_cast<SizeType>(size));
 		offset += static_cast<SizeType>(size);
 
 		return true;
@@ -66,7 +111,40 @@ struct OutputHandler : nvtt::OutputHandler {
 	}
 };
 
-bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &outputDir) {
+/// Write the header of a txlib. The stored data of the images should follow in the same order.
+void writeHeader(std::ofstream &ofs, const Vector<ImageHeader> &headers) {
+	uint32_t magic = TXLIB_MAGIC;
+	uint32_t version = TXLIB_VERSION;
+	ofs.write(reinterpret_cast<char *>(&magic), sizeof(uint32_t));
+	ofs.write(reinterpret_cast<char *>(&version), sizeof(uint32_t));
+
+	for (auto &header : headers) {
+		dassert(header.mipMapCount == static_cast<int>(header.mipOffsets.size()));
+
+		auto nameSz = static_cast<uint32_t>(header.filename.size() * sizeof(String::value_type));
+		ofs.write(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
+		ofs.write(reinterpret_cast<const char*>(header.filename.data()), nameSz);
+
+		ofs.write(reinterpret_cast<const char *>(&header.size), sizeof(SizeType));
+		ofs.write(reinterpret_cast<const char*>(&header.width), sizeof(int));
+		ofs.write(reinterpret_cast<const char*>(&header.height), sizeof(int));
+		ofs.write(reinterpret_cast<const char*>(&header.ncomp), sizeof(int));
+		ofs.write(reinterpret_cast<const char*>(&header.mipMapCount), sizeof(int));
+		for (SizeType i = 0; i < header.mipOffsets.size(); ++i) {
+			ofs.write(reinterpret_cast<const char*>(&header.mipOffsets[i]), sizeof(SizeType));
+		}
+
+		auto numChunks = static_cast<uint32_t>(header.chunks.size());
+		ofs.write(reinterpret_cast<const char*>(&header.compression), sizeof(ImageCompression));
+		ofs.write(reinterpret_cast<const char*>(&numChunks), sizeof(uint32_t));
+		ofs.write(reinterpret_cast<const char*>(header.chunks.data()), numChunks * sizeof(ImageChunk));
+	}
+
+	uint32_t headerEnd = HEADER_END;
+	ofs.write(reinterpret_cast<char *>(&headerEnd), sizeof(uint32_t));
+}
+
+bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &outputDir, ImageCompression compression, bool useNvttMips, const fs::path &outputName) {
 	if (imgPaths.empty()) {
 		LOG(Error, "No image data to serialize!");
 		return false;
@@ -77,7 +155,7 @@ bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &
 		fs::create_directories(mkdir);
 	}
 
-	auto outPath = std::filesystem::path(outputDir) / L"textures.txlib";
+	auto outPath = std::filesystem::path(outputDir) / outputName;
 	outPath = std::filesystem::absolute(outPath);
 
 	const bool stdioOldSyncFlag = std::ios_base::sync_with_stdio(false);
@@ -92,10 +170,10 @@ bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &
 	nvtt::Context nvttCtx;
 
 	// TODO: we need different format per texture type.
-	// TODO: Also maybe normal maps need to be renormalized after resizing?
 	nvtt::CompressionOptions compressionOpts;
 	compressionOpts.setFormat(nvtt::Format_BC7);
 
+	double mipGenTime = 0.0;
 	Vector<ImageData> imgs;
 	for (auto& imgPath : imgPaths) {
 		ImageData img;
@@ -123,22 +201,56 @@ bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &
 		outputOpts.setOutputHandler(&outputHandler);
 
 		bool success = true;
-		for (int i = 0; i < img.header.mipMapCount; ++i) {
-			if (!nvttCtx.compress(nvttImg, 0 /* face */, i, compressionOpts, outputOpts)) {
-				LOG_FMT(Error, "Failed to compress %s", imgPath.c_str());
-				success = false;
-				break;
+		if (useNvttMips) {
+			for (int i = 0; i < img.header.mipMapCount; ++i) {
+				if (!nvttCtx.compress(nvttImg, 0 /* face */, i, compressionOpts, outputOpts)) {
+					LOG_FMT(Error, "Failed to compress %s", imgPath.c_str());
+					success = false;
+					break;
+				}
+
+				Timer timer;
+				nvttImg.toLinearFromSrgb();
+				if (hasAlpha) {
+					nvttImg.premultiplyAlpha();
+				}
+
+				nvttImg.buildNextMipmap(nvtt::MipmapFilter_Box);
+
+				nvttImg.demultiplyAlpha();
+				nvttImg.toSrgb();
+				mipGenTime += timer.time();
 			}
-
-			nvttImg.toLinearFromSrgb();
-			if (hasAlpha) {
-				nvttImg.premultiplyAlpha();
+		} else {
+			Timer timer;
+			MipGen::MipLevel mip0;
+			mip0.width = nvttImg.width();
+			mip0.height = nvttImg.height();
+			mip0.data.assign(nvttImg.data(), nvttImg.data() + SizeType(mip0.width) * mip0.height * 4);
+
+			const MipGen::MipSettings mipSettings = MipGen::detectMipSettings(mip0, hasAlpha);
+			if (mipSettings.normalMap) {
+				LOG_FMT(Info, "%s looks like a normal map. Its mips will be renormalized.", img.header.filename.c_str());
 			}
 
-			nvttImg.buildNextMipmap(nvtt::MipmapFilter_Box);
+			Vector<MipGen::MipLevel> mips;
+			MipGen::generateMipChain(mip0, mipSettings, mips);
+			mipGenTime += timer.time();
+
+			dassert(static_cast<int>(mips.size()) == img.header.mipMapCount);
 
-			nvttImg.demultiplyAlpha();
-			nvttImg.toSrgb();
+			nvtt::Surface mipSurface;
+			for (int i = 0; i < img.header.mipMapCount; ++i) {
+				const auto &mip = mips[i];
+				mipSurface.setImage(mip.width, mip.height, 1);
+				memcpy(mipSurface.data(), mip.data.data(), mip.data.size() * sizeof(float));
+
+				if (!nvttCtx.compress(mipSurface, 0 /* face */, i, compressionOpts, outputOpts)) {
+					LOG_FMT(Error, "Failed to compress %s", imgPath.c_str());
+					success = false;
+					break;
+				}
+			}
 		}
 
 		if (!success) {
@@ -150,32 +262,35 @@ bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &
 		imgs.push_back(img);
 	}
 
-	for (auto &img : imgs) {
-		dassert(img.header.mipMapCount == static_cast<int>(img.header.mipOffsets.size()));
+	LOG_FMT(Info, "Generated mips with %s in %.2fms", useNvttMips ? "nvtt" : "MipGen", mipGenTime);
 
-		auto nameSz = static_cast<uint32_t>(img.header.filename.size() * sizeof(String::value_type));
-		ofs.write(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
-		ofs.write(reinterpret_cast<const char*>(img.header.filename.data()), nameSz);
-
-		ofs.write(reinterpret_cast<const char *>(&img.header.size), sizeof(SizeType));
-		ofs.write(reinterpret_cast<const char*>(&img.header.width), sizeof(int));
-		ofs.write(reinterpret_cast<const char*>(&img.header.height), sizeof(int));
-		ofs.write(reinterpret_cast<const char*>(&img.header.ncomp), sizeof(int));
-		ofs.write(reinterpret_cast<const char*>(&img.header.mipMapCount), sizeof(int));
-		for (SizeType i = 0; i < img.header.mipOffsets.size(); ++i) {
-			ofs.write(reinterpret_cast<const char*>(&img.header.mipOffsets[i]), sizeof(SizeType));
+	Vector<Vector<uint8_t>> storedData(imgs.size());
+	if (compression != ImageCompression::None) {
+		SizeType totalSize = 0;
+		SizeType totalStoredSize = 0;
+		for (SizeType i = 0; i < imgs.size(); ++i) {
+			compressImageData(imgs[i], compression, storedData[i]);
+			totalSize += imgs[i].header.size;
+			totalStoredSize += storedData[i].size();
 		}
-	}
 
-	uint32_t headerEnd = HEADER_END;
-	ofs.write(reinterpret_cast<char *>(&headerEnd), sizeof(uint32_t));
+		LOG_FMT(Info, "Compressed texture data from %llu to %llu bytes(%.2f%%)", totalSize, totalStoredSize, totalSize ? 100.0 * totalStoredSize / totalSize : 0.0);
+	}
 
+	Vector<ImageHeader> headers;
 	for (auto &img : imgs) {
-		SizeType dataSize = img.header.size;
+		headers.push_back(img.header);
+	}
+	writeHeader(ofs, headers);
+
+	for (SizeType i = 0; i < imgs.size(); ++i) {
+		auto &img = imgs[i];
+		const uint8_t *data = storedData[i].empty() ? img.data.get() : storedData[i].data();
+		SizeType dataSize = img.header.getStoredSize();
 		SizeType offset = 0;
 		while (dataSize > 0) {
 			SizeType chunk = dataSize < 4*1024 ? dataSize : 4*1024;
-			ofs.write(reinterpret_cast<const char *>(img.data) + offset, chunk);
+			ofs.write(reinterpret_cast<const char *>(data) + offset, chunk);
 			if (ofs.fail()) {
 				LOG_FMT(Error, "Failed to serialize %ls! Error: %s(%d)", img.header.filename.c_str(), GetLastErrorAsString().c_str(), GetLastError());
 				return false;
@@ -186,8 +301,6 @@ bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &
 		}
 	}
 
-	std::for_each(imgs.begin(), imgs.end(), [](ImageData& img) { STBI_FREE((void*)img.data); });
-
 	ofs.close();
 
 	std::ios_base::sync_with_stdio(stdioOldSyncFlag);
@@ -195,6 +308,77 @@ bool serializeTextureDataToFile(const Vector<String> &imgPaths, const fs::path &
 	return true;
 }
 
+bool linkTextureLibraries(const Vector<fs::path> &txLibs, const fs::path &outputFile) {
+	Vector<ImageHeader> headers;
+	Vector<Vector<char>> storedData;
+	for (auto &txLib : txLibs) {
+		Header header = readHeader(txLib);
+		if (header.imgDataStartPos == INVALID_IMG_DATA_POS) {
+			// Libraries of images which failed to load are empty.
+			continue;
+		}
+
+		SizeType storedSize = 0;
+		for (auto &imgh : header.headers) {
+			storedSize += imgh.getStoredSize();
+		}
+
+		std::ifstream ifs(txLib, std::ios::in | std::ios::binary);
+		Vector<char> &data = storedData.emplace_back(storedSize);
+		ifs.seekg(header.imgDataStartPos);
+		ifs.read(data.data(), storedSize);
+		if (!ifs) {
+			LOG_FMT(Error, "Failed to read the image data of %s!", txLib.string().c_str());
+			return false;
+		}
+
+		headers.insert(headers.end(), header.headers.begin(), header.headers.end());
+	}
+
+	if (headers.empty()) {
+		LOG(Error, "No image data to link!");
+		return false;
+	}
+
+	std::ofstream ofs(outputFile, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!ofs.good()) {
+		LOG_FMT(Error, "Failed to open %s!", outputFile.string().c_str());
+		return false;
+	}
+
+	writeHeader(ofs, headers);
+	for (auto &data : storedData) {
+		ofs.write(data.data(), data.size());
+	}
+
+	ofs.close();
+	if (ofs.fail()) {
+		LOG_FMT(Error, "Failed to write %s!", outputFile.string().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+/// Read-only stream buffer over memory, so headers of files read as a whole could be parsed in place.
+struct MemoryStreamBuffer : std::streambuf {
+	MemoryStreamBuffer(const uint8_t *data, SizeType size) {
+		auto begin = reinterpret_cast<char*>(const_cast<uint8_t*>(data));
+		setg(begin, begin, begin + size);
+	}
+
+	/// Only telling the current position is supported.
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+		if (dir != std::ios_base::cur || off != 0) {
+			return pos_type(off_type(-1));
+		}
+
+		return pos_type(gptr() - eback());
+	}
+};
+
+Header readHeaderFromStream(std::istream &ifs, const String &txLibName);
+
 Header readHeader(const fs::path &txLibFile) {
 	std::ifstream ifs(txLibFile, std::ios::in | std::ios::binary);
 	if (!ifs.good()) {
@@ -202,11 +386,38 @@ Header readHeader(const fs::path &txLibFile) {
 		return Header{};
 	}
 
+	return readHeaderFromStream(ifs, txLibFile.string());
+}
+
+Header readHeader(const uint8_t *data, SizeType size, const String &txLibName) {
+	MemoryStreamBuffer buffer(data, size);
+	std::istream is(&buffer);
+
+	return readHeaderFromStream(is, txLibName);
+}
+
+Header readHeaderFromStream(std::istream &ifs, const String &txLibName) {
 	Header result;
 	SizeType headerSize = 0;
-	while (!ifs.eof()) {
-		uint32_t nameSz;
+
+	uint32_t version = 1;
+	uint32_t nameSz;
+	ifs.read(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
+	if (nameSz == TXLIB_MAGIC) {
+		ifs.read(reinterpret_cast<char *>(&version), sizeof(uint32_t));
 		ifs.read(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
+		headerSize += 2 * sizeof(uint32_t);
+	}
+
+	if (version > TXLIB_VERSION) {
+		LOG_FMT(Error, "Unsupported txlib version %u of %s!", version, txLibName.c_str());
+		return Header{};
+	}
+
+	for (bool first = true; !ifs.eof(); first = false) {
+		if (!first) {
+			ifs.read(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
+		}
 
 		if (nameSz == HEADER_END) {
 			headerSize += sizeof(uint32_t); // header end
@@ -229,6 +440,16 @@ Header readHeader(const fs::path &txLibFile) {
 
 		headerSize += sizeof(uint32_t) + nameSz + sizeof(SizeType) + 4 * sizeof(int) + header.mipMapCount * sizeof(SizeType);
 
+		if (version >= 2) {
+			uint32_t numChunks = 0;
+			ifs.read(reinterpret_cast<char*>(&header.compression), sizeof(ImageCompression));
+			ifs.read(reinterpret_cast<char*>(&numChunks), sizeof(uint32_t));
+			header.chunks.resize(numChunks);
+			ifs.read(reinterpret_cast<char*>(header.chunks.data()), numChunks * sizeof(ImageChunk));
+
+			headerSize += sizeof(ImageCompression) + sizeof(uint32_t) + numChunks * sizeof(ImageChunk);
+		}
+
 		result.headers.push_back(header);
 	}
 
@@ -281,111 +502,635 @@ WString shaderTypeToWStr(ShaderType type) {
 	return L"";
 }
 
-bool outputBlobToFile(const Vector<CompiledShader> &shaders, const String &outputDir, bool truncateFile) {
-	if (!std::filesystem::exists(outputDir)) {
-		auto mkdir = std::filesystem::absolute(outputDir);
-		std::filesystem::create_directories(mkdir);
-	}
+constexpr uint32_t SHLIB_V1_HEADER = 0xFADE00BE; ///< First, non-indexed, version of the format
+constexpr uint32_t SHLIB_MAGIC = 0x53484C42;
+constexpr uint32_t SHLIB_VERSION = 2;
+constexpr SizeType SHLIB_BLOB_ALIGNMENT = 16;
 
-	auto outPath = std::filesystem::path(outputDir) / L"shaders.shlib";
-	outPath = std::filesystem::absolute(outPath);
+bool outputBlobToFile(const Vector<CompiledShader> &shaders, const fs::path &outputFile, bool truncateFile) {
+	auto outPath = std::filesystem::absolute(outputFile);
+	if (!std::filesystem::exists(outPath.parent_path())) {
+		std::filesystem::create_directories(outPath.parent_path());
+	}
 
-	auto fstreamFlags = std::ios::binary | std::ios::out;
-	if (truncateFile) {
-		fstreamFlags |= std::ios::trunc;
-	} else {
-		fstreamFlags |= std::ios::app;
+	// The table of contents is at the beginning of the file, so appending means rewriting it.
+	Vector<CompiledShader> allShaders;
+	if (!truncateFile) {
+		allShaders = readBlob(outPath.string());
 	}
-	std::ofstream ofs(outPath, fstreamFlags);
+	allShaders.insert(allShaders.end(), shaders.begin(), shaders.end());
+
+	std::ofstream ofs(outPath, std::ios::binary | std::ios::out | std::ios::trunc);
 	if (!ofs.good()) {
 		LOG_FMT(Error, "Failed to write %s, error: %s", outPath.string().c_str(), strerror(errno));
 		return false;
 	}
 
-	if (truncateFile) {
-		const uint32_t header = 0xFADE00BE;
-		ofs.write(reinterpret_cast<const char *>(&header), sizeof(uint32_t));
+	const auto numEntries = static_cast<uint32_t>(allShaders.size());
+	SizeType tocSize = 3 * sizeof(uint32_t);
+	for (auto &shader : allShaders) {
+		tocSize += sizeof(uint32_t) + shader.name.size() * sizeof(String::value_type) + 3 * sizeof(uint64_t);
 	}
 
-	for (auto &shader : shaders) {
-		auto nameSz = uint32_t(shader.name.size() * sizeof(String::value_type));
+	auto align = [](SizeType offset) {
+		return (offset + SHLIB_BLOB_ALIGNMENT - 1) & ~(SHLIB_BLOB_ALIGNMENT - 1);
+	};
+
+	// Shader variants often compile to the same DXIL, so identical blobs are stored once.
+	Vector<ShaderLibEntry> entries;
+	Vector<bool> isDuplicate(allShaders.size(), false);
+	Map<uint64_t, SizeType> hashToEntry;
+	SizeType offset = align(tocSize);
+	SizeType dedupedSize = 0;
+	for (SizeType i = 0; i < allShaders.size(); ++i) {
+		auto &shader = allShaders[i];
+		ShaderLibEntry entry;
+		entry.name = shader.name;
+		entry.offset = offset;
+		entry.size = shader.blob->GetBufferSize();
+		entry.hash = hashData(shader.blob->GetBufferPointer(), entry.size);
+
+		auto it = hashToEntry.find(entry.hash);
+		if (it != hashToEntry.end()) {
+			auto &other = allShaders[it->second];
+			if (other.blob->GetBufferSize() == entry.size && memcmp(other.blob->GetBufferPointer(), shader.blob->GetBufferPointer(), entry.size) == 0) {
+				entry.offset = entries[it->second].offset;
+				isDuplicate[i] = true;
+				dedupedSize += entry.size;
+			}
+		} else {
+			hashToEntry[entry.hash] = i;
+		}
+
+		entries.push_back(entry);
+
+		if (!isDuplicate[i]) {
+			offset = align(offset + entry.size);
+		}
+	}
+
+	const uint32_t magic = SHLIB_MAGIC;
+	const uint32_t version = SHLIB_VERSION;
+	ofs.write(reinterpret_cast<const char *>(&magic), sizeof(uint32_t));
+	ofs.write(reinterpret_cast<const char *>(&version), sizeof(uint32_t));
+	ofs.write(reinterpret_cast<const char *>(&numEntries), sizeof(uint32_t));
+
+	for (auto &entry : entries) {
+		auto nameSz = uint32_t(entry.name.size() * sizeof(String::value_type));
 		ofs.write(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
-		ofs.write(reinterpret_cast<const char *>(shader.name.data()), nameSz);
+		ofs.write(reinterpret_cast<const char *>(entry.name.data()), nameSz);
+		ofs.write(reinterpret_cast<const char *>(&entry.offset), sizeof(uint64_t));
+		ofs.write(reinterpret_cast<const char *>(&entry.size), sizeof(uint64_t));
+		ofs.write(reinterpret_cast<const char *>(&entry.hash), sizeof(uint64_t));
+	}
+
+	const char padding[SHLIB_BLOB_ALIGNMENT] = {};
+	SizeType pos = tocSize;
+	for (SizeType i = 0; i < allShaders.size(); ++i) {
+		if (isDuplicate[i]) {
+			continue;
+		}
 
-		// Let's hope our blobs don't get bigger than 4GB
-		uint32_t sz = static_cast<uint32_t>(shader.blob->GetBufferSize());
-		ofs.write(reinterpret_cast<char *>(&sz), sizeof(uint32_t));
-		ofs.write(reinterpret_cast<char *>(shader.blob->GetBufferPointer()), shader.blob->GetBufferSize());
+		ofs.write(padding, entries[i].offset - pos);
+		ofs.write(reinterpret_cast<const char *>(allShaders[i].blob->GetBufferPointer()), entries[i].size);
+		pos = entries[i].offset + entries[i].size;
 	}
 
 	ofs.close();
 
+	if (dedupedSize > 0) {
+		LOG_FMT(Info, "Shader library: %llu shaders, %llu bytes saved by storing identical DXIL once", allShaders.size(), dedupedSize);
+	}
+
+	return !ofs.fail();
+}
+
+bool readShaderLibIndex(const uint8_t *data, SizeType size, Vector<ShaderLibEntry> &entries) {
+	entries.clear();
+
+	SizeType pos = 0;
+	auto read = [&](void *dst, SizeType bytes) {
+		if (pos + bytes > size) {
+			return false;
+		}
+
+		memcpy(dst, data + pos, bytes);
+		pos += bytes;
+		return true;
+	};
+
+	uint32_t magic = 0, version = 0, numEntries = 0;
+	if (!read(&magic, sizeof(uint32_t)) || magic != SHLIB_MAGIC) {
+		return false;
+	}
+
+	if (!read(&version, sizeof(uint32_t)) || version != SHLIB_VERSION || !read(&numEntries, sizeof(uint32_t))) {
+		return false;
+	}
+
+	entries.resize(numEntries);
+	for (auto &entry : entries) {
+		uint32_t nameSz = 0;
+		if (!read(&nameSz, sizeof(uint32_t)) || pos + nameSz > size) {
+			return false;
+		}
+
+		entry.name.resize(nameSz / sizeof(String::value_type));
+		read(entry.name.data(), nameSz);
+
+		const bool success = read(&entry.offset, sizeof(uint64_t)) && read(&entry.size, sizeof(uint64_t)) && read(&entry.hash, sizeof(uint64_t));
+		if (!success || entry.offset + entry.size > size) {
+			return false;
+		}
+	}
+
 	return true;
 }
 
-bool compileFolderAsBlob(const String &shaderFolder, const String &outputDir) {
-	Set<String> basenames;
+/// DXC instances of the current thread. They are not thread-safe, so each thread gets its own.
+struct DxcContext {
+	ComPtr<IDxcCompiler3> compiler;
+	ComPtr<IDxcUtils> utils;
+	ComPtr<IDxcIncludeHandler> includeHandler;
+	uint64_t versionHash = 0; ///< Hash of the DXC version, so updating DXC invalidates the shader cache.
+};
 
-	for (auto &entry : std::filesystem::directory_iterator(shaderFolder)) {
-		if (!entry.is_regular_file()) {
+DxcContext& getDxcContext() {
+	thread_local DxcContext ctx;
+	if (ctx.compiler == nullptr) {
+		DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(ctx.compiler.GetAddressOf()));
+		DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(ctx.utils.GetAddressOf()));
+		ctx.utils->CreateDefaultIncludeHandler(ctx.includeHandler.GetAddressOf());
+
+		UINT32 version[2] = {};
+		ComPtr<IDxcVersionInfo> versionInfo;
+		if (SUCCEEDED(ctx.compiler.As(&versionInfo))) {
+			versionInfo->GetVersion(&version[0], &version[1]);
+		}
+		ctx.versionHash = hashData(version, sizeof(version));
+	}
+
+	return ctx;
+}
+
+bool readTextFile(const fs::path &p, String &content) {
+	std::ifstream ifs(p, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!ifs.good()) {
+		return false;
+	}
+
+	content.resize(static_cast<SizeType>(ifs.tellg()));
+	ifs.seekg(0, std::ios::beg);
+	ifs.read(content.data(), content.size());
+
+	return true;
+}
+
+/// Find the names of the files included by a shader source.
+/// Includes are found textually, so ones under a disabled #if are found as well.
+/// At worst this causes a needless recompilation.
+void findIncludes(std::string_view src, Vector<String> &includes) {
+	SizeType pos = 0;
+	while (pos < src.size()) {
+		SizeType lineEnd = src.find('\n', pos);
+		if (lineEnd == std::string_view::npos) {
+			lineEnd = src.size();
+		}
+
+		auto line = src.substr(pos, lineEnd - pos);
+		pos = lineEnd + 1;
+
+		const SizeType hashPos = line.find_first_not_of(" \t");
+		if (hashPos == std::string_view::npos || line[hashPos] != '#') {
+			continue;
+		}
+
+		line = line.substr(hashPos + 1);
+		line = line.substr(std::min(line.size(), line.find_first_not_of(" \t")));
+		if (!line.starts_with("include")) {
+			continue;
+		}
+
+		const SizeType nameStart = line.find_first_of("\"<");
+		if (nameStart == std::string_view::npos) {
 			continue;
 		}
 
-		auto filename = entry.path().filename().string();
-		auto sv = std::string_view{ filename };
+		const char closing = line[nameStart] == '<' ? '>' : '"';
+		const SizeType nameEnd = line.find(closing, nameStart + 1);
+		if (nameEnd != std::string_view::npos) {
+			includes.emplace_back(line.substr(nameStart + 1, nameEnd - nameStart - 1));
+		}
+	}
+}
+
+/// Find an included file the way DXC does it - first in the directory of the including file, then in the include dirs.
+/// @return Canonical path to the file or an empty path if it's not found.
+fs::path resolveInclude(const String &include, const fs::path &currentDir, const Vector<WString> &includeDirs) {
+	fs::path includePath;
+	if (!currentDir.empty() && fs::exists(currentDir / include)) {
+		includePath = currentDir / include;
+	} else {
+		for (const auto &dir : includeDirs) {
+			if (fs::exists(fs::path(dir) / include)) {
+				includePath = fs::path(dir) / include;
+				break;
+			}
+		}
+	}
+
+	if (includePath.empty()) {
+		return includePath;
+	}
+
+	std::error_code ec;
+	return fs::weakly_canonical(includePath, ec);
+}
+
+/// Hash the contents of all files included by the source, recursively.
+/// @param visited Already hashed files. Each file is hashed once, as if all of them had #pragma once.
+uint64_t hashIncludes(std::string_view src, const fs::path &currentDir, const Vector<WString> &includeDirs, Set<String> &visited, uint64_t hash) {
+	Vector<String> includes;
+	findIncludes(src, includes);
+
+	for (const auto &include : includes) {
+		hash = hashData(include.data(), include.size(), hash);
+
+		// DXC will report the missing file
+		const fs::path includePath = resolveInclude(include, currentDir, includeDirs);
+		if (includePath.empty()) {
+			continue;
+		}
 
-		auto extPos = sv.find_last_of('.');
-		if (extPos == std::string::npos) {
+		if (!visited.insert(includePath.string()).second) {
 			continue;
 		}
-		auto ext = sv.substr(extPos + 1);
-		sv = sv.substr(0, extPos);
-		if (ext != "hlsl") {
+
+		String content;
+		if (!readTextFile(includePath, content)) {
 			continue;
 		}
 
-		extPos = sv.find_last_of('_');
-		if (extPos == std::string::npos) {
+		hash = hashData(content.data(), content.size(), hash);
+		hash = hashIncludes(content, includePath.parent_path(), includeDirs, visited, hash);
+	}
+
+	return hash;
+}
+
+void findShaderIncludes(const fs::path &shaderFile, const Vector<WString> &includeDirs, Vector<fs::path> &includes) {
+	Set<String> visited;
+	Vector<fs::path> stack = { shaderFile };
+	while (!stack.empty()) {
+		const fs::path p = stack.back();
+		stack.pop_back();
+
+		String src;
+		if (!readTextFile(p, src)) {
 			continue;
 		}
-		auto base = sv.substr(0, extPos);
-		ext = sv.substr(extPos + 1);
-		if (ext == "vs" || ext == "ps" || ext == "cs" /* || TODO */) {
-			basenames.insert(filename.substr(0, extPos));
+
+		Vector<String> names;
+		findIncludes(src, names);
+		for (const auto &name : names) {
+			const fs::path includePath = resolveInclude(name, p.parent_path(), includeDirs);
+			if (!includePath.empty() && visited.insert(includePath.string()).second) {
+				includes.push_back(includePath);
+				stack.push_back(includePath);
+			}
 		}
 	}
+}
 
-	bool truncateFile = true;
-	for (auto &basename : basenames) {
-		auto p = std::filesystem::path(shaderFolder) / basename;
-		if (!compileShaderAsBlob(p.string(), outputDir, truncateFile)) {
-			// TODO: delete generated file?
+fs::path getCachedShaderPath(const ShaderCache &cache, uint64_t key) {
+	char filename[32];
+	snprintf(filename, sizeof(filename), "%016llx.dxil", static_cast<unsigned long long>(key));
+	return cache.dir / filename;
+}
+
+ComPtr<IDxcBlob> readCachedShader(const fs::path &p, IDxcUtils *utils) {
+	String data;
+	if (!readTextFile(p, data) || data.empty()) {
+		return nullptr;
+	}
+
+	ComPtr<IDxcBlobEncoding> blobEncoding;
+	if (FAILED(utils->CreateBlob(data.data(), static_cast<UINT32>(data.size()), DXC_CP_ACP, blobEncoding.GetAddressOf()))) {
+		return nullptr;
+	}
+
+	ComPtr<IDxcBlob> blob;
+	blobEncoding.As<IDxcBlob>(&blob);
+
+	return blob;
+}
+
+void writeCachedShader(const fs::path &p, IDxcBlob *blob) {
+	// Write to a temporary file first, so other processes never see partially written shaders.
+	auto tmpPath = p;
+	tmpPath += ".tmp" + std::to_string(GetCurrentThreadId());
+	{
+		std::ofstream ofs(tmpPath, std::ios::binary | std::ios::out | std::ios::trunc);
+		if (!ofs.good()) {
+			return;
+		}
+
+		ofs.write(reinterpret_cast<const char*>(blob->GetBufferPointer()), blob->GetBufferSize());
+	}
+
+	std::error_code ec;
+	fs::rename(tmpPath, p, ec);
+	if (ec) {
+		fs::remove(tmpPath, ec);
+	}
+}
+
+Vector<String> findShaderKeywords(std::string_view src) {
+	constexpr std::string_view KEYWORDS_TAG = "@keywords";
+
+	Vector<String> keywords;
+	SizeType pos = 0;
+	while (pos < src.size()) {
+		SizeType lineEnd = src.find('\n', pos);
+		if (lineEnd == std::string_view::npos) {
+			lineEnd = src.size();
+		}
+
+		auto line = src.substr(pos, lineEnd - pos);
+		pos = lineEnd + 1;
+
+		const SizeType commentPos = line.find_first_not_of(" \t");
+		if (commentPos == std::string_view::npos || !line.substr(commentPos).starts_with("//")) {
+			continue;
+		}
+
+		line = line.substr(commentPos + 2);
+		line = line.substr(std::min(line.size(), line.find_first_not_of(" \t")));
+		if (!line.starts_with(KEYWORDS_TAG)) {
+			continue;
+		}
+
+		line = line.substr(KEYWORDS_TAG.size());
+		while (!line.empty()) {
+			const SizeType start = line.find_first_not_of(" \t\r");
+			if (start == std::string_view::npos) {
+				break;
+			}
+
+			const SizeType end = std::min(line.size(), line.find_first_of(" \t\r", start));
+			String keyword{ line.substr(start, end - start) };
+			if (std::find(keywords.begin(), keywords.end(), keyword) == keywords.end()) {
+				keywords.push_back(keyword);
+			}
+			line = line.substr(end);
+		}
+	}
+
+	return keywords;
+}
+
+String getShaderVariantName(const String &shaderName, uint32_t variant) {
+	if (variant == 0) {
+		return shaderName;
+	}
+
+	return shaderName + "@" + std::to_string(variant);
+}
+
+/// A shader file compiled with a specific set of keywords.
+struct ShaderVariantFile {
+	fs::path path;
+	ShaderType type;
+	Vector<String> defines;
+	Optional<CompiledShader> compiled;
+};
+
+/// Entry of the shader library pointing to a compiled variant.
+/// Variants differing only in keywords the stage doesn't declare point to the same file.
+struct ShaderVariantEntry {
+	String name;
+	SizeType file;
+};
+
+/// Add all variants of all stages of a shader.
+/// @param base Path to the shader without the stage suffix, f.e shaders/deferred.
+/// @return false if the shader declares too many keywords.
+bool addShaderVariants(const fs::path &base, Vector<ShaderVariantFile> &files, Vector<ShaderVariantEntry> &entries) {
+	struct Stage {
+		fs::path path;
+		ShaderType type;
+		Vector<String> keywords;
+	};
+
+	Vector<Stage> stages;
+	Vector<String> keywords;
+	for (int i = 0; i < static_cast<int>(ShaderType::COUNT); ++i) {
+		auto shaderType = static_cast<ShaderType>(i);
+		const auto p = fs::absolute(base.string() + "_" + shaderTypeToStr(shaderType) + ".hlsl");
+		if (!fs::exists(p) || !fs::is_regular_file(p)) {
+			continue;
+		}
+
+		String src;
+		readTextFile(p, src);
+
+		Stage stage = { p, shaderType, findShaderKeywords(src) };
+		for (auto &keyword : stage.keywords) {
+			if (std::find(keywords.begin(), keywords.end(), keyword) == keywords.end()) {
+				keywords.push_back(keyword);
+			}
+		}
+		stages.push_back(stage);
+	}
+
+	if (keywords.size() > MAX_SHADER_KEYWORDS) {
+		LOG_FMT(Error, "Shader %s declares %llu keywords, max is %d!", base.string().c_str(), keywords.size(), MAX_SHADER_KEYWORDS);
+		return false;
+	}
+
+	const uint32_t numVariants = 1u << keywords.size();
+	for (auto &stage : stages) {
+		uint32_t stageMask = 0;
+		for (SizeType i = 0; i < keywords.size(); ++i) {
+			if (std::find(stage.keywords.begin(), stage.keywords.end(), keywords[i]) != stage.keywords.end()) {
+				stageMask |= 1u << i;
+			}
+		}
+
+		const SizeType firstFile = files.size();
+		Map<uint32_t, SizeType> stageVariantToFile;
+		for (uint32_t variant = 0; variant < numVariants; ++variant) {
+			const uint32_t stageVariant = variant & stageMask;
+			auto it = stageVariantToFile.find(stageVariant);
+			if (it == stageVariantToFile.end()) {
+				ShaderVariantFile file = { stage.path, stage.type, {}, std::nullopt };
+				for (SizeType i = 0; i < keywords.size(); ++i) {
+					if (stageMask & (1u << i)) {
+						file.defines.push_back(keywords[i] + ((stageVariant & (1u << i)) ? "=1" : "=0"));
+					}
+				}
+				files.push_back(file);
+				it = stageVariantToFile.insert({ stageVariant, files.size() - 1 }).first;
+			}
+
+			const String shaderName = base.filename().string() + "_" + shaderTypeToStr(stage.type);
+			entries.push_back(ShaderVariantEntry{ getShaderVariantName(shaderName, variant), it->second });
+		}
+
+		dassert(files.size() - firstFile == (SizeType(1) << std::bitset<32>(stageMask).count()));
+	}
+
+	return true;
+}
+
+Optional<CompiledShader> compileShaderFile(const fs::path &p, ShaderType type, const Vector<String> &defines, ShaderCache *cache) {
+	auto shaderNameBase = p.stem().string();
+	auto underscorePos = shaderNameBase.find_last_of('_');
+	shaderNameBase = shaderNameBase.substr(0, underscorePos);
+
+	String src;
+	if (!readTextFile(p, src)) {
+		return std::nullopt;
+	}
+
+	auto includeDir = p.parent_path().wstring();
+	return compileFromSource(src.data(), src.size(), shaderNameBase, { includeDir }, type, defines, cache);
+}
+
+/// Gather the compiled variants in the order of the entries.
+/// @return false if any of the variants failed to compile.
+bool collectShaderVariants(const Vector<ShaderVariantFile> &files, const Vector<ShaderVariantEntry> &entries, Vector<CompiledShader> &result) {
+	for (auto &file : files) {
+		if (!file.compiled.has_value()) {
+			LOG_FMT(Error, "Failed to compile %s!", file.path.string().c_str());
 			return false;
 		}
-		truncateFile = false;
+	}
+
+	for (auto &entry : entries) {
+		result.push_back(CompiledShader{ files[entry.file].compiled->blob, entry.name });
 	}
 
 	return true;
 }
 
-Optional<CompiledShader> compileFromSource(const char *src, SizeType srcLen, const String &basename, const Vector<WString> includeDirs, ShaderType type) {
-	ComPtr<IDxcCompiler3> compiler;
-	DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(compiler.GetAddressOf()));
+fs::path getShaderBasename(const fs::path &shaderFile) {
+	if (shaderFile.extension() != ".hlsl") {
+		return {};
+	}
 
-	ComPtr<IDxcUtils> utils;
-	DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(utils.GetAddressOf()));
+	auto stem = shaderFile.stem().string();
+	auto extPos = stem.find_last_of('_');
+	if (extPos == std::string::npos) {
+		return {};
+	}
 
-	ComPtr<IDxcIncludeHandler> includeHandler;
-	utils->CreateDefaultIncludeHandler(includeHandler.GetAddressOf());
+	auto ext = std::string_view{ stem }.substr(extPos + 1);
+	if (ext == "vs" || ext == "ps" || ext == "cs" /* || TODO */) {
+		return shaderFile.parent_path() / stem.substr(0, extPos);
+	}
 
-	ComPtr<IDxcBlobEncoding> source;
-	utils->CreateBlob(src, static_cast<uint32_t>(srcLen), CP_UTF8, source.GetAddressOf());
+	return {};
+}
+
+bool compileShadersToFile(const Vector<fs::path> &basenames, const fs::path &outputFile, const fs::path &cacheDir) {
+	Vector<ShaderVariantFile> files;
+	Vector<ShaderVariantEntry> entries;
+	for (auto &basename : basenames) {
+		if (!addShaderVariants(basename, files, entries)) {
+			return false;
+		}
+	}
+
+	ShaderCache cache;
+	cache.dir = cacheDir;
+	if (!cacheDir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(cache.dir, ec);
+	}
+
+	struct CompileParams {
+		ShaderVariantFile *files;
+		ShaderCache *cache;
+	} params = { files.data(), cacheDir.empty() ? nullptr : &cache };
+
+	Timer timer;
+	JobSystem::parallelFor(
+		files.size(),
+		1,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<CompileParams*>(param);
+			for (SizeType i = begin; i < end; ++i) {
+				auto &file = p->files[i];
+				file.compiled = compileShaderFile(file.path, file.type, file.defines, p->cache);
+			}
+		},
+		&params
+	);
+
+	const int numLookups = cache.hits + cache.misses;
+	LOG_FMT(
+		Info,
+		"Compiled %llu shader variants(%llu library entries) in %.2fms. Shader cache hits: %d/%d(%.1f%%)",
+		files.size(), entries.size(), timer.time(), cache.hits.load(), numLookups, numLookups > 0 ? 100.0 * cache.hits / numLookups : 0.0
+	);
+
+	Vector<CompiledShader> result;
+	if (!collectShaderVariants(files, entries, result) || result.empty()) {
+		return false;
+	}
+
+	return outputBlobToFile(result, outputFile, true);
+}
+
+bool linkShaderLibraries(const Vector<fs::path> &shaderLibs, const fs::path &outputFile) {
+	Vector<CompiledShader> shaders;
+	for (auto &shaderLib : shaderLibs) {
+		auto libShaders = readBlob(shaderLib.string());
+		if (libShaders.empty()) {
+			LOG_FMT(Error, "Failed to read shader library %s!", shaderLib.string().c_str());
+			return false;
+		}
+
+		shaders.insert(shaders.end(), libShaders.begin(), libShaders.end());
+	}
+
+	return outputBlobToFile(shaders, outputFile, true);
+}
+
+bool compileFolderAsBlob(const String &shaderFolder, const String &outputDir) {
+	Set<String> basenames;
+	for (auto &entry : std::filesystem::directory_iterator(shaderFolder)) {
+		if (!entry.is_regular_file()) {
+			continue;
+		}
+
+		auto basename = getShaderBasename(entry.path());
+		if (!basename.empty()) {
+			basenames.insert(basename.string());
+		}
+	}
+
+	// Sorted, so the library doesn't depend on the order the files are iterated in.
+	Vector<fs::path> sortedBasenames{ basenames.begin(), basenames.end() };
+	std::sort(sortedBasenames.begin(), sortedBasenames.end());
+
+	return compileShadersToFile(sortedBasenames, std::filesystem::path(outputDir) / "shaders.shlib", std::filesystem::path(outputDir) / "shadercache");
+}
+
+Optional<CompiledShader> compileFromSource(const char *src, SizeType srcLen, const String &basename, const Vector<WString> includeDirs, ShaderType type, const Vector<String> &defines, ShaderCache *cache) {
+	auto &dxc = getDxcContext();
 
 	Vector<WString> argsStr;
 	for (auto &includeDir : includeDirs) {
 		argsStr.push_back(L"-I");
 		argsStr.push_back(includeDir);
 	}
+	const SizeType numIncludeArgs = argsStr.size();
+	for (auto &define : defines) {
+		argsStr.push_back(L"-D");
+		argsStr.push_back(WString{ define.begin(), define.end() });
+	}
 	argsStr.push_back(L"-E");
 	argsStr.push_back(L"main");
 	argsStr.push_back(L"-T");
@@ -394,6 +1139,32 @@ Optional<CompiledShader> compileFromSource(const char *src, SizeType srcLen, con
 	argsStr.push_back(L"-Qstrip_reflect");
 	argsStr.push_back(L"-no-warnings");
 
+	String shaderName = basename + "_" + shaderTypeToStr(type);
+
+	fs::path cachedShaderPath;
+	if (cache != nullptr) {
+		// Include dirs only matter for finding the includes, whose contents are hashed anyway.
+		Set<String> visited;
+		uint64_t key = hashData(src, srcLen, dxc.versionHash);
+		key = hashIncludes(std::string_view{ src, srcLen }, {}, includeDirs, visited, key);
+		for (SizeType i = numIncludeArgs; i < argsStr.size(); ++i) {
+			key = hashData(argsStr[i].data(), argsStr[i].size() * sizeof(WString::value_type), key);
+		}
+
+		cachedShaderPath = getCachedShaderPath(*cache, key);
+		if (auto blob = readCachedShader(cachedShaderPath, dxc.utils.Get())) {
+			++cache->hits;
+			return CompiledShader{ blob, shaderName };
+		}
+
+		++cache->misses;
+	}
+
+	LOG_FMT(Info, "Compiling shader %s...", shaderName.c_str());
+
+	ComPtr<IDxcBlobEncoding> source;
+	dxc.utils->CreateBlob(src, static_cast<uint32_t>(srcLen), CP_UTF8, source.GetAddressOf());
+
 	Vector<LPCWSTR> args;
 	for (auto &arg : argsStr) {
 		args.push_back(arg.c_str());
@@ -405,9 +1176,7 @@ Optional<CompiledShader> compileFromSource(const char *src, SizeType srcLen, con
 	sourceBuffer.Encoding = 0;
 
 	ComPtr<IDxcResult> compileResult;
-	compiler->Compile(&sourceBuffer, args.data(), uint32_t(args.size()), includeHandler.Get(), IID_PPV_ARGS(compileResult.GetAddressOf()));
-
-	String shaderName = basename + "_" + shaderTypeToStr(type);
+	dxc.compiler->Compile(&sourceBuffer, args.data(), uint32_t(args.size()), dxc.includeHandler.Get(), IID_PPV_ARGS(compileResult.GetAddressOf()));
 
 	ComPtr<IDxcBlobUtf8> errors;
 	compileResult->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(errors.GetAddressOf()), nullptr);
@@ -424,51 +1193,66 @@ Optional<CompiledShader> compileFromSource(const char *src, SizeType srcLen, con
 			std::nullopt,
 			"Failed to get shader %s output!", name.c_str()
 		);
+
+		if (cache != nullptr) {
+			writeCachedShader(cachedShaderPath, result.blob.Get());
+		}
 	}
 
 	return result;
 }
 
 bool compileShaderAsBlob(const String &basename, const String &outputDir, bool truncateFile) {
-	Vector <CompiledShader> result;
-	for (int i = 0; i < static_cast<int>(ShaderType::COUNT); ++i) {
-		auto shaderType = static_cast<ShaderType>(i);
-		const auto p = std::filesystem::absolute(basename + "_" + shaderTypeToStr(shaderType) + ".hlsl");
-		auto shaderNameBase = p.stem().string();
-		auto underscorePos = shaderNameBase.find_last_of('_');
-		shaderNameBase = shaderNameBase.substr(0, underscorePos);
+	Vector<ShaderVariantFile> files;
+	Vector<ShaderVariantEntry> entries;
+	if (!addShaderVariants(basename, files, entries)) {
+		return false;
+	}
 
-		if (!std::filesystem::exists(p) || !std::filesystem::is_regular_file(p)) {
-			continue;
-		}
+	for (auto &file : files) {
+		file.compiled = compileShaderFile(file.path, file.type, file.defines, nullptr);
+	}
 
-		std::ifstream ifs(p.c_str(), std::ios::in | std::ios::ate);
-		if (!ifs.good()) {
-			continue;
-		}
+	Vector<CompiledShader> result;
+	if (!collectShaderVariants(files, entries, result) || result.empty()) {
+		return false;
+	}
+
+	return outputBlobToFile(result, std::filesystem::path(outputDir) / "shaders.shlib", truncateFile);
+}
 
-		LOG_FMT(Info, "Compiling shader file %s...", p.string().c_str());
+Vector<CompiledShader> readBlobV1(std::ifstream &ifs, IDxcUtils *utils) {
+	auto res = Vector<CompiledShader>{};
 
-		const auto size = ifs.tellg();
-		auto srcMemblock = std::make_unique<char[]>(size);
-		ifs.seekg(0, std::ios::beg);
-		ifs.read(srcMemblock.get(), size);
-		ifs.close();
+	while (!ifs.eof()) {
+		CompiledShader shader{};
 
-		auto include_dir = p.parent_path().wstring();
-		auto compiled = compileFromSource(srcMemblock.get(), size, shaderNameBase, {include_dir}, shaderType);
-		if (compiled.has_value()) {
-			result.push_back(*compiled);
+		uint32_t nameSz;
+		ifs.read(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
+		if (ifs.eof()) {
+			break;
 		}
-	}
 
-	if (result.empty()) {
-		return false;
+		shader.name.resize(nameSz / sizeof(String::value_type));
+		ifs.read(reinterpret_cast<char *>(shader.name.data()), nameSz);
+
+		uint32_t blob_size;
+		ifs.read(reinterpret_cast<char *>(&blob_size), sizeof(uint32_t));
+
+		auto memblock = std::make_unique<char[]>(blob_size);
+		ifs.read(memblock.get(), blob_size);
+
+		ComPtr<IDxcBlobEncoding> blob;
+		utils->CreateBlob((void *)memblock.get(), blob_size, DXC_CP_ACP, blob.GetAddressOf());
+		blob.As<IDxcBlob>(&shader.blob);
+
+		res.push_back(shader);
 	}
 
-	outputBlobToFile(result, outputDir, truncateFile);
+	std::ignore = ifs.get();
+	dassert(ifs.eof());
 
-	return true;
+	return res;
 }
 
 // TODO: error ifs error checking
@@ -488,41 +1272,40 @@ Vector<CompiledShader> readBlob(const String &filename) {
 
 	uint32_t header;
 	ifs.read(reinterpret_cast<char *>(&header), sizeof(uint32_t));
-	if (header != 0xFADE00BE) {
+	if (header != SHLIB_V1_HEADER && header != SHLIB_MAGIC) {
 		return res;
 	}
 
 	ComPtr<IDxcUtils> utils;
 	DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(utils.GetAddressOf()));
 
-	while (!ifs.eof()) {
-		CompiledShader shader{};
-
-		uint32_t nameSz;
-		ifs.read(reinterpret_cast<char *>(&nameSz), sizeof(uint32_t));
-		if (ifs.eof()) {
-			break;
-		}
+	if (header == SHLIB_V1_HEADER) {
+		return readBlobV1(ifs, utils.Get());
+	}
 
-		shader.name.resize(nameSz / sizeof(String::value_type));
-		ifs.read(reinterpret_cast<char *>(shader.name.data()), nameSz);
+	String data;
+	if (!readTextFile(p, data)) {
+		return res;
+	}
 
-		uint32_t blob_size;
-		ifs.read(reinterpret_cast<char *>(&blob_size), sizeof(uint32_t));
+	auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+	Vector<ShaderLibEntry> entries;
+	if (!readShaderLibIndex(bytes, data.size(), entries)) {
+		LOG_FMT(Error, "Invalid shader library %s!", filename.c_str());
+		return res;
+	}
 
-		auto memblock = std::make_unique<char[]>(blob_size);
-		ifs.read(memblock.get(), blob_size);
+	for (auto &entry : entries) {
+		CompiledShader shader{};
+		shader.name = entry.name;
 
 		ComPtr<IDxcBlobEncoding> blob;
-		utils->CreateBlob((void *)memblock.get(), blob_size, DXC_CP_ACP, blob.GetAddressOf());
+		utils->CreateBlob(bytes + entry.offset, static_cast<UINT32>(entry.size), DXC_CP_ACP, blob.GetAddressOf());
 		blob.As<IDxcBlob>(&shader.blob);
 
 		res.push_back(shader);
 	}
 
-	std::ignore = ifs.get();
-	dassert(ifs.eof());
-
 	return res;
 }
 
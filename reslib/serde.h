@@ -23,11 +23,25 @@ struct Header {
 /// Create a file named textures.txlib inside outputDir containing the given image data.
 /// @param imgs Images to be serialized
 /// @param outputDir Where to put the output file
+/// @param compression Compression applied on top of the BCn data. Each mip is split
+///                    into chunks which are compressed independently, so they can be decompressed in parallel.
+/// @param useNvttMips Generate the mips with nvtt's box filter instead of MipGen. Useful for comparing the two.
+/// @param outputName Name of the output file. Used for writing delta libraries, see ResourceLibrary::pollHotReload().
 /// @return true on success, false otherwise
-bool serializeTextureDataToFile(const Vector<String> &imgs, const fs::path &outputDir);
+bool serializeTextureDataToFile(const Vector<String> &imgs, const fs::path &outputDir, ImageCompression compression = ImageCompression::None, bool useNvttMips = false, const fs::path &outputName = L"textures.txlib");
+
+/// Merge texture libraries into a single one, f.e the libraries of the single images built by the resource compiler.
+/// The stored image data is copied as is, so the images are not compressed again.
+/// Libraries without images are skipped.
+/// @return false if none of the libraries contains images or any of them could not be read.
+bool linkTextureLibraries(const Vector<fs::path> &txLibs, const fs::path &outputFile);
 
 Header readHeader(const fs::path &txLibFile);
 
+/// Parse the header of a txlib read in memory as a whole.
+/// @param txLibName Used for logging.
+Header readHeader(const uint8_t *data, SizeType size, const String &txLibName);
+
 } // namespace TxLib
 
 namespace ShaderCompiler {
@@ -49,22 +63,89 @@ struct CompiledShader {
 	String name;
 };
 
-Optional<CompiledShader> compileFromSource(const char *source, SizeType srcLen, const String &basename, const Vector<WString> includeDirs, ShaderType type);
+/// On-disk cache of compiled shaders. Entries are keyed by a hash of the shader source
+/// together with all files it includes, the target profile, the compiler flags and the DXC version.
+/// Shaders found in the cache never reach DXC.
+struct ShaderCache {
+	fs::path dir; ///< Directory containing the cached DXIL files.
+	Atomic<int> hits = 0;
+	Atomic<int> misses = 0;
+};
+
+/// Max number of keywords of a shader. Each keyword doubles the number of its variants.
+constexpr int MAX_SHADER_KEYWORDS = 8;
+
+/// Compile a shader from source. DXC instances are created once per thread, so
+/// it's safe to compile multiple shaders in parallel.
+/// @param defines Macro definitions in the form NAME=VALUE passed to DXC.
+/// @param cache Optional cache to look the shader up in and to store it in after compilation.
+Optional<CompiledShader> compileFromSource(const char *source, SizeType srcLen, const String &basename, const Vector<WString> includeDirs, ShaderType type, const Vector<String> &defines = {}, ShaderCache *cache = nullptr);
+
+/// Find the keywords declared by a shader source. Keywords are declared on a single line
+/// in the form `// @keywords NORMAL_MAPPING SPOT_LIGHT`, and each of them is defined as either 0 or 1
+/// when compiling a variant of the shader. Bit i of the variant mask enables the i-th keyword.
+Vector<String> findShaderKeywords(std::string_view source);
+
+/// Find all files included by a shader, recursively. Includes are found textually,
+/// so ones under a disabled #if are found as well.
+/// @param includes Receives the canonical paths of the included files.
+void findShaderIncludes(const fs::path &shaderFile, const Vector<WString> &includeDirs, Vector<fs::path> &includes);
+
+/// Name of a shader variant in the shader library. The variant with no keywords enabled has the name of the shader.
+/// @param shaderName Name of the shader, f.e deferred_ps.
+/// @param variant Mask of the enabled keywords.
+String getShaderVariantName(const String &shaderName, uint32_t variant);
 
 /// @brief Given a shader base name generates a single file containing all compiled shaders.
+/// Every variant of the shaders is compiled. Keywords of all stages are merged in the order of the stages,
+/// so the same variant mask could be used for all stages. Stages are not compiled again for keywords they don't declare
+/// and variants with identical DXIL are stored once.
 /// @param basename of shaders. Shaders should follow the following template - basename_{vs,ps,etc}.hlsl
 /// @param outputDir Directory to output the compiled shaders. Output file will always be `shaders.shlib`
 /// @param truncateFile Delete contents of `shaders.shlib` if it aldready exists.
 /// @return true of it manages to compile the shaders, false otherwise
 bool compileShaderAsBlob(const String &basename, const String &outputDir, bool truncateFile);
 
+/// Base name of a shader stage file, f.e `shaders/deferred` for `shaders/deferred_ps.hlsl`.
+/// @return Empty path if the file is not a shader stage.
+fs::path getShaderBasename(const fs::path &shaderFile);
+
+/// Compile the shaders with the given base names, together with all of their variants, into a single shader library.
+/// Shaders are compiled in parallel on the job system.
+/// @param basenames Base names of the shaders. See getShaderBasename().
+/// @param outputFile Path of the shader library.
+/// @param cacheDir Directory of the ShaderCache. Empty for not caching the shaders.
+/// @note Must be called from inside a job. See JobSystem::parallelFor.
+bool compileShadersToFile(const Vector<fs::path> &basenames, const fs::path &outputFile, const fs::path &cacheDir);
+
+/// Merge shader libraries into a single one, f.e the libraries of the single shaders built by the resource compiler.
+/// The DXIL is copied as is and identical blobs of different libraries are stored once.
+bool linkShaderLibraries(const Vector<fs::path> &shaderLibs, const fs::path &outputFile);
+
 /// @brief Same as compileShaderAsBlob but looks for all hlsl files.
+/// Shaders and their variants are compiled in parallel on the job system and cached in `outputDir/shadercache`.
+/// @note Must be called from inside a job. See JobSystem::parallelFor.
 bool compileFolderAsBlob(const String &shaderFolder, const String &outputDir);
 
 /// @brief Given a shader blob file returns a vector of blobs containing compiled shaders together with their types.
+/// Reads both the indexed and the first version of the format. The blobs are copied.
 /// @return empty vector if the file was invalid or there were no shaders in the file.
 Vector<CompiledShader> readBlob(const String &filename);
 
+/// Entry in the table of contents at the beginning of a shlib.
+struct ShaderLibEntry {
+	String name;
+	uint64_t offset = 0; ///< Offset of the DXIL from the beginning of the file.
+	uint64_t size = 0; ///< Size of the DXIL in bytes.
+	uint64_t hash = 0; ///< Hash of the DXIL. See hashData().
+};
+
+/// Read the table of contents of a shlib, f.e from a memory-mapped file.
+/// DXIL blobs are 16 byte aligned, so they could be used directly from the mapping.
+/// Entries with identical DXIL share the same offset.
+/// @return false if the data is not a valid indexed shlib.
+bool readShaderLibIndex(const uint8_t *data, SizeType size, Vector<ShaderLibEntry> &entries);
+
 } // namespace ShaderCompiler
 
 } // namespace Dar
@@ -0,0 +1,343 @@
+#include "txlib_verify.h"
+
+#include "bc_decoder.h"
+#include "mip_generator.h"
+#include "serde.h"
+
+#include "async/async.h"
+#include "async/job_system.h"
+#include "utils/timer.h"
+
+#include "nvtt/nvtt.h"
+
+#include <cmath>
+#include <fstream>
+
+namespace Dar {
+
+namespace TxLib {
+
+struct MipMetrics {
+	double psnr = 0.0;
+	double ssim = 0.0;
+};
+
+/// Key of a mip-level in the baseline report.
+static String getMetricsKey(const String &filename, int mip) {
+	return filename + ":" + std::to_string(mip);
+}
+
+static Map<String, MipMetrics> readReport(const fs::path &reportFile) {
+	Map<String, MipMetrics> result;
+
+	std::ifstream ifs(reportFile);
+	if (!ifs.good()) {
+		LOG_FMT(Error, "Could not open baseline report %s!", reportFile.string().c_str());
+		return result;
+	}
+
+	String filename;
+	int mip;
+	MipMetrics metrics;
+	while (ifs >> filename >> mip >> metrics.psnr >> metrics.ssim) {
+		result[getMetricsKey(filename, mip)] = metrics;
+	}
+
+	return result;
+}
+
+/// Quantize a mip-level to tightly packed RGBA8 pixels.
+static void mipToRGBA8(const MipGen::MipLevel &mip, Vector<uint8_t> &rgba) {
+	const SizeType numPixels = SizeType(mip.width) * mip.height;
+	rgba.resize(numPixels * 4);
+	for (int c = 0; c < 4; ++c) {
+		const float *channel = mip.channel(c);
+		for (SizeType i = 0; i < numPixels; ++i) {
+			const float v = std::min(std::max(channel[i], 0.f), 1.f);
+			rgba[i * 4 + c] = static_cast<uint8_t>(v * 255.f + 0.5f);
+		}
+	}
+}
+
+/// Generate the same mips as the ones serializeTextureDataToFile() compresses.
+/// @param mipMapCount Number of mips in the txlib. Only used for nvtt's mips, as MipGen always builds the full chain.
+static void generateReferenceMips(nvtt::Surface surface, bool hasAlpha, bool useNvttMips, int mipMapCount, Vector<MipGen::MipLevel> &mips) {
+	auto toMipLevel = [](const nvtt::Surface &s) {
+		MipGen::MipLevel mip;
+		mip.width = s.width();
+		mip.height = s.height();
+		mip.data.assign(s.data(), s.data() + SizeType(mip.width) * mip.height * 4);
+		return mip;
+	};
+
+	mips.clear();
+	if (!useNvttMips) {
+		MipGen::MipLevel mip0 = toMipLevel(surface);
+		MipGen::generateMipChain(mip0, MipGen::detectMipSettings(mip0, hasAlpha), mips);
+		return;
+	}
+
+	for (int i = 0; i < mipMapCount; ++i) {
+		mips.push_back(toMipLevel(surface));
+
+		surface.toLinearFromSrgb();
+		if (hasAlpha) {
+			surface.premultiplyAlpha();
+		}
+
+		if (!surface.buildNextMipmap(nvtt::MipmapFilter_Box)) {
+			break;
+		}
+
+		surface.demultiplyAlpha();
+		surface.toSrgb();
+	}
+}
+
+/// Compute the PSNR over the RGB(A) channels and the mean SSIM of the luminance
+/// over 8x8 windows with a stride of 4 pixels.
+static MipMetrics computeMetrics(const uint8_t *decoded, const uint8_t *reference, int width, int height, bool hasAlpha) {
+	constexpr int WINDOW_SIZE = 8;
+	constexpr int WINDOW_STRIDE = 4;
+
+	struct MetricsParams {
+		const uint8_t *decoded;
+		const uint8_t *reference;
+		int width;
+		int height;
+		int windowWidth;
+		int windowHeight;
+		int numWindowsX;
+		int numChannels;
+		SpinLock lock;
+		double squaredError;
+		double ssimSum;
+	} params = {
+		decoded,
+		reference,
+		width,
+		height,
+		std::min(width, WINDOW_SIZE),
+		std::min(height, WINDOW_SIZE),
+		(width - std::min(width, WINDOW_SIZE)) / WINDOW_STRIDE + 1,
+		hasAlpha ? 4 : 3,
+		{},
+		0.0,
+		0.0
+	};
+
+	const int numWindowsY = (height - params.windowHeight) / WINDOW_STRIDE + 1;
+
+	// Squared error over rows
+	JobSystem::parallelFor(
+		height,
+		64,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<MetricsParams*>(param);
+			uint64_t squaredError = 0;
+			for (SizeType i = begin * p->width; i < end * p->width; ++i) {
+				for (int c = 0; c < p->numChannels; ++c) {
+					const int diff = int(p->decoded[i * 4 + c]) - int(p->reference[i * 4 + c]);
+					squaredError += diff * diff;
+				}
+			}
+
+			auto lock = p->lock.lock();
+			p->squaredError += static_cast<double>(squaredError);
+		},
+		&params
+	);
+
+	// SSIM over rows of windows
+	JobSystem::parallelFor(
+		numWindowsY,
+		16,
+		[](SizeType begin, SizeType end, void *param) {
+			auto p = reinterpret_cast<MetricsParams*>(param);
+			constexpr double C1 = (0.01 * 255) * (0.01 * 255);
+			constexpr double C2 = (0.03 * 255) * (0.03 * 255);
+
+			auto luma = [](const uint8_t *px) {
+				return 0.299 * px[0] + 0.587 * px[1] + 0.114 * px[2];
+			};
+
+			const double n = p->windowWidth * p->windowHeight;
+			double ssimSum = 0.0;
+			for (SizeType wy = begin; wy < end; ++wy) {
+				for (int wx = 0; wx < p->numWindowsX; ++wx) {
+					double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumYY = 0.0, sumXY = 0.0;
+					for (int y = 0; y < p->windowHeight; ++y) {
+						const SizeType row = (wy * WINDOW_STRIDE + y) * p->width + wx * WINDOW_STRIDE;
+						for (int x = 0; x < p->windowWidth; ++x) {
+							const double a = luma(p->decoded + (row + x) * 4);
+							const double b = luma(p->reference + (row + x) * 4);
+							sumX += a;
+							sumY += b;
+							sumXX += a * a;
+							sumYY += b * b;
+							sumXY += a * b;
+						}
+					}
+
+					const double meanX = sumX / n;
+					const double meanY = sumY / n;
+					const double varX = sumXX / n - meanX * meanX;
+					const double varY = sumYY / n - meanY * meanY;
+					const double covXY = sumXY / n - meanX * meanY;
+					ssimSum += ((2 * meanX * meanY + C1) * (2 * covXY + C2)) / ((meanX * meanX + meanY * meanY + C1) * (varX + varY + C2));
+				}
+			}
+
+			auto lock = p->lock.lock();
+			p->ssimSum += ssimSum;
+		},
+		&params
+	);
+
+	MipMetrics result;
+	const double mse = params.squaredError / (double(width) * height * params.numChannels);
+	result.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	result.ssim = params.ssimSum / (double(params.numWindowsX) * numWindowsY);
+
+	return result;
+}
+
+bool verifyTextureLibrary(const fs::path &txLibFile, const fs::path &texturesDir, const VerifySettings &settings) {
+	auto header = readHeader(txLibFile);
+	if (header.headers.empty() || header.imgDataStartPos == INVALID_IMG_DATA_POS) {
+		LOG_FMT(Error, "Failed to read %s!", txLibFile.string().c_str());
+		return false;
+	}
+
+	std::ifstream ifs(txLibFile, std::ios::in | std::ios::binary);
+	if (!ifs.good()) {
+		LOG_FMT(Error, "Could not open %s!", txLibFile.string().c_str());
+		return false;
+	}
+
+	Map<String, MipMetrics> baseline;
+	if (!settings.baselineFile.empty()) {
+		baseline = readReport(settings.baselineFile);
+	}
+
+	std::ofstream report;
+	if (!settings.reportFile.empty()) {
+		report.open(settings.reportFile, std::ios::out | std::ios::trunc);
+		if (!report.good()) {
+			LOG_FMT(Error, "Could not open report file %s!", settings.reportFile.string().c_str());
+			return false;
+		}
+	}
+
+	int numRegressions = 0;
+	double decodeTime = 0.0;
+	SizeType numDecodedPixels = 0;
+
+	Vector<uint8_t> decoded;
+	Vector<uint8_t> reference;
+	SizeType pos = header.imgDataStartPos;
+	for (const auto &imgHeader : header.headers) {
+		const SizeType imgPos = pos;
+		pos += imgHeader.getStoredSize();
+
+		const auto srcPath = texturesDir / imgHeader.filename;
+
+		bool hasAlpha;
+		nvtt::Surface surface;
+		if (!surface.load(srcPath.string().c_str(), &hasAlpha)) {
+			LOG_FMT(Error, "Failed to load source image %s!", srcPath.string().c_str());
+			++numRegressions;
+			continue;
+		}
+
+		ImageData img{ .header = imgHeader };
+		if (!img.loadFromStream(ifs, imgPos)) {
+			LOG_FMT(Error, "Failed to load %s from the txlib!", imgHeader.filename.c_str());
+			++numRegressions;
+			continue;
+		}
+
+		if (surface.width() != imgHeader.width || surface.height() != imgHeader.height) {
+			LOG_FMT(Error, "Size of %s doesn't match its source image!", imgHeader.filename.c_str());
+			++numRegressions;
+			continue;
+		}
+
+		Vector<MipGen::MipLevel> mips;
+		generateReferenceMips(surface, hasAlpha, settings.useNvttMips, imgHeader.mipMapCount, mips);
+
+		if (static_cast<int>(mips.size()) != imgHeader.mipMapCount) {
+			LOG_FMT(Error, "Unexpected number of mips in %s!", imgHeader.filename.c_str());
+			++numRegressions;
+			continue;
+		}
+
+		for (int mip = 0; mip < imgHeader.mipMapCount; ++mip) {
+			const int width = mips[mip].width;
+			const int height = mips[mip].height;
+			const SizeType mipEnd = mip + 1 < imgHeader.mipMapCount ? imgHeader.mipOffsets[mip + 1] : imgHeader.size;
+			const SizeType mipSize = mipEnd - imgHeader.mipOffsets[mip];
+			if (mipSize != BCn::getSurfaceSize(BCn::BCFormat::BC7, width, height)) {
+				LOG_FMT(Error, "Unexpected size of mip %d of %s!", mip, imgHeader.filename.c_str());
+				++numRegressions;
+				break;
+			}
+
+			decoded.resize(SizeType(width) * height * 4);
+
+			Timer timer;
+			BCn::decodeSurface(BCn::BCFormat::BC7, img.data.get() + img.getMipOffset(mip), width, height, decoded.data());
+			decodeTime += timer.time();
+			numDecodedPixels += SizeType(width) * height;
+
+			mipToRGBA8(mips[mip], reference);
+
+			const MipMetrics metrics = computeMetrics(decoded.data(), reference.data(), width, height, hasAlpha);
+			if (report.is_open()) {
+				report << imgHeader.filename << " " << mip << " " << metrics.psnr << " " << metrics.ssim << "\n";
+			}
+
+			bool regression = false;
+			if (metrics.psnr < settings.minPSNR || metrics.ssim < settings.minSSIM) {
+				regression = true;
+			}
+
+			if (auto it = baseline.find(getMetricsKey(imgHeader.filename, mip)); it != baseline.end()) {
+				const MipMetrics &base = it->second;
+				if (base.psnr - metrics.psnr > settings.maxPSNRDrop || base.ssim - metrics.ssim > settings.maxSSIMDrop) {
+					regression = true;
+				}
+			}
+
+			if (regression) {
+				LOG_FMT(
+					Error,
+					"Regression in %s mip %d(%dx%d): PSNR %.2fdB, SSIM %.4f",
+					imgHeader.filename.c_str(), mip, width, height, metrics.psnr, metrics.ssim
+				);
+				++numRegressions;
+			} else if (mip == 0) {
+				LOG_FMT(Info, "%s: PSNR %.2fdB, SSIM %.4f", imgHeader.filename.c_str(), metrics.psnr, metrics.ssim);
+			}
+		}
+	}
+
+	LOG_FMT(
+		Info,
+		"Decoded %llu pixels in %.2fms(%.2f GPix/s)",
+		numDecodedPixels, decodeTime, decodeTime > 0.0 ? numDecodedPixels / (decodeTime * 1e6) : 0.0
+	);
+
+	if (numRegressions > 0) {
+		LOG_FMT(Error, "Found %d regressions in %s!", numRegressions, txLibFile.string().c_str());
+		return false;
+	}
+
+	LOG_FMT(Info, "No regressions found in %s.", txLibFile.string().c_str());
+
+	return true;
+}
+
+} // namespace TxLib
+
+} // namespace Dar
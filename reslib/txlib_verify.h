@@ -0,0 +1,31 @@
+#pragma once
+
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace TxLib {
+
+struct VerifySettings {
+	double minPSNR = 35.0; ///< Min PSNR in dB of every mip-level against the source image.
+	double minSSIM = 0.9; ///< Min SSIM of every mip-level against the source image.
+	double maxPSNRDrop = 0.5; ///< Max allowed PSNR drop in dB compared to the baseline.
+	double maxSSIMDrop = 0.005; ///< Max allowed SSIM drop compared to the baseline.
+	fs::path baselineFile; ///< Report of a previous run to compare against. Ignored if empty.
+	fs::path reportFile; ///< Where to write the report of this run. Ignored if empty.
+	bool useNvttMips = false; ///< The txlib was compiled with nvtt's mips, so the reference mips are generated with nvtt as well.
+};
+
+/// Decode every mip-level of every image in a txlib on the CPU and compare it
+/// against the respective mip-level generated from the source image.
+/// Mip-levels below the thresholds in the settings or worse than the baseline are reported as regressions.
+/// @note Must be called from inside a job, as the decoding runs on the job system.
+/// @note Not device-free in the CI sense: it needs the fiber job system and nvtt to load the source images.
+/// @param txLibFile The txlib to verify.
+/// @param texturesDir Directory containing the source images the txlib was compiled from.
+/// @return true if the txlib was read and no regressions were found, false otherwise.
+bool verifyTextureLibrary(const fs::path &txLibFile, const fs::path &texturesDir, const VerifySettings &settings);
+
+} // namespace TxLib
+
+} // namespace Dar
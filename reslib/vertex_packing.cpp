@@ -0,0 +1,86 @@
+#include "vertex_packing.h"
+
+namespace Dar {
+
+namespace VertexPacking {
+
+static Vec2 signNotZero(const Vec2 &v) {
+	return Vec2{ v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f };
+}
+
+Vec2 octahedralEncode(const Vec3 &v) {
+	const float l1 = glm::abs(v.x) + glm::abs(v.y) + glm::abs(v.z);
+	if (l1 <= 0.f) {
+		return Vec2{ 0.f };
+	}
+
+	Vec2 e = Vec2{ v.x, v.y } / l1;
+	if (v.z < 0.f) {
+		// Fold the lower half of the octahedron over the upper one
+		e = (Vec2{ 1.f } - glm::abs(Vec2{ e.y, e.x })) * signNotZero(e);
+	}
+
+	return e;
+}
+
+Vec3 octahedralDecode(const Vec2 &e) {
+	Vec3 v = Vec3{ e.x, e.y, 1.f - glm::abs(e.x) - glm::abs(e.y) };
+	if (v.z < 0.f) {
+		const Vec2 xy = (Vec2{ 1.f } - glm::abs(Vec2{ v.y, v.x })) * signNotZero(Vec2{ v.x, v.y });
+		v.x = xy.x;
+		v.y = xy.y;
+	}
+
+	return glm::normalize(v);
+}
+
+PackedPosition packPosition(const Vec3 &p, const Vec3 &boxMin, const Vec3 &boxSize, float tangentSign) {
+	PackedPosition result;
+	uint16_t *components[3] = { &result.x, &result.y, &result.z };
+	for (int i = 0; i < 3; ++i) {
+		const float t = boxSize[i] > 0.f ? (p[i] - boxMin[i]) / boxSize[i] : 0.f;
+		*components[i] = glm::packUnorm1x16(t);
+	}
+	result.tangentSign = tangentSign < 0.f ? 0 : 0xffff;
+
+	return result;
+}
+
+Vec3 unpackPosition(const PackedPosition &p, const Vec3 &boxMin, const Vec3 &boxSize) {
+	const Vec3 t = Vec3{ glm::unpackUnorm1x16(p.x), glm::unpackUnorm1x16(p.y), glm::unpackUnorm1x16(p.z) };
+	return boxMin + t * boxSize;
+}
+
+float unpackTangentSign(const PackedPosition &p) {
+	return glm::unpackUnorm1x16(p.tangentSign) * 2.f - 1.f;
+}
+
+PackedUV packUV(const Vec2 &uv) {
+	return PackedUV{ glm::packHalf1x16(uv.x), glm::packHalf1x16(uv.y) };
+}
+
+Vec2 unpackUV(const PackedUV &uv) {
+	return Vec2{ glm::unpackHalf1x16(uv.u), glm::unpackHalf1x16(uv.v) };
+}
+
+PackedTangentFrame packTangentFrame(const Vec3 &normal, const Vec3 &tangent) {
+	const Vec2 n = octahedralEncode(normal);
+	const Vec2 t = octahedralEncode(tangent);
+
+	PackedTangentFrame result;
+	result.normal[0] = glm::packSnorm1x16(n.x);
+	result.normal[1] = glm::packSnorm1x16(n.y);
+	result.tangent[0] = glm::packSnorm1x16(t.x);
+	result.tangent[1] = glm::packSnorm1x16(t.y);
+
+	return result;
+}
+
+void unpackTangentFrame(const PackedTangentFrame &frame, Vec3 &normal, Vec3 &tangent) {
+	normal = octahedralDecode(Vec2{ glm::unpackSnorm1x16(frame.normal[0]), glm::unpackSnorm1x16(frame.normal[1]) });
+	tangent = octahedralDecode(Vec2{ glm::unpackSnorm1x16(frame.tangent[0]), glm::unpackSnorm1x16(frame.tangent[1]) });
+}
+
+} // namespace VertexPacking
+
+} // namespace Dar
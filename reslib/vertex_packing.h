@@ -0,0 +1,58 @@
+#pragma once
+
+#include "dar/math/dar_math.h"
+#include "dar/utils/defines.h"
+
+namespace Dar {
+
+namespace VertexPacking {
+
+/// Quantized position. Read by the shaders as R16G16B16A16_UNORM.
+struct PackedPosition {
+	uint16_t x, y, z;
+	uint16_t tangentSign; ///< 0 for -1 and 0xffff for 1, so the shaders get it as (w * 2 - 1).
+};
+
+/// Half float uv. Read by the shaders as R16G16_FLOAT.
+struct PackedUV {
+	uint16_t u, v;
+};
+
+/// Octahedral encoded normal and tangent. Read by the shaders as two R16G16_SNORM attributes.
+struct PackedTangentFrame {
+	uint16_t normal[2];
+	uint16_t tangent[2];
+};
+
+/// Max difference per axis between a position and its packed version, relative to the size of the bounds.
+constexpr float POSITION_QUANTIZATION_ERROR = 0.5f / 65535.f;
+
+/// Max relative difference between an uv coordinate and its packed version.
+constexpr float UV_QUANTIZATION_ERROR = 1.f / 2048.f;
+
+/// Max angle in radians between a unit vector and its packed octahedral version.
+/// The worst case found by sampling the sphere is ~6.5e-5.
+constexpr float TANGENT_FRAME_QUANTIZATION_ERROR = 1e-4f;
+
+/// Map a unit vector to the [-1, 1] square by projecting it on an octahedron and unfolding it.
+Vec2 octahedralEncode(const Vec3 &v);
+
+/// Inverse of octahedralEncode(). The result is normalized.
+Vec3 octahedralDecode(const Vec2 &e);
+
+/// @param boxMin Min point of the bounds the position is quantized to.
+/// @param boxSize Size of the bounds the position is quantized to.
+/// @param tangentSign Sign of the bitangent, B = cross(N, T) * tangentSign.
+PackedPosition packPosition(const Vec3 &p, const Vec3 &boxMin, const Vec3 &boxSize, float tangentSign);
+Vec3 unpackPosition(const PackedPosition &p, const Vec3 &boxMin, const Vec3 &boxSize);
+float unpackTangentSign(const PackedPosition &p);
+
+PackedUV packUV(const Vec2 &uv);
+Vec2 unpackUV(const PackedUV &uv);
+
+PackedTangentFrame packTangentFrame(const Vec3 &normal, const Vec3 &tangent);
+void unpackTangentFrame(const PackedTangentFrame &frame, Vec3 &normal, Vec3 &tangent);
+
+} // namespace VertexPacking
+
+} // namespace Dar
@@ -0,0 +1,385 @@
+#include "build_graph.h"
+
+#include "async/job_system.h"
+#include "utils/timer.h"
+
+#include "reslib/hash.h"
+
+#include <fstream>
+
+constexpr uint32_t BUILD_DATABASE_MAGIC = 0x42444C42; // BLDB
+constexpr uint32_t BUILD_DATABASE_VERSION = 1;
+
+bool getFileStamp(const fs::path &p, FileStamp &stamp) {
+	std::error_code ec;
+	const auto size = fs::file_size(p, ec);
+	if (ec) {
+		return false;
+	}
+
+	const auto mtime = fs::last_write_time(p, ec);
+	if (ec) {
+		return false;
+	}
+
+	stamp.size = size;
+	stamp.mtime = mtime.time_since_epoch().count();
+
+	return true;
+}
+
+bool hashFile(const fs::path &p, uint64_t &hash) {
+	std::ifstream ifs(p, std::ios::in | std::ios::binary);
+	if (!ifs.good()) {
+		return false;
+	}
+
+	constexpr SizeType CHUNK_SIZE = 1 << 20;
+	Vector<char> chunk(CHUNK_SIZE);
+
+	hash = Dar::HASH_SEED;
+	while (ifs) {
+		ifs.read(chunk.data(), chunk.size());
+		hash = Dar::hashData(chunk.data(), static_cast<SizeType>(ifs.gcount()), hash);
+	}
+
+	return ifs.eof();
+}
+
+int BuildGraph::addNode(const BuildNode &node) {
+	nodes.push_back(node);
+	return static_cast<int>(nodes.size()) - 1;
+}
+
+bool BuildGraph::isOutOfDate(int node, String &reason) {
+	const BuildNode &n = nodes[node];
+
+	auto it = records.find(n.output.string());
+	if (it == records.end()) {
+		reason = "never built";
+		return true;
+	}
+
+	NodeRecord &record = it->second;
+	if (record.settingsHash != n.settingsHash) {
+		reason = "settings changed";
+		return true;
+	}
+
+	FileStamp outputStamp;
+	if (!getFileStamp(n.output, outputStamp)) {
+		reason = "output is missing";
+		return true;
+	}
+
+	if (outputStamp.size != record.output.size || outputStamp.mtime != record.output.mtime) {
+		reason = "output was modified";
+		return true;
+	}
+
+	for (auto &dep : n.dependencies) {
+		if (states[dep].dirty) {
+			reason = nodes[dep].name + " is rebuilt";
+			return true;
+		}
+	}
+
+	Set<String> recordedInputs;
+	for (auto &[path, stamp] : record.inputs) {
+		recordedInputs.insert(path);
+	}
+
+	for (auto &input : n.inputs) {
+		if (recordedInputs.find(input.string()) == recordedInputs.end()) {
+			reason = input.filename().string() + " was added";
+			return true;
+		}
+	}
+
+	for (auto &[path, stamp] : record.inputs) {
+		FileStamp current;
+		if (!getFileStamp(path, current)) {
+			reason = fs::path(path).filename().string() + " was removed";
+			return true;
+		}
+
+		if (current.size == stamp.size && current.mtime == stamp.mtime) {
+			continue;
+		}
+
+		// Touched, but possibly not changed. Compare the contents.
+		if (current.size != stamp.size || !hashFile(path, current.hash) || current.hash != stamp.hash) {
+			reason = fs::path(path).filename().string() + " changed";
+			return true;
+		}
+
+		stamp = current;
+		databaseChanged = true;
+	}
+
+	return false;
+}
+
+void BuildGraph::stampInputs(const Vector<fs::path> &inputs, Set<String> &visited, Vector<std::pair<String, FileStamp>> &stamps) {
+	for (auto &p : inputs) {
+		FileStamp stamp;
+		if (visited.insert(p.string()).second && getFileStamp(p, stamp) && hashFile(p, stamp.hash)) {
+			stamps.push_back({ p.string(), stamp });
+		}
+	}
+}
+
+void BuildGraph::recordNode(const NodeState &state) {
+	const BuildNode &n = nodes[state.index];
+
+	NodeRecord record;
+	record.settingsHash = n.settingsHash;
+	record.inputs = state.inputStamps;
+
+	Set<String> visited;
+	for (auto &[path, stamp] : record.inputs) {
+		visited.insert(path);
+	}
+
+	// Discovered inputs are only known once the node is built.
+	stampInputs(state.discoveredInputs, visited, record.inputs);
+
+	getFileStamp(n.output, record.output);
+
+	records[n.output.string()] = std::move(record);
+	databaseChanged = true;
+}
+
+void BuildGraph::buildNodeJob(void *param) {
+	auto state = reinterpret_cast<NodeState*>(param);
+	const BuildNode &node = state->graph->nodes[state->index];
+
+	LOG_FMT(Info, "Building %s...", node.name.c_str());
+
+	Dar::Timer timer;
+
+	Set<String> visited;
+	state->inputStamps.clear();
+	stampInputs(node.inputs, visited, state->inputStamps);
+
+	state->success = node.build(node, state->discoveredInputs);
+
+	if (state->success) {
+		LOG_FMT(Info, "Built %s in %.2fms", node.name.c_str(), timer.time());
+	} else {
+		LOG_FMT(Error, "Failed to build %s!", node.name.c_str());
+	}
+}
+
+bool BuildGraph::build(const fs::path &databaseFile, const BuildOptions &options) {
+	Dar::Timer timer;
+
+	readDatabase(databaseFile);
+
+	const int numNodes = static_cast<int>(nodes.size());
+	states.assign(numNodes, NodeState{});
+	for (int i = 0; i < numNodes; ++i) {
+		states[i].graph = this;
+		states[i].index = i;
+	}
+
+	// Build the nodes in waves. Each wave contains the nodes whose dependencies are done,
+	// so the nodes in a wave are independent and are built in parallel.
+	Vector<bool> done(numNodes, false);
+	int numDone = 0;
+	int numRebuilt = 0;
+	bool success = true;
+	while (numDone < numNodes) {
+		Vector<int> wave;
+		for (int i = 0; i < numNodes; ++i) {
+			if (done[i]) {
+				continue;
+			}
+
+			bool ready = true;
+			for (int dep : nodes[i].dependencies) {
+				ready &= done[dep];
+			}
+
+			if (ready) {
+				wave.push_back(i);
+			}
+		}
+
+		if (wave.empty()) {
+			LOG(Error, "Cyclic dependency in the build graph!");
+			return false;
+		}
+
+		Vector<Dar::JobSystem::JobDecl> jobs;
+		for (int i : wave) {
+			done[i] = true;
+			++numDone;
+
+			bool failedDependency = false;
+			for (int dep : nodes[i].dependencies) {
+				failedDependency |= states[dep].dirty && !states[dep].success;
+			}
+
+			if (failedDependency) {
+				LOG_FMT(Error, "Skipping %s because of failed dependencies!", nodes[i].name.c_str());
+				success = false;
+				continue;
+			}
+
+			String reason = "forced";
+			states[i].dirty = options.force || isOutOfDate(i, reason);
+			if (!states[i].dirty) {
+				LOG_FMT(Info, "%s is up to date.", nodes[i].name.c_str());
+				continue;
+			}
+
+			if (options.dryRun) {
+				LOG_FMT(Info, "Would rebuild %s: %s", nodes[i].name.c_str(), reason.c_str());
+				// Dependent nodes would be rebuilt as well
+				states[i].success = true;
+				continue;
+			}
+
+			LOG_FMT(Info, "Rebuilding %s: %s", nodes[i].name.c_str(), reason.c_str());
+			jobs.push_back(Dar::JobSystem::JobDecl{ buildNodeJob, &states[i] });
+		}
+
+		if (!jobs.empty()) {
+			Dar::JobSystem::kickJobsAndWait(jobs.data(), static_cast<int>(jobs.size()));
+		}
+
+		for (auto &job : jobs) {
+			auto state = reinterpret_cast<NodeState*>(job.param);
+			if (state->success) {
+				recordNode(*state);
+				++numRebuilt;
+			} else {
+				records.erase(nodes[state->index].output.string());
+				databaseChanged = true;
+				success = false;
+			}
+		}
+	}
+
+	if (!options.dryRun && databaseChanged) {
+		writeDatabase(databaseFile);
+	}
+
+	LOG_FMT(Info, "Build finished in %.2fms. %d/%d nodes rebuilt.", timer.time(), numRebuilt, numNodes);
+
+	return success;
+}
+
+bool BuildGraph::readDatabase(const fs::path &databaseFile) {
+	records.clear();
+
+	std::ifstream ifs(databaseFile, std::ios::in | std::ios::binary);
+	if (!ifs.good()) {
+		return false;
+	}
+
+	auto readString = [&ifs](String &str) {
+		uint32_t size = 0;
+		ifs.read(reinterpret_cast<char*>(&size), sizeof(uint32_t));
+		str.resize(size);
+		ifs.read(str.data(), size);
+	};
+
+	auto readStamp = [&ifs](FileStamp &stamp) {
+		ifs.read(reinterpret_cast<char*>(&stamp.size), sizeof(uint64_t));
+		ifs.read(reinterpret_cast<char*>(&stamp.mtime), sizeof(int64_t));
+		ifs.read(reinterpret_cast<char*>(&stamp.hash), sizeof(uint64_t));
+	};
+
+	uint32_t magic = 0, version = 0, numRecords = 0;
+	ifs.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+	ifs.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+	ifs.read(reinterpret_cast<char*>(&numRecords), sizeof(uint32_t));
+	if (!ifs || magic != BUILD_DATABASE_MAGIC || version != BUILD_DATABASE_VERSION) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < numRecords && ifs; ++i) {
+		String output;
+		NodeRecord record;
+		readString(output);
+		ifs.read(reinterpret_cast<char*>(&record.settingsHash), sizeof(uint64_t));
+		readStamp(record.output);
+
+		uint32_t numInputs = 0;
+		ifs.read(reinterpret_cast<char*>(&numInputs), sizeof(uint32_t));
+		for (uint32_t j = 0; j < numInputs && ifs; ++j) {
+			std::pair<String, FileStamp> input;
+			readString(input.first);
+			readStamp(input.second);
+			record.inputs.push_back(input);
+		}
+
+		if (ifs) {
+			records[output] = std::move(record);
+		}
+	}
+
+	return !ifs.fail();
+}
+
+bool BuildGraph::writeDatabase(const fs::path &databaseFile) const {
+	// Write to a temporary file first, so an interrupted build never leaves a partially written database.
+	auto tmpFile = databaseFile;
+	tmpFile += ".tmp";
+
+	std::ofstream ofs(tmpFile, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!ofs.good()) {
+		LOG_FMT(Error, "Failed to write build database %s!", tmpFile.string().c_str());
+		return false;
+	}
+
+	auto writeString = [&ofs](const String &str) {
+		const auto size = static_cast<uint32_t>(str.size());
+		ofs.write(reinterpret_cast<const char*>(&size), sizeof(uint32_t));
+		ofs.write(str.data(), size);
+	};
+
+	auto writeStamp = [&ofs](const FileStamp &stamp) {
+		ofs.write(reinterpret_cast<const char*>(&stamp.size), sizeof(uint64_t));
+		ofs.write(reinterpret_cast<const char*>(&stamp.mtime), sizeof(int64_t));
+		ofs.write(reinterpret_cast<const char*>(&stamp.hash), sizeof(uint64_t));
+	};
+
+	const uint32_t magic = BUILD_DATABASE_MAGIC;
+	const uint32_t version = BUILD_DATABASE_VERSION;
+	const auto numRecords = static_cast<uint32_t>(records.size());
+	ofs.write(reinterpret_cast<const char*>(&magic), sizeof(uint32_t));
+	ofs.write(reinterpret_cast<const char*>(&version), sizeof(uint32_t));
+	ofs.write(reinterpret_cast<const char*>(&numRecords), sizeof(uint32_t));
+
+	for (auto &[output, record] : records) {
+		writeString(output);
+		ofs.write(reinterpret_cast<const char*>(&record.settingsHash), sizeof(uint64_t));
+		writeStamp(record.output);
+
+		const auto numInputs = static_cast<uint32_t>(record.inputs.size());
+		ofs.write(reinterpret_cast<const char*>(&numInputs), sizeof(uint32_t));
+		for (auto &[path, stamp] : record.inputs) {
+			writeString(path);
+			writeStamp(stamp);
+		}
+	}
+
+	ofs.close();
+	if (ofs.fail()) {
+		LOG_FMT(Error, "Failed to write build database %s!", tmpFile.string().c_str());
+		return false;
+	}
+
+	std::error_code ec;
+	fs::rename(tmpFile, databaseFile, ec);
+	if (ec) {
+		LOG_FMT(Error, "Failed to write build database %s!", databaseFile.string().c_str());
+		fs::remove(tmpFile, ec);
+		return false;
+	}
+
+	return true;
+}
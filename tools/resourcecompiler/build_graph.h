@@ -0,0 +1,95 @@
+#pragma once
+
+#include "utils/defines.h"
+
+/// Size, modification time and content hash of a file at the time it was last built from or built.
+struct FileStamp {
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+};
+
+struct BuildNode;
+
+/// Build the output of a node. Called from inside a job, so it may use JobSystem::parallelFor.
+/// @param discoveredInputs Receives inputs found while building, f.e files included by shaders.
+///                         They are checked for changes on the next build together with the node's inputs.
+using BuildFunction = bool(*)(const BuildNode &node, Vector<fs::path> &discoveredInputs);
+
+/// A step of the resource build turning a set of input files into a single output file.
+struct BuildNode {
+	String name; ///< Used for logging.
+	fs::path output;
+	Vector<fs::path> inputs; ///< Inputs known before building, f.e all images in the textures folder.
+	uint64_t settingsHash = 0; ///< Hash of the settings the output depends on. Changing them rebuilds the node.
+	Vector<int> dependencies; ///< Nodes that need to be built before this one. Rebuilding them rebuilds the node as well.
+	BuildFunction build = nullptr;
+	void *param = nullptr; ///< Processor specific data.
+};
+
+struct BuildOptions {
+	bool dryRun = false; ///< Only log which nodes would be rebuilt and why.
+	bool force = false; ///< Rebuild all nodes.
+};
+
+/// Graph of the resource build. A node is rebuilt only if its settings, any of its inputs,
+/// including the ones discovered during its last build, or its output changed since it was last built.
+/// Files are first compared by size and modification time and only hashed if those differ,
+/// so a build with nothing to do doesn't read any of the inputs.
+/// Nodes that don't depend on each other are built in parallel on the job system.
+class BuildGraph {
+public:
+	/// @return Index of the node used for declaring dependencies.
+	int addNode(const BuildNode &node);
+
+	/// Build all out-of-date nodes.
+	/// @note Must be called from inside a job.
+	/// @param databaseFile Where the stamps of the inputs and outputs of each node are stored between builds.
+	/// @return false if any of the nodes failed to build.
+	bool build(const fs::path &databaseFile, const BuildOptions &options);
+
+private:
+	struct NodeRecord {
+		uint64_t settingsHash = 0;
+		Vector<std::pair<String, FileStamp>> inputs; ///< All inputs of the last build, including the discovered ones.
+		FileStamp output;
+	};
+
+	struct NodeState {
+		BuildGraph *graph = nullptr;
+		int index = -1;
+		Vector<std::pair<String, FileStamp>> inputStamps; ///< Stamps of the declared inputs, taken before the build.
+		Vector<fs::path> discoveredInputs;
+		bool dirty = false;
+		bool success = false;
+	};
+
+	/// @param reason Receives the reason the node has to be rebuilt.
+	bool isOutOfDate(int node, String &reason);
+
+	/// Stamp the inputs of a node. Inputs which don't exist are skipped.
+	static void stampInputs(const Vector<fs::path> &inputs, Set<String> &visited, Vector<std::pair<String, FileStamp>> &stamps);
+
+	/// Record a successful build of a node. The declared inputs are recorded with
+	/// the stamps taken before the build, so an input changed while the node was building
+	/// is still seen as out of date on the next build.
+	void recordNode(const NodeState &state);
+
+	bool readDatabase(const fs::path &databaseFile);
+	bool writeDatabase(const fs::path &databaseFile) const;
+
+	static void buildNodeJob(void *param);
+
+	Vector<BuildNode> nodes;
+	Vector<NodeState> states;
+	Map<String, NodeRecord> records; ///< Key is the output of the node.
+	bool databaseChanged = false;
+};
+
+/// Get the size and modification time of a file.
+/// @return false if the file doesn't exist.
+bool getFileStamp(const fs::path &p, FileStamp &stamp);
+
+/// Hash the contents of a file.
+/// @return false if the file could not be read.
+bool hashFile(const fs::path &p, uint64_t &hash);
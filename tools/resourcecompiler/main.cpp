@@ -1,80 +1,426 @@
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 
+#include "build_graph.h"
+#include "self_test.h"
+#include "txlib_benchmark.h"
+#include "watch.h"
+
+#include "reslib/hash.h"
+#include "reslib/scene_importer.h"
 #include "reslib/serde.h"
+#include "reslib/txlib_verify.h"
+
+#include "async/job_system.h"
 
 namespace fs = std::filesystem;
 
-bool iterateTexturesDir(fs::path p, const fs::path &outputDir) {
-	Vector<String> imgPaths;
-	LOG_FMT(Info, "Compiling textures folder %s...", p.string().c_str());
-	for (auto t : fs::directory_iterator{ p }) {
-		if (t.is_regular_file()) {
-			imgPaths.push_back(t.path().string());
-		}
-	}
+struct CompileParams {
+	String inputDir;
+	fs::path outputDir;
+	Optional<String> resourceType;
+	Dar::ImageCompression compression = Dar::ImageCompression::None;
+	bool useNvttMips = false;
+	fs::path shadersDir; ///< Folder of the shaders node. Its includes are resolved relative to it.
+	BuildOptions buildOptions;
+	fs::path deltaDir; ///< Where the delta libraries are written when watching. See watchResources().
+	bool watch = false;
+	bool success = false;
+};
+
+/// Bump when the output of a processor changes for the same inputs and settings,
+/// so outputs of older builds are rebuilt.
+constexpr uint64_t TEXTURES_PROCESSOR_VERSION = 2;
+constexpr uint64_t SHADERS_PROCESSOR_VERSION = 2;
+constexpr uint64_t SCENES_PROCESSOR_VERSION = 5;
+
+template <typename T>
+uint64_t hashSetting(const T &value, uint64_t seed) {
+	return Dar::hashData(&value, sizeof(T), seed);
+}
+
+bool buildTexture(const BuildNode &node, Vector<fs::path>&) {
+	dassert(node.inputs.size() == 1);
+	auto params = reinterpret_cast<const CompileParams*>(node.param);
+
+	return Dar::TxLib::serializeTextureDataToFile({ node.inputs[0].string() }, node.output.parent_path(), params->compression, params->useNvttMips, node.output.filename());
+}
+
+/// Inputs of the link nodes are the outputs of the nodes of the single assets, followed by the source files.
+/// The source files are only there for noticing removed assets.
+Vector<fs::path> getLinkedLibraries(const BuildNode &node) {
+	return Vector<fs::path>(node.inputs.begin(), node.inputs.begin() + node.dependencies.size());
+}
+
+bool linkTextures(const BuildNode &node, Vector<fs::path>&) {
+	return Dar::TxLib::linkTextureLibraries(getLinkedLibraries(node), node.output);
+}
 
-	if (!Dar::TxLib::serializeTextureDataToFile(imgPaths, outputDir)) {
-		LOG_FMT(Error, "Failed to create %stextures.txlib file!", outputDir.string().c_str());
+bool buildShader(const BuildNode &node, Vector<fs::path> &discoveredInputs) {
+	auto params = reinterpret_cast<const CompileParams*>(node.param);
+	const fs::path &shadersDir = params->shadersDir;
+
+	const fs::path basename = Dar::ShaderCompiler::getShaderBasename(node.inputs[0]);
+	if (!Dar::ShaderCompiler::compileShadersToFile({ basename }, node.output, params->outputDir / "shadercache")) {
 		return false;
 	}
 
-	LOG_FMT(Info, "Successfully created %stextures.txlib", outputDir.string().c_str());
+	// Includes from outside the shaders folder are not inputs of the node,
+	// but changing them should still rebuild the shader.
+	for (auto &input : node.inputs) {
+		Dar::ShaderCompiler::findShaderIncludes(input, { shadersDir.wstring() }, discoveredInputs);
+	}
 
 	return true;
 }
 
-bool compileShaders(fs::path dir, const fs::path &outputDir) {
-	LOG_FMT(Info, "Compiling shaders from %s...", dir.string().c_str());
-	if (Dar::ShaderCompiler::compileFolderAsBlob(dir.string(), outputDir.string())) {
-		LOG_FMT(Info, "Written %sshaders.shlib!", outputDir.string().c_str());
-		return true;
+bool linkShaders(const BuildNode &node, Vector<fs::path>&) {
+	return Dar::ShaderCompiler::linkShaderLibraries(getLinkedLibraries(node), node.output);
+}
+
+bool buildScene(const BuildNode &node, Vector<fs::path> &discoveredInputs) {
+	dassert(node.inputs.size() == 1);
+
+	Dar::ScnLib::SceneData scene;
+	const auto importFlags = Dar::ScnLib::ImportFlags(Dar::ScnLib::importFlags_buildMeshlets | Dar::ScnLib::importFlags_generateLods);
+	if (!Dar::ScnLib::importScene(node.inputs[0], scene, importFlags, &discoveredInputs)) {
+		return false;
 	}
 
-	LOG(Error, "Failed to compile shaders!");
-	return false;
-}
+	LOG_FMT(
+		Info,
+		"Imported %s: %llu vertices, %llu indices, %llu meshes, %llu meshlets, %llu materials, %llu textures, %llu nodes",
+		node.inputs[0].filename().string().c_str(), scene.vertices.size(), scene.indices.size(), scene.meshes.size(), scene.meshlets.size(), scene.materials.size(), scene.textures.size(), scene.nodes.size()
+	);
 
-int main(int argc, char **argv) {
-	if (argc < 3) {
-		LOG_FMT(
-			Error,
-			"Usage: %s <res_dir> <lib_output_dir> [resource_type]\n"
-			"\tOptional resource_type: shaders, textures\n",
-			"\tSearches in res_dir for the following folders: scenes, shaders, textures",
-			argv[0]
-		);
+	return Dar::ScnLib::writeScene(scene, node.output);
+}
 
-		exit(1);
+/// Files in a folder sorted by name, so the order of the inputs doesn't depend on the file system.
+Vector<fs::path> getFolderFiles(const fs::path &dir) {
+	Vector<fs::path> files;
+	for (auto &entry : fs::directory_iterator{ dir }) {
+		if (entry.is_regular_file()) {
+			files.push_back(entry.path());
+		}
 	}
 
-	String inputDir = argv[1];
-	auto outputDir = fs::path(argv[2]);
-	auto resource_type = (argc > 3 ? Optional<String>(argv[3]) : std::nullopt);
+	std::sort(files.begin(), files.end());
 
-	LOG_FMT(Info, "Current path: %s", fs::current_path().string().c_str());
+	return files;
+}
 
-	for (auto p : fs::directory_iterator{ inputDir }) {
+bool compileResources(CompileParams &params) {
+	BuildGraph graph;
+	for (auto p : fs::directory_iterator{ params.inputDir }) {
 		if (!p.is_directory()) {
 			continue;
 		}
 
 		auto path = p.path();
 
-		if (path.filename() == "textures" && (!resource_type.has_value() || *resource_type == "textures")) {
-			if (!iterateTexturesDir(path, outputDir)) {
-				return 1;
+		if (path.filename() == "textures" && (!params.resourceType.has_value() || *params.resourceType == "textures")) {
+			uint64_t settingsHash = hashSetting(TEXTURES_PROCESSOR_VERSION, Dar::HASH_SEED);
+			settingsHash = hashSetting(params.compression, settingsHash);
+			settingsHash = hashSetting(params.useNvttMips, settingsHash);
+
+			// Each image is encoded into its own library, so changing an image only encodes it again.
+			// The textures library is then linked by copying the encoded data of all images.
+			const auto images = getFolderFiles(path);
+			BuildNode link;
+			for (auto &image : images) {
+				BuildNode node;
+				node.name = "textures/" + image.filename().string();
+				node.output = params.outputDir / "intermediate" / "textures" / image.filename();
+				node.output += ".txlib";
+				node.inputs = { image };
+				node.settingsHash = settingsHash;
+				node.build = buildTexture;
+				node.param = &params;
+
+				link.dependencies.push_back(graph.addNode(node));
+				link.inputs.push_back(node.output);
 			}
+
+			link.name = "textures";
+			link.output = params.outputDir / "textures.txlib";
+			link.inputs.insert(link.inputs.end(), images.begin(), images.end());
+			link.settingsHash = settingsHash;
+			link.build = linkTextures;
+			link.param = &params;
+			graph.addNode(link);
 		}
 
-		if (path.filename() == "shaders" && (!resource_type.has_value() || *resource_type == "shaders")) {
-			if (!compileShaders(path, outputDir)) {
-				return 1;
+		if (path.filename() == "shaders" && (!params.resourceType.has_value() || *params.resourceType == "shaders")) {
+			params.shadersDir = path;
+
+			const uint64_t settingsHash = hashSetting(SHADERS_PROCESSOR_VERSION, Dar::HASH_SEED);
+
+			// Stages of each shader are compiled into their own library, so changing a shader, or a file it includes,
+			// only compiles it again. The shader library is then linked by copying the DXIL of all shaders.
+			const auto files = getFolderFiles(path);
+			Map<String, Vector<fs::path>> shaderStages;
+			for (auto &file : files) {
+				auto basename = Dar::ShaderCompiler::getShaderBasename(file);
+				if (!basename.empty()) {
+					shaderStages[basename.filename().string()].push_back(file);
+				}
+			}
+
+			BuildNode link;
+			for (auto &[name, stages] : shaderStages) {
+				BuildNode node;
+				node.name = "shaders/" + name;
+				node.output = params.outputDir / "intermediate" / "shaders" / (name + ".shlib");
+				node.inputs = stages;
+				node.settingsHash = settingsHash;
+				node.build = buildShader;
+				node.param = &params;
+
+				link.dependencies.push_back(graph.addNode(node));
+				link.inputs.push_back(node.output);
+			}
+
+			link.name = "shaders";
+			link.output = params.outputDir / "shaders.shlib";
+			link.inputs.insert(link.inputs.end(), files.begin(), files.end());
+			link.settingsHash = settingsHash;
+			link.build = linkShaders;
+			link.param = &params;
+			graph.addNode(link);
+		}
+
+		if (path.filename() == "scenes" && (!params.resourceType.has_value() || *params.resourceType == "scenes")) {
+			// Each scene description is compiled into its own scene library
+			for (auto &scene : getFolderFiles(path)) {
+				if (scene.extension() != ".json") {
+					continue;
+				}
+
+				BuildNode node;
+				node.name = "scenes/" + scene.stem().string();
+				node.output = params.outputDir / scene.filename().replace_extension(".scnlib");
+				node.inputs = { scene };
+				node.settingsHash = hashSetting(SCENES_PROCESSOR_VERSION, Dar::HASH_SEED);
+				node.build = buildScene;
+				node.param = &params;
+				graph.addNode(node);
 			}
 		}
 
 		// TODO: else...
 	}
 
-	return 0;
-}
\ No newline at end of file
+	std::error_code ec;
+	fs::create_directories(params.outputDir, ec);
+	fs::create_directories(params.outputDir / "intermediate" / "textures", ec);
+	fs::create_directories(params.outputDir / "intermediate" / "shaders", ec);
+
+	return graph.build(params.outputDir / "resources.builddb", params.buildOptions);
+}
+
+/// Run a single job on the job system and wait for it. Resources are
+/// processed in parallel with JobSystem::parallelFor which needs to be called from inside a job.
+void runJob(Dar::JobSystem::JobFunction f, void *param) {
+	Dar::JobSystem::init(-1);
+
+	Dar::JobSystem::JobDecl job = {};
+	job.f = f;
+	job.param = param;
+
+	Dar::JobSystem::kickJobs(&job, 1, nullptr);
+	Dar::JobSystem::waitForAll();
+}
+
+struct VerifyParams {
+	fs::path texturesDir;
+	fs::path txLibFile;
+	Dar::TxLib::VerifySettings settings;
+	bool success = false;
+};
+
+/// Verify a txlib against its source images. See Dar::TxLib::verifyTextureLibrary.
+int verifyTextures(int argc, char **argv) {
+	VerifyParams params;
+	Vector<String> args;
+	for (int i = 2; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+			params.settings.baselineFile = argv[++i];
+		} else if (strcmp(argv[i], "--report") == 0 && hasValue) {
+			params.settings.reportFile = argv[++i];
+		} else if (strcmp(argv[i], "--min-psnr") == 0 && hasValue) {
+			params.settings.minPSNR = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--min-ssim") == 0 && hasValue) {
+			params.settings.minSSIM = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--nvtt-mips") == 0) {
+			params.settings.useNvttMips = true;
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+
+	if (args.size() < 2) {
+		LOG_FMT(
+			Error,
+			"Usage: %s verify <textures_dir> <txlib_file> [--baseline <report>] [--report <report>] [--min-psnr <dB>] [--min-ssim <value>] [--nvtt-mips]\n"
+			"\tDecodes all mips in txlib_file and compares them against the source images in textures_dir.\n"
+			"\t--nvtt-mips: txlib_file was compiled with --nvtt-mips. Otherwise its mips are compared against MipGen's.\n"
+			"\t--baseline: Report of a previous run. Mips with worse quality than in it are regressions.\n"
+			"\t--report: Where to write the quality of each mip, f.e to be used as a baseline.\n",
+			argv[0]
+		);
+
+		return 1;
+	}
+
+	params.texturesDir = args[0];
+	params.txLibFile = args[1];
+
+	runJob(
+		[](void *param) {
+			auto p = reinterpret_cast<VerifyParams*>(param);
+			p->success = Dar::TxLib::verifyTextureLibrary(p->txLibFile, p->texturesDir, p->settings);
+
+			Dar::JobSystem::stop();
+		},
+		&params
+	);
+
+	return params.success ? 0 : 1;
+}
+
+struct TxLibBenchmarkParams {
+	TxLibBenchmarkSettings settings;
+	bool success = false;
+};
+
+/// Compare cold loads of texture libraries. See benchmarkTextureLibraries.
+int benchmarkTextures(int argc, char **argv) {
+	TxLibBenchmarkParams params;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+			params.settings.numPasses = atoi(argv[++i]);
+		} else {
+			params.settings.txLibs.push_back(argv[i]);
+		}
+	}
+
+	if (params.settings.txLibs.empty()) {
+		LOG_FMT(
+			Error,
+			"Usage: %s benchtxlib <txlib_file>... [--passes <count>]\n"
+			"\tReads each txlib bypassing the file cache and decodes all of its images. Reports the read and decode times of each one.\n"
+			"\tPass the same textures compiled with and without --compress to compare the LZ4 and the uncompressed load.\n",
+			argv[0]
+		);
+
+		return 1;
+	}
+
+	runJob(
+		[](void *param) {
+			auto p = reinterpret_cast<TxLibBenchmarkParams*>(param);
+			p->success = benchmarkTextureLibraries(p->settings);
+
+			Dar::JobSystem::stop();
+		},
+		&params
+	);
+
+	return params.success ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "verify") == 0) {
+		return verifyTextures(argc, argv);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "benchtxlib") == 0) {
+		return benchmarkTextures(argc, argv);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "selftest") == 0) {
+		return runSelfTests() == 0 ? 0 : 1;
+	}
+
+	CompileParams params;
+	Vector<String> args;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--compress") == 0) {
+			params.compression = Dar::ImageCompression::LZ4;
+		} else if (strcmp(argv[i], "--nvtt-mips") == 0) {
+			params.useNvttMips = true;
+		} else if (strcmp(argv[i], "--dry-run") == 0) {
+			params.buildOptions.dryRun = true;
+		} else if (strcmp(argv[i], "--force") == 0) {
+			params.buildOptions.force = true;
+		} else if (strcmp(argv[i], "--watch") == 0) {
+			params.watch = true;
+		} else if (strcmp(argv[i], "--delta-dir") == 0 && i + 1 < argc) {
+			params.deltaDir = fs::path(argv[++i]);
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+
+	if (args.size() < 2) {
+		LOG_FMT(
+			Error,
+			"Usage: %s <res_dir> <lib_output_dir> [resource_type] [--compress] [--nvtt-mips] [--dry-run] [--force] [--watch [--delta-dir <dir>]]\n"
+			"       %s verify <textures_dir> <txlib_file> [options]\n"
+			"       %s benchtxlib <txlib_file>... [--passes <count>]\n"
+			"       %s selftest\n"
+			"\tOptional resource_type: scenes, shaders, textures\n"
+			"\tSearches in res_dir for the following folders: scenes, shaders, textures\n"
+			"\t--compress: LZ4 compress the texture data on top of BC7\n"
+			"\t--nvtt-mips: Generate the texture mips with nvtt's box filter\n"
+			"\t--dry-run: Only list the resources which would be rebuilt and why\n"
+			"\t--force: Rebuild all resources even if they are up to date\n"
+			"\t--watch: After building, keep compiling the changed resources into delta libraries picked up by the running app\n"
+			"\t--delta-dir: Where to write the delta libraries, f.e the res folder of the app. Defaults to lib_output_dir\n"
+			"\tbenchtxlib: Compare cold loads of texture libraries, f.e compiled with and without --compress\n"
+			"\tselftest: Run the checks of the engine code which doesn't need a device, f.e the pipeline cache\n",
+			argv[0],
+			argv[0],
+			argv[0],
+			argv[0]
+		);
+
+		exit(1);
+	}
+
+	params.inputDir = args[0];
+	params.outputDir = fs::path(args[1]);
+	params.resourceType = (args.size() > 2 ? Optional<String>(args[2]) : std::nullopt);
+	if (params.deltaDir.empty()) {
+		params.deltaDir = params.outputDir;
+	}
+
+	LOG_FMT(Info, "Current path: %s", fs::current_path().string().c_str());
+
+	runJob(
+		[](void *param) {
+			auto p = reinterpret_cast<CompileParams*>(param);
+			p->success = compileResources(*p);
+
+			if (p->success && p->watch && !p->buildOptions.dryRun) {
+				WatchSettings settings;
+				settings.inputDir = p->inputDir;
+				settings.outputDir = p->outputDir;
+				settings.deltaDir = p->deltaDir;
+				settings.resourceType = p->resourceType;
+				settings.compression = p->compression;
+				settings.useNvttMips = p->useNvttMips;
+				watchResources(settings);
+			}
+
+			Dar::JobSystem::stop();
+		},
+		&params
+	);
+
+	return params.success ? 0 : 1;
+}
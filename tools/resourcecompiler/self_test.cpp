@@ -0,0 +1,515 @@
+#include "self_test.h"
+
+#include "d3d12/pipeline_cache.h"
+
+#include "reslib/meshlets.h"
+#include "reslib/vertex_packing.h"
+
+#include <fstream>
+#include <random>
+
+#define SELF_TEST_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			LOG_FMT(Error, "Self test check failed: %s(%s:%d)", #condition, __FILE__, __LINE__); \
+			++failures; \
+		} \
+	} while (false)
+
+/// Blob of a pipeline state with recognizable contents.
+static Vector<uint8_t> makeBlob(uint64_t key, SizeType size) {
+	Vector<uint8_t> blob(size);
+	for (SizeType i = 0; i < size; ++i) {
+		blob[i] = static_cast<uint8_t>(key * 31 + i);
+	}
+	return blob;
+}
+
+static bool readFile(const fs::path &file, Vector<uint8_t> &data) {
+	std::ifstream ifs(file, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!ifs.good()) {
+		return false;
+	}
+
+	data.resize(static_cast<SizeType>(ifs.tellg()));
+	ifs.seekg(0, std::ios::beg);
+	ifs.read(reinterpret_cast<char*>(data.data()), data.size());
+	return !ifs.fail();
+}
+
+static bool writeFile(const fs::path &file, const Vector<uint8_t> &data) {
+	std::ofstream ofs(file, std::ios::out | std::ios::binary | std::ios::trunc);
+	ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return !ofs.fail();
+}
+
+/// Offset of the blob of each entry in a saved pipeline cache, following the file format in PipelineCache.
+static Map<uint64_t, SizeType> findBlobOffsets(const Vector<uint8_t> &data) {
+	Map<uint64_t, SizeType> offsets;
+
+	constexpr SizeType HEADER_SIZE = 4 * sizeof(uint32_t);
+	constexpr SizeType ENTRY_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+	for (SizeType pos = HEADER_SIZE; pos + ENTRY_HEADER_SIZE <= data.size();) {
+		uint64_t key = 0, size = 0;
+		memcpy(&key, data.data() + pos, sizeof(uint64_t));
+		memcpy(&size, data.data() + pos + sizeof(uint64_t) + sizeof(uint32_t), sizeof(uint64_t));
+
+		offsets[key] = pos + ENTRY_HEADER_SIZE;
+		pos += ENTRY_HEADER_SIZE + size;
+	}
+
+	return offsets;
+}
+
+static int testPipelineCache(const fs::path &dir) {
+	int failures = 0;
+
+	const fs::path file = dir / "pipelines.psocache";
+	constexpr uint64_t NUM_KEYS = 4;
+	constexpr SizeType BLOB_SIZE = 1000;
+
+	// Round-trip
+	{
+		Dar::PipelineCache cache;
+		SELF_TEST_CHECK(cache.load(file));
+		SELF_TEST_CHECK(cache.getNumEntries() == 0);
+
+		for (uint64_t key = 1; key <= NUM_KEYS; ++key) {
+			const auto blob = makeBlob(key, BLOB_SIZE);
+			cache.store(key, blob.data(), blob.size());
+		}
+		SELF_TEST_CHECK(cache.save());
+	}
+
+	{
+		Dar::PipelineCache cache;
+		SELF_TEST_CHECK(cache.load(file));
+		SELF_TEST_CHECK(cache.getNumEntries() == NUM_KEYS);
+		SELF_TEST_CHECK(cache.getSize() == NUM_KEYS * BLOB_SIZE);
+
+		for (uint64_t key = 1; key <= NUM_KEYS; ++key) {
+			Vector<uint8_t> blob;
+			SELF_TEST_CHECK(cache.find(key, blob) && blob == makeBlob(key, BLOB_SIZE));
+		}
+
+		Vector<uint8_t> blob;
+		SELF_TEST_CHECK(!cache.find(NUM_KEYS + 1, blob));
+		SELF_TEST_CHECK(cache.getNumHits() == NUM_KEYS && cache.getNumMisses() == 1);
+	}
+
+	Vector<uint8_t> saved;
+	SELF_TEST_CHECK(readFile(file, saved));
+
+	// A corrupted entry is skipped, the rest are kept.
+	{
+		auto offsets = findBlobOffsets(saved);
+		SELF_TEST_CHECK(offsets.size() == NUM_KEYS);
+
+		auto corrupted = saved;
+		corrupted[offsets[2] + BLOB_SIZE / 2] ^= 0xFF;
+		SELF_TEST_CHECK(writeFile(file, corrupted));
+
+		Dar::PipelineCache cache;
+		SELF_TEST_CHECK(cache.load(file));
+		SELF_TEST_CHECK(cache.getNumEntries() == NUM_KEYS - 1);
+
+		Vector<uint8_t> blob;
+		SELF_TEST_CHECK(!cache.find(2, blob));
+		SELF_TEST_CHECK(cache.find(1, blob) && blob == makeBlob(1, BLOB_SIZE));
+	}
+
+	// A truncated entry is skipped, the ones before it are kept.
+	{
+		auto truncated = saved;
+		truncated.resize(saved.size() - BLOB_SIZE / 2);
+		SELF_TEST_CHECK(writeFile(file, truncated));
+
+		Dar::PipelineCache cache;
+		SELF_TEST_CHECK(cache.load(file));
+		SELF_TEST_CHECK(cache.getNumEntries() == NUM_KEYS - 1);
+	}
+
+	// A cache of another version is discarded as a whole.
+	{
+		auto stale = saved;
+		const uint32_t version = uint32_t(-1);
+		memcpy(stale.data() + sizeof(uint32_t), &version, sizeof(uint32_t));
+		SELF_TEST_CHECK(writeFile(file, stale));
+
+		Dar::PipelineCache cache;
+		SELF_TEST_CHECK(cache.load(file));
+		SELF_TEST_CHECK(cache.getNumEntries() == 0);
+
+		// and is overwritten on save.
+		const auto blob = makeBlob(1, BLOB_SIZE);
+		cache.store(1, blob.data(), blob.size());
+		SELF_TEST_CHECK(cache.save());
+
+		Dar::PipelineCache reloaded;
+		SELF_TEST_CHECK(reloaded.load(file));
+		SELF_TEST_CHECK(reloaded.getNumEntries() == 1);
+	}
+
+	// Least recently used entries are evicted first above the max size.
+	{
+		std::error_code ec;
+		fs::remove(file, ec);
+
+		Dar::PipelineCacheSettings settings;
+		settings.maxSize = 3 * BLOB_SIZE;
+
+		// Session 0
+		Dar::PipelineCache cache;
+		SELF_TEST_CHECK(cache.load(file, settings));
+		for (uint64_t key = 1; key <= 2; ++key) {
+			const auto blob = makeBlob(key, BLOB_SIZE);
+			cache.store(key, blob.data(), blob.size());
+		}
+		SELF_TEST_CHECK(cache.save());
+
+		// Session 1 uses entry 1 and adds 3 and 4, so entry 2 is the least recently used.
+		SELF_TEST_CHECK(cache.load(file, settings));
+		Vector<uint8_t> blob;
+		SELF_TEST_CHECK(cache.find(1, blob));
+		for (uint64_t key = 3; key <= 4; ++key) {
+			blob = makeBlob(key, BLOB_SIZE);
+			cache.store(key, blob.data(), blob.size());
+		}
+		SELF_TEST_CHECK(cache.save());
+
+		SELF_TEST_CHECK(cache.load(file, settings));
+		SELF_TEST_CHECK(cache.getNumEntries() == 3);
+		SELF_TEST_CHECK(cache.getSize() <= settings.maxSize);
+		SELF_TEST_CHECK(!cache.find(2, blob));
+		SELF_TEST_CHECK(cache.find(1, blob) && cache.find(3, blob) && cache.find(4, blob));
+	}
+
+	// Entries not used in maxUnusedSessions sessions are evicted regardless of the size.
+	{
+		Dar::PipelineCacheSettings settings;
+		settings.maxUnusedSessions = 1;
+
+		Dar::PipelineCache cache;
+		Vector<uint8_t> blob;
+		for (int i = 0; i < 2; ++i) {
+			SELF_TEST_CHECK(cache.load(file, settings));
+			SELF_TEST_CHECK(cache.find(1, blob));
+
+			// Force a save, even if nothing else changed.
+			cache.store(5, blob.data(), blob.size());
+			SELF_TEST_CHECK(cache.save());
+		}
+
+		SELF_TEST_CHECK(cache.load(file, settings));
+		SELF_TEST_CHECK(cache.find(1, blob) && cache.find(5, blob));
+		SELF_TEST_CHECK(!cache.find(3, blob) && !cache.find(4, blob));
+	}
+
+	if (failures == 0) {
+		LOG(Info, "PipelineCache: all checks passed.");
+	} else {
+		LOG_FMT(Error, "PipelineCache: %d checks failed!", failures);
+	}
+
+	return failures;
+}
+
+/// Angle in radians between two unit vectors. acos of the dot product isn't precise enough for small angles.
+static float angleBetween(const Vec3 &a, const Vec3 &b) {
+	return glm::atan(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+static int testVertexPacking() {
+	using namespace Dar::VertexPacking;
+
+	int failures = 0;
+
+	// Absolute slack for the float rounding of boxMin + t * boxSize, a few ulps of the positions used below.
+	constexpr float FLOAT_SLACK = 1e-5f;
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+	auto checkTangentFrame = [&failures](const Vec3 &normal, const Vec3 &tangent) {
+		Vec3 unpackedNormal, unpackedTangent;
+		unpackTangentFrame(packTangentFrame(normal, tangent), unpackedNormal, unpackedTangent);
+		SELF_TEST_CHECK(angleBetween(normal, unpackedNormal) <= TANGENT_FRAME_QUANTIZATION_ERROR);
+		SELF_TEST_CHECK(angleBetween(tangent, unpackedTangent) <= TANGENT_FRAME_QUANTIZATION_ERROR);
+	};
+
+	// The axes map to the corners and the middles of the edges of the octahedron and decode exactly.
+	const Vec3 axes[] = {
+		Vec3{ 1.f, 0.f, 0.f }, Vec3{ -1.f, 0.f, 0.f },
+		Vec3{ 0.f, 1.f, 0.f }, Vec3{ 0.f, -1.f, 0.f },
+		Vec3{ 0.f, 0.f, 1.f }, Vec3{ 0.f, 0.f, -1.f },
+	};
+	for (const Vec3 &axis : axes) {
+		SELF_TEST_CHECK(octahedralDecode(octahedralEncode(axis)) == axis);
+		checkTangentFrame(axis, axes[(&axis - axes + 2) % 6]);
+	}
+
+	// Vectors on both sides of the fold seam at z = 0, where the lower half of the octahedron is folded over the upper one,
+	// and around -Z, where all 4 folded corners of the square meet.
+	for (int i = 0; i < 64; ++i) {
+		const float angle = i * glm::two_pi<float>() / 64;
+		for (const float z : { 0.f, 1e-4f, -1e-4f, 1e-2f, -1e-2f }) {
+			const Vec3 v = glm::normalize(Vec3{ glm::cos(angle), glm::sin(angle), z });
+			checkTangentFrame(v, glm::normalize(Vec3{ -v.y, v.x, 0.f }));
+		}
+		for (const float xy : { 1e-4f, 1e-2f }) {
+			const Vec3 v = glm::normalize(Vec3{ xy * glm::cos(angle), xy * glm::sin(angle), -1.f });
+			checkTangentFrame(v, glm::normalize(glm::cross(v, Vec3{ 1.f, 0.f, 0.f })));
+		}
+	}
+
+	// Random directions over the whole sphere.
+	for (int i = 0; i < 100000; ++i) {
+		Vec3 normal{ unit(rng), unit(rng), unit(rng) };
+		if (glm::length(normal) < 1e-3f) {
+			continue;
+		}
+		normal = glm::normalize(normal);
+		const Vec3 tangent = glm::normalize(glm::cross(normal, glm::abs(normal.x) < 0.9f ? Vec3{ 1.f, 0.f, 0.f } : Vec3{ 0.f, 1.f, 0.f }));
+		checkTangentFrame(normal, tangent);
+	}
+
+	// Positions, including the corners of the bounds and bounds that are flat along an axis.
+	{
+		const Vec3 boxMin{ -10.f, -5.f, 2.f };
+		const Vec3 boxSizes[] = { Vec3{ 20.f, 10.f, 3.f }, Vec3{ 1.f, 0.f, 1.f } };
+		for (const Vec3 &boxSize : boxSizes) {
+			auto checkPosition = [&failures, &boxMin, &boxSize](const Vec3 &p, float tangentSign) {
+				const PackedPosition packed = packPosition(p, boxMin, boxSize, tangentSign);
+				const Vec3 error = glm::abs(unpackPosition(packed, boxMin, boxSize) - p);
+				for (int i = 0; i < 3; ++i) {
+					SELF_TEST_CHECK(error[i] <= POSITION_QUANTIZATION_ERROR * boxSize[i] + FLOAT_SLACK);
+				}
+				SELF_TEST_CHECK(unpackTangentSign(packed) == tangentSign);
+			};
+
+			for (int corner = 0; corner < 8; ++corner) {
+				const Vec3 t{ float(corner & 1), float((corner >> 1) & 1), float((corner >> 2) & 1) };
+				checkPosition(boxMin + t * boxSize, corner % 2 ? 1.f : -1.f);
+			}
+			for (int i = 0; i < 10000; ++i) {
+				const Vec3 t = (Vec3{ unit(rng), unit(rng), unit(rng) } + 1.f) * 0.5f;
+				checkPosition(boxMin + t * boxSize, i % 2 ? 1.f : -1.f);
+			}
+		}
+	}
+
+	// Uvs, including wrapping ones outside of [0, 1].
+	{
+		auto checkUV = [&failures](const Vec2 &uv) {
+			const Vec2 error = glm::abs(unpackUV(packUV(uv)) - uv) / glm::max(glm::abs(uv), Vec2(1e-3f));
+			SELF_TEST_CHECK(error.x <= UV_QUANTIZATION_ERROR && error.y <= UV_QUANTIZATION_ERROR);
+		};
+
+		for (const float x : { 0.f, 1.f, -1.f, 0.5f, 1e-3f, 1e-5f }) {
+			checkUV(Vec2{ x, -x });
+		}
+		for (int i = 0; i < 10000; ++i) {
+			checkUV(Vec2{ unit(rng), unit(rng) } * 8.f);
+		}
+	}
+
+	if (failures == 0) {
+		LOG(Info, "VertexPacking: all checks passed.");
+	} else {
+		LOG_FMT(Error, "VertexPacking: %d checks failed!", failures);
+	}
+
+	return failures;
+}
+
+/// Synthetic mesh for the meshlet tests. The front face of each triangle is the clockwise one, as in the scenes.
+struct TestMesh {
+	const char *name = nullptr;
+	bool hasNarrowCones = true; ///< Whether the normal cones of the meshlets are expected to cull anything.
+	Vector<Vec3> positions;
+	Vector<uint32_t> indices;
+
+	/// Add a triangle, flipping its winding if needed so its front face points along outside.
+	void addTriangle(uint32_t a, uint32_t b, uint32_t c, const Vec3 &outside) {
+		const Vec3 normal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+		if (glm::dot(normal, outside) < 0.f) {
+			std::swap(b, c);
+		}
+		indices.insert(indices.end(), { a, b, c });
+	}
+};
+
+static TestMesh makeSphereMesh(int numRings, int numSegments) {
+	TestMesh mesh;
+	mesh.name = "sphere";
+	for (int r = 0; r <= numRings; ++r) {
+		const float theta = r * glm::pi<float>() / numRings;
+		for (int s = 0; s <= numSegments; ++s) {
+			const float phi = s * glm::two_pi<float>() / numSegments;
+			mesh.positions.push_back(Vec3{ glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi) } * 5.f);
+		}
+	}
+
+	for (int r = 0; r < numRings; ++r) {
+		for (int s = 0; s < numSegments; ++s) {
+			const uint32_t v0 = r * (numSegments + 1) + s;
+			const uint32_t v1 = v0 + numSegments + 1;
+			const Vec3 outside = mesh.positions[v0] + mesh.positions[v1 + 1];
+			// Skip the degenerate triangles at the poles
+			if (r != 0) {
+				mesh.addTriangle(v0, v0 + 1, v1 + 1, outside);
+			}
+			if (r != numRings - 1) {
+				mesh.addTriangle(v0, v1 + 1, v1, outside);
+			}
+		}
+	}
+
+	return mesh;
+}
+
+/// Wavy height field facing +Y, so the meshlets have narrow cones.
+static TestMesh makeTerrainMesh(int size) {
+	TestMesh mesh;
+	mesh.name = "terrain";
+	for (int z = 0; z <= size; ++z) {
+		for (int x = 0; x <= size; ++x) {
+			mesh.positions.push_back(Vec3{ float(x - size / 2), glm::sin(x * 0.3f) * glm::cos(z * 0.2f), float(z - size / 2) } * 0.5f);
+		}
+	}
+
+	for (int z = 0; z < size; ++z) {
+		for (int x = 0; x < size; ++x) {
+			const uint32_t v0 = z * (size + 1) + x;
+			const uint32_t v1 = v0 + size + 1;
+			mesh.addTriangle(v0, v0 + 1, v1 + 1, Vec3UnitY());
+			mesh.addTriangle(v0, v1 + 1, v1, Vec3UnitY());
+		}
+	}
+
+	return mesh;
+}
+
+/// Clusters of randomly oriented triangles, so the meshlets are culled only by the frustum.
+static TestMesh makeTriangleSoupMesh(int numTriangles, std::mt19937 &rng) {
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+	TestMesh mesh;
+	mesh.name = "triangle soup";
+	mesh.hasNarrowCones = false;
+	Vec3 clusterCenter;
+	for (int t = 0; t < numTriangles; ++t) {
+		if (t % 32 == 0) {
+			clusterCenter = Vec3{ unit(rng), unit(rng), unit(rng) } * 10.f;
+		}
+		const Vec3 center = clusterCenter + Vec3{ unit(rng), unit(rng), unit(rng) };
+		for (int j = 0; j < 3; ++j) {
+			mesh.positions.push_back(center + Vec3{ unit(rng), unit(rng), unit(rng) } * 0.5f);
+		}
+		mesh.indices.insert(mesh.indices.end(), { uint32_t(t * 3), uint32_t(t * 3 + 1), uint32_t(t * 3 + 2) });
+	}
+
+	return mesh;
+}
+
+static int testMeshletCulling() {
+	using namespace Dar::Meshlets;
+
+	int failures = 0;
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+	const TestMesh meshes[] = { makeSphereMesh(48, 96), makeTerrainMesh(96), makeTriangleSoupMesh(4000, rng) };
+	for (const TestMesh &mesh : meshes) {
+		MeshletData data;
+		buildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), mesh.positions.size(), sizeof(Vec3), data);
+		SELF_TEST_CHECK(validateMeshlets(data, mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), sizeof(Vec3)).numErrors == 0);
+
+		// Every meshlet culled by isMeshletCulled() must have only triangles which are backfacing or have all of
+		// their vertices outside of the same frustum plane.
+		SizeType numTests = 0, numCulledByPlanes = 0, numCulledByCone = 0, numWrong = 0;
+		for (int c = 0; c < 64; ++c) {
+			const Vec3 cameraPos = Vec3{ unit(rng), unit(rng), unit(rng) } * 15.f;
+			const Vec3 target = Vec3{ unit(rng), unit(rng), unit(rng) } * 5.f;
+			const float farPlane = c % 2 ? 1000.f : 10.f;
+			const Mat4 viewProjection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, farPlane) * glm::lookAt(cameraPos, target, Vec3UnitY());
+
+			Vec4 planes[static_cast<int>(FrustumPlane::Count)];
+			extractFrustumPlanes(viewProjection, planes);
+
+			for (const Meshlet &meshlet : data.meshlets) {
+				++numTests;
+				if (!isMeshletCulled(meshlet, cameraPos, planes, static_cast<int>(FrustumPlane::Count))) {
+					continue;
+				}
+				if (isMeshletCulled(meshlet, cameraPos)) {
+					++numCulledByCone;
+				} else {
+					++numCulledByPlanes;
+				}
+
+				const float epsilon = std::max(meshlet.radius, 1e-3f) * 1e-4f;
+				const uint32_t *vertices = data.vertices.data() + meshlet.vertexOffset;
+				const uint8_t *triangles = data.triangles.data() + meshlet.triangleOffset;
+				for (uint32_t t = 0; t < meshlet.numTriangles; ++t) {
+					const Vec3 p[3] = {
+						mesh.positions[vertices[triangles[t * 3 + 0]]],
+						mesh.positions[vertices[triangles[t * 3 + 1]]],
+						mesh.positions[vertices[triangles[t * 3 + 2]]],
+					};
+
+					const Vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+					bool visible = glm::dot(cameraPos - p[0], glm::normalize(normal)) > epsilon;
+					for (const Vec4 &plane : planes) {
+						bool outside = true;
+						for (const Vec3 &v : p) {
+							outside &= glm::dot(Vec3(plane), v) + plane.w < epsilon;
+						}
+						visible &= !outside;
+					}
+
+					if (visible) {
+						++numWrong;
+						break;
+					}
+				}
+			}
+		}
+
+		SELF_TEST_CHECK(numWrong == 0);
+		// Make sure both ways of culling are exercised, so the checks above test something.
+		SELF_TEST_CHECK(numCulledByPlanes > 0);
+		SELF_TEST_CHECK(numCulledByCone > 0 || !mesh.hasNarrowCones);
+
+		LOG_FMT(
+			Info,
+			"Meshlet culling of the %s: %llu meshlets, %llu tests, %llu culled by the frustum, %llu by the cone, %llu culled with visible triangles.",
+			mesh.name, data.meshlets.size(), numTests, numCulledByPlanes, numCulledByCone, numWrong
+		);
+	}
+
+	if (failures == 0) {
+		LOG(Info, "MeshletCulling: all checks passed.");
+	} else {
+		LOG_FMT(Error, "MeshletCulling: %d checks failed!", failures);
+	}
+
+	return failures;
+}
+
+int runSelfTests() {
+	std::error_code ec;
+	const fs::path dir = fs::temp_directory_path(ec) / "dar_selftest";
+	fs::remove_all(dir, ec);
+	fs::create_directories(dir, ec);
+
+	int failures = 0;
+	failures += testPipelineCache(dir);
+	failures += testVertexPacking();
+	failures += testMeshletCulling();
+
+	fs::remove_all(dir, ec);
+
+	return failures;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+/// Checks of engine code which runs without a device, f.e the on-disk formats of the caches.
+/// Run with `resourcecompiler selftest`. Failed checks are logged.
+/// @return Number of failed checks.
+int runSelfTests();
@@ -0,0 +1,214 @@
+#include "txlib_benchmark.h"
+
+#include "reslib/hash.h"
+#include "reslib/serde.h"
+
+#include "utils/timer.h"
+
+#include <algorithm>
+#include <limits>
+
+/// Reads with FILE_FLAG_NO_BUFFERING must be aligned to the sector size of the volume.
+/// 4KiB covers both the 512B and the 4KiB sector drives.
+constexpr SizeType UNBUFFERED_READ_ALIGNMENT = 4096;
+constexpr SizeType UNBUFFERED_READ_SIZE = 1024 * 1024;
+
+struct TxLibLoadResult {
+	SizeType fileSize = 0;
+	SizeType numImages = 0;
+	SizeType decodedSize = 0;
+	double readTime = 0.0; ///< Best read time of all passes in ms.
+	double decodeTime = 0.0; ///< Best decode time of all passes in ms.
+	Map<String, uint64_t> imageHashes; ///< Hash of the decoded data of each image.
+};
+
+/// Read a whole file bypassing the system file cache.
+/// @param data Receives the file contents. Page aligned and rounded up to UNBUFFERED_READ_ALIGNMENT, free it with VirtualFree.
+static bool readFileUnbuffered(const fs::path &path, uint8_t *&data, SizeType &size) {
+	data = nullptr;
+	size = 0;
+
+	HANDLE file = CreateFileW(
+		path.wstring().c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr
+	);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		LOG_FMT(Error, "Failed to open %s!", path.string().c_str());
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		LOG_FMT(Error, "Failed to get the size of %s!", path.string().c_str());
+		CloseHandle(file);
+		return false;
+	}
+
+	size = static_cast<SizeType>(fileSize.QuadPart);
+	const SizeType alignedSize = (size + UNBUFFERED_READ_ALIGNMENT - 1) & ~(UNBUFFERED_READ_ALIGNMENT - 1);
+
+	// VirtualAlloc returns page aligned memory which satisfies the buffer alignment of unbuffered reads.
+	data = static_cast<uint8_t*>(VirtualAlloc(nullptr, alignedSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if (data == nullptr) {
+		LOG_FMT(Error, "Failed to allocate %llu bytes for %s!", static_cast<unsigned long long>(alignedSize), path.string().c_str());
+		CloseHandle(file);
+		return false;
+	}
+
+	bool success = true;
+	SizeType offset = 0;
+	while (offset < size) {
+		// The last read is rounded up too. It stops at the end of the file.
+		const DWORD toRead = static_cast<DWORD>(std::min(UNBUFFERED_READ_SIZE, alignedSize - offset));
+		DWORD read = 0;
+		if (!ReadFile(file, data + offset, toRead, &read, nullptr) || read == 0) {
+			LOG_FMT(Error, "Failed to read %s!", path.string().c_str());
+			success = false;
+			break;
+		}
+
+		offset += read;
+	}
+
+	CloseHandle(file);
+
+	if (!success) {
+		VirtualFree(data, 0, MEM_RELEASE);
+		data = nullptr;
+	}
+
+	return success;
+}
+
+static bool loadTextureLibrary(const fs::path &path, bool hashImages, TxLibLoadResult &result) {
+	uint8_t *data = nullptr;
+	SizeType size = 0;
+
+	Dar::Timer timer;
+	if (!readFileUnbuffered(path, data, size)) {
+		return false;
+	}
+	const double readTime = timer.time();
+
+	timer.restart();
+
+	Dar::TxLib::Header header = Dar::TxLib::readHeader(data, size, path.filename().string());
+	if (header.imgDataStartPos == Dar::TxLib::INVALID_IMG_DATA_POS) {
+		VirtualFree(data, 0, MEM_RELEASE);
+		return false;
+	}
+
+	bool success = true;
+	SizeType decodedSize = 0;
+	SizeType pos = header.imgDataStartPos;
+	for (const auto &imgHeader : header.headers) {
+		const SizeType storedSize = imgHeader.getStoredSize();
+		if (pos + storedSize > size) {
+			LOG_FMT(Error, "Image %s is past the end of %s!", imgHeader.filename.c_str(), path.string().c_str());
+			success = false;
+			break;
+		}
+
+		Dar::ImageData img{ .header = imgHeader };
+		if (!img.loadFromMemory(data + pos, storedSize)) {
+			success = false;
+			break;
+		}
+
+		if (hashImages) {
+			result.imageHashes[imgHeader.filename] = Dar::hashData(img.data.get(), imgHeader.size);
+		}
+
+		decodedSize += imgHeader.size;
+		pos += storedSize;
+	}
+	const double decodeTime = timer.time();
+
+	VirtualFree(data, 0, MEM_RELEASE);
+
+	if (!success) {
+		return false;
+	}
+
+	result.fileSize = size;
+	result.numImages = header.headers.size();
+	result.decodedSize = decodedSize;
+	result.readTime = std::min(result.readTime, readTime);
+	result.decodeTime = std::min(result.decodeTime, decodeTime);
+
+	return true;
+}
+
+static double getMBPerSecond(SizeType size, double ms) {
+	return ms > 0.0 ? (size / (1024.0 * 1024.0)) / (ms / 1000.0) : 0.0;
+}
+
+bool benchmarkTextureLibraries(const TxLibBenchmarkSettings &settings) {
+	const int numPasses = std::max(1, settings.numPasses);
+
+	Vector<TxLibLoadResult> results(settings.txLibs.size());
+	for (SizeType i = 0; i < settings.txLibs.size(); ++i) {
+		auto &result = results[i];
+		result.readTime = std::numeric_limits<double>::max();
+		result.decodeTime = std::numeric_limits<double>::max();
+
+		for (int pass = 0; pass < numPasses; ++pass) {
+			if (!loadTextureLibrary(settings.txLibs[i], pass == 0, result)) {
+				LOG_FMT(Error, "Failed to load %s!", settings.txLibs[i].string().c_str());
+				return false;
+			}
+		}
+	}
+
+	LOG_FMT(Info, "Cold load of texture libraries, best of %d passes with unbuffered reads:", numPasses);
+
+	bool success = true;
+	for (SizeType i = 0; i < settings.txLibs.size(); ++i) {
+		const auto &result = results[i];
+		LOG_FMT(
+			Info,
+			"\t%s: %llu images, %.2fMB on disk, %.2fMB decoded (ratio %.3f). Read %.2fms (%.1fMB/s), decode %.2fms (%.1fMB/s), total %.2fms",
+			settings.txLibs[i].filename().string().c_str(),
+			static_cast<unsigned long long>(result.numImages),
+			result.fileSize / (1024.0 * 1024.0),
+			result.decodedSize / (1024.0 * 1024.0),
+			result.decodedSize > 0 ? double(result.fileSize) / result.decodedSize : 0.0,
+			result.readTime,
+			getMBPerSecond(result.fileSize, result.readTime),
+			result.decodeTime,
+			getMBPerSecond(result.decodedSize, result.decodeTime),
+			result.readTime + result.decodeTime
+		);
+
+		if (i == 0) {
+			continue;
+		}
+
+		const auto &first = results[0];
+		LOG_FMT(
+			Info,
+			"\t%s speedup over %s: read %.2fx, decode %.2fx, total %.2fx",
+			settings.txLibs[i].filename().string().c_str(),
+			settings.txLibs[0].filename().string().c_str(),
+			result.readTime > 0.0 ? first.readTime / result.readTime : 0.0,
+			result.decodeTime > 0.0 ? first.decodeTime / result.decodeTime : 0.0,
+			result.readTime + result.decodeTime > 0.0 ? (first.readTime + first.decodeTime) / (result.readTime + result.decodeTime) : 0.0
+		);
+
+		for (const auto &[name, hash] : result.imageHashes) {
+			auto it = first.imageHashes.find(name);
+			if (it != first.imageHashes.end() && it->second != hash) {
+				LOG_FMT(Error, "Image %s in %s doesn't match the one in %s!", name.c_str(), settings.txLibs[i].string().c_str(), settings.txLibs[0].string().c_str());
+				success = false;
+			}
+		}
+	}
+
+	return success;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "utils/defines.h"
+
+struct TxLibBenchmarkSettings {
+	Vector<fs::path> txLibs; ///< Libraries to load, f.e the same textures compiled with and without --compress.
+	int numPasses = 3; ///< Each library is loaded this many times and the best pass is reported.
+};
+
+/// Load whole texture libraries the way the app does - read the file and then decode
+/// every image in it - and report the read and decode times of each library separately.
+/// The files are read with FILE_FLAG_NO_BUFFERING so every pass bypasses the system file cache
+/// and measures a cold load, which is where LZ4 is supposed to pay off by reading less data.
+/// Images with the same name in different libraries are checked to decode to the same data.
+/// @note Must be called from inside a job, as compressed images are decompressed on the job system.
+/// @return true if all libraries were loaded and their images match, false otherwise.
+bool benchmarkTextureLibraries(const TxLibBenchmarkSettings &settings);
@@ -0,0 +1,227 @@
+#include "watch.h"
+
+#include "build_graph.h"
+
+#include "utils/timer.h"
+
+#include <algorithm>
+#include <chrono>
+
+/// Changes closer than this are compiled together. Editors usually save a file with multiple writes.
+constexpr DWORD WATCH_DEBOUNCE_MS = 50;
+
+struct WatchState {
+	const WatchSettings *settings = nullptr;
+	fs::path shadersDir;
+	fs::path texturesDir;
+	Map<String, FileStamp> stamps; ///< Stamps of all watched files.
+	Set<String> changedShaders; ///< Base names of the shaders changed since the watch started.
+	Set<String> changedTextures; ///< Images changed since the watch started.
+};
+
+static bool watchesShaders(const WatchState &state) {
+	const auto &type = state.settings->resourceType;
+	return fs::is_directory(state.shadersDir) && (!type.has_value() || *type == "shaders");
+}
+
+static bool watchesTextures(const WatchState &state) {
+	const auto &type = state.settings->resourceType;
+	return fs::is_directory(state.texturesDir) && (!type.has_value() || *type == "textures");
+}
+
+static Vector<fs::path> getWatchedFiles(const WatchState &state) {
+	Vector<fs::path> files;
+	auto addFolder = [&files](const fs::path &dir) {
+		for (auto &entry : fs::directory_iterator{ dir }) {
+			if (entry.is_regular_file()) {
+				files.push_back(entry.path());
+			}
+		}
+	};
+
+	if (watchesShaders(state)) {
+		addFolder(state.shadersDir);
+	}
+
+	if (watchesTextures(state)) {
+		addFolder(state.texturesDir);
+	}
+
+	return files;
+}
+
+/// Write to a temporary file first, so the app never sees a partially written delta.
+template <typename WriteFunction>
+static bool writeDelta(const fs::path &deltaFile, WriteFunction write) {
+	auto tmpFile = deltaFile;
+	tmpFile += ".tmp";
+	if (!write(tmpFile)) {
+		return false;
+	}
+
+	std::error_code ec;
+	fs::rename(tmpFile, deltaFile, ec);
+	if (ec) {
+		LOG_FMT(Error, "Failed to write %s!", deltaFile.string().c_str());
+		fs::remove(tmpFile, ec);
+		return false;
+	}
+
+	return true;
+}
+
+static bool writeShadersDelta(WatchState &state, const Set<String> &changedFiles) {
+	// A shader is changed if any of its stages or the files they include changed.
+	bool changed = false;
+	for (auto &file : getWatchedFiles(state)) {
+		auto basename = Dar::ShaderCompiler::getShaderBasename(file);
+		if (basename.empty()) {
+			continue;
+		}
+
+		Vector<fs::path> includes;
+		Dar::ShaderCompiler::findShaderIncludes(file, { state.shadersDir.wstring() }, includes);
+		includes.push_back(file);
+
+		for (auto &include : includes) {
+			if (changedFiles.find(include.string()) != changedFiles.end()) {
+				state.changedShaders.insert(basename.string());
+				changed = true;
+				break;
+			}
+		}
+	}
+
+	if (!changed) {
+		return true;
+	}
+
+	Vector<fs::path> basenames{ state.changedShaders.begin(), state.changedShaders.end() };
+	std::sort(basenames.begin(), basenames.end());
+
+	const auto &settings = *state.settings;
+	return writeDelta(
+		settings.deltaDir / "shaders.delta.shlib",
+		[&](const fs::path &tmpFile) {
+			return Dar::ShaderCompiler::compileShadersToFile(basenames, tmpFile, settings.outputDir / "shadercache");
+		}
+	);
+}
+
+static bool writeTexturesDelta(WatchState &state, const Set<String> &changedFiles) {
+	bool changed = false;
+	for (auto &file : changedFiles) {
+		if (fs::path(file).parent_path() == state.texturesDir) {
+			state.changedTextures.insert(file);
+			changed = true;
+		}
+	}
+
+	if (!changed) {
+		return true;
+	}
+
+	Vector<String> imgPaths{ state.changedTextures.begin(), state.changedTextures.end() };
+	std::sort(imgPaths.begin(), imgPaths.end());
+
+	const auto &settings = *state.settings;
+	return writeDelta(
+		settings.deltaDir / "textures.delta.txlib",
+		[&](const fs::path &tmpFile) {
+			return Dar::TxLib::serializeTextureDataToFile(imgPaths, tmpFile.parent_path(), settings.compression, settings.useNvttMips, tmpFile.filename());
+		}
+	);
+}
+
+/// Compare the watched files against their last stamps.
+/// @param lastWriteTime Receives the time of the most recent change.
+/// @return Canonical paths of the changed and added files.
+static Set<String> findChangedFiles(WatchState &state, fs::file_time_type &lastWriteTime) {
+	Set<String> changedFiles;
+	for (auto &file : getWatchedFiles(state)) {
+		std::error_code ec;
+		auto path = fs::canonical(file, ec);
+		FileStamp stamp;
+		if (ec || !getFileStamp(path, stamp)) {
+			continue;
+		}
+
+		auto it = state.stamps.find(path.string());
+		if (it != state.stamps.end() && it->second.size == stamp.size && it->second.mtime == stamp.mtime) {
+			continue;
+		}
+
+		state.stamps[path.string()] = stamp;
+		changedFiles.insert(path.string());
+		lastWriteTime = std::max(lastWriteTime, fs::last_write_time(path, ec));
+	}
+
+	return changedFiles;
+}
+
+void watchResources(const WatchSettings &settings) {
+	WatchState state;
+	state.settings = &settings;
+	std::error_code ec;
+	state.shadersDir = fs::canonical(settings.inputDir / "shaders", ec);
+	state.texturesDir = fs::canonical(settings.inputDir / "textures", ec);
+
+	// Deltas of a previous watch are superseded by the libraries.
+	fs::create_directories(settings.deltaDir, ec);
+	fs::remove(settings.deltaDir / "shaders.delta.shlib", ec);
+	fs::remove(settings.deltaDir / "textures.delta.txlib", ec);
+
+	fs::file_time_type lastWriteTime;
+	findChangedFiles(state, lastWriteTime);
+
+	HANDLE notification = FindFirstChangeNotificationW(
+		settings.inputDir.wstring().c_str(),
+		TRUE, /*bWatchSubtree*/
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE
+	);
+
+	if (notification == INVALID_HANDLE_VALUE) {
+		LOG_FMT(Error, "Failed to watch %s!", settings.inputDir.string().c_str());
+		return;
+	}
+
+	LOG_FMT(Info, "Watching %s for changes. Deltas are written to %s", settings.inputDir.string().c_str(), settings.deltaDir.string().c_str());
+
+	while (WaitForSingleObject(notification, INFINITE) == WAIT_OBJECT_0) {
+		// Wait for the writes to settle down.
+		do {
+			FindNextChangeNotification(notification);
+		} while (WaitForSingleObject(notification, WATCH_DEBOUNCE_MS) == WAIT_OBJECT_0);
+
+		lastWriteTime = fs::file_time_type::min();
+		auto changedFiles = findChangedFiles(state, lastWriteTime);
+		if (changedFiles.empty()) {
+			continue;
+		}
+
+		Dar::Timer timer;
+		bool success = true;
+		if (watchesShaders(state)) {
+			success &= writeShadersDelta(state, changedFiles);
+		}
+
+		if (watchesTextures(state)) {
+			success &= writeTexturesDelta(state, changedFiles);
+		}
+
+		if (!success) {
+			LOG(Error, "Failed to compile the changed resources! Waiting for the next change...");
+			continue;
+		}
+
+		// Time since the last save, including the debounce interval and the compilation.
+		const auto editLatency = std::chrono::duration_cast<std::chrono::milliseconds>(fs::file_time_type::clock::now() - lastWriteTime);
+		LOG_FMT(
+			Info,
+			"Written deltas in %.2fms(%lld ms since the last edit). Changed since the watch started: %llu shaders, %llu textures",
+			timer.time(), static_cast<long long>(editLatency.count()), state.changedShaders.size(), state.changedTextures.size()
+		);
+	}
+
+	FindCloseChangeNotification(notification);
+}
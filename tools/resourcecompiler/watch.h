@@ -0,0 +1,22 @@
+#pragma once
+
+#include "utils/defines.h"
+
+#include "reslib/serde.h"
+
+struct WatchSettings {
+	fs::path inputDir; ///< Folder containing the resource folders. Watched recursively.
+	fs::path outputDir; ///< Folder of the libraries. The shader cache inside it is used for compiling the shaders.
+	fs::path deltaDir; ///< Where the delta libraries are written. Usually the res folder of the running app.
+	Optional<String> resourceType; ///< Only watch this type of resources if set.
+	Dar::ImageCompression compression = Dar::ImageCompression::None;
+	bool useNvttMips = false;
+};
+
+/// Watch the resource folders and compile the changed resources into delta libraries -
+/// `shaders.delta.shlib` and `textures.delta.txlib` inside WatchSettings::deltaDir.
+/// A running app picks them up through ResourceLibrary::pollHotReload().
+/// Each delta contains all resources changed since the watch started, so only the latest one matters.
+/// The libraries themselves are left as they are and are rebuilt by the next regular build.
+/// @note Must be called from inside a job. Never returns.
+void watchResources(const WatchSettings &settings);